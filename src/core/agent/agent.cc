@@ -29,7 +29,9 @@
 #include "core/behavior/behavior.h"
 #include "core/environment/environment.h"
 #include "core/execution_context/in_place_exec_ctxt.h"
+#include "core/param/param.h"
 #include "core/resource_manager.h"
+#include "core/scheduler.h"
 #include "core/simulation.h"
 #include "core/util/log.h"
 #include "core/util/macros.h"
@@ -40,6 +42,7 @@ namespace bdm {
 
 Agent::Agent() {
   uid_ = Simulation::GetActive()->GetAgentUidGenerator()->GenerateUid();
+  rng_key_ = (static_cast<uint64_t>(uid_.GetReused()) << 32) | uid_.GetIndex();
 }
 
 Agent::Agent(TRootIOCtor* io_ctor) {}
@@ -47,6 +50,8 @@ Agent::Agent(TRootIOCtor* io_ctor) {}
 Agent::Agent(const Agent& other)
     : uid_(other.uid_),
       box_idx_(other.box_idx_),
+      rng_key_(other.rng_key_),
+      num_daughters_(other.num_daughters_),
       run_behavior_loop_idx_(other.run_behavior_loop_idx_),
       propagate_staticness_neighborhood_(
           other.propagate_staticness_neighborhood_),
@@ -63,7 +68,11 @@ Agent::~Agent() {
 }
 
 void Agent::Initialize(const NewAgentEvent& event) {
-  box_idx_ = event.existing_agent->GetBoxIdx();
+  auto* existing = event.existing_agent;
+  box_idx_ = existing->GetBoxIdx();
+  auto step = Simulation::GetActive()->GetScheduler()->GetSimulatedSteps();
+  rng_key_ = CounterRng::DaughterKey(existing->rng_key_, step,
+                                     existing->num_daughters_++);
   // copy behaviors_ to me
   InitializeBehaviors(event);
 }
@@ -97,6 +106,13 @@ void Agent::PropagateStaticness() {
                         env->GetLargestAgentSizeSquared());
 }
 
+void Agent::WakeUp() const {
+  auto* sim = Simulation::GetActive();
+  if (sim->GetParam()->skip_static_agents) {
+    sim->GetResourceManager()->WakeUp(uid_);
+  }
+}
+
 void Agent::RunDiscretization() {}
 
 void Agent::AssignNewUid() {
@@ -105,6 +121,14 @@ void Agent::AssignNewUid() {
 
 const AgentUid& Agent::GetUid() const { return uid_; }
 
+CounterRng Agent::GetNextDaughterCounterRng(uint32_t stream) const {
+  auto* sim = Simulation::GetActive();
+  auto step = sim->GetScheduler()->GetSimulatedSteps();
+  return CounterRng(sim->GetParam()->random_seed,
+                    CounterRng::DaughterKey(rng_key_, step, num_daughters_),
+                    step, stream);
+}
+
 uint32_t Agent::GetBoxIdx() const { return box_idx_; }
 
 void Agent::SetBoxIdx(uint32_t idx) { box_idx_ = idx; }
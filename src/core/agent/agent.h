@@ -33,6 +33,7 @@
 #include "core/container/math_array.h"
 #include "core/interaction_force.h"
 #include "core/shape.h"
+#include "core/util/counter_rng.h"
 #include "core/util/macros.h"
 #include "core/util/root.h"
 #include "core/util/spinlock.h"
@@ -147,6 +148,15 @@ class Agent {
 
   const AgentUid& GetUid() const;
 
+  /// Returns the key of the counter-based random number generators of this
+  /// agent (see `Simulation::GetCounterRng`).\n
+  /// Agents created with `CreateNewAgents` (e.g. by `Cell::Divide`) derive
+  /// their key from the key of the existing agent, the current step and the
+  /// number of agents it created before. All other agents derive it from
+  /// their uid. Hence, the key only depends on the order of creation for
+  /// agents that are created in parallel without `CreateNewAgents`.
+  uint64_t GetRngKey() const { return rng_key_; }
+
   Spinlock* GetLock() { return &lock_; }
 
   /// If the thread-safety mechanism is set to user-specified this function
@@ -163,14 +173,22 @@ class Agent {
 
   void SetStaticnessNextTimestep(bool value) const {
     is_static_next_ts_ = value;
+    if (!value && is_static_) {
+      WakeUp();
+    }
   }
 
+  bool GetStaticnessNextTimestep() const { return is_static_next_ts_; }
+
   bool GetPropagateStaticness() const {
     return propagate_staticness_neighborhood_;
   }
 
   void SetPropagateStaticness(bool value = true) {
     propagate_staticness_neighborhood_ = value;
+    if (value && is_static_) {
+      WakeUp();
+    }
   }
 
   void PropagateStaticness();
@@ -246,9 +264,19 @@ class Agent {
   /// collection of behaviors which define the internal behavior
   InlineVector<Behavior*, 2> behaviors_;
 
+  /// Returns a counter-based random number generator keyed by the agent
+  /// that the next call to `CreateNewAgents` will create. Can be used to
+  /// draw the parameters of this event (see `Cell::Divide`).
+  CounterRng GetNextDaughterCounterRng(uint32_t stream) const;
+
  private:
   Spinlock lock_;  //!
 
+  /// Key of the counter-based random number generators
+  uint64_t rng_key_ = 0;
+  /// Number of agents that this agent created with `CreateNewAgents`
+  uint32_t num_daughters_ = 0;
+
   /// Helper variable used to support removal of behaviors while
   /// `RunBehaviors` iterates over them.
   uint16_t run_behavior_loop_idx_ = 0;
@@ -261,6 +289,10 @@ class Agent {
   /// Flag to determine of an agent is static in the next timestep
   mutable bool is_static_next_ts_ = false;  //!
 
+  /// Registers a static agent with the resource manager, so that it is
+  /// processed again by agent operations (see `Param::skip_static_agents`).
+  void WakeUp() const;
+
   /// Function to copy behaviors from existing Agent to this one
   /// and to initialize them.
   /// This function sets the attributes `NewAgentEvent::existing_behavior`
@@ -275,7 +307,7 @@ class Agent {
   /// and `NewAgentEvent::new_behaviors` to their correct value.
   void UpdateBehaviors(const NewAgentEvent& event);
 
-  BDM_CLASS_DEF(Agent, 1)
+  BDM_CLASS_DEF(Agent, 2)
 };
 
 }  // namespace bdm
@@ -130,33 +130,31 @@ class Cell : public Agent {
   ///
   /// CellDivisionEvent::volume_ratio will be between 0.9 and 1.1\n
   /// The axis of division is random.
-  /// \see CellDivisionEvent
-  virtual Cell* Divide() {
-    auto* random = Simulation::GetActive()->GetRandom();
-    return Divide(random->Uniform(0.9, 1.1));
-  }
+  /// \see CellDivisionEvent, `Param::use_counter_rng`
+  virtual Cell* Divide() { return Divide(RandomVolumeRatio()); }
 
   /// \brief Divide this cell.
   ///
   /// The axis of division is random.
-  /// \see CellDivisionEvent
+  /// \see CellDivisionEvent, `Param::use_counter_rng`
   virtual Cell* Divide(double volume_ratio) {
-    // find random point on sphere (based on :
-    // http://mathworld.wolfram.com/SpherePointPicking.html)
-    auto* random = Simulation::GetActive()->GetRandom();
-    double theta = 2 * Math::kPi * random->Uniform(0, 1);
-    double phi = std::acos(2 * random->Uniform(0, 1) - 1);
+    double phi, theta;
+    if (Simulation::GetActive()->GetParam()->use_counter_rng) {
+      auto rng = GetNextDaughterCounterRng(kDivisionAxisStream);
+      RandomPointOnSphere(&rng, &phi, &theta);
+    } else {
+      RandomPointOnSphere(Simulation::GetActive()->GetRandom(), &phi, &theta);
+    }
     return Divide(volume_ratio, phi, theta);
   }
 
   /// \brief Divide this cell.
   ///
   /// CellDivisionEvent::volume_ratio will be between 0.9 and 1.1\n
-  /// \see CellDivisionEvent
+  /// \see CellDivisionEvent, `Param::use_counter_rng`
   virtual Cell* Divide(const Double3& axis) {
-    auto* random = Simulation::GetActive()->GetRandom();
     auto polarcoord = TransformCoordinatesGlobalToPolar(axis + position_);
-    return Divide(random->Uniform(0.9, 1.1), polarcoord[1], polarcoord[2]);
+    return Divide(RandomVolumeRatio(), polarcoord[1], polarcoord[2]);
   }
 
   /// \brief Divide this cell.
@@ -259,22 +257,6 @@ class Cell : public Agent {
     // is not applied if the total Force is smaller than adherence.
     // Once, I should look at this more carefully.
 
-    // fixme why? copying
-    const auto& tf = GetTractorForce();
-
-    // the 3 types of movement that can occur
-    // bool biological_translation = false;
-    bool physical_translation = false;
-    // bool physical_rotation = false;
-
-    double h = dt;
-    Double3 movement_at_next_step{0, 0, 0};
-
-    // BIOLOGY :
-    // 0) Start with tractor force : What the biology defined as active
-    // movement------------
-    movement_at_next_step += tf * h;
-
     // PHYSICS
     // the physics force to move the point mass
     Double3 translation_force_on_point_mass{0, 0, 0};
@@ -291,15 +273,83 @@ class Cell : public Agent {
     //  (We check for every neighbor object if they touch us, i.e. push us
     //  away)
 
-    auto* ctxt = Simulation::GetActive()->GetExecutionContext();
-    auto calculate_neighbor_forces =
-        L2F([&](Agent* neighbor, double squared_distance) {
-          auto neighbor_force = force->Calculate(this, neighbor);
-          translation_force_on_point_mass[0] += neighbor_force[0];
-          translation_force_on_point_mass[1] += neighbor_force[1];
-          translation_force_on_point_mass[2] += neighbor_force[2];
-        });
-    ctxt->ForEachNeighbor(calculate_neighbor_forces, *this, squared_radius);
+    auto* sim = Simulation::GetActive();
+    auto* ctxt = sim->GetExecutionContext();
+    if (sim->GetParam()->vectorize_sphere_forces &&
+        GetShape() == Shape::kSphere) {
+      // Gather sphere neighbors into aligned buffers and evaluate the
+      // interaction with multiple neighbors at once.
+      static constexpr uint64_t kBatchSize = 64;
+      alignas(64) double x[kBatchSize];
+      alignas(64) double y[kBatchSize];
+      alignas(64) double z[kBatchSize];
+      alignas(64) double diameter[kBatchSize];
+      uint64_t size = 0;
+      auto flush = [&]() {
+        translation_force_on_point_mass +=
+            force->CalculateSphereBatch(this, x, y, z, diameter, size);
+        size = 0;
+      };
+      auto gather_neighbors =
+          L2F([&](Agent* neighbor, double squared_distance) {
+            if (neighbor->GetShape() != Shape::kSphere) {
+              auto neighbor_force = force->Calculate(this, neighbor);
+              translation_force_on_point_mass[0] += neighbor_force[0];
+              translation_force_on_point_mass[1] += neighbor_force[1];
+              translation_force_on_point_mass[2] += neighbor_force[2];
+              return;
+            }
+            const auto& pos = neighbor->GetPosition();
+            x[size] = pos[0];
+            y[size] = pos[1];
+            z[size] = pos[2];
+            diameter[size] = neighbor->GetDiameter();
+            if (++size == kBatchSize) {
+              flush();
+            }
+          });
+      ctxt->ForEachNeighborInRange(gather_neighbors, *this, squared_radius,
+                                   force->GetInteractionMargin());
+      if (size != 0) {
+        flush();
+      }
+    } else {
+      auto calculate_neighbor_forces =
+          L2F([&](Agent* neighbor, double squared_distance) {
+            auto neighbor_force = force->Calculate(this, neighbor);
+            translation_force_on_point_mass[0] += neighbor_force[0];
+            translation_force_on_point_mass[1] += neighbor_force[1];
+            translation_force_on_point_mass[2] += neighbor_force[2];
+          });
+      ctxt->ForEachNeighborInRange(calculate_neighbor_forces, *this,
+                                   squared_radius,
+                                   force->GetInteractionMargin());
+    }
+
+    return DisplacementFromForce(translation_force_on_point_mass, dt);
+  }
+
+  /// Returns the displacement caused by the tractor force and the sum of the
+  /// forces that the neighbors exert on this cell.\n
+  /// Used by `MechanicalForcesOp` if the forces have been calculated for
+  /// each pair of cells (see `Param::symmetric_forces`).
+  Double3 DisplacementFromForce(const Double3& translation_force_on_point_mass,
+                                double dt) {
+    // fixme why? copying
+    const auto& tf = GetTractorForce();
+
+    // the 3 types of movement that can occur
+    // bool biological_translation = false;
+    bool physical_translation = false;
+    // bool physical_rotation = false;
+
+    double h = dt;
+    Double3 movement_at_next_step{0, 0, 0};
+
+    // BIOLOGY :
+    // 0) Start with tractor force : What the biology defined as active
+    // movement------------
+    movement_at_next_step += tf * h;
 
     // 4) PhysicalBonds
     // How the physics influences the next displacement
@@ -344,7 +394,30 @@ class Cell : public Agent {
   /// @return the position in local coordinates
   Double3 TransformCoordinatesGlobalToPolar(const Double3& coord) const;
 
+  /// Returns a random volume ratio between 0.9 and 1.1 for a division.
+  double RandomVolumeRatio() const {
+    auto* sim = Simulation::GetActive();
+    if (sim->GetParam()->use_counter_rng) {
+      return GetNextDaughterCounterRng(kVolumeRatioStream).Uniform(0.9, 1.1);
+    }
+    return sim->GetRandom()->Uniform(0.9, 1.1);
+  }
+
+  /// Finds a random point on the unit sphere (based on :
+  /// http://mathworld.wolfram.com/SpherePointPicking.html)
+  template <typename TRng>
+  static void RandomPointOnSphere(TRng* rng, double* phi, double* theta) {
+    *theta = 2 * Math::kPi * rng->Uniform(0, 1);
+    *phi = std::acos(2 * rng->Uniform(0, 1) - 1);
+  }
+
  private:
+  /// Streams of the counter-based random number generators of a division.
+  /// They are keyed by the daughter, hence, the streams are chosen such
+  /// that they do not overlap with the ones used in behaviors.
+  static constexpr uint32_t kVolumeRatioStream = 0xFFFFFFFF;
+  static constexpr uint32_t kDivisionAxisStream = 0xFFFFFFFE;
+
   /// NB: Use setter and don't assign values directly
   Double3 position_ = {{0, 0, 0}};
   Double3 tractor_force_ = {{0, 0, 0}};
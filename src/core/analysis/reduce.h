@@ -22,6 +22,7 @@
 #include "core/container/shared_data.h"
 #include "core/functor.h"
 #include "core/operation/reduction_op.h"
+#include "core/param/param.h"
 #include "core/resource_manager.h"
 #include "core/util/thread_info.h"
 
@@ -62,7 +63,8 @@ inline T Reduce(Simulation* sim, Functor<void, Agent*, T*>& agent_functor,
     agent_functor(agent, &(tl_results[tid]));
   });
   auto* rm = sim->GetResourceManager();
-  rm->ForEachAgentParallel(actual_agent_func, filter);
+  auto batch_size = sim->GetParam()->scheduling_batch_size;
+  rm->ForEachAgentParallel(batch_size, actual_agent_func, filter);
   //   combine thread-local results
   return reduce_partial_results(tl_results);
 }
@@ -98,7 +100,8 @@ inline uint64_t Count(Simulation* sim, Functor<bool, Agent*>& condition,
     }
   });
   auto* rm = sim->GetResourceManager();
-  rm->ForEachAgentParallel(actual_agent_func, filter);
+  auto batch_size = sim->GetParam()->scheduling_batch_size;
+  rm->ForEachAgentParallel(batch_size, actual_agent_func, filter);
   //   combine thread-local results
   SumReduction<uint64_t> sum;
   return sum(tl_results);
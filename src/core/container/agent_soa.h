@@ -0,0 +1,144 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#ifndef CORE_CONTAINER_AGENT_SOA_H_
+#define CORE_CONTAINER_AGENT_SOA_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "core/agent/agent.h"
+#include "core/agent/agent_uid.h"
+#include "core/container/math_array.h"
+
+namespace bdm {
+
+/// Structure-of-arrays mirror of the most frequently accessed agent
+/// attributes of one NUMA domain.\n
+/// Element `i` corresponds to the agent with AgentHandle `(numa_node, i)`
+/// inside the ResourceManager. Algorithms that only need positions, diameters,
+/// uids, box indices or the static flag can stream over these arrays instead
+/// of dereferencing `Agent*` and calling virtual getters for each agent.\n
+/// The ResourceManager keeps the element order in sync with its agent
+/// container. The attribute values reflect the state of the agents at the
+/// time they were last written (see `ResourceManager::UpdateAgentSoA`).
+class AgentSoA {
+ public:
+  uint64_t size() const { return x_.size(); }  // NOLINT
+
+  void clear() {  // NOLINT
+    x_.clear();
+    y_.clear();
+    z_.clear();
+    diameter_.clear();
+    uid_.clear();
+    box_idx_.clear();
+    is_static_.clear();
+  }
+
+  void reserve(uint64_t capacity) {  // NOLINT
+    x_.reserve(capacity);
+    y_.reserve(capacity);
+    z_.reserve(capacity);
+    diameter_.reserve(capacity);
+    uid_.reserve(capacity);
+    box_idx_.reserve(capacity);
+    is_static_.reserve(capacity);
+  }
+
+  void resize(uint64_t new_size) {  // NOLINT
+    x_.resize(new_size);
+    y_.resize(new_size);
+    z_.resize(new_size);
+    diameter_.resize(new_size);
+    uid_.resize(new_size);
+    box_idx_.resize(new_size);
+    is_static_.resize(new_size);
+  }
+
+  /// Copies the hot attributes of `agent` into element `idx`.
+  /// Thread-safe as long as different threads write different elements.
+  void Set(uint64_t idx, const Agent& agent) {
+    const auto& pos = agent.GetPosition();
+    x_[idx] = pos[0];
+    y_[idx] = pos[1];
+    z_[idx] = pos[2];
+    diameter_[idx] = agent.GetDiameter();
+    uid_[idx] = agent.GetUid();
+    box_idx_[idx] = agent.GetBoxIdx();
+    is_static_[idx] = agent.IsStatic();
+  }
+
+  void PushBack(const Agent& agent) {
+    resize(size() + 1);
+    Set(size() - 1, agent);
+  }
+
+  /// Copies element `src` to element `dest`.
+  void Copy(uint64_t src, uint64_t dest) {
+    x_[dest] = x_[src];
+    y_[dest] = y_[src];
+    z_[dest] = z_[src];
+    diameter_[dest] = diameter_[src];
+    uid_[dest] = uid_[src];
+    box_idx_[dest] = box_idx_[src];
+    is_static_[dest] = is_static_[src];
+  }
+
+  /// Swaps element `a` and `b`.
+  void Swap(uint64_t a, uint64_t b) {
+    std::swap(x_[a], x_[b]);
+    std::swap(y_[a], y_[b]);
+    std::swap(z_[a], z_[b]);
+    std::swap(diameter_[a], diameter_[b]);
+    std::swap(uid_[a], uid_[b]);
+    std::swap(box_idx_[a], box_idx_[b]);
+    std::swap(is_static_[a], is_static_[b]);
+  }
+
+  Double3 GetPosition(uint64_t idx) const {
+    return {x_[idx], y_[idx], z_[idx]};
+  }
+  double GetDiameter(uint64_t idx) const { return diameter_[idx]; }
+  const AgentUid& GetUid(uint64_t idx) const { return uid_[idx]; }
+  uint32_t GetBoxIdx(uint64_t idx) const { return box_idx_[idx]; }
+  bool IsStatic(uint64_t idx) const { return is_static_[idx]; }
+
+  void SetBoxIdx(uint64_t idx, uint32_t box_idx) { box_idx_[idx] = box_idx; }
+
+  /// Raw pointers for streaming access.
+  const double* GetX() const { return x_.data(); }
+  const double* GetY() const { return y_.data(); }
+  const double* GetZ() const { return z_.data(); }
+  const double* GetDiameters() const { return diameter_.data(); }
+  const AgentUid* GetUids() const { return uid_.data(); }
+  const uint32_t* GetBoxIndices() const { return box_idx_.data(); }
+  /// Stored as `char` instead of `bool` to avoid the bit-packed
+  /// `std::vector<bool>` specialization.
+  const char* GetStaticFlags() const { return is_static_.data(); }
+
+ private:
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<double> z_;
+  std::vector<double> diameter_;
+  std::vector<AgentUid> uid_;
+  std::vector<uint32_t> box_idx_;
+  std::vector<char> is_static_;
+};
+
+}  // namespace bdm
+
+#endif  // CORE_CONTAINER_AGENT_SOA_H_
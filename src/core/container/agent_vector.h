@@ -59,6 +59,22 @@ class AgentVector {
     }
   }
 
+  /// Like `reserve`, but keeps the existing elements.
+  /// Returns false without changing anything if the reserved memory of a
+  /// NUMA node is too small for its current number of agents.
+  bool resize_in_place() {  // NOLINT
+    auto* rm = Simulation::GetActive()->GetResourceManager();
+    for (int n = 0; n < thread_info_->GetNumaNodes(); n++) {
+      if (data_[n].capacity() < rm->GetNumAgents(n)) {
+        return false;
+      }
+    }
+    for (int n = 0; n < thread_info_->GetNumaNodes(); n++) {
+      size_[n] = rm->GetNumAgents(n);
+    }
+    return true;
+  }
+
   void clear() {  // NOLINT
     for (auto& el : size_) {
       el = 0;
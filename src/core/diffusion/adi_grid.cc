@@ -0,0 +1,144 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#include "core/diffusion/adi_grid.h"
+#include "core/util/work_stealing_executor.h"
+
+namespace bdm {
+
+void ADIGrid::DiffuseWithClosedEdge() { Solve(true); }
+
+void ADIGrid::DiffuseWithOpenEdge() { Solve(false); }
+
+void ADIGrid::Solve(bool closed_edge) {
+  const double d = 1 - dc_[0];
+  const double r = d * dt_ / (box_length_ * box_length_);
+
+  for (int axis = 0; axis < 3; axis++) {
+    CalculateCoefficients(axis, closed_edge, r);
+    SolveAxis(axis, closed_edge, r);
+    c1_.swap(c2_);
+  }
+
+  if (mu_ != 0) {
+    auto decay = [&](uint64_t start, uint64_t end) {
+#pragma omp simd
+      for (uint64_t i = start; i < end; i++) {
+        c1_[i] *= (1 - mu_ * dt_);
+      }
+    };
+    WorkStealingExecutor::GetInstance()->ParallelFor(total_num_boxes_, 4096,
+                                                     decay);
+  }
+}
+
+void ADIGrid::CalculateCoefficients(int axis, bool closed_edge, double r) {
+  // The system of each line is
+  //   -r/2 u'[i-1] + (1 + r) u'[i] - r/2 u'[i+1] =
+  //        r/2 u[i-1] + (1 - r) u[i] + r/2 u[i+1]
+  // A closed edge mirrors the boundary value (no flux), an open edge
+  // assumes a concentration of zero outside the grid.
+  const size_t n = num_boxes_axis_[axis];
+  auto& cp = cp_[axis];
+  auto& inv_denom = inv_denom_[axis];
+  cp.resize(n);
+  inv_denom.resize(n);
+  const double a = -r / 2;
+  const double edge = closed_edge ? 1 + r / 2 : 1 + r;
+  for (size_t i = 0; i < n; i++) {
+    double b = (i == 0 || i == n - 1) ? edge : 1 + r;
+    if (n == 1) {
+      b = closed_edge ? 1 : 1 + r;
+    }
+    double denom = i == 0 ? b : b - a * cp[i - 1];
+    inv_denom[i] = 1 / denom;
+    cp[i] = a * inv_denom[i];
+  }
+}
+
+void ADIGrid::SolveAxis(int axis, bool closed_edge, double r) {
+  const size_t nx = num_boxes_axis_[0];
+  const size_t ny = num_boxes_axis_[1];
+  const size_t nz = num_boxes_axis_[2];
+  const size_t n = num_boxes_axis_[axis];
+
+  // Lines along y and z are solved in batches of nx lines, such that the
+  // innermost loop runs over contiguous memory.
+  size_t num_batches;
+  size_t stride;
+  size_t width;
+  if (axis == 0) {
+    num_batches = ny * nz;
+    stride = 1;
+    width = 1;
+  } else if (axis == 1) {
+    num_batches = nz;
+    stride = nx;
+    width = nx;
+  } else {
+    num_batches = ny;
+    stride = nx * ny;
+    width = nx;
+  }
+  auto batch_offset = [&](size_t batch) {
+    if (axis == 0) {
+      return batch * nx;
+    } else if (axis == 1) {
+      return batch * nx * ny;
+    }
+    return batch * nx;
+  };
+
+  const double a = -r / 2;
+  const double* cp = cp_[axis].data();
+  const double* inv_denom = inv_denom_[axis].data();
+  const double outside = closed_edge ? 1 : 0;
+
+  auto solve = [&](uint64_t start, uint64_t end) {
+    for (uint64_t batch = start; batch < end; batch++) {
+      const size_t offset = batch_offset(batch);
+      // forward elimination
+      for (size_t i = 0; i < n; i++) {
+        const double* u = &c1_[offset + i * stride];
+        const double* lower = i == 0 ? u : u - stride;
+        const double* upper = i == n - 1 ? u : u + stride;
+        const double lower_factor = i == 0 ? outside : 1;
+        const double upper_factor = i == n - 1 ? outside : 1;
+        double* dp = &c2_[offset + i * stride];
+        const double* dp_prev = i == 0 ? dp : dp - stride;
+        const double prev_factor = i == 0 ? 0 : 1;
+#pragma omp simd
+        for (size_t x = 0; x < width; x++) {
+          double rhs =
+              u[x] + r / 2 *
+                         (lower_factor * lower[x] - 2 * u[x] +
+                          upper_factor * upper[x]);
+          dp[x] = (rhs - a * prev_factor * dp_prev[x]) * inv_denom[i];
+        }
+      }
+      // back substitution
+      for (size_t i = n - 1; i-- > 0;) {
+        double* x_i = &c2_[offset + i * stride];
+        const double* x_next = x_i + stride;
+#pragma omp simd
+        for (size_t x = 0; x < width; x++) {
+          x_i[x] -= cp[i] * x_next[x];
+        }
+      }
+    }
+  };
+  WorkStealingExecutor::GetInstance()->ParallelFor(num_batches, 1, solve);
+}
+
+}  // namespace bdm
@@ -0,0 +1,67 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#ifndef CORE_DIFFUSION_ADI_GRID_H_
+#define CORE_DIFFUSION_ADI_GRID_H_
+
+#include <limits>
+#include <vector>
+
+#include "core/diffusion/diffusion_grid.h"
+
+namespace bdm {
+
+/// Solves the diffusion equation with an alternating direction implicit
+/// (ADI) scheme. Each time step is split into three one dimensional
+/// Crank-Nicolson steps along x, y and z (locally one dimensional splitting).
+/// Each of them solves one tridiagonal system per grid line with the Thomas
+/// algorithm. The lines are solved in parallel.\n
+/// In contrast to the explicit solvers, the scheme is unconditionally stable.
+/// Therefore, the stability limit `D * dt / dx^2 < 1/6` is not enforced.
+/// Large values of `D * dt / dx^2` remain stable, but reduce accuracy.
+class ADIGrid : public DiffusionGrid {
+ public:
+  ADIGrid() {}
+  ADIGrid(int substance_id, std::string substance_name, double dc, double mu,
+          int resolution = 11)
+      : DiffusionGrid(substance_id, substance_name, dc, mu, resolution) {}
+
+  void DiffuseWithClosedEdge() override;
+
+  void DiffuseWithOpenEdge() override;
+
+ private:
+  /// Forward elimination coefficients of the Thomas algorithm for each axis.
+  /// They only depend on the number of boxes and the boundary condition.
+  std::array<std::vector<double>, 3> cp_;         //!
+  std::array<std::vector<double>, 3> inv_denom_;  //!
+
+  double GetStabilityLimit() const override {
+    return std::numeric_limits<double>::infinity();
+  }
+
+  void Solve(bool closed_edge);
+
+  /// Solves the Crank-Nicolson step along `axis`. Reads `c1_` and writes the
+  /// result to `c2_`.
+  void SolveAxis(int axis, bool closed_edge, double r);
+
+  void CalculateCoefficients(int axis, bool closed_edge, double r);
+
+  BDM_CLASS_DEF_OVERRIDE(ADIGrid, 1);
+};
+
+}  // namespace bdm
+
+#endif  // CORE_DIFFUSION_ADI_GRID_H_
@@ -13,9 +13,13 @@
 // -----------------------------------------------------------------------------
 
 #include "core/diffusion/diffusion_grid.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <mutex>
 #include "core/environment/environment.h"
 #include "core/simulation.h"
+#include "core/util/work_stealing_executor.h"
 
 namespace bdm {
 
@@ -26,12 +30,12 @@ void DiffusionGrid::Initialize() {
                "')");
   }
 
-  // Get neighbor grid dimensions
-  auto* env = Simulation::GetActive()->GetEnvironment();
-  auto bounds = env->GetDimensionThresholds();
-
-  grid_dimensions_ = {bounds[0], bounds[1]};
+  grid_dimensions_ = GetEnvironmentBounds();
+  auto grid_size = GetGridSize();
+  auto max_length =
+      std::max(grid_size[0], std::max(grid_size[1], grid_size[2]));
 
+  // The resolution applies to the longest axis.
   // Example: diffusion grid dimensions from 0-40 and resolution
   // of 4. Resolution must be adjusted otherwise one data pointer will be
   // missing.
@@ -43,8 +47,7 @@ void DiffusionGrid::Initialize() {
   //   data points: {0, 13.3, 26.6, 39.9}
   auto adjusted_res =
       resolution_ == 1 ? 2 : resolution_;  // avoid division by 0
-  box_length_ = (grid_dimensions_[1] - grid_dimensions_[0]) /
-                static_cast<double>(adjusted_res - 1);
+  box_length_ = max_length / static_cast<double>(adjusted_res - 1);
   // TODO(ahmad): parametrize the minimum box_length
   if (box_length_ <= 1e-15) {
     Log::Fatal("DiffusionGrid::Initialize",
@@ -55,17 +58,43 @@ void DiffusionGrid::Initialize() {
 
   ParametersCheck();
   box_volume_ = box_length_ * box_length_ * box_length_;
-  parity_ = resolution_ % 2;
-  total_num_boxes_ = resolution_ * resolution_ * resolution_;
+  // The other axes use the same box length and therefore need fewer boxes
+  // to cover their length. The gradient calculation requires at least three
+  // boxes along each axis.
+  for (int i = 0; i < 3; i++) {
+    size_t num_boxes = std::ceil(grid_size[i] / box_length_ - 1e-9) + 1;
+    num_boxes = std::max(num_boxes, std::min<size_t>(resolution_, 3));
+    num_boxes_axis_[i] = std::min(num_boxes, resolution_);
+    parity_[i] = num_boxes_axis_[i] % 2;
+  }
+  total_num_boxes_ = num_boxes_axis_[0] * num_boxes_axis_[1] *
+                     num_boxes_axis_[2];
 
   // Allocate memory for the concentration and gradient arrays
-  locks_.resize(total_num_boxes_);
+  auto* param = Simulation::GetActive()->GetParam();
+  trilinear_ = param->trilinear_diffusion_sampling;
+  deferred_deposits_ = param->deferred_secretion;
+  AllocateData();
+}
+
+void DiffusionGrid::AllocateData() {
+  if (!deferred_deposits_) {
+    locks_.resize(total_num_boxes_);
+  }
   c1_.resize(total_num_boxes_);
   c2_.resize(total_num_boxes_);
   gradients_.resize(total_num_boxes_);
 }
 
 void DiffusionGrid::Diffuse() {
+  ApplyDeposits();
+  // slowly changing substances are only updated every n-th step
+  if (steps_since_update_ < update_frequency_) {
+    steps_since_update_++;
+    return;
+  }
+  steps_since_update_ = 1;
+
   // check if diffusion coefficient and decay constant are 0
   // i.e. if we don't need to calculate diffusion update
   if (IsFixedSubstance()) {
@@ -73,47 +102,121 @@ void DiffusionGrid::Diffuse() {
   }
 
   auto* param = Simulation::GetActive()->GetParam();
-  if (param->diffusion_boundary_condition == "closed") {
-    DiffuseWithClosedEdge();
-  } else if (param->diffusion_boundary_condition == "open") {
-    DiffuseWithOpenEdge();
-  } else {
+  if (param->diffusion_boundary_condition != "closed" &&
+      param->diffusion_boundary_condition != "open" &&
+      param->diffusion_boundary_condition != "periodic") {
     Log::Error(
         "EulerGrid::Diffuse", "Boundary condition of type '",
         param->diffusion_boundary_condition,
         "' is not implemented. Defaulting to 'closed' boundary condition");
+    return;
+  }
+  if (interpolate_) {
+    StoreState();
   }
+  auto num_steps = CalculateTimeStep();
+  for (uint64_t i = 0; i < num_steps; i++) {
+    if (param->diffusion_boundary_condition == "closed") {
+      DiffuseWithClosedEdge();
+    } else if (param->diffusion_boundary_condition == "periodic") {
+      DiffuseWithPeriodicEdge();
+    } else {
+      DiffuseWithOpenEdge();
+    }
+  }
+}
+
+void DiffusionGrid::DiffuseWithPeriodicEdge() {
+  Log::Fatal("DiffusionGrid::DiffuseWithPeriodicEdge",
+             "The diffusion method of substance '", substance_name_,
+             "' does not support the periodic boundary condition. Please "
+             "use the \"euler\" method.");
+}
+
+uint64_t DiffusionGrid::CalculateTimeStep() {
+  auto* param = Simulation::GetActive()->GetParam();
+  double interval = static_cast<double>(update_frequency_);
+  if (param->scale_diffusion_with_time_step) {
+    interval *= param->simulation_time_step;
+  }
+  ParametersCheck();
+  uint64_t num_steps = 1;
+  if (max_dt_ > 0) {
+    num_steps = std::ceil(interval / max_dt_ - 1e-9);
+  } else {
+    // the time step must be strictly smaller than the stability limit
+    num_steps = std::floor(interval / GetStabilityLimit()) + 1;
+  }
+  num_steps = std::max(num_steps, static_cast<uint64_t>(1));
+  dt_ = interval / num_steps;
+  return num_steps;
+}
+
+void DiffusionGrid::SetUpdateFrequency(uint64_t frequency, bool interpolate) {
+  if (frequency == 0) {
+    Log::Fatal("DiffusionGrid::SetUpdateFrequency",
+               "The update frequency of substance '", substance_name_,
+               "' must be at least one.");
+  }
+  update_frequency_ = frequency;
+  interpolate_ = interpolate && frequency > 1;
+  // the next call to Diffuse performs an update
+  steps_since_update_ = frequency;
+  if (!interpolate_) {
+    c0_.clear();
+    gradients0_.clear();
+  }
+}
+
+void DiffusionGrid::StoreState() {
+  c0_.resize(total_num_boxes_);
+  gradients0_.resize(total_num_boxes_);
+  auto copy = [&](uint64_t start, uint64_t end) {
+    for (uint64_t i = start; i < end; i++) {
+      c0_[i] = c1_[i];
+      gradients0_[i] = gradients_[i];
+    }
+  };
+  WorkStealingExecutor::GetInstance()->ParallelFor(total_num_boxes_, 4096,
+                                                   copy);
 }
 
 void DiffusionGrid::Update() {
-  // Get neighbor grid dimensions
-  auto* env = Simulation::GetActive()->GetEnvironment();
-  auto bounds = env->GetDimensionThresholds();
-  // Update the grid dimensions such that each dimension ranges from
-  // {bounds[0] - bounds[1]}
-  grid_dimensions_ = {bounds[0], bounds[1]};
-
-  // If the grid is not perfectly divisible along each dimension by the
-  // box length, extend the grid so that it is
-  int dimension_length = bounds[1] - bounds[0];
-  for (int i = 0; i < 1; i++) {
+  // buffered changes refer to the box indices of the current grid
+  ApplyDeposits();
+  auto bounds = GetEnvironmentBounds();
+  auto old_dimensions = grid_dimensions_;
+  auto old_num_boxes_axis = num_boxes_axis_;
+  bool grown = false;
+
+  for (int i = 0; i < 3; i++) {
+    // Update the grid dimensions such that each dimension ranges from
+    // {bounds[2 * i] - bounds[2 * i + 1]}
+    grid_dimensions_[2 * i] = bounds[2 * i];
+    grid_dimensions_[2 * i + 1] = bounds[2 * i + 1];
+
+    // If the grid is not perfectly divisible along each dimension by the
+    // box length, extend the grid so that it is
+    int dimension_length = bounds[2 * i + 1] - bounds[2 * i];
     int r = fmod(dimension_length, box_length_);
     if (r > 1e-9) {
       // std::abs for the case that box_length_ > dimension_length
       grid_dimensions_[2 * i + 1] += (box_length_ - r);
     }
-  }
 
-  // Calculate new_dimension_length and new_resolution
-  int new_dimension_length = grid_dimensions_[1] - grid_dimensions_[0];
-  size_t new_resolution = std::ceil(new_dimension_length / box_length_);
+    // Calculate new_dimension_length and new number of boxes
+    int new_dimension_length =
+        grid_dimensions_[2 * i + 1] - grid_dimensions_[2 * i];
+    size_t new_num_boxes = std::ceil(new_dimension_length / box_length_);
 
-  if (new_resolution > resolution_) {
-    // Store the old number of boxes along each axis for comparison
-    size_t tmp_resolution = resolution_;
-
-    // Set new resolution
-    resolution_ = new_resolution;
+    if (new_num_boxes <= num_boxes_axis_[i]) {
+      // the data along this axis stays where it is
+      grid_dimensions_[2 * i] = old_dimensions[2 * i];
+      grid_dimensions_[2 * i + 1] = old_dimensions[2 * i + 1];
+      continue;
+    }
+    grown = true;
+    num_boxes_axis_[i] = new_num_boxes;
 
     // We need to maintain the parity of the number of boxes along each
     // dimension, otherwise copying of the substances to the increases grid
@@ -121,47 +224,88 @@ void DiffusionGrid::Update() {
     // We add a box in the negative direction, because the only way the parity
     // could have changed is because of adding a box in the positive direction
     // (due to the grid not being perfectly divisible; see above)
-    if (resolution_ % 2 != parity_) {
-      grid_dimensions_[0] -= box_length_;
-      resolution_++;
+    if (num_boxes_axis_[i] % 2 != parity_[i]) {
+      grid_dimensions_[2 * i] -= box_length_;
+      num_boxes_axis_[i]++;
     }
+  }
 
-    // Temporarily save previous grid data
-    auto tmp_c1 = c1_;
-    auto tmp_gradients = gradients_;
+  if (grown) {
+    resolution_ = std::max(num_boxes_axis_[0],
+                           std::max(num_boxes_axis_[1], num_boxes_axis_[2]));
+    total_num_boxes_ = num_boxes_axis_[0] * num_boxes_axis_[1] *
+                       num_boxes_axis_[2];
+    GrowData(old_num_boxes_axis);
+    // Interpolated reads continue from the current state
+    if (interpolate_) {
+      StoreState();
+    }
+  }
+}
 
-    c1_.clear();
-    c2_.clear();
-    gradients_.clear();
+void DiffusionGrid::GrowData(const std::array<size_t, 3>& old_num_boxes_axis) {
+  // Temporarily save previous grid data
+  auto tmp_c1 = c1_;
+  auto tmp_gradients = gradients_;
 
-    total_num_boxes_ = resolution_ * resolution_ * resolution_;
+  c1_.clear();
+  c2_.clear();
+  gradients_.clear();
 
-    CopyOldData(tmp_c1, tmp_gradients, tmp_resolution);
+  CopyOldData(tmp_c1, tmp_gradients, old_num_boxes_axis);
+}
+
+std::array<int32_t, 6> DiffusionGrid::GetEnvironmentBounds() const {
+  auto* sim = Simulation::GetActive();
+  auto* env = sim->GetEnvironment();
+  auto* param = sim->GetParam();
+  if (param->bound_space == Param::BoundSpaceMode::kTorus) {
+    // The grid must span exactly one period, such that the first and the
+    // last box lie on opposite bounds (see `DiffuseWithPeriodicEdge`).
+    // The bounds are truncated like in the environment.
+    int32_t min = param->min_bound;
+    int32_t max = param->max_bound;
+    return {min, max, min, max, min, max};
   }
+  if (param->non_cubic_diffusion_grid) {
+    return env->GetDimensions();
+  }
+  auto thresholds = env->GetDimensionThresholds();
+  return {thresholds[0], thresholds[1], thresholds[0],
+          thresholds[1], thresholds[0], thresholds[1]};
 }
 
 void DiffusionGrid::CopyOldData(
     const ParallelResizeVector<double>& old_c1,
-    const ParallelResizeVector<Double3>& old_gradients, size_t old_resolution) {
+    const ParallelResizeVector<Double3>& old_gradients,
+    const std::array<size_t, 3>& old_num_boxes_axis) {
   // Allocate more memory for the grid data arrays
+  if (!deferred_deposits_) {
+    locks_.resize(total_num_boxes_);
+  }
   c1_.resize(total_num_boxes_);
   c2_.resize(total_num_boxes_);
   gradients_.resize(total_num_boxes_);
 
-  auto incr_num_boxes = resolution_ - old_resolution;
-  int off_dim = incr_num_boxes / 2;
+  const auto& nba = num_boxes_axis_;
+  const auto& old_nba = old_num_boxes_axis;
+  std::array<size_t, 3> off_dim;
+  for (int i = 0; i < 3; i++) {
+    off_dim[i] = (nba[i] - old_nba[i]) / 2;
+  }
 
-  int num_box_xy = resolution_ * resolution_;
-  int old_box_xy = old_resolution * old_resolution;
-  int new_origin = off_dim * (num_box_xy) + off_dim * resolution_ + off_dim;
-  for (size_t k = 0; k < old_resolution; k++) {
-    int offset = new_origin + k * num_box_xy;
-    for (size_t j = 0; j < old_resolution; j++) {
+  size_t num_box_xy = nba[0] * nba[1];
+  size_t old_box_xy = old_nba[0] * old_nba[1];
+  size_t new_origin =
+      off_dim[2] * num_box_xy + off_dim[1] * nba[0] + off_dim[0];
+  for (size_t k = 0; k < old_nba[2]; k++) {
+    size_t offset = new_origin + k * num_box_xy;
+    for (size_t j = 0; j < old_nba[1]; j++) {
       if (j != 0) {
-        offset += resolution_;
+        offset += nba[0];
       }
-      for (size_t i = 0; i < old_resolution; i++) {
-        auto idx = k * old_box_xy + j * old_resolution + i;
+      for (size_t i = 0; i < old_nba[0]; i++) {
+        auto idx = k * old_box_xy + j * old_nba[0] + i;
         c1_[offset + i] = old_c1[idx];
         gradients_[offset + i] = old_gradients[idx];
       }
@@ -174,21 +318,23 @@ void DiffusionGrid::RunInitializers() {
     return;
   }
 
-  auto nx = resolution_;
-  auto ny = resolution_;
-  auto nz = resolution_;
+  auto nx = num_boxes_axis_[0];
+  auto ny = num_boxes_axis_[1];
+  auto nz = num_boxes_axis_[2];
 
   // Apply all functions that initialize this diffusion grid
   for (size_t f = 0; f < initializers_.size(); f++) {
     for (uint32_t x = 0; x < nx; x++) {
       double real_x = grid_dimensions_[0] + x * box_length_;
       for (uint32_t y = 0; y < ny; y++) {
-        double real_y = grid_dimensions_[0] + y * box_length_;
+        double real_y = grid_dimensions_[2] + y * box_length_;
         for (uint32_t z = 0; z < nz; z++) {
-          double real_z = grid_dimensions_[0] + z * box_length_;
+          double real_z = grid_dimensions_[4] + z * box_length_;
           std::array<uint32_t, 3> box_coord = {x, y, z};
           size_t idx = GetBoxIndex(box_coord);
-          ChangeConcentrationBy(idx, initializers_[f](real_x, real_y, real_z));
+          // Write directly into the grid, such that the initial values are
+          // visible before the first step in deferred mode as well
+          AddToBox(idx, initializers_[f](real_x, real_y, real_z));
         }
       }
     }
@@ -209,48 +355,72 @@ void DiffusionGrid::CalculateGradient() {
 
   double gd = 1 / (box_length_ * 2);
 
-  auto nx = resolution_;
-  auto ny = resolution_;
-  auto nz = resolution_;
-
-#pragma omp parallel for collapse(2)
-  for (size_t z = 0; z < nz; z++) {
-    for (size_t y = 0; y < ny; y++) {
+  auto nx = num_boxes_axis_[0];
+  auto ny = num_boxes_axis_[1];
+  auto nz = num_boxes_axis_[2];
+  // In a periodic space the neighbors of the edge boxes are on the opposite
+  // side of the grid. The last box along each axis is a copy of the first
+  // one (see EulerGrid::DiffuseWithPeriodicEdge).
+  bool periodic = Simulation::GetActive()->GetParam()
+                      ->diffusion_boundary_condition == "periodic";
+  const size_t px = std::max<size_t>(nx - 1, 1);
+  const size_t py = std::max<size_t>(ny - 1, 1);
+  const size_t pz = std::max<size_t>(nz - 1, 1);
+
+  auto calculate_gradient = [&](uint64_t start, uint64_t end) {
+    for (uint64_t row = start; row < end; ++row) {
+      const size_t z = row / ny;
+      const size_t y = row % ny;
       for (size_t x = 0; x < nx; x++) {
         int c, e, w, n, s, b, t;
         c = x + y * nx + z * nx * ny;
 
-        if (x == 0) {
-          e = c;
-          w = c + 2;
-        } else if (x == nx - 1) {
-          e = c - 2;
-          w = c;
+        if (periodic) {
+          const size_t xw = x % px;
+          const size_t yw = y % py;
+          const size_t zw = z % pz;
+          auto index = [&](size_t i, size_t j, size_t k) {
+            return static_cast<int>(i + j * nx + k * nx * ny);
+          };
+          e = index((xw + px - 1) % px, yw, zw);
+          w = index((xw + 1) % px, yw, zw);
+          s = index(xw, (yw + py - 1) % py, zw);
+          n = index(xw, (yw + 1) % py, zw);
+          b = index(xw, yw, (zw + pz - 1) % pz);
+          t = index(xw, yw, (zw + 1) % pz);
         } else {
-          e = c - 1;
-          w = c + 1;
-        }
-
-        if (y == 0) {
-          n = c + 2 * nx;
-          s = c;
-        } else if (y == ny - 1) {
-          n = c;
-          s = c - 2 * nx;
-        } else {
-          n = c + nx;
-          s = c - nx;
-        }
-
-        if (z == 0) {
-          t = c + 2 * nx * ny;
-          b = c;
-        } else if (z == nz - 1) {
-          t = c;
-          b = c - 2 * nx * ny;
-        } else {
-          t = c + nx * ny;
-          b = c - nx * ny;
+          if (x == 0) {
+            e = c;
+            w = c + 2;
+          } else if (x == nx - 1) {
+            e = c - 2;
+            w = c;
+          } else {
+            e = c - 1;
+            w = c + 1;
+          }
+
+          if (y == 0) {
+            n = c + 2 * nx;
+            s = c;
+          } else if (y == ny - 1) {
+            n = c;
+            s = c - 2 * nx;
+          } else {
+            n = c + nx;
+            s = c - nx;
+          }
+
+          if (z == 0) {
+            t = c + 2 * nx * ny;
+            b = c;
+          } else if (z == nz - 1) {
+            t = c;
+            b = c - 2 * nx * ny;
+          } else {
+            t = c + nx * ny;
+            b = c - nx * ny;
+          }
         }
 
         // Let the gradient point from low to high concentration
@@ -259,7 +429,9 @@ void DiffusionGrid::CalculateGradient() {
         gradients_[c][2] = (c1_[t] - c1_[b]) * gd;
       }
     }
-  }
+  };
+  WorkStealingExecutor::GetInstance()->ParallelFor(nz * ny, 16,
+                                                   calculate_gradient);
   if (!init_gradient_) {
     init_gradient_ = true;
   }
@@ -279,50 +451,296 @@ void DiffusionGrid::ChangeConcentrationBy(size_t idx, double amount) {
                "the diffusion grid! The change was ignored.");
     return;
   }
+  if (deferred_deposits_) {
+    auto tid = ThreadInfo::GetInstance()->GetMyThreadId();
+    deposits_[tid].push_back({idx, amount});
+    return;
+  }
+  AddToBoxLocked(idx, amount);
+}
+
+void DiffusionGrid::AddToBoxLocked(size_t idx, double amount) {
   std::lock_guard<Spinlock> guard(locks_[idx]);
+  AddToBox(idx, amount);
+}
+
+void DiffusionGrid::AddToBox(size_t idx, double amount) {
   c1_[idx] += amount;
   if (c1_[idx] > concentration_threshold_) {
     c1_[idx] = concentration_threshold_;
   }
+  // the change must also be visible in interpolated reads
+  if (interpolate_ && c0_.size() == total_num_boxes_) {
+    c0_[idx] += amount;
+    if (c0_[idx] > concentration_threshold_) {
+      c0_[idx] = concentration_threshold_;
+    }
+  }
+}
+
+void DiffusionGrid::ApplyDeposits() {
+  size_t num_deposits = 0;
+  for (auto& buffer : deposits_) {
+    num_deposits += buffer.size();
+  }
+  if (num_deposits == 0) {
+    return;
+  }
+
+  auto* executor = WorkStealingExecutor::GetInstance();
+  auto sort = [&](uint64_t start, uint64_t end) {
+    for (uint64_t t = start; t < end; t++) {
+      auto& buffer = deposits_[t];
+      std::sort(buffer.begin(), buffer.end(),
+                [](const std::pair<size_t, double>& lhs,
+                   const std::pair<size_t, double>& rhs) {
+                  return lhs.first < rhs.first;
+                });
+    }
+  };
+  executor->ParallelFor(deposits_.size(), 1, sort);
+
+  // Each task owns a disjoint range of boxes and collects the changes of
+  // this range from all buffers.
+  auto apply = [&](uint64_t start, uint64_t end) {
+    for (auto& buffer : deposits_) {
+      auto it = std::lower_bound(
+          buffer.begin(), buffer.end(), start,
+          [](const std::pair<size_t, double>& deposit, uint64_t idx) {
+            return deposit.first < idx;
+          });
+      for (; it != buffer.end() && it->first < end; ++it) {
+        AddToBox(it->first, it->second);
+      }
+    }
+  };
+  executor->ParallelFor(total_num_boxes_, 4096, apply);
+
+  for (auto& buffer : deposits_) {
+    buffer.clear();
+  }
+}
+
+template <typename T>
+T DiffusionGrid::Interpolate(const ParallelResizeVector<T>& data, size_t idx,
+                             const Double3& weights) const {
+  const auto nx = num_boxes_axis_[0];
+  const auto nxy = nx * num_boxes_axis_[1];
+  // offsets of the upper corner (zero along axes with only one box)
+  const size_t dx = nx > 1 ? 1 : 0;
+  const size_t dy = num_boxes_axis_[1] > 1 ? nx : 0;
+  const size_t dz = num_boxes_axis_[2] > 1 ? nxy : 0;
+  const double wx = weights[0];
+  const double wy = weights[1];
+  const double wz = weights[2];
+  auto c00 = data[idx] * (1 - wx) + data[idx + dx] * wx;
+  auto c10 = data[idx + dy] * (1 - wx) + data[idx + dy + dx] * wx;
+  auto c01 = data[idx + dz] * (1 - wx) + data[idx + dz + dx] * wx;
+  auto c11 = data[idx + dz + dy] * (1 - wx) + data[idx + dz + dy + dx] * wx;
+  auto c0 = c00 * (1 - wy) + c10 * wy;
+  auto c1 = c01 * (1 - wy) + c11 * wy;
+  return c0 * (1 - wz) + c1 * wz;
+}
+
+double DiffusionGrid::InterpolateConcentrationLocked(
+    size_t idx, const Double3& weights) const {
+  const auto nx = num_boxes_axis_[0];
+  const size_t dx = nx > 1 ? 1 : 0;
+  const size_t dy = num_boxes_axis_[1] > 1 ? nx : 0;
+  const size_t dz = num_boxes_axis_[2] > 1 ? nx * num_boxes_axis_[1] : 0;
+  const bool blend = InterpolatesInTime();
+  const double w = GetInterpolationWeight();
+  // values of the eight corners; bit 0, 1 and 2 of the index select the
+  // upper corner along x, y and z
+  std::array<double, 8> c;
+  for (size_t i = 0; i < 8; i++) {
+    auto box = idx + (i & 1 ? dx : 0) + (i & 2 ? dy : 0) + (i & 4 ? dz : 0);
+    std::lock_guard<Spinlock> guard(locks_[box]);
+    c[i] = blend ? (1 - w) * c0_[box] + w * c1_[box] : c1_[box];
+  }
+  // reduce along x, then y, then z
+  for (size_t axis = 0, n = 4; axis < 3; axis++, n /= 2) {
+    for (size_t i = 0; i < n; i++) {
+      c[i] = c[2 * i] * (1 - weights[axis]) + c[2 * i + 1] * weights[axis];
+    }
+  }
+  return c[0];
 }
 
 /// Get the concentration at specified position
 double DiffusionGrid::GetConcentration(const Double3& position) const {
+  if (trilinear_) {
+    size_t idx;
+    Double3 weights;
+    GetInterpolationStencil(position, &idx, &weights);
+    if (!deferred_deposits_) {
+      return InterpolateConcentrationLocked(idx, weights);
+    }
+    auto concentration = Interpolate(c1_, idx, weights);
+    if (InterpolatesInTime()) {
+      auto w = GetInterpolationWeight();
+      concentration =
+          (1 - w) * Interpolate(c0_, idx, weights) + w * concentration;
+    }
+    return concentration;
+  }
+
   auto idx = GetBoxIndex(position);
-  std::lock_guard<Spinlock> guard(locks_[idx]);
+  // Without locks the concentrations must not be modified concurrently,
+  // which is guaranteed in deferred mode
+  std::unique_lock<Spinlock> guard;
+  if (!deferred_deposits_) {
+    guard = std::unique_lock<Spinlock>(locks_[idx]);
+  }
+  if (InterpolatesInTime()) {
+    auto w = GetInterpolationWeight();
+    return (1 - w) * c0_[idx] + w * c1_[idx];
+  }
   return c1_[idx];
 }
 
 /// Get the (normalized) gradient at specified position
 void DiffusionGrid::GetGradient(const Double3& position,
                                 Double3* gradient) const {
-  auto idx = GetBoxIndex(position);
-  if (idx >= total_num_boxes_) {
-    Log::Error("DiffusionGrid::GetGradient",
-               "You tried to get the gradient outside the bounds of "
-               "the diffusion grid! Returning zero gradient.");
-    return;
+  if (trilinear_) {
+    size_t idx;
+    Double3 weights;
+    GetInterpolationStencil(position, &idx, &weights);
+    *gradient = Interpolate(gradients_, idx, weights);
+    if (InterpolatesInTime()) {
+      auto w = GetInterpolationWeight();
+      *gradient =
+          Interpolate(gradients0_, idx, weights) * (1 - w) + *gradient * w;
+    }
+  } else {
+    auto idx = GetBoxIndex(position);
+    if (idx >= total_num_boxes_) {
+      Log::Error("DiffusionGrid::GetGradient",
+                 "You tried to get the gradient outside the bounds of "
+                 "the diffusion grid! Returning zero gradient.");
+      return;
+    }
+    if (InterpolatesInTime()) {
+      auto w = GetInterpolationWeight();
+      *gradient = gradients0_[idx] * (1 - w) + gradients_[idx] * w;
+    } else {
+      *gradient = gradients_[idx];
+    }
   }
-  *gradient = gradients_[idx];
   auto norm = gradient->Norm();
   if (norm > 1e-10) {
     gradient->Normalize();
   }
 }
 
+// The batch functions first calculate the stencils of a batch of positions
+// and then gather the values, such that both loops can be vectorized.
+static constexpr size_t kSamplingBatchSize = 64;
+
+void DiffusionGrid::GetConcentrations(const Double3* positions,
+                                      size_t num_positions,
+                                      double* concentrations) const {
+  const bool blend = InterpolatesInTime();
+  const double w = GetInterpolationWeight();
+  size_t idx[kSamplingBatchSize];
+  Double3 weights[kSamplingBatchSize];
+  for (size_t start = 0; start < num_positions;
+       start += kSamplingBatchSize) {
+    const auto n = std::min(kSamplingBatchSize, num_positions - start);
+    const auto* pos = positions + start;
+    auto* result = concentrations + start;
+    if (!trilinear_) {
+      for (size_t i = 0; i < n; i++) {
+        idx[i] = GetBoxIndex(pos[i]);
+      }
+#pragma omp simd
+      for (size_t i = 0; i < n; i++) {
+        result[i] = blend ? (1 - w) * c0_[idx[i]] + w * c1_[idx[i]]
+                          : c1_[idx[i]];
+      }
+      continue;
+    }
+#pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+      GetInterpolationStencil(pos[i], &idx[i], &weights[i]);
+    }
+#pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+      result[i] = Interpolate(c1_, idx[i], weights[i]);
+    }
+    if (blend) {
+#pragma omp simd
+      for (size_t i = 0; i < n; i++) {
+        result[i] =
+            (1 - w) * Interpolate(c0_, idx[i], weights[i]) + w * result[i];
+      }
+    }
+  }
+}
+
+void DiffusionGrid::GetGradients(const Double3* positions,
+                                 size_t num_positions, Double3* gradients,
+                                 bool normalize) const {
+  const bool blend = InterpolatesInTime();
+  const double w = GetInterpolationWeight();
+  size_t idx[kSamplingBatchSize];
+  Double3 weights[kSamplingBatchSize];
+  for (size_t start = 0; start < num_positions;
+       start += kSamplingBatchSize) {
+    const auto n = std::min(kSamplingBatchSize, num_positions - start);
+    const auto* pos = positions + start;
+    auto* result = gradients + start;
+    if (trilinear_) {
+#pragma omp simd
+      for (size_t i = 0; i < n; i++) {
+        GetInterpolationStencil(pos[i], &idx[i], &weights[i]);
+      }
+      for (size_t i = 0; i < n; i++) {
+        result[i] = Interpolate(gradients_, idx[i], weights[i]);
+      }
+      if (blend) {
+        for (size_t i = 0; i < n; i++) {
+          result[i] = Interpolate(gradients0_, idx[i], weights[i]) * (1 - w) +
+                      result[i] * w;
+        }
+      }
+    } else {
+      for (size_t i = 0; i < n; i++) {
+        idx[i] = std::min(GetBoxIndex(pos[i]), total_num_boxes_ - 1);
+      }
+      for (size_t i = 0; i < n; i++) {
+        result[i] = blend ? gradients0_[idx[i]] * (1 - w) +
+                                gradients_[idx[i]] * w
+                          : gradients_[idx[i]];
+      }
+    }
+    if (normalize) {
+#pragma omp simd
+      for (size_t i = 0; i < n; i++) {
+        auto& g = result[i];
+        double norm = std::sqrt(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+        double scale = norm > 1e-10 ? 1 / norm : 1;
+        g[0] *= scale;
+        g[1] *= scale;
+        g[2] *= scale;
+      }
+    }
+  }
+}
+
 std::array<uint32_t, 3> DiffusionGrid::GetBoxCoordinates(
     const Double3& position) const {
   std::array<uint32_t, 3> box_coord;
   box_coord[0] = (floor(position[0]) - grid_dimensions_[0]) / box_length_;
-  box_coord[1] = (floor(position[1]) - grid_dimensions_[0]) / box_length_;
-  box_coord[2] = (floor(position[2]) - grid_dimensions_[0]) / box_length_;
+  box_coord[1] = (floor(position[1]) - grid_dimensions_[2]) / box_length_;
+  box_coord[2] = (floor(position[2]) - grid_dimensions_[4]) / box_length_;
   return box_coord;
 }
 
 size_t DiffusionGrid::GetBoxIndex(
     const std::array<uint32_t, 3>& box_coord) const {
-  size_t ret = box_coord[2] * resolution_ * resolution_ +
-               box_coord[1] * resolution_ + box_coord[0];
+  size_t ret = box_coord[2] * num_boxes_axis_[0] * num_boxes_axis_[1] +
+               box_coord[1] * num_boxes_axis_[0] + box_coord[0];
   return ret;
 }
 
@@ -333,14 +751,22 @@ size_t DiffusionGrid::GetBoxIndex(const Double3& position) const {
 }
 
 void DiffusionGrid::ParametersCheck() {
-  if (((1 - dc_[0]) * dt_) / (box_length_ * box_length_) >= (1.0 / 6)) {
+  if (max_dt_ > 0 && max_dt_ >= GetStabilityLimit()) {
     Log::Fatal(
         "DiffusionGrid",
         "The specified parameters of the diffusion grid with substance [",
         substance_name_,
         "] will result in unphysical behavior (diffusion coefficient = ",
-        (1 - dc_[0]), ", resolution = ", resolution_,
-        "). Please refer to the user guide for more information.");
+        (1 - dc_[0]), ", resolution = ", resolution_, ", time step = ",
+        max_dt_, "). Please refer to the user guide for more information.");
+  }
+}
+
+double DiffusionGrid::GetStabilityLimit() const {
+  double d = 1 - dc_[0];
+  if (d <= 0) {
+    return std::numeric_limits<double>::infinity();
   }
+  return box_length_ * box_length_ / (6 * d);
 }
 }  // namespace bdm
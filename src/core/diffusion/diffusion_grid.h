@@ -15,16 +15,21 @@
 #ifndef CORE_DIFFUSION_DIFFUSION_GRID_H_
 #define CORE_DIFFUSION_DIFFUSION_GRID_H_
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <functional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "core/container/math_array.h"
 #include "core/container/parallel_resize_vector.h"
+#include "core/container/shared_data.h"
 #include "core/util/log.h"
 #include "core/util/root.h"
 #include "core/util/spinlock.h"
+#include "core/util/thread_info.h"
 
 namespace bdm {
 
@@ -50,10 +55,51 @@ class DiffusionGrid {
   /// concentration / gradient
   virtual void Update();
 
+  /// Advances the concentrations by one simulation step. If the update
+  /// frequency is larger than one (see `SetUpdateFrequency`), only every
+  /// n-th call updates the concentrations; the update then covers the time
+  /// of n simulation steps. Each update is split into sub-steps of at most
+  /// `SetTimeStep` (see `CalculateTimeStep`).
   void Diffuse();
 
+  /// Returns true if the last call to `Diffuse` updated the concentrations.
+  bool UpdatedInLastStep() const { return steps_since_update_ == 1; }
+
+  /// Calculates the time step of the sub-steps of the next update and
+  /// returns the number of sub-steps. The update advances the grid by one
+  /// time unit per simulation step (or by `Param::simulation_time_step` if
+  /// `Param::scale_diffusion_with_time_step` is set), times the update
+  /// frequency. If no time step has been set, the largest time step below
+  /// the stability limit of the diffusion method is used.
+  uint64_t CalculateTimeStep();
+
+  /// Sets the maximum physical time step of one diffusion sub-step.
+  /// Zero (default) chooses the time step automatically from the stability
+  /// limit of the diffusion method.
+  void SetTimeStep(double dt) { max_dt_ = dt; }
+
+  /// Returns the time step of the sub-steps of the last update.
+  double GetTimeStep() const { return dt_; }
+
+  /// Updates the concentrations only every `frequency` simulation steps.
+  /// This reduces the cost of slowly changing substances.
+  /// If `interpolate` is true, `GetConcentration` and `GetGradient` return
+  /// values that are linearly interpolated between the last two updates
+  /// (the last update computes the state `frequency` steps ahead);
+  /// otherwise they return the values of the last update.
+  void SetUpdateFrequency(uint64_t frequency, bool interpolate = false);
+
+  uint64_t GetUpdateFrequency() const { return update_frequency_; }
+
   virtual void DiffuseWithClosedEdge() = 0;
   virtual void DiffuseWithOpenEdge() = 0;
+  /// Substances that leave the grid on one side enter it on the opposite
+  /// side (see `Param::BoundSpaceMode::kTorus`). The first and the last box
+  /// along each axis are located at opposite bounds and therefore represent
+  /// the same point.\n
+  /// The default implementation aborts the simulation, because not all
+  /// diffusion methods support this boundary condition.
+  virtual void DiffuseWithPeriodicEdge();
 
   /// Calculates the gradient for each box in the diffusion grid.
   /// The gradient is calculated in each direction (x, y, z) as following:
@@ -63,22 +109,47 @@ class DiffusionGrid {
   /// where c(x) implies the concentration at position x
   ///
   /// At the edges the gradient is the same as the box next to it
-  void CalculateGradient();
+  virtual void CalculateGradient();
 
   /// Initialize the diffusion grid according to the initialization functions
   void RunInitializers();
 
-  /// Increase the concentration at specified box with specified amount
+  /// Increase the concentration at specified box with specified amount.
+  /// If `Param::deferred_secretion` is set, the change is recorded in a
+  /// buffer of the calling thread and only applied by `ApplyDeposits`.
   void ChangeConcentrationBy(const Double3& position, double amount);
   void ChangeConcentrationBy(size_t idx, double amount);
 
+  /// Applies the changes recorded by `ChangeConcentrationBy` in deferred
+  /// mode. The buffers are sorted by box index, and each box range is
+  /// processed by one task, such that no locks are required.
+  /// Must not be called concurrently with `ChangeConcentrationBy`.
+  void ApplyDeposits();
+
   /// Get the concentration at specified position
-  double GetConcentration(const Double3& position) const;
+  /// (interpolated if `Param::trilinear_diffusion_sampling` is set)
+  virtual double GetConcentration(const Double3& position) const;
 
   /// Get the (normalized) gradient at specified position
+  /// (interpolated if `Param::trilinear_diffusion_sampling` is set)
   // TODO: virtual because of test
   virtual void GetGradient(const Double3& position, Double3* gradient) const;
 
+  /// Batch version of `GetConcentration`. Writes the concentration at
+  /// `positions[i]` to `concentrations[i]` for `i < num_positions`.
+  /// The boxes are read without locks. Hence, the concentrations must not be
+  /// changed concurrently, which is guaranteed if
+  /// `Param::deferred_secretion` is set.
+  virtual void GetConcentrations(const Double3* positions,
+                                 size_t num_positions,
+                                 double* concentrations) const;
+
+  /// Batch version of `GetGradient`. Writes the gradient at `positions[i]`
+  /// to `gradients[i]` for `i < num_positions`.
+  /// \param normalize if false, the gradients are not normalized
+  virtual void GetGradients(const Double3* positions, size_t num_positions,
+                            Double3* gradients, bool normalize = true) const;
+
   std::array<uint32_t, 3> GetBoxCoordinates(const Double3& position) const;
 
   size_t GetBoxIndex(const std::array<uint32_t, 3>& box_coord) const;
@@ -92,18 +163,17 @@ class DiffusionGrid {
 
   double GetConcentrationThreshold() const { return concentration_threshold_; }
 
-  const double* GetAllConcentrations() const { return c1_.data(); }
-
-  const double* GetAllGradients() const { return gradients_.data()->data(); }
+  /// Returns the concentrations of all boxes (in the order of the box
+  /// indices)
+  virtual const double* GetAllConcentrations() const { return c1_.data(); }
 
-  std::array<size_t, 3> GetNumBoxesArray() const {
-    std::array<size_t, 3> ret;
-    ret[0] = resolution_;
-    ret[1] = resolution_;
-    ret[2] = resolution_;
-    return ret;
+  /// Returns the gradients of all boxes (x, y, z of each box)
+  virtual const double* GetAllGradients() const {
+    return gradients_.data()->data();
   }
 
+  std::array<size_t, 3> GetNumBoxesArray() const { return num_boxes_axis_; }
+
   size_t GetNumBoxes() const { return total_num_boxes_; }
 
   double GetBoxLength() const { return box_length_; }
@@ -116,27 +186,19 @@ class DiffusionGrid {
 
   const int32_t* GetDimensionsPtr() const { return grid_dimensions_.data(); }
 
-  std::array<int32_t, 6> GetDimensions() const {
-    std::array<int32_t, 6> ret;
-    ret[0] = grid_dimensions_[0];
-    ret[1] = grid_dimensions_[1];
-    ret[2] = grid_dimensions_[0];
-    ret[3] = grid_dimensions_[1];
-    ret[4] = grid_dimensions_[0];
-    ret[5] = grid_dimensions_[1];
-    return ret;
-  }
+  std::array<int32_t, 6> GetDimensions() const { return grid_dimensions_; }
 
   std::array<int32_t, 3> GetGridSize() const {
     std::array<int32_t, 3> ret;
     ret[0] = grid_dimensions_[1] - grid_dimensions_[0];
-    ret[1] = grid_dimensions_[1] - grid_dimensions_[0];
-    ret[2] = grid_dimensions_[1] - grid_dimensions_[0];
+    ret[1] = grid_dimensions_[3] - grid_dimensions_[2];
+    ret[2] = grid_dimensions_[5] - grid_dimensions_[4];
     return ret;
   }
 
   const std::array<double, 7>& GetDiffusionCoefficients() const { return dc_; }
 
+  /// Returns the number of boxes along the longest axis
   int GetResolution() const { return resolution_; }
 
   double GetBoxVolume() const { return box_volume_; }
@@ -153,11 +215,84 @@ class DiffusionGrid {
   }
 
  private:
+  friend class ADIGrid;
   friend class RungaKuttaGrid;
+  friend class SparseEulerGrid;
   friend class EulerGrid;
   friend class StencilGrid;
 
-  void ParametersCheck();
+  /// Aborts if the time step set with `SetTimeStep` violates the stability
+  /// limit of the diffusion method
+  virtual void ParametersCheck();
+
+  /// Returns the time step at which the diffusion method becomes unstable.
+  /// The default is the limit of the explicit solvers.
+  virtual double GetStabilityLimit() const;
+
+  /// Allocates the concentration and gradient arrays for
+  /// `total_num_boxes_` boxes
+  virtual void AllocateData();
+
+  /// Moves the data to the grown grid (see `CopyOldData`).
+  /// `num_boxes_axis_` and `total_num_boxes_` already have their new values.
+  virtual void GrowData(const std::array<size_t, 3>& old_num_boxes_axis);
+
+  /// Copies the concentrations and gradients to `c0_` and `gradients0_`
+  virtual void StoreState();
+
+  /// Adds `amount` to box `idx`, respecting the concentration threshold.
+  /// Might be called concurrently for different boxes.
+  virtual void AddToBox(size_t idx, double amount);
+
+  /// Adds `amount` to box `idx` while holding the lock of the box. Used by
+  /// `ChangeConcentrationBy` if the changes are not deferred.
+  virtual void AddToBoxLocked(size_t idx, double amount);
+
+  /// Calculates the index of the grid point at the lower corner of the cell
+  /// that contains `position` and the position within this cell ([0, 1] for
+  /// each axis). Positions outside the grid are clamped to its border.
+  void GetInterpolationStencil(const Double3& position, size_t* idx,
+                               Double3* weights) const {
+    *idx = 0;
+    size_t stride = 1;
+    for (int i = 0; i < 3; i++) {
+      auto n = num_boxes_axis_[i];
+      double u = (position[i] - grid_dimensions_[2 * i]) / box_length_;
+      double max = n > 1 ? n - 2 : 0;
+      double lower = std::min(std::max(std::floor(u), 0.0), max);
+      (*weights)[i] = n > 1 ? std::min(std::max(u - lower, 0.0), 1.0) : 0;
+      *idx += static_cast<size_t>(lower) * stride;
+      stride *= n;
+    }
+  }
+
+  /// Trilinear interpolation of `data` (see `GetInterpolationStencil`)
+  template <typename T>
+  T Interpolate(const ParallelResizeVector<T>& data, size_t idx,
+                const Double3& weights) const;
+
+  /// Trilinear interpolation of the concentration. Each box of the stencil
+  /// is read while holding its lock, such that concurrent calls of
+  /// `ChangeConcentrationBy` don't race with the read.
+  double InterpolateConcentrationLocked(size_t idx,
+                                        const Double3& weights) const;
+
+  /// Returns true if reads interpolate between the last two updates
+  bool InterpolatesInTime() const {
+    return interpolate_ && steps_since_update_ < update_frequency_;
+  }
+
+  /// Returns the weight of the last update for interpolated reads.
+  double GetInterpolationWeight() const {
+    return static_cast<double>(steps_since_update_) / update_frequency_;
+  }
+
+  /// Returns the dimensions of the environment the grid must cover
+  /// [min_x, max_x, min_y, max_y, min_z, max_z]. All axes use the same
+  /// bounds unless `Param::non_cubic_diffusion_grid` is set. In a periodic
+  /// space (`Param::BoundSpaceMode::kTorus`), these are the bound space
+  /// limits `Param::min_bound` and `Param::max_bound`.
+  std::array<int32_t, 6> GetEnvironmentBounds() const;
 
   /// Copies the concentration and gradients values to the new
   /// (larger) grid. In the 2D case it looks like the following:
@@ -169,11 +304,12 @@ class DiffusionGrid {
   ///
   /// The dimensions are doubled in this case from 2x2 to 4x4
   /// If the dimensions would be increased from 2x2 to 3x3, it will still
-  /// be increased to 4x4 in order for GetBoxIndex to function correctly
+  /// be increased to 4x4 in order for GetBoxIndex to function correctly.
+  /// Each axis is handled independently.
   ///
   void CopyOldData(const ParallelResizeVector<double>& old_c1,
                    const ParallelResizeVector<Double3>& old_gradients,
-                   size_t old_resolution);
+                   const std::array<size_t, 3>& old_num_boxes_axis);
 
   /// The id of the substance of this grid
   int substance_ = 0;
@@ -184,8 +320,18 @@ class DiffusionGrid {
   /// the volume of each box
   double box_volume_ = 0;
   /// Lock for each voxel used to prevent race conditions between
-  /// multiple threads
+  /// multiple threads. Empty if `deferred_deposits_` is true.
   mutable ParallelResizeVector<Spinlock> locks_ = {};
+  /// If true, concentrations and gradients are interpolated trilinearly
+  /// (see `Param::trilinear_diffusion_sampling`)
+  bool trilinear_ = false;
+  /// If true, concentration changes are buffered (see
+  /// `Param::deferred_secretion`)
+  bool deferred_deposits_ = false;
+  /// Buffered concentration changes (box index, amount) of each thread
+  SharedData<std::vector<std::pair<size_t, double>>> deposits_ =
+      SharedData<std::vector<std::pair<size_t, double>>>(
+          ThreadInfo::GetInstance()->GetMaxThreads());  //!
   /// The array of concentration values
   ParallelResizeVector<double> c1_ = {};
   /// An extra concentration data buffer for faster value updating
@@ -196,22 +342,35 @@ class DiffusionGrid {
   double concentration_threshold_ = 1e15;
   /// The diffusion coefficients [cc, cw, ce, cs, cn, cb, ct]
   std::array<double, 7> dc_ = {{0}};
-  /// The timestep resolution fhe diffusion grid
-  // TODO(ahmad): this probably needs to scale with Param::simulation_timestep
+  /// The time step of one sub-step (see `CalculateTimeStep`)
   double dt_ = 1.0;
+  /// The maximum time step set by the user (0: automatic)
+  double max_dt_ = 0;
+  /// Number of simulation steps covered by one update
+  uint64_t update_frequency_ = 1;
+  /// Number of calls to `Diffuse` since the last update (including the call
+  /// that performed it)
+  uint64_t steps_since_update_ = 1;
+  /// If true, reads interpolate between `c0_` and `c1_`
+  bool interpolate_ = false;
+  /// Concentrations and gradients before the last update. Only used if
+  /// `interpolate_` is true.
+  ParallelResizeVector<double> c0_ = {};
+  ParallelResizeVector<Double3> gradients0_ = {};
   /// The decay constant
   double mu_ = 0;
-  /// The grid dimensions of the diffusion grid (cubic shaped)
-  std::array<int32_t, 2> grid_dimensions_ = {{0}};
-  /// The number of boxes at each axis [x, y, z] (same along each axis)
-  uint64_t num_boxes_axis_ = 0;
+  /// The grid dimensions of the diffusion grid
+  /// [min_x, max_x, min_y, max_y, min_z, max_z]
+  std::array<int32_t, 6> grid_dimensions_ = {{0}};
+  /// The number of boxes at each axis [x, y, z]
+  std::array<size_t, 3> num_boxes_axis_ = {{0}};
   /// The total number of boxes in the diffusion grid
   size_t total_num_boxes_ = 0;
-  /// The resolution of the diffusion grid (i.e. number of boxes along each
-  /// axis)
+  /// The resolution of the diffusion grid (i.e. number of boxes along the
+  /// longest axis)
   size_t resolution_ = 0;
-  /// If false, grid dimensions are even; if true, they are odd
-  bool parity_ = false;
+  /// If false, the number of boxes along an axis is even; if true, it is odd
+  std::array<bool, 3> parity_ = {{false, false, false}};
   /// A list of functions that initialize this diffusion grid
   /// ROOT currently doesn't support IO of std::function
   std::vector<std::function<double(double, double, double)>> initializers_ =
@@ -219,7 +378,7 @@ class DiffusionGrid {
   // Turn to true after gradient initialization
   bool init_gradient_ = false;
 
-  BDM_CLASS_DEF(DiffusionGrid, 1);
+  BDM_CLASS_DEF(DiffusionGrid, 5);
 };
 
 }  // namespace bdm
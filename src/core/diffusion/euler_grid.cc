@@ -13,21 +13,24 @@
 // -----------------------------------------------------------------------------
 
 #include "core/diffusion/euler_grid.h"
+#include <algorithm>
+#include "core/util/work_stealing_executor.h"
 
 namespace bdm {
 
 void EulerGrid::DiffuseWithClosedEdge() {
-  const auto nx = resolution_;
-  const auto ny = resolution_;
-  const auto nz = resolution_;
+  const auto nx = num_boxes_axis_[0];
+  const auto ny = num_boxes_axis_[1];
+  const auto nz = num_boxes_axis_[2];
 
   const double ibl2 = 1 / (box_length_ * box_length_);
   const double d = 1 - dc_[0];
 
 #define YBF 16
-#pragma omp parallel for collapse(2)
-  for (size_t yy = 0; yy < ny; yy += YBF) {
-    for (size_t z = 0; z < nz; z++) {
+  auto diffuse = [&](uint64_t start, uint64_t end) {
+    for (uint64_t tile = start; tile < end; ++tile) {
+      const size_t yy = (tile / nz) * YBF;
+      const size_t z = tile % nz;
       size_t ymax = yy + YBF;
       if (ymax >= ny) {
         ymax = ny;
@@ -56,7 +59,7 @@ void EulerGrid::DiffuseWithClosedEdge() {
                     d * dt_ * (c1_[c - 1] - 2 * c1_[c] + c1_[c + 1]) * ibl2 +
                     d * dt_ * (c1_[s] - 2 * c1_[c] + c1_[n]) * ibl2 +
                     d * dt_ * (c1_[b] - 2 * c1_[c] + c1_[t]) * ibl2) *
-                   (1 - mu_);
+                   (1 - mu_ * dt_);
         }
         ++c;
         ++n;
@@ -65,23 +68,26 @@ void EulerGrid::DiffuseWithClosedEdge() {
         ++t;
       }  // tile ny
     }    // tile nz
-  }      // block ny
+  };     // block ny
+  auto num_tiles = ((ny + YBF - 1) / YBF) * nz;
+  WorkStealingExecutor::GetInstance()->ParallelFor(num_tiles, 1, diffuse);
   c1_.swap(c2_);
 }
 
 void EulerGrid::DiffuseWithOpenEdge() {
-  const auto nx = resolution_;
-  const auto ny = resolution_;
-  const auto nz = resolution_;
+  const auto nx = num_boxes_axis_[0];
+  const auto ny = num_boxes_axis_[1];
+  const auto nz = num_boxes_axis_[2];
 
   const double ibl2 = 1 / (box_length_ * box_length_);
   const double d = 1 - dc_[0];
-  std::array<int, 4> l;
 
 #define YBF 16
-#pragma omp parallel for collapse(2)
-  for (size_t yy = 0; yy < ny; yy += YBF) {
-    for (size_t z = 0; z < nz; z++) {
+  auto diffuse = [&](uint64_t start, uint64_t end) {
+    std::array<int, 4> l;
+    for (uint64_t tile = start; tile < end; ++tile) {
+      const size_t yy = (tile / nz) * YBF;
+      const size_t z = tile % nz;
       size_t ymax = yy + YBF;
       if (ymax >= ny) {
         ymax = ny;
@@ -124,7 +130,7 @@ void EulerGrid::DiffuseWithOpenEdge() {
         c2_[c] = (c1_[c] + d * dt_ * (0 - 2 * c1_[c] + c1_[c + 1]) * ibl2 +
                   d * dt_ * (c1_[s] - 2 * c1_[c] + c1_[n]) * ibl2 +
                   d * dt_ * (c1_[b] - 2 * c1_[c] + c1_[t]) * ibl2) *
-                 (1 - mu_);
+                 (1 - mu_ * dt_);
 #pragma omp simd
         for (x = 1; x < nx - 1; x++) {
           ++c;
@@ -137,7 +143,7 @@ void EulerGrid::DiffuseWithOpenEdge() {
                d * dt_ * (c1_[c - 1] - 2 * c1_[c] + c1_[c + 1]) * ibl2 +
                d * dt_ * (l[0] * c1_[s] - 2 * c1_[c] + l[1] * c1_[n]) * ibl2 +
                d * dt_ * (l[2] * c1_[b] - 2 * c1_[c] + l[3] * c1_[t]) * ibl2) *
-              (1 - mu_);
+              (1 - mu_ * dt_);
         }
         ++c;
         ++n;
@@ -147,11 +153,255 @@ void EulerGrid::DiffuseWithOpenEdge() {
         c2_[c] = (c1_[c] + d * dt_ * (c1_[c - 1] - 2 * c1_[c] + 0) * ibl2 +
                   d * dt_ * (c1_[s] - 2 * c1_[c] + c1_[n]) * ibl2 +
                   d * dt_ * (c1_[b] - 2 * c1_[c] + c1_[t]) * ibl2) *
-                 (1 - mu_);
+                 (1 - mu_ * dt_);
       }  // tile ny
     }    // tile nz
-  }      // block ny
+  };     // block ny
+  auto num_tiles = ((ny + YBF - 1) / YBF) * nz;
+  WorkStealingExecutor::GetInstance()->ParallelFor(num_tiles, 1, diffuse);
   c1_.swap(c2_);
 }
 
+void EulerGrid::DiffuseWithPeriodicEdge() {
+  const auto nx = num_boxes_axis_[0];
+  const auto ny = num_boxes_axis_[1];
+  const auto nz = num_boxes_axis_[2];
+  // The last box along each axis is a copy of the first one. It is updated
+  // with the same (wrapped) neighbors and therefore stays identical.
+  const size_t px = std::max<size_t>(nx - 1, 1);
+  const size_t py = std::max<size_t>(ny - 1, 1);
+  const size_t pz = std::max<size_t>(nz - 1, 1);
+
+  const double ibl2 = 1 / (box_length_ * box_length_);
+  const double d = 1 - dc_[0];
+
+  auto diffuse = [&](uint64_t start, uint64_t end) {
+    for (uint64_t row = start; row < end; ++row) {
+      const size_t y = row % ny;
+      const size_t z = row / ny;
+      const size_t yw = y % py;
+      const size_t zw = z % pz;
+      // start index of the rows of the center box and its neighbors
+      const size_t c = yw * nx + zw * nx * ny;
+      const size_t n = ((yw + py - 1) % py) * nx + zw * nx * ny;
+      const size_t s = ((yw + 1) % py) * nx + zw * nx * ny;
+      const size_t b = yw * nx + ((zw + pz - 1) % pz) * nx * ny;
+      const size_t t = yw * nx + ((zw + 1) % pz) * nx * ny;
+      const size_t out = y * nx + z * nx * ny;
+      for (size_t x = 0; x < nx; x++) {
+        const size_t xw = x % px;
+        const size_t w = (xw + px - 1) % px;
+        const size_t e = (xw + 1) % px;
+        const double center = c1_[c + xw];
+        c2_[out + x] =
+            (center +
+             d * dt_ * (c1_[c + w] - 2 * center + c1_[c + e]) * ibl2 +
+             d * dt_ * (c1_[s + xw] - 2 * center + c1_[n + xw]) * ibl2 +
+             d * dt_ * (c1_[b + xw] - 2 * center + c1_[t + xw]) * ibl2) *
+            (1 - mu_ * dt_);
+      }
+    }
+  };
+  WorkStealingExecutor::GetInstance()->ParallelFor(ny * nz, 16, diffuse);
+  c1_.swap(c2_);
+}
+
+bool EulerGrid::IsColocated(const EulerGrid& other) const {
+  return num_boxes_axis_ == other.num_boxes_axis_ &&
+         grid_dimensions_ == other.grid_dimensions_ &&
+         box_length_ == other.box_length_;
+}
+
+void EulerGrid::DiffuseFused(const std::vector<EulerGrid*>& grids,
+                             bool closed_edge, bool calculate_gradients) {
+  if (grids.empty()) {
+    return;
+  }
+  const auto nx = grids[0]->num_boxes_axis_[0];
+  const auto ny = grids[0]->num_boxes_axis_[1];
+  const auto nz = grids[0]->num_boxes_axis_[2];
+  const double box_length = grids[0]->box_length_;
+  const double ibl2 = 1 / (box_length * box_length);
+  const double gd = 1 / (box_length * 2);
+
+  // Same update as in DiffuseWithClosedEdge and DiffuseWithOpenEdge
+  auto diffuse_row = [&](EulerGrid* grid, size_t y, size_t z, size_t row) {
+    const double* c1 = grid->c1_.data();
+    double* c2 = grid->c2_.data();
+    const double d = 1 - grid->dc_[0];
+    const double dt = grid->dt_;
+    const double mu = grid->mu_ * dt;
+    if (closed_edge) {
+      if (y == 0 || y == (ny - 1) || z == 0 || z == (nz - 1)) {
+        return;
+      }
+#pragma omp simd
+      for (size_t c = row + 1; c < row + nx - 1; c++) {
+        const size_t n = c - nx;
+        const size_t s = c + nx;
+        const size_t b = c - nx * ny;
+        const size_t t = c + nx * ny;
+        c2[c] = (c1[c] + d * dt * (c1[c - 1] - 2 * c1[c] + c1[c + 1]) * ibl2 +
+                 d * dt * (c1[s] - 2 * c1[c] + c1[n]) * ibl2 +
+                 d * dt * (c1[b] - 2 * c1[c] + c1[t]) * ibl2) *
+                (1 - mu);
+      }
+      return;
+    }
+
+    std::array<int, 4> l;
+    l.fill(1);
+    size_t c = row;
+    size_t n, s, b, t;
+    if (y == 0) {
+      n = c;
+      l[0] = 0;
+    } else {
+      n = c - nx;
+    }
+    if (y == ny - 1) {
+      s = c;
+      l[1] = 0;
+    } else {
+      s = c + nx;
+    }
+    if (z == 0) {
+      b = c;
+      l[2] = 0;
+    } else {
+      b = c - nx * ny;
+    }
+    if (z == nz - 1) {
+      t = c;
+      l[3] = 0;
+    } else {
+      t = c + nx * ny;
+    }
+    c2[c] = (c1[c] + d * dt * (0 - 2 * c1[c] + c1[c + 1]) * ibl2 +
+             d * dt * (c1[s] - 2 * c1[c] + c1[n]) * ibl2 +
+             d * dt * (c1[b] - 2 * c1[c] + c1[t]) * ibl2) *
+            (1 - mu);
+#pragma omp simd
+    for (size_t x = 1; x < nx - 1; x++) {
+      const size_t cx = c + x;
+      c2[cx] = (c1[cx] +
+                d * dt * (c1[cx - 1] - 2 * c1[cx] + c1[cx + 1]) * ibl2 +
+                d * dt *
+                    (l[0] * c1[s + x] - 2 * c1[cx] + l[1] * c1[n + x]) *
+                    ibl2 +
+                d * dt *
+                    (l[2] * c1[b + x] - 2 * c1[cx] + l[3] * c1[t + x]) *
+                    ibl2) *
+               (1 - mu);
+    }
+    c += nx - 1;
+    n += nx - 1;
+    s += nx - 1;
+    b += nx - 1;
+    t += nx - 1;
+    c2[c] = (c1[c] + d * dt * (c1[c - 1] - 2 * c1[c] + 0) * ibl2 +
+             d * dt * (c1[s] - 2 * c1[c] + c1[n]) * ibl2 +
+             d * dt * (c1[b] - 2 * c1[c] + c1[t]) * ibl2) *
+            (1 - mu);
+  };
+
+  // Same as DiffusionGrid::CalculateGradient, but reads the concentrations
+  // of this step, which are still stored in c2_
+  auto gradient_row = [&](EulerGrid* grid, size_t y, size_t z, size_t row) {
+    const double* c2 = grid->c2_.data();
+    Double3* gradients = grid->gradients_.data();
+    const size_t n = y == 0 ? 2 * nx : (y == ny - 1 ? 0 : nx);
+    const size_t s = y == 0 ? 0 : (y == ny - 1 ? 2 * nx : nx);
+    const size_t t = z == 0 ? 2 * nx * ny : (z == nz - 1 ? 0 : nx * ny);
+    const size_t b = z == 0 ? 0 : (z == nz - 1 ? 2 * nx * ny : nx * ny);
+    for (size_t x = 0; x < nx; x++) {
+      const size_t c = row + x;
+      size_t e, w;
+      if (x == 0) {
+        e = c;
+        w = c + 2;
+      } else if (x == nx - 1) {
+        e = c - 2;
+        w = c;
+      } else {
+        e = c - 1;
+        w = c + 1;
+      }
+      // Let the gradient point from low to high concentration
+      gradients[c][0] = (c2[w] - c2[e]) * gd;
+      gradients[c][1] = (c2[c + n] - c2[c - s]) * gd;
+      gradients[c][2] = (c2[c + t] - c2[c - b]) * gd;
+    }
+  };
+  auto gradient_plane = [&](size_t z) {
+    for (size_t y = 0; y < ny; y++) {
+      const size_t row = y * nx + z * nx * ny;
+      for (auto* grid : grids) {
+        gradient_row(grid, y, z, row);
+      }
+    }
+  };
+  // The gradients of plane z depend on the updated planes first_plane(z) to
+  // last_plane(z)
+  auto first_plane = [&](size_t z) {
+    return z == 0 ? 0 : (z == nz - 1 ? z - 2 : z - 1);
+  };
+  auto last_plane = [&](size_t z) {
+    return z == 0 ? 2 : (z == nz - 1 ? z : z + 1);
+  };
+
+  // Each task diffuses a slab of z planes. The gradients of a plane are
+  // calculated as soon as its neighbor planes in the slab are updated. The
+  // planes at the border of a slab depend on other tasks and are processed
+  // after the sweep.
+  const size_t slab_size = std::max<size_t>(
+      8, nz / (4 * ThreadInfo::GetInstance()->GetMaxThreads()));
+  std::vector<char> gradient_done(nz, 0);
+  auto sweep = [&](uint64_t start, uint64_t end) {
+    for (uint64_t slab = start; slab < end; ++slab) {
+      const size_t z0 = slab * slab_size;
+      const size_t z1 = std::min(z0 + slab_size, nz);
+      for (size_t z = z0; z < z1; z++) {
+        for (size_t y = 0; y < ny; y++) {
+          const size_t row = y * nx + z * nx * ny;
+          for (auto* grid : grids) {
+            diffuse_row(grid, y, z, row);
+          }
+        }
+        if (!calculate_gradients) {
+          continue;
+        }
+        for (size_t p = (z >= z0 + 2 ? z - 2 : z0); p <= z; p++) {
+          if (!gradient_done[p] && first_plane(p) >= z0 &&
+              last_plane(p) <= z) {
+            gradient_plane(p);
+            gradient_done[p] = 1;
+          }
+        }
+      }
+    }
+  };
+  auto num_slabs = (nz + slab_size - 1) / slab_size;
+  auto* executor = WorkStealingExecutor::GetInstance();
+  executor->ParallelFor(num_slabs, 1, sweep);
+
+  if (calculate_gradients) {
+    auto remaining_gradients = [&](uint64_t start, uint64_t end) {
+      for (uint64_t z = start; z < end; ++z) {
+        if (!gradient_done[z]) {
+          gradient_plane(z);
+        }
+      }
+    };
+    executor->ParallelFor(nz, 1, remaining_gradients);
+  }
+
+  for (auto* grid : grids) {
+    grid->c1_.swap(grid->c2_);
+    if (calculate_gradients) {
+      grid->init_gradient_ = true;
+    }
+  }
+}
+
 }  // namespace bdm
@@ -15,6 +15,8 @@
 #ifndef CORE_DIFFUSION_EULER_GRID_H_
 #define CORE_DIFFUSION_EULER_GRID_H_
 
+#include <vector>
+
 #include "core/diffusion/diffusion_grid.h"
 
 namespace bdm {
@@ -30,6 +32,21 @@ class EulerGrid : public DiffusionGrid {
 
   void DiffuseWithOpenEdge() override;
 
+  void DiffuseWithPeriodicEdge() override;
+
+  /// Returns true if `DiffuseFused` can process this grid together with
+  /// `other` (same number of boxes, dimensions and box length).
+  bool IsColocated(const EulerGrid& other) const;
+
+  /// Diffuses all `grids` in one parallel sweep over the boxes. Each slab of
+  /// the sweep updates all substances before it moves on, such that the
+  /// neighbor indices are computed once and the slab's data is still in cache
+  /// when the gradients are calculated.\n
+  /// The result is the same as `Diffuse` followed by `CalculateGradient`.\n
+  /// All grids must be co-located (see `IsColocated`).
+  static void DiffuseFused(const std::vector<EulerGrid*>& grids,
+                           bool closed_edge, bool calculate_gradients);
+
  private:
   BDM_CLASS_DEF_OVERRIDE(EulerGrid, 1);
 };
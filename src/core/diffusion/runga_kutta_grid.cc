@@ -13,13 +13,14 @@
 // -----------------------------------------------------------------------------
 
 #include "core/diffusion/runga_kutta_grid.h"
+#include "core/util/work_stealing_executor.h"
 
 namespace bdm {
 
 void RungaKuttaGrid::DiffuseWithClosedEdge() {
-  const auto nx = resolution_;
-  const auto ny = resolution_;
-  const auto nz = resolution_;
+  const auto nx = num_boxes_axis_[0];
+  const auto ny = num_boxes_axis_[1];
+  const auto nz = num_boxes_axis_[2];
 
   const double ibl2 = 1 / (box_length_ * box_length_);
   const double d = 1 - dc_[0];
@@ -28,9 +29,10 @@ void RungaKuttaGrid::DiffuseWithClosedEdge() {
 #define YBF 16
   for (size_t i = 0; i < step; i++) {
     for (size_t order = 0; order < 2; order++) {
-#pragma omp parallel for collapse(2)
-      for (size_t yy = 0; yy < ny; yy += YBF) {
-        for (size_t z = 0; z < nz; z++) {
+      auto diffuse = [&](uint64_t start, uint64_t end) {
+        for (uint64_t tile = start; tile < end; ++tile) {
+          const size_t yy = (tile / nz) * YBF;
+          const size_t z = tile % nz;
           size_t ymax = yy + YBF;
           if (ymax >= ny) {
             ymax = ny;
@@ -78,25 +80,28 @@ void RungaKuttaGrid::DiffuseWithClosedEdge() {
             ++t;
           }  // tile ny
         }    // tile nz
-      }      // block ny
+      };     // block ny
+      auto num_tiles = ((ny + YBF - 1) / YBF) * nz;
+      WorkStealingExecutor::GetInstance()->ParallelFor(num_tiles, 1, diffuse);
     }
     c1_.swap(c2_);
   }
 }
 
 void RungaKuttaGrid::DiffuseWithOpenEdge() {
-  const auto nx = resolution_;
-  const auto ny = resolution_;
-  const auto nz = resolution_;
+  const auto nx = num_boxes_axis_[0];
+  const auto ny = num_boxes_axis_[1];
+  const auto nz = num_boxes_axis_[2];
 
   const double ibl2 = 1 / (box_length_ * box_length_);
-  std::array<int, 4> l;
   const double d = 1 - dc_[0];
 
 #define YBF 16
-#pragma omp parallel for collapse(2)
-  for (size_t yy = 0; yy < ny; yy += YBF) {
-    for (size_t z = 0; z < nz; z++) {
+  auto diffuse = [&](uint64_t start, uint64_t end) {
+    std::array<int, 4> l;
+    for (uint64_t tile = start; tile < end; ++tile) {
+      const size_t yy = (tile / nz) * YBF;
+      const size_t z = tile % nz;
       size_t ymax = yy + YBF;
       if (ymax >= ny) {
         ymax = ny;
@@ -139,7 +144,7 @@ void RungaKuttaGrid::DiffuseWithOpenEdge() {
         c2_[c] = (c1_[c] + d * dt_ * (0 - 2 * c1_[c] + c1_[c + 1]) * ibl2 +
                   d * dt_ * (c1_[s] - 2 * c1_[c] + c1_[n]) * ibl2 +
                   d * dt_ * (c1_[b] - 2 * c1_[c] + c1_[t]) * ibl2) *
-                 (1 - mu_);
+                 (1 - mu_ * dt_);
 #pragma omp simd
         for (x = 1; x < nx - 1; x++) {
           ++c;
@@ -152,7 +157,7 @@ void RungaKuttaGrid::DiffuseWithOpenEdge() {
                d * dt_ * (c1_[c - 1] - 2 * c1_[c] + c1_[c + 1]) * ibl2 +
                d * dt_ * (l[0] * c1_[s] - 2 * c1_[c] + l[1] * c1_[n]) * ibl2 +
                d * dt_ * (l[2] * c1_[b] - 2 * c1_[c] + l[3] * c1_[t]) * ibl2) *
-              (1 - mu_);
+              (1 - mu_ * dt_);
         }
         ++c;
         ++n;
@@ -162,10 +167,12 @@ void RungaKuttaGrid::DiffuseWithOpenEdge() {
         c2_[c] = (c1_[c] + d * dt_ * (c1_[c - 1] - 2 * c1_[c] + 0) * ibl2 +
                   d * dt_ * (c1_[s] - 2 * c1_[c] + c1_[n]) * ibl2 +
                   d * dt_ * (c1_[b] - 2 * c1_[c] + c1_[t]) * ibl2) *
-                 (1 - mu_);
+                 (1 - mu_ * dt_);
       }  // tile ny
     }    // tile nz
-  }      // block ny
+  };     // block ny
+  auto num_tiles = ((ny + YBF - 1) / YBF) * nz;
+  WorkStealingExecutor::GetInstance()->ParallelFor(num_tiles, 1, diffuse);
   c1_.swap(c2_);
 }
 
@@ -0,0 +1,495 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#include "core/diffusion/sparse_euler_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#include "core/param/param.h"
+#include "core/simulation.h"
+#include "core/util/work_stealing_executor.h"
+
+namespace bdm {
+
+void SparseEulerGrid::Initialize() {
+  DiffusionGrid::Initialize();
+  threshold_ = Simulation::GetActive()->GetParam()->sparse_diffusion_threshold;
+}
+
+void SparseEulerGrid::Update() {
+  DiffusionGrid::Update();
+  // The locks are not persistent (e.g. after restoring a backup)
+  if (tile_locks_.size() != tiles_.size()) {
+    tile_locks_.resize(tiles_.size());
+  }
+}
+
+void SparseEulerGrid::DiffuseWithClosedEdge() { Step(true); }
+
+void SparseEulerGrid::DiffuseWithOpenEdge() { Step(false); }
+
+size_t SparseEulerGrid::GetNumActiveTiles() const {
+  size_t num_active = 0;
+  for (auto& tile : tiles_) {
+    num_active += !tile.empty();
+  }
+  return num_active;
+}
+
+void SparseEulerGrid::AllocateData() {
+  size_t num_tiles = 1;
+  for (int i = 0; i < 3; i++) {
+    num_tiles_axis_[i] = (num_boxes_axis_[i] + kTileSize - 1) / kTileSize;
+    num_tiles *= num_tiles_axis_[i];
+  }
+  tiles_.clear();
+  tiles_.resize(num_tiles);
+  tile_gradients_.clear();
+  tile_gradients_.resize(num_tiles);
+  tile_locks_.clear();
+  tile_locks_.resize(num_tiles);
+  dense_valid_ = false;
+}
+
+void SparseEulerGrid::GrowData(
+    const std::array<size_t, 3>& old_num_boxes_axis) {
+  auto old_tiles = std::move(tiles_);
+  auto old_gradients = std::move(tile_gradients_);
+  auto old_num_tiles_axis = num_tiles_axis_;
+  AllocateData();
+
+  // Same placement as `DiffusionGrid::CopyOldData`
+  std::array<size_t, 3> off_dim;
+  for (int i = 0; i < 3; i++) {
+    off_dim[i] = (num_boxes_axis_[i] - old_num_boxes_axis[i]) / 2;
+  }
+  const auto otx = old_num_tiles_axis[0];
+  const auto oty = old_num_tiles_axis[1];
+  for (size_t t = 0; t < old_tiles.size(); t++) {
+    if (old_tiles[t].empty()) {
+      continue;
+    }
+    const std::array<size_t, 3> origin = {(t % otx) * kTileSize,
+                                          ((t / otx) % oty) * kTileSize,
+                                          (t / (otx * oty)) * kTileSize};
+    size_t local = 0;
+    for (size_t z = 0; z < kTileSize; z++) {
+      for (size_t y = 0; y < kTileSize; y++) {
+        for (size_t x = 0; x < kTileSize; x++, local++) {
+          std::array<size_t, 3> box = {origin[0] + x, origin[1] + y,
+                                       origin[2] + z};
+          if (box[0] >= old_num_boxes_axis[0] ||
+              box[1] >= old_num_boxes_axis[1] ||
+              box[2] >= old_num_boxes_axis[2]) {
+            continue;
+          }
+          for (int i = 0; i < 3; i++) {
+            box[i] += off_dim[i];
+          }
+          auto location = Locate(box);
+          auto& c = tiles_[location.first];
+          if (c.empty()) {
+            c.resize(kTileVolume);
+          }
+          c[location.second] = old_tiles[t][local];
+          if (!old_gradients[t].empty()) {
+            auto& g = tile_gradients_[location.first];
+            if (g.empty()) {
+              g.resize(kTileVolume);
+            }
+            g[location.second] = old_gradients[t][local];
+          }
+        }
+      }
+    }
+  }
+}
+
+void SparseEulerGrid::StoreState() {
+  Log::Fatal("SparseEulerGrid::StoreState",
+             "The diffusion method of substance '", substance_name_,
+             "' does not support interpolated reads between updates. Please "
+             "use the \"euler\" method.");
+}
+
+void SparseEulerGrid::AddToBox(size_t idx, double amount) {
+  if (amount == 0) {
+    return;
+  }
+  auto location = Locate(idx);
+  std::lock_guard<Spinlock> guard(tile_locks_[location.first]);
+  auto& c = tiles_[location.first];
+  if (c.empty()) {
+    c.resize(kTileVolume);
+  }
+  c[location.second] =
+      std::min(c[location.second] + amount, concentration_threshold_);
+  dense_valid_ = false;
+}
+
+void SparseEulerGrid::AddToBoxLocked(size_t idx, double amount) {
+  AddToBox(idx, amount);
+}
+
+std::array<size_t, 3> SparseEulerGrid::GetTileOrigin(size_t tile) const {
+  const auto tx = num_tiles_axis_[0];
+  const auto ty = num_tiles_axis_[1];
+  return {(tile % tx) * kTileSize, ((tile / tx) % ty) * kTileSize,
+          (tile / (tx * ty)) * kTileSize};
+}
+
+std::pair<size_t, size_t> SparseEulerGrid::Locate(
+    const std::array<size_t, 3>& box) const {
+  const size_t tile =
+      ((box[2] / kTileSize) * num_tiles_axis_[1] + box[1] / kTileSize) *
+          num_tiles_axis_[0] +
+      box[0] / kTileSize;
+  const size_t local = box[0] % kTileSize +
+                       (box[1] % kTileSize + (box[2] % kTileSize) * kTileSize) *
+                           kTileSize;
+  return {tile, local};
+}
+
+std::pair<size_t, size_t> SparseEulerGrid::Locate(size_t idx) const {
+  const auto nx = num_boxes_axis_[0];
+  const auto ny = num_boxes_axis_[1];
+  return Locate({idx % nx, (idx / nx) % ny, idx / (nx * ny)});
+}
+
+double SparseEulerGrid::GetBoxConcentration(size_t idx) const {
+  auto location = Locate(idx);
+  const auto& c = tiles_[location.first];
+  return c.empty() ? 0 : c[location.second];
+}
+
+Double3 SparseEulerGrid::GetBoxGradient(size_t idx) const {
+  auto location = Locate(idx);
+  const auto& g = tile_gradients_[location.first];
+  return g.empty() ? Double3() : g[location.second];
+}
+
+template <typename T, typename F>
+T SparseEulerGrid::InterpolateBoxes(size_t idx, const Double3& weights,
+                                    F value) const {
+  const auto nx = num_boxes_axis_[0];
+  const size_t dx = nx > 1 ? 1 : 0;
+  const size_t dy = num_boxes_axis_[1] > 1 ? nx : 0;
+  const size_t dz = num_boxes_axis_[2] > 1 ? nx * num_boxes_axis_[1] : 0;
+  // values of the eight corners; bit 0, 1 and 2 of the index select the
+  // upper corner along x, y and z
+  std::array<T, 8> c;
+  for (size_t i = 0; i < 8; i++) {
+    c[i] = value(idx + (i & 1 ? dx : 0) + (i & 2 ? dy : 0) + (i & 4 ? dz : 0));
+  }
+  // reduce along x, then y, then z
+  for (size_t axis = 0, n = 4; axis < 3; axis++, n /= 2) {
+    for (size_t i = 0; i < n; i++) {
+      c[i] = c[2 * i] * (1 - weights[axis]) + c[2 * i + 1] * weights[axis];
+    }
+  }
+  return c[0];
+}
+
+double SparseEulerGrid::GetConcentration(const Double3& position) const {
+  // Without locks the concentrations must not be modified concurrently,
+  // which is guaranteed in deferred mode
+  auto value = [&](size_t box) {
+    if (deferred_deposits_) {
+      return GetBoxConcentration(box);
+    }
+    std::lock_guard<Spinlock> guard(tile_locks_[Locate(box).first]);
+    return GetBoxConcentration(box);
+  };
+  if (trilinear_) {
+    size_t idx;
+    Double3 weights;
+    GetInterpolationStencil(position, &idx, &weights);
+    return InterpolateBoxes<double>(idx, weights, value);
+  }
+  return value(GetBoxIndex(position));
+}
+
+void SparseEulerGrid::GetGradient(const Double3& position,
+                                  Double3* gradient) const {
+  if (trilinear_) {
+    size_t idx;
+    Double3 weights;
+    GetInterpolationStencil(position, &idx, &weights);
+    *gradient = InterpolateBoxes<Double3>(
+        idx, weights, [&](size_t box) { return GetBoxGradient(box); });
+  } else {
+    auto idx = GetBoxIndex(position);
+    if (idx >= total_num_boxes_) {
+      Log::Error("SparseEulerGrid::GetGradient",
+                 "You tried to get the gradient outside the bounds of "
+                 "the diffusion grid! Returning zero gradient.");
+      return;
+    }
+    *gradient = GetBoxGradient(idx);
+  }
+  auto norm = gradient->Norm();
+  if (norm > 1e-10) {
+    gradient->Normalize();
+  }
+}
+
+void SparseEulerGrid::GetConcentrations(const Double3* positions,
+                                        size_t num_positions,
+                                        double* concentrations) const {
+  auto value = [&](size_t box) { return GetBoxConcentration(box); };
+  for (size_t i = 0; i < num_positions; i++) {
+    if (trilinear_) {
+      size_t idx;
+      Double3 weights;
+      GetInterpolationStencil(positions[i], &idx, &weights);
+      concentrations[i] = InterpolateBoxes<double>(idx, weights, value);
+    } else {
+      concentrations[i] = value(GetBoxIndex(positions[i]));
+    }
+  }
+}
+
+void SparseEulerGrid::GetGradients(const Double3* positions,
+                                   size_t num_positions, Double3* gradients,
+                                   bool normalize) const {
+  auto value = [&](size_t box) { return GetBoxGradient(box); };
+  for (size_t i = 0; i < num_positions; i++) {
+    auto& g = gradients[i];
+    if (trilinear_) {
+      size_t idx;
+      Double3 weights;
+      GetInterpolationStencil(positions[i], &idx, &weights);
+      g = InterpolateBoxes<Double3>(idx, weights, value);
+    } else {
+      g = value(std::min(GetBoxIndex(positions[i]), total_num_boxes_ - 1));
+    }
+    if (normalize && g.Norm() > 1e-10) {
+      g.Normalize();
+    }
+  }
+}
+
+const double* SparseEulerGrid::GetAllConcentrations() const {
+  std::lock_guard<Spinlock> guard(dense_lock_);
+  if (!dense_valid_) {
+    dense_c_.resize(total_num_boxes_);
+    dense_gradients_.resize(total_num_boxes_);
+    auto copy = [&](uint64_t start, uint64_t end) {
+      for (uint64_t i = start; i < end; i++) {
+        dense_c_[i] = GetBoxConcentration(i);
+        dense_gradients_[i] = GetBoxGradient(i);
+      }
+    };
+    WorkStealingExecutor::GetInstance()->ParallelFor(total_num_boxes_, 4096,
+                                                     copy);
+    dense_valid_ = true;
+  }
+  return dense_c_.data();
+}
+
+const double* SparseEulerGrid::GetAllGradients() const {
+  // assembles the concentrations and gradients together
+  GetAllConcentrations();
+  return dense_gradients_.data()->data();
+}
+
+void SparseEulerGrid::Step(bool closed_edge) {
+  // Collect the active tiles and their face neighbors
+  const auto tx_max = num_tiles_axis_[0];
+  const auto ty_max = num_tiles_axis_[1];
+  const auto tz_max = num_tiles_axis_[2];
+  auto is_active = [&](size_t tile) { return !tiles_[tile].empty(); };
+  update_tiles_.clear();
+  for (size_t tz = 0, tile = 0; tz < tz_max; tz++) {
+    for (size_t ty = 0; ty < ty_max; ty++) {
+      for (size_t tx = 0; tx < tx_max; tx++, tile++) {
+        if (is_active(tile) || (tx > 0 && is_active(tile - 1)) ||
+            (tx + 1 < tx_max && is_active(tile + 1)) ||
+            (ty > 0 && is_active(tile - tx_max)) ||
+            (ty + 1 < ty_max && is_active(tile + tx_max)) ||
+            (tz > 0 && is_active(tile - tx_max * ty_max)) ||
+            (tz + 1 < tz_max && is_active(tile + tx_max * ty_max))) {
+          update_tiles_.push_back(tile);
+        }
+      }
+    }
+  }
+  if (update_tiles_.empty()) {
+    return;
+  }
+
+  buffer_.resize(update_tiles_.size() * kTileVolume);
+  auto* executor = WorkStealingExecutor::GetInstance();
+  auto update = [&](uint64_t start, uint64_t end) {
+    for (uint64_t i = start; i < end; i++) {
+      UpdateTile(update_tiles_[i], closed_edge, &buffer_[i * kTileVolume]);
+    }
+  };
+  executor->ParallelFor(update_tiles_.size(), 1, update);
+
+  // Store the tiles above the threshold and release the others. The
+  // substance left in a released tile is discarded.
+  auto store = [&](uint64_t start, uint64_t end) {
+    for (uint64_t i = start; i < end; i++) {
+      const auto tile = update_tiles_[i];
+      const double* result = &buffer_[i * kTileVolume];
+      double max = 0;
+      for (size_t j = 0; j < kTileVolume; j++) {
+        max = std::max(max, std::abs(result[j]));
+      }
+      if (max > threshold_) {
+        tiles_[tile].assign(result, result + kTileVolume);
+      } else {
+        std::vector<double>().swap(tiles_[tile]);
+        std::vector<Double3>().swap(tile_gradients_[tile]);
+      }
+    }
+  };
+  executor->ParallelFor(update_tiles_.size(), 1, store);
+  dense_valid_ = false;
+}
+
+void SparseEulerGrid::UpdateTile(size_t tile, bool closed_edge,
+                                 double* result) const {
+  const auto& nba = num_boxes_axis_;
+  const auto origin = GetTileOrigin(tile);
+
+  // Gather the concentrations of the tile and the adjacent boxes. Boxes
+  // outside the grid have the concentration of the closest box inside the
+  // grid (closed edge) or zero (open edge).
+  constexpr size_t kHalo = kTileSize + 2;
+  std::array<double, kHalo * kHalo * kHalo> c;
+  for (size_t z = 0, i = 0; z < kHalo; z++) {
+    for (size_t y = 0; y < kHalo; y++) {
+      for (size_t x = 0; x < kHalo; x++, i++) {
+        const std::array<size_t, 3> local = {x, y, z};
+        std::array<size_t, 3> box;
+        bool outside = false;
+        for (int a = 0; a < 3; a++) {
+          // the halo starts one box before the origin
+          if (origin[a] + local[a] == 0) {
+            box[a] = 0;
+            outside = true;
+          } else if (origin[a] + local[a] > nba[a]) {
+            box[a] = nba[a] - 1;
+            outside = true;
+          } else {
+            box[a] = origin[a] + local[a] - 1;
+          }
+        }
+        if (outside && !closed_edge) {
+          c[i] = 0;
+          continue;
+        }
+        auto location = Locate(box);
+        const auto& tile_c = tiles_[location.first];
+        c[i] = tile_c.empty() ? 0 : tile_c[location.second];
+      }
+    }
+  }
+
+  const double ibl2 = 1 / (box_length_ * box_length_);
+  const double d = 1 - dc_[0];
+  const double decay = 1 - mu_ * dt_;
+  const size_t sy = kHalo;
+  const size_t sz = kHalo * kHalo;
+  const size_t x1 = std::min(kTileSize, nba[0] - origin[0]);
+  const size_t y1 = std::min(kTileSize, nba[1] - origin[1]);
+  const size_t z1 = std::min(kTileSize, nba[2] - origin[2]);
+  std::fill(result, result + kTileVolume, 0.0);
+  for (size_t z = 0; z < z1; z++) {
+    for (size_t y = 0; y < y1; y++) {
+      double* row = result + (y + z * kTileSize) * kTileSize;
+      for (size_t x = 0; x < x1; x++) {
+        const size_t i = (x + 1) + (y + 1) * sy + (z + 1) * sz;
+        const double cc = c[i];
+        row[x] = (cc + d * dt_ *
+                           (c[i - 1] + c[i + 1] + c[i - sy] + c[i + sy] +
+                            c[i - sz] + c[i + sz] - 6 * cc) *
+                           ibl2) *
+                 decay;
+      }
+    }
+  }
+}
+
+void SparseEulerGrid::CalculateGradient() {
+  // check if gradient has been calculated once
+  // and if diffusion coefficient and decay constant are 0
+  // i.e. if we don't need to calculate gradient update
+  if (init_gradient_ && IsFixedSubstance()) {
+    return;
+  }
+  update_tiles_.clear();
+  for (size_t tile = 0; tile < tiles_.size(); tile++) {
+    if (!tiles_[tile].empty()) {
+      update_tiles_.push_back(tile);
+    }
+  }
+  auto calculate_gradient = [&](uint64_t start, uint64_t end) {
+    for (uint64_t i = start; i < end; i++) {
+      UpdateTileGradients(update_tiles_[i]);
+    }
+  };
+  WorkStealingExecutor::GetInstance()->ParallelFor(update_tiles_.size(), 1,
+                                                   calculate_gradient);
+  init_gradient_ = true;
+  dense_valid_ = false;
+}
+
+void SparseEulerGrid::UpdateTileGradients(size_t tile) {
+  const auto& nba = num_boxes_axis_;
+  const auto origin = GetTileOrigin(tile);
+  const double gd = 1 / (box_length_ * 2);
+  auto concentration = [&](const std::array<size_t, 3>& box) {
+    auto location = Locate(box);
+    const auto& c = tiles_[location.first];
+    return c.empty() ? 0 : c[location.second];
+  };
+
+  auto& g = tile_gradients_[tile];
+  g.resize(kTileVolume);
+  const size_t x1 = std::min(kTileSize, nba[0] - origin[0]);
+  const size_t y1 = std::min(kTileSize, nba[1] - origin[1]);
+  const size_t z1 = std::min(kTileSize, nba[2] - origin[2]);
+  for (size_t z = 0; z < z1; z++) {
+    for (size_t y = 0; y < y1; y++) {
+      for (size_t x = 0; x < x1; x++) {
+        const std::array<size_t, 3> box = {origin[0] + x, origin[1] + y,
+                                           origin[2] + z};
+        auto& gradient = g[x + (y + z * kTileSize) * kTileSize];
+        // Same stencil as `DiffusionGrid::CalculateGradient`: central
+        // differences inside the grid, one-sided ones at the edges. The
+        // gradient points from low to high concentration.
+        for (int a = 0; a < 3; a++) {
+          auto lower = box;
+          auto upper = box;
+          if (box[a] == 0) {
+            upper[a] += 2;
+          } else if (box[a] == nba[a] - 1) {
+            lower[a] -= 2;
+          } else {
+            lower[a]--;
+            upper[a]++;
+          }
+          gradient[a] = (concentration(upper) - concentration(lower)) * gd;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace bdm
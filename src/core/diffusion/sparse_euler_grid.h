@@ -0,0 +1,166 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#ifndef CORE_DIFFUSION_SPARSE_EULER_GRID_H_
+#define CORE_DIFFUSION_SPARSE_EULER_GRID_H_
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "core/diffusion/diffusion_grid.h"
+
+namespace bdm {
+
+/// Explicit Euler solver that only stores and updates the regions of the
+/// grid with a non-negligible concentration.\n
+/// The grid is divided into tiles of `kTileSize`^3 boxes. Only the active
+/// tiles store concentrations and gradients; the boxes of all other tiles
+/// have a concentration and gradient of zero. Each step updates the active
+/// tiles and their face neighbors, into which the substance can flow.
+/// Afterwards, updated tiles whose maximum concentration is at most
+/// `Param::sparse_diffusion_threshold` are released and their remaining
+/// substance is discarded. Hence, the closed edge conserves the amount of
+/// substance only up to this threshold per box. `ChangeConcentrationBy`
+/// activates the tile of the changed box.\n
+/// Memory and computation scale with the active region instead of the whole
+/// grid. `GetAllConcentrations` and `GetAllGradients` assemble a dense copy
+/// of the grid on demand (e.g. for the export).\n
+/// At the closed edge, boxes outside the grid have the concentration of the
+/// adjacent box (no flux). At the open edge, they have a concentration of
+/// zero. Interpolated reads between updates (see `SetUpdateFrequency`) are
+/// not supported.
+class SparseEulerGrid : public DiffusionGrid {
+ public:
+  /// Number of boxes along each axis of a tile
+  static constexpr size_t kTileSize = 8;
+  /// Number of boxes of a tile
+  static constexpr size_t kTileVolume = kTileSize * kTileSize * kTileSize;
+
+  SparseEulerGrid() {}
+  SparseEulerGrid(int substance_id, std::string substance_name, double dc,
+                  double mu, int resolution = 11)
+      : DiffusionGrid(substance_id, substance_name, dc, mu, resolution) {}
+
+  void Initialize() override;
+
+  void Update() override;
+
+  void DiffuseWithClosedEdge() override;
+
+  void DiffuseWithOpenEdge() override;
+
+  /// Calculates the gradients of the active tiles (see
+  /// `DiffusionGrid::CalculateGradient`)
+  void CalculateGradient() override;
+
+  double GetConcentration(const Double3& position) const override;
+
+  void GetGradient(const Double3& position, Double3* gradient) const override;
+
+  void GetConcentrations(const Double3* positions, size_t num_positions,
+                         double* concentrations) const override;
+
+  void GetGradients(const Double3* positions, size_t num_positions,
+                    Double3* gradients, bool normalize = true) const override;
+
+  /// Returns a dense copy of the concentrations, which is assembled if the
+  /// grid has changed since the last call
+  const double* GetAllConcentrations() const override;
+
+  /// Returns a dense copy of the gradients, which is assembled if the grid
+  /// has changed since the last call
+  const double* GetAllGradients() const override;
+
+  size_t GetNumTiles() const { return tiles_.size(); }
+
+  /// Returns the number of tiles that store concentrations and will be
+  /// updated by the next step (excluding their neighbors)
+  size_t GetNumActiveTiles() const;
+
+ private:
+  /// Tiles whose maximum concentration is above this threshold are active
+  double threshold_ = 1e-9;
+  /// The number of tiles at each axis [x, y, z]
+  std::array<size_t, 3> num_tiles_axis_ = {{0, 0, 0}};
+  /// Concentrations of each tile (empty if the tile is inactive). The boxes
+  /// are stored in x, y, z order; boxes outside the grid are zero.
+  std::vector<std::vector<double>> tiles_;
+  /// Gradients of each tile, in the same layout as `tiles_` (empty if the
+  /// tile is inactive or the gradients have not been calculated yet)
+  std::vector<std::vector<Double3>> tile_gradients_;
+  /// Lock for each tile, held while a concentration of the tile is changed
+  mutable ParallelResizeVector<Spinlock> tile_locks_ = {};  //!
+  /// Tiles that are processed in the current step
+  std::vector<size_t> update_tiles_;  //!
+  /// New concentrations of the tiles in `update_tiles_`
+  std::vector<double> buffer_;  //!
+  /// Dense copies returned by `GetAllConcentrations` and `GetAllGradients`
+  mutable ParallelResizeVector<double> dense_c_ = {};          //!
+  mutable ParallelResizeVector<Double3> dense_gradients_ = {};  //!
+  /// False if the grid has changed since the dense copies were assembled
+  mutable std::atomic<bool> dense_valid_{false};  //!
+  /// Protects the assembly of the dense copies
+  mutable Spinlock dense_lock_;  //!
+
+  /// Allocates the (empty) tiles for the current number of boxes
+  void AllocateData() override;
+
+  void GrowData(const std::array<size_t, 3>& old_num_boxes_axis) override;
+
+  /// Aborts the simulation, because interpolated reads are not supported
+  void StoreState() override;
+
+  /// Adds `amount` to box `idx` and activates its tile
+  void AddToBox(size_t idx, double amount) override;
+
+  /// Same as `AddToBox`, which already locks the tile
+  void AddToBoxLocked(size_t idx, double amount) override;
+
+  /// Performs one step of the active tiles and their neighbors
+  void Step(bool closed_edge);
+
+  /// Calculates the new concentrations of `tile` and writes them to `result`
+  void UpdateTile(size_t tile, bool closed_edge, double* result) const;
+
+  /// Calculates the gradients of the active `tile`
+  void UpdateTileGradients(size_t tile);
+
+  /// Returns the coordinates of the first box of `tile`
+  std::array<size_t, 3> GetTileOrigin(size_t tile) const;
+
+  /// Returns the tile that contains the box with coordinates `box` and the
+  /// index of the box within the tile
+  std::pair<size_t, size_t> Locate(const std::array<size_t, 3>& box) const;
+  std::pair<size_t, size_t> Locate(size_t idx) const;
+
+  /// Returns the concentration of box `idx` without locking its tile
+  double GetBoxConcentration(size_t idx) const;
+
+  /// Returns the gradient of box `idx`
+  Double3 GetBoxGradient(size_t idx) const;
+
+  /// Trilinear interpolation of the values returned by `value(box index)`
+  /// (see `DiffusionGrid::GetInterpolationStencil`)
+  template <typename T, typename F>
+  T InterpolateBoxes(size_t idx, const Double3& weights, F value) const;
+
+  BDM_CLASS_DEF_OVERRIDE(SparseEulerGrid, 2);
+};
+
+}  // namespace bdm
+
+#endif  // CORE_DIFFUSION_SPARSE_EULER_GRID_H_
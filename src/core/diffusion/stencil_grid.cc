@@ -13,18 +13,34 @@
 // -----------------------------------------------------------------------------
 
 #include "core/diffusion/stencil_grid.h"
+#include "core/util/work_stealing_executor.h"
 
 namespace bdm {
 
+std::array<double, 7> StencilGrid::GetStepCoefficients() const {
+  if (dt_ == 1) {
+    return dc_;
+  }
+  // the coefficients of the stencil correspond to a time step of one
+  std::array<double, 7> dc;
+  dc[0] = 1 - (1 - dc_[0]) * dt_;
+  for (int i = 1; i < 7; i++) {
+    dc[i] = dc_[i] * dt_;
+  }
+  return dc;
+}
+
 void StencilGrid::DiffuseWithClosedEdge() {
-  auto nx = resolution_;
-  auto ny = resolution_;
-  auto nz = resolution_;
+  const auto dc = GetStepCoefficients();
+  auto nx = num_boxes_axis_[0];
+  auto ny = num_boxes_axis_[1];
+  auto nz = num_boxes_axis_[2];
 
 #define YBF 16
-#pragma omp parallel for collapse(2)
-  for (size_t yy = 0; yy < ny; yy += YBF) {
-    for (size_t z = 0; z < nz; z++) {
+  auto diffuse = [&](uint64_t start, uint64_t end) {
+    for (uint64_t tile = start; tile < end; ++tile) {
+      const size_t yy = (tile / nz) * YBF;
+      const size_t z = tile % nz;
       size_t ymax = yy + YBF;
       if (ymax >= ny) {
         ymax = ny;
@@ -38,10 +54,10 @@ void StencilGrid::DiffuseWithClosedEdge() {
         s = (y == ny - 1) ? c : c + nx;
         b = (z == 0) ? c : c - nx * ny;
         t = (z == nz - 1) ? c : c + nx * ny;
-        c2_[c] = (dc_[0] * c1_[c] + dc_[1] * c1_[c] + dc_[2] * c1_[c + 1] +
-                  dc_[3] * c1_[s] + dc_[4] * c1_[n] + dc_[5] * c1_[b] +
-                  dc_[6] * c1_[t]) *
-                 (1 - mu_);
+        c2_[c] = (dc[0] * c1_[c] + dc[1] * c1_[c] + dc[2] * c1_[c + 1] +
+                  dc[3] * c1_[s] + dc[4] * c1_[n] + dc[5] * c1_[b] +
+                  dc[6] * c1_[t]) *
+                 (1 - mu_ * dt_);
 #pragma omp simd
         for (x = 1; x < nx - 1; x++) {
           ++c;
@@ -49,44 +65,48 @@ void StencilGrid::DiffuseWithClosedEdge() {
           ++s;
           ++b;
           ++t;
-          c2_[c] = (dc_[0] * c1_[c] + dc_[1] * c1_[c - 1] +
-                    dc_[2] * c1_[c + 1] + dc_[3] * c1_[s] + dc_[4] * c1_[n] +
-                    dc_[5] * c1_[b] + dc_[6] * c1_[t]) *
-                   (1 - mu_);
+          c2_[c] = (dc[0] * c1_[c] + dc[1] * c1_[c - 1] +
+                    dc[2] * c1_[c + 1] + dc[3] * c1_[s] + dc[4] * c1_[n] +
+                    dc[5] * c1_[b] + dc[6] * c1_[t]) *
+                   (1 - mu_ * dt_);
         }
         ++c;
         ++n;
         ++s;
         ++b;
         ++t;
-        c2_[c] = (dc_[0] * c1_[c] + dc_[1] * c1_[c - 1] + dc_[2] * c1_[c] +
-                  dc_[3] * c1_[s] + dc_[4] * c1_[n] + dc_[5] * c1_[b] +
-                  dc_[6] * c1_[t]) *
-                 (1 - mu_);
+        c2_[c] = (dc[0] * c1_[c] + dc[1] * c1_[c - 1] + dc[2] * c1_[c] +
+                  dc[3] * c1_[s] + dc[4] * c1_[n] + dc[5] * c1_[b] +
+                  dc[6] * c1_[t]) *
+                 (1 - mu_ * dt_);
       }  // tile ny
     }    // tile nz
-  }      // block ny
+  };     // block ny
+  auto num_tiles = ((ny + YBF - 1) / YBF) * nz;
+  WorkStealingExecutor::GetInstance()->ParallelFor(num_tiles, 1, diffuse);
   c1_.swap(c2_);
 }
 
 void StencilGrid::DiffuseWithOpenEdge() {
-  int nx = resolution_;
-  int ny = resolution_;
-  int nz = resolution_;
+  const auto dc = GetStepCoefficients();
+  int nx = num_boxes_axis_[0];
+  int ny = num_boxes_axis_[1];
+  int nz = num_boxes_axis_[2];
 
 #define YBF 16
-#pragma omp parallel for collapse(2)
-  for (int yy = 0; yy < ny; yy += YBF) {
-    for (int z = 0; z < nz; z++) {
+  auto diffuse = [&](uint64_t start, uint64_t end) {
+    for (uint64_t tile = start; tile < end; ++tile) {
+      const int yy = (tile / nz) * YBF;
+      const int z = tile % nz;
       // To let the edges bleed we set some diffusion coefficients
       // to zero. This prevents substance building up at the edges
-      auto dc_2_ = dc_;
+      auto dc_2_ = dc;
       int ymax = yy + YBF;
       if (ymax >= ny) {
         ymax = ny;
       }
       for (int y = yy; y < ymax; y++) {
-        dc_2_ = dc_;
+        dc_2_ = dc;
         int x;
         int c, n, s, b, t;
         x = 0;
@@ -119,7 +139,7 @@ void StencilGrid::DiffuseWithOpenEdge() {
         c2_[c] = (dc_2_[0] * c1_[c] + 0 * c1_[c] + dc_2_[2] * c1_[c + 1] +
                   dc_2_[3] * c1_[s] + dc_2_[4] * c1_[n] + dc_2_[5] * c1_[b] +
                   dc_2_[6] * c1_[t]) *
-                 (1 - mu_);
+                 (1 - mu_ * dt_);
 #pragma omp simd
         for (x = 1; x < nx - 1; x++) {
           ++c;
@@ -130,7 +150,7 @@ void StencilGrid::DiffuseWithOpenEdge() {
           c2_[c] = (dc_2_[0] * c1_[c] + dc_2_[1] * c1_[c - 1] +
                     dc_2_[2] * c1_[c + 1] + dc_2_[3] * c1_[s] +
                     dc_2_[4] * c1_[n] + dc_2_[5] * c1_[b] + dc_2_[6] * c1_[t]) *
-                   (1 - mu_);
+                   (1 - mu_ * dt_);
         }
         ++c;
         ++n;
@@ -141,10 +161,12 @@ void StencilGrid::DiffuseWithOpenEdge() {
         c2_[c] = (dc_2_[0] * c1_[c] + dc_2_[1] * c1_[c - 1] + 0 * c1_[c] +
                   dc_2_[3] * c1_[s] + dc_2_[4] * c1_[n] + dc_2_[5] * c1_[b] +
                   dc_2_[6] * c1_[t]) *
-                 (1 - mu_);
+                 (1 - mu_ * dt_);
       }  // tile ny
     }    // tile nz
-  }      // block ny
+  };     // block ny
+  auto num_tiles = ((ny + YBF - 1) / YBF) * nz;
+  WorkStealingExecutor::GetInstance()->ParallelFor(num_tiles, 1, diffuse);
   c1_.swap(c2_);
 }
 
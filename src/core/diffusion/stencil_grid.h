@@ -15,6 +15,9 @@
 #ifndef CORE_DIFFUSION_STENCIL_GRID_H_
 #define CORE_DIFFUSION_STENCIL_GRID_H_
 
+#include <array>
+#include <string>
+
 #include "core/diffusion/diffusion_grid.h"
 
 namespace bdm {
@@ -31,6 +34,9 @@ class StencilGrid : public DiffusionGrid {
   void DiffuseWithOpenEdge() override;
 
  private:
+  /// Returns the stencil coefficients scaled to the current time step
+  std::array<double, 7> GetStepCoefficients() const;
+
   BDM_CLASS_DEF_OVERRIDE(StencilGrid, 1);
 };
 
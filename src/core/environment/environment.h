@@ -40,12 +40,30 @@ class Environment {
   virtual void ForEachNeighbor(Functor<void, Agent*>& lambda,
                                const Agent& query, void* criteria) {}
 
+  /// Iterates over the neighbors of `query` within `squared_radius` that
+  /// are in range, i.e. whose center is closer than
+  /// `0.5 * (query diameter + neighbor diameter) + margin`. Environments
+  /// can use the sizes of both agents to limit the search. Agents out of
+  /// range might still be passed to `lambda`.\n
+  /// The default implementation ignores the sizes and forwards the call to
+  /// `ForEachNeighbor`. \see `MultiLevelGridEnvironment`
+  virtual void ForEachNeighborInRange(Functor<void, Agent*, double>& lambda,
+                                      const Agent& query,
+                                      double squared_radius, double margin) {
+    ForEachNeighbor(lambda, query, squared_radius);
+  }
+
   virtual void Clear() = 0;
 
   virtual std::array<int32_t, 6> GetDimensions() const = 0;
 
   virtual std::array<int32_t, 2> GetDimensionThresholds() const = 0;
 
+  /// Returns the length of the space along each axis if the environment
+  /// wraps around at the bounds (`Param::BoundSpaceMode::kTorus`), and zero
+  /// otherwise. Only valid after `Update`.
+  virtual double GetPeriod() const { return 0; }
+
   /// Return the size of the largest agent
   double GetLargestAgentSize() const { return largest_object_size_; };
   double GetLargestAgentSizeSquared() const {
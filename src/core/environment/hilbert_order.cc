@@ -0,0 +1,97 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#include "core/environment/hilbert_order.h"
+#include <algorithm>
+#include <utility>
+
+namespace bdm {
+
+// -----------------------------------------------------------------------------
+uint64_t HilbertOrder::GetHilbertCode(std::array<uint32_t, 3> coord,
+                                      uint32_t bits) {
+  const uint32_t m = 1u << (bits - 1);
+  // inverse undo excess work
+  for (uint32_t q = m; q > 1; q >>= 1) {
+    const uint32_t p = q - 1;
+    for (int i = 0; i < 3; ++i) {
+      if (coord[i] & q) {
+        coord[0] ^= p;
+      } else {
+        uint32_t t = (coord[0] ^ coord[i]) & p;
+        coord[0] ^= t;
+        coord[i] ^= t;
+      }
+    }
+  }
+  // gray encode
+  for (int i = 1; i < 3; ++i) {
+    coord[i] ^= coord[i - 1];
+  }
+  uint32_t t = 0;
+  for (uint32_t q = m; q > 1; q >>= 1) {
+    if (coord[2] & q) {
+      t ^= q - 1;
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    coord[i] ^= t;
+  }
+  // interleave the transposed representation, most significant bit first
+  uint64_t code = 0;
+  for (int b = bits - 1; b >= 0; --b) {
+    for (int i = 0; i < 3; ++i) {
+      code = (code << 1) | ((coord[i] >> b) & 1);
+    }
+  }
+  return code;
+}
+
+// -----------------------------------------------------------------------------
+void HilbertOrder::Update(const std::array<uint64_t, 3>& num_boxes_axis) {
+  if (num_boxes_axis == num_boxes_axis_) {
+    return;
+  }
+  num_boxes_axis_ = num_boxes_axis;
+  auto max_dim = std::max(num_boxes_axis[0],
+                          std::max(num_boxes_axis[1], num_boxes_axis[2]));
+  uint32_t bits = 1;
+  while ((1ull << bits) < max_dim) {
+    bits++;
+  }
+
+  auto num_boxes = num_boxes_axis[0] * num_boxes_axis[1] * num_boxes_axis[2];
+  std::vector<std::pair<uint64_t, uint64_t>> codes(num_boxes);
+  auto num_boxes_xy = num_boxes_axis[0] * num_boxes_axis[1];
+#pragma omp parallel for
+  for (uint64_t z = 0; z < num_boxes_axis[2]; ++z) {
+    for (uint64_t y = 0; y < num_boxes_axis[1]; ++y) {
+      for (uint64_t x = 0; x < num_boxes_axis[0]; ++x) {
+        auto idx = z * num_boxes_xy + y * num_boxes_axis[0] + x;
+        std::array<uint32_t, 3> coord = {{static_cast<uint32_t>(x),
+                                          static_cast<uint32_t>(y),
+                                          static_cast<uint32_t>(z)}};
+        codes[idx] = {GetHilbertCode(coord, bits), idx};
+      }
+    }
+  }
+  std::sort(codes.begin(), codes.end());
+
+  box_indices_.resize(num_boxes);
+  for (uint64_t i = 0; i < num_boxes; ++i) {
+    box_indices_[i] = codes[i].second;
+  }
+}
+
+}  // namespace bdm
@@ -0,0 +1,57 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#ifndef CORE_ENVIRONMENT_HILBERT_ORDER_H_
+#define CORE_ENVIRONMENT_HILBERT_ORDER_H_
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace bdm {
+
+/// Sorts the boxes of a uniform grid along a three dimensional Hilbert
+/// curve. In contrast to the Morton order (`MortonOrder`), consecutive boxes
+/// on a Hilbert curve are always face neighbors. Grids whose dimensions are
+/// not a power of two are embedded in the smallest enclosing power of two
+/// cube. Boxes outside the grid are skipped.
+class HilbertOrder {
+ public:
+  /// Recomputes the order if the grid dimensions changed.
+  /// Runtime O(num_boxes * log(num_boxes))
+  void Update(const std::array<uint64_t, 3>& num_boxes_axis);
+
+  /// Returns the row-major index (x runs fastest) of the box at position
+  /// `position` along the curve.
+  uint64_t GetBoxIndex(uint64_t position) const {
+    return box_indices_[position];
+  }
+
+  uint64_t GetNumBoxes() const { return box_indices_.size(); }
+
+  /// Returns the distance of the given coordinates along a Hilbert curve
+  /// that fills a cube with side length `2^bits`.
+  /// Based on J. Skilling, "Programming the Hilbert curve",
+  /// AIP Conference Proceedings 707, 381 (2004).
+  /// \param bits must be in [1, 21]
+  static uint64_t GetHilbertCode(std::array<uint32_t, 3> coord, uint32_t bits);
+
+ private:
+  std::array<uint64_t, 3> num_boxes_axis_ = {{0, 0, 0}};
+  std::vector<uint64_t> box_indices_;
+};
+
+}  // namespace bdm
+
+#endif  // CORE_ENVIRONMENT_HILBERT_ORDER_H_
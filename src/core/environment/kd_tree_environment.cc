@@ -16,8 +16,12 @@
 
 #include "core/environment/kd_tree_environment.h"
 
+#include <omp.h>
+#include <cmath>
 #include <nanoflann.hpp>
 
+#include "core/container/shared_data.h"
+
 namespace bdm {
 
 using nanoflann::KDTreeSingleIndexAdaptor;
@@ -28,17 +32,217 @@ typedef KDTreeSingleIndexAdaptor<L2_Simple_Adaptor<double, NanoFlannAdapter>,
                                  NanoFlannAdapter, 3, uint64_t>
     bdm_kd_tree_t;
 
+/// Extends nanoflann's index with a parallel build, which creates the same
+/// tree as `buildIndex()`.
+class BdmKDTree : public bdm_kd_tree_t {
+ public:
+  using NodePtr = bdm_kd_tree_t::NodePtr;
+  using BoundingBox = bdm_kd_tree_t::BoundingBox;
+
+  /// Subtrees with more points are built in separate tasks
+  static constexpr uint64_t kTaskSize = 4096;
+
+  BdmKDTree(const NanoFlannAdapter& adapter,
+            const KDTreeSingleIndexAdaptorParams& params)
+      : bdm_kd_tree_t(3, adapter, params) {}
+
+  void BuildParallel() {
+    auto size = dataset.kdtree_get_point_count();
+    this->m_size = size;
+    this->vind.resize(size);
+#pragma omp parallel for
+    for (uint64_t i = 0; i < size; ++i) {
+      this->vind[i] = i;
+    }
+    this->freeIndex(*this);
+    pools_.resize(omp_get_max_threads());
+    for (auto& pool : pools_) {
+      if (pool == nullptr) {
+        pool.reset(new nanoflann::PooledAllocator());
+      }
+      pool->free_all();
+    }
+    this->m_size_at_index_build = size;
+    if (size == 0) {
+      return;
+    }
+    ComputeBoundingBox(&this->root_bbox);
+#pragma omp parallel
+#pragma omp single
+    this->root_node = DivideTree(0, size, this->root_bbox);
+  }
+
+ private:
+  /// One allocator for each thread
+  std::vector<std::unique_ptr<nanoflann::PooledAllocator>> pools_;
+
+  const Double3& GetPoint(uint64_t i) const {
+    return dataset.positions_[this->vind[i]];
+  }
+
+  void ComputeBoundingBox(BoundingBox* bbox) const {
+    auto size = this->m_size;
+    double xmin = Math::kInfinity, ymin = Math::kInfinity;
+    double zmin = Math::kInfinity;
+    double xmax = -Math::kInfinity, ymax = -Math::kInfinity;
+    double zmax = -Math::kInfinity;
+    const auto& positions = dataset.positions_;
+#pragma omp parallel for reduction(min : xmin, ymin, zmin) \
+    reduction(max : xmax, ymax, zmax)
+    for (uint64_t i = 0; i < size; ++i) {
+      const auto& p = positions[i];
+      xmin = std::min(xmin, p[0]);
+      xmax = std::max(xmax, p[0]);
+      ymin = std::min(ymin, p[1]);
+      ymax = std::max(ymax, p[1]);
+      zmin = std::min(zmin, p[2]);
+      zmax = std::max(zmax, p[2]);
+    }
+    (*bbox)[0].low = xmin;
+    (*bbox)[0].high = xmax;
+    (*bbox)[1].low = ymin;
+    (*bbox)[1].high = ymax;
+    (*bbox)[2].low = zmin;
+    (*bbox)[2].high = zmax;
+  }
+
+  /// Same as `divideTree` in nanoflann, but large subtrees are built in
+  /// parallel and nodes are allocated from thread local pools.
+  NodePtr DivideTree(uint64_t left, uint64_t right, BoundingBox& bbox) {
+    auto* pool = pools_[omp_get_thread_num()].get();
+    NodePtr node = pool->allocate<Node>();
+
+    if (right - left <= this->m_leaf_max_size) {
+      node->child1 = node->child2 = nullptr;
+      node->node_type.lr.left = left;
+      node->node_type.lr.right = right;
+      for (int d = 0; d < 3; ++d) {
+        bbox[d].low = bbox[d].high = GetPoint(left)[d];
+      }
+      for (uint64_t k = left + 1; k < right; ++k) {
+        const auto& p = GetPoint(k);
+        for (int d = 0; d < 3; ++d) {
+          bbox[d].low = std::min(bbox[d].low, p[d]);
+          bbox[d].high = std::max(bbox[d].high, p[d]);
+        }
+      }
+      return node;
+    }
+
+    uint64_t idx;
+    int cutfeat;
+    double cutval;
+    this->middleSplit_(*this, &this->vind[0] + left, right - left, idx,
+                       cutfeat, cutval, bbox);
+    node->node_type.sub.divfeat = cutfeat;
+
+    BoundingBox left_bbox(bbox);
+    left_bbox[cutfeat].high = cutval;
+    BoundingBox right_bbox(bbox);
+    right_bbox[cutfeat].low = cutval;
+    if (right - left > kTaskSize) {
+#pragma omp task shared(left_bbox)
+      node->child1 = DivideTree(left, left + idx, left_bbox);
+      node->child2 = DivideTree(left + idx, right, right_bbox);
+#pragma omp taskwait
+    } else {
+      node->child1 = DivideTree(left, left + idx, left_bbox);
+      node->child2 = DivideTree(left + idx, right, right_bbox);
+    }
+
+    node->node_type.sub.divlow = left_bbox[cutfeat].high;
+    node->node_type.sub.divhigh = right_bbox[cutfeat].low;
+    for (int d = 0; d < 3; ++d) {
+      bbox[d].low = std::min(left_bbox[d].low, right_bbox[d].low);
+      bbox[d].high = std::max(left_bbox[d].high, right_bbox[d].high);
+    }
+    return node;
+  }
+};
+
 struct KDTreeEnvironment::NanoflannImpl {
-  bdm_kd_tree_t* index_ = nullptr;
+  BdmKDTree* index_ = nullptr;
+};
+
+// -----------------------------------------------------------------------------
+struct UpdateSnapshotFunctor : public Functor<void, Agent*, AgentHandle> {
+  NanoFlannAdapter* adapter;
+  bool set_box_idx;
+
+  UpdateSnapshotFunctor(NanoFlannAdapter* adapter, bool set_box_idx)
+      : adapter(adapter), set_box_idx(set_box_idx) {}
+
+  void operator()(Agent* agent, AgentHandle ah) override {
+    auto idx = adapter->flat_idx_map_.GetFlatIdx(ah);
+    auto* soa = adapter->rm_->GetAgentSoA(ah.GetNumaNode());
+    adapter->positions_[idx] =
+        soa ? soa->GetPosition(ah.GetElementIdx()) : agent->GetPosition();
+    adapter->handles_[idx] = ah;
+    adapter->uids_[idx] = agent->GetUid();
+    if (set_box_idx) {
+      agent->SetBoxIdx(idx);
+      if (soa) {
+        soa->SetBoxIdx(ah.GetElementIdx(), idx);
+      }
+    }
+  }
+};
+
+void NanoFlannAdapter::Update(bool set_box_idx) {
+  auto num_agents = rm_->GetNumAgents();
+  positions_.resize(num_agents);
+  handles_.resize(num_agents);
+  uids_.resize(num_agents);
+  UpdateSnapshotFunctor functor(this, set_box_idx);
+  rm_->ForEachAgentParallel(1000, functor);
+}
+
+// -----------------------------------------------------------------------------
+struct MaxDisplacementFunctor : public Functor<void, Agent*, AgentHandle> {
+  NanoFlannAdapter* adapter;
+  /// Largest squared displacement of each thread
+  SharedData<double> max;
+
+  explicit MaxDisplacementFunctor(NanoFlannAdapter* adapter)
+      : adapter(adapter), max(omp_get_max_threads(), 0.0) {}
+
+  void operator()(Agent* agent, AgentHandle ah) override {
+    auto tid = omp_get_thread_num();
+    auto idx = adapter->flat_idx_map_.GetFlatIdx(ah);
+    if (adapter->uids_[idx] != agent->GetUid()) {
+      max[tid] = Math::kInfinity;
+      return;
+    }
+    adapter->handles_[idx] = ah;
+    auto* soa = adapter->rm_->GetAgentSoA(ah.GetNumaNode());
+    auto diff = (soa ? soa->GetPosition(ah.GetElementIdx())
+                     : agent->GetPosition()) -
+                adapter->positions_[idx];
+    max[tid] = std::max(max[tid], diff * diff);
+  }
 };
 
-KDTreeEnvironment::KDTreeEnvironment() {
+double NanoFlannAdapter::GetMaxDisplacement() {
+  if (uids_.size() != rm_->GetNumAgents()) {
+    return Math::kInfinity;
+  }
+  MaxDisplacementFunctor functor(this);
+  rm_->ForEachAgentParallel(1000, functor);
+  double max = 0;
+  for (uint64_t i = 0; i < functor.max.size(); ++i) {
+    max = std::max(max, functor.max[i]);
+  }
+  return std::sqrt(max);
+}
+
+// -----------------------------------------------------------------------------
+KDTreeEnvironment::KDTreeEnvironment() : lbi_(this), nb_mutex_builder_(this) {
   auto* param = Simulation::GetActive()->GetParam();
   nf_adapter_ = new NanoFlannAdapter();
   impl_ = std::unique_ptr<KDTreeEnvironment::NanoflannImpl>(
       new KDTreeEnvironment::NanoflannImpl());
-  impl_->index_ = new bdm_kd_tree_t(
-      3, *nf_adapter_, KDTreeSingleIndexAdaptorParams(param->nanoflann_depth));
+  impl_->index_ = new BdmKDTree(
+      *nf_adapter_, KDTreeSingleIndexAdaptorParams(param->nanoflann_depth));
 }
 
 KDTreeEnvironment::~KDTreeEnvironment() {
@@ -47,6 +251,7 @@ KDTreeEnvironment::~KDTreeEnvironment() {
 }
 
 void KDTreeEnvironment::Update() {
+  auto* param = Simulation::GetActive()->GetParam();
   nf_adapter_->rm_ = Simulation::GetActive()->GetResourceManager();
 
   // Update the flattened indices map
@@ -58,11 +263,28 @@ void KDTreeEnvironment::Update() {
     CalcSimDimensionsAndLargestAgent(&tmp_dim);
     RoundOffGridDimensions(tmp_dim);
     CheckGridGrowth();
-    impl_->index_->buildIndex();
+
+    // Reuse the tree if the agents did not move far since it was built
+    search_margin_ = 0;
+    bool rebuild = true;
+    if (param->kd_tree_skin > 0 && impl_->index_->root_node != nullptr) {
+      auto displacement = nf_adapter_->GetMaxDisplacement();
+      if (displacement <= param->kd_tree_skin) {
+        search_margin_ = displacement;
+        rebuild = false;
+      }
+    }
+    const bool automatic_locking = param->thread_safety_mechanism ==
+                                   Param::ThreadSafetyMechanism::kAutomatic;
+    if (rebuild) {
+      nf_adapter_->Update(automatic_locking);
+      impl_->index_->BuildParallel();
+    }
+    if (automatic_locking) {
+      nb_mutex_builder_.Update();
+    }
   } else {
     // There are no sim objects in this simulation
-    auto* param = Simulation::GetActive()->GetParam();
-
     bool uninitialized = impl_->index_->m_size == 0;
     if (uninitialized && param->bound_space) {
       // Simulation has never had any simulation objects
@@ -99,15 +321,31 @@ void KDTreeEnvironment::ForEachNeighbor(Functor<void, Agent*, double>& lambda,
   params.sorted = false;
 
   const auto& position = query.GetPosition();
+  // The tree contains the positions of its last build. Agents might have
+  // moved up to `search_margin_` since then.
+  double search_radius_squared = squared_radius;
+  if (search_margin_ > 0) {
+    auto search_radius = std::sqrt(squared_radius) + search_margin_;
+    search_radius_squared = search_radius * search_radius;
+  }
 
   // calculate neighbors
-  impl_->index_->radiusSearch(&position[0], squared_radius, neighbors, params);
+  impl_->index_->radiusSearch(&position[0], search_radius_squared, neighbors,
+                              params);
 
   auto* rm = Simulation::GetActive()->GetResourceManager();
   for (auto& n : neighbors) {
-    Agent* nb_so =
-        rm->GetAgent(nf_adapter_->flat_idx_map_.GetAgentHandle(n.first));
-    if (nb_so != &query) {
+    Agent* nb_so = rm->GetAgent(nf_adapter_->handles_[n.first]);
+    if (nb_so == &query) {
+      continue;
+    }
+    if (search_margin_ > 0) {
+      auto diff = nb_so->GetPosition() - position;
+      auto distance = diff * diff;
+      if (distance <= squared_radius) {
+        lambda(nb_so, distance);
+      }
+    } else {
       lambda(nb_so, n.second);
     }
   }
@@ -122,16 +360,14 @@ std::array<int32_t, 2> KDTreeEnvironment::GetDimensionThresholds() const {
 }
 
 LoadBalanceInfo* KDTreeEnvironment::GetLoadBalanceInfo() {
-  Log::Fatal("KDTreeEnvironment::GetLoadBalanceInfo",
-             "You tried to call GetLoadBalanceInfo in an environment that does "
-             "not support it.");
-  return nullptr;
+  lbi_.Update();
+  return &lbi_;
 }
 
 Environment::NeighborMutexBuilder*
 KDTreeEnvironment::GetNeighborMutexBuilder() {
-  return nullptr;
-};
+  return &nb_mutex_builder_;
+}
 
 void KDTreeEnvironment::Clear() {
   int32_t inf = std::numeric_limits<int32_t>::max();
@@ -166,4 +402,96 @@ void KDTreeEnvironment::CheckGridGrowth() {
   }
 }
 
+// -----------------------------------------------------------------------------
+void KDTreeEnvironment::LoadBalanceInfoKDTree::Update() {
+  const auto& vind = env_->impl_->index_->vind;
+  const auto& handles = env_->nf_adapter_->handles_;
+  sorted_handles_.resize(vind.size());
+#pragma omp parallel for
+  for (uint64_t i = 0; i < vind.size(); ++i) {
+    sorted_handles_[i] = handles[vind[i]];
+  }
+}
+
+struct SortedHandleIterator : public Iterator<AgentHandle> {
+  const std::vector<AgentHandle>& handles;
+  uint64_t current;
+  uint64_t end;
+
+  SortedHandleIterator(const std::vector<AgentHandle>& handles, uint64_t start,
+                       uint64_t end)
+      : handles(handles), current(start), end(end) {}
+
+  bool HasNext() const override { return current < end; }
+
+  AgentHandle Next() override { return handles[current++]; }
+};
+
+void KDTreeEnvironment::LoadBalanceInfoKDTree::CallHandleIteratorConsumer(
+    uint64_t start, uint64_t end,
+    Functor<void, Iterator<AgentHandle>*>& f) const {
+  end = std::min(end, static_cast<uint64_t>(sorted_handles_.size()));
+  if (end <= start) {
+    return;
+  }
+  SortedHandleIterator it(sorted_handles_, start, end);
+  f(&it);
+}
+
+// -----------------------------------------------------------------------------
+using NeighborMutex = Environment::NeighborMutexBuilder::NeighborMutex;
+using KDTreeNeighborMutexBuilder =
+    KDTreeEnvironment::KDTreeNeighborMutexBuilder;
+
+void KDTreeNeighborMutexBuilder::Update() {
+  const auto& dims = env_->grid_dimensions_;
+  origin_ = {static_cast<double>(dims[0]), static_cast<double>(dims[2]),
+             static_cast<double>(dims[4])};
+  // neighbors are searched in the positions of the last build
+  box_length_ = std::max(
+      env_->GetLargestAgentSize() + 2 * env_->search_margin_, 1e-9);
+  // at most one occupied cube per agent
+  uint64_t num_agents = env_->nf_adapter_->positions_.size();
+  uint64_t size = 1024;
+  while (size < num_agents && size < (1u << 20)) {
+    size <<= 1;
+  }
+  if (mutexes_.size() != size) {
+    mutexes_.resize(size);
+  }
+}
+
+NeighborMutex* KDTreeNeighborMutexBuilder::GetMutex(uint64_t box_idx) {
+  const auto& position = env_->nf_adapter_->positions_[box_idx];
+  int64_t coord[3];
+  for (int d = 0; d < 3; ++d) {
+    auto relative = (position[d] - origin_[d]) / box_length_;
+    coord[d] = static_cast<int64_t>(std::floor(relative));
+  }
+  std::array<uint64_t, 27> hashes;
+  uint64_t n = 0;
+  const uint64_t mask = mutexes_.size() - 1;
+  for (int64_t z = coord[2] - 1; z <= coord[2] + 1; ++z) {
+    for (int64_t y = coord[1] - 1; y <= coord[1] + 1; ++y) {
+      for (int64_t x = coord[0] - 1; x <= coord[0] + 1; ++x) {
+        uint64_t hash = static_cast<uint64_t>(x) * 73856093u ^
+                        static_cast<uint64_t>(y) * 19349663u ^
+                        static_cast<uint64_t>(z) * 83492791u;
+        hashes[n++] = hash & mask;
+      }
+    }
+  }
+  // Deadlocks occur if mutliple threads try to acquire the same locks,
+  // but in different order. Different cubes can share a mutex.
+  std::sort(hashes.begin(), hashes.end());
+  auto last = std::unique(hashes.begin(), hashes.end());
+  FixedSizeVector<uint64_t, 27> mutex_indices;
+  for (auto it = hashes.begin(); it != last; ++it) {
+    mutex_indices.push_back(*it);
+  }
+  thread_local KDTreeNeighborMutex* mutex = new KDTreeNeighborMutex();
+  mutex->SetMutexIndices(mutex_indices, this);
+  return mutex;
+}
+
 }  // namespace bdm
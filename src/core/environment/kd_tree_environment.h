@@ -15,13 +15,22 @@
 #ifndef CORE_ENVIRONMENT_KD_TREE_ENVIRONMENT_
 #define CORE_ENVIRONMENT_KD_TREE_ENVIRONMENT_
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "core/container/agent_flat_idx_map.h"
+#include "core/container/fixed_size_vector.h"
 #include "core/container/math_array.h"
 #include "core/environment/environment.h"
 #include "core/simulation.h"
 
 namespace bdm {
 
+/// Provides the agent positions to nanoflann.\n
+/// The positions are copied into a contiguous array at each update, such that
+/// building and querying the tree does not call `Agent::GetPosition` and
+/// does not need to map flat indices to AgentHandles.
 struct NanoFlannAdapter {
   using coord_t = Double3;
   using idx_t = uint64_t;
@@ -29,26 +38,20 @@ struct NanoFlannAdapter {
   NanoFlannAdapter() { rm_ = Simulation::GetActive()->GetResourceManager(); }
 
   /// Must return the number of data points
-  inline size_t kdtree_get_point_count() const {
-    return Simulation::GetActive()->GetResourceManager()->GetNumAgents();
-  }
+  inline size_t kdtree_get_point_count() const { return positions_.size(); }
 
   /// Returns the distance between the vector "p1[0:size-1]" and the data point
   /// with index "idx_p2" stored in the class:
   inline double kdtree_distance(const coord_t& p1, const idx_t idx_p2,
                                 size_t /*size*/) const {
-    AgentHandle ah = flat_idx_map_.GetAgentHandle(idx_p2);
-    auto& p2 = rm_->GetAgent(ah)->GetPosition();
-    return p1 * p2;
+    return p1 * positions_[idx_p2];
   }
 
   /// Returns the dim'th component of the idx'th point in the class:
   /// Since this is inlined and the "dim" argument is typically an immediate
   /// value, the "if/else's" are actually solved at compile time.
   inline double kdtree_get_pt(const idx_t idx, int dim) const {
-    AgentHandle ah = flat_idx_map_.GetAgentHandle(idx);
-    auto& pos = rm_->GetAgent(ah)->GetPosition();
-    return pos[dim];
+    return positions_[idx][dim];
   }
 
   /// Optional bounding-box computation: return false to default to a standard
@@ -63,8 +66,24 @@ struct NanoFlannAdapter {
     return false;
   }
 
+  /// Copies the positions, handles and uids of all agents (in parallel).
+  /// \param set_box_idx stores the flat index of each agent with
+  ///        `Agent::SetBoxIdx` (see `KDTreeNeighborMutexBuilder`)
+  void Update(bool set_box_idx);
+
+  /// Returns the largest distance an agent moved since the last call to
+  /// `Update`, or infinity if agents have been added or removed since then.
+  /// Updates the AgentHandles (in parallel).
+  double GetMaxDisplacement();
+
   AgentFlatIdxMap flat_idx_map_;
   ResourceManager* rm_ = nullptr;
+  /// Position of each agent; indexed by flat index
+  std::vector<Double3> positions_;
+  /// AgentHandle of each agent; indexed by flat index
+  std::vector<AgentHandle> handles_;
+  /// Uid of each agent; indexed by flat index
+  std::vector<AgentUid> uids_;
 };
 
 class KDTreeEnvironment : public Environment {
@@ -84,13 +103,103 @@ class KDTreeEnvironment : public Environment {
 
   std::array<int32_t, 2> GetDimensionThresholds() const override;
 
+  /// Orders the agents by the leaves of the tree.
   LoadBalanceInfo* GetLoadBalanceInfo() override;
 
+  /// Locks all agents in the neighborhood of the agent with the given flat
+  /// index (see `KDTreeNeighborMutexBuilder`).
   NeighborMutexBuilder* GetNeighborMutexBuilder() override;
 
   void Clear() override;
 
+  /// Returns true if the last update reused the existing tree
+  /// (see `Param::kd_tree_skin`).
+  bool IsTreeReused() const { return search_margin_ > 0; }
+
+  // NeighborMutex ---------------------------------------------------------
+
+  /// Ensures thread-safety if agents modify their neighbors
+  /// (`Param::ThreadSafetyMechanism::kAutomatic`).\n
+  /// Space is divided into cubes with the size of the largest agent. An agent
+  /// locks the mutexes of the 27 cubes around it. Since the tree is meant for
+  /// sparse and non-uniform populations, the cubes are mapped to a fixed
+  /// number of mutexes with a spatial hash. Collisions only cause additional
+  /// serialization.\n
+  /// The box index of an agent (`Agent::GetBoxIdx`) is its flat index in the
+  /// tree.
+  class KDTreeNeighborMutexBuilder : public NeighborMutexBuilder {
+   public:
+    class KDTreeNeighborMutex : public NeighborMutex {
+     public:
+      virtual ~KDTreeNeighborMutex() {}
+
+      void lock() override {  // NOLINT
+        for (auto idx : mutex_indices_) {
+          auto& mutex = mutex_builder_->mutexes_[idx].mutex_;
+          // acquire lock (and spin if another thread is holding it)
+          while (mutex.test_and_set(std::memory_order_acquire)) {
+          }
+        }
+      }
+
+      void unlock() override {  // NOLINT
+        for (auto idx : mutex_indices_) {
+          auto& mutex = mutex_builder_->mutexes_[idx].mutex_;
+          mutex.clear(std::memory_order_release);
+        }
+      }
+
+      /// Indices must be sorted and unique to avoid deadlocks.
+      void SetMutexIndices(const FixedSizeVector<uint64_t, 27>& indices,
+                           KDTreeNeighborMutexBuilder* mutex_builder) {
+        mutex_indices_ = indices;
+        mutex_builder_ = mutex_builder;
+      }
+
+     private:
+      FixedSizeVector<uint64_t, 27> mutex_indices_;
+      KDTreeNeighborMutexBuilder* mutex_builder_ = nullptr;
+    };
+
+    /// Used to store mutexes in a vector.
+    /// Always creates a new mutex (even for the copy constructor)
+    struct MutexWrapper {
+      MutexWrapper() {}
+      MutexWrapper(const MutexWrapper&) {}
+      std::atomic_flag mutex_ = ATOMIC_FLAG_INIT;
+    };
+
+    explicit KDTreeNeighborMutexBuilder(KDTreeEnvironment* env) : env_(env) {}
+    virtual ~KDTreeNeighborMutexBuilder() {}
+
+    void Update();
+
+    NeighborMutex* GetMutex(uint64_t box_idx) override;
+
+   private:
+    KDTreeEnvironment* env_;
+    std::vector<MutexWrapper> mutexes_;
+    Double3 origin_;
+    double box_length_ = 1;
+  };
+
  private:
+  /// Iterates over the agents in the order of the leaves of the tree.
+  class LoadBalanceInfoKDTree : public LoadBalanceInfo {
+   public:
+    explicit LoadBalanceInfoKDTree(KDTreeEnvironment* env) : env_(env) {}
+    virtual ~LoadBalanceInfoKDTree() {}
+    void Update();
+    void CallHandleIteratorConsumer(
+        uint64_t start, uint64_t end,
+        Functor<void, Iterator<AgentHandle>*>& f) const override;
+
+   private:
+    KDTreeEnvironment* env_;
+    /// AgentHandles in the order of the leaves
+    std::vector<AgentHandle> sorted_handles_;
+  };
+
   // Hide nanoflann-specific types from header (pimpl idiom)
   std::unique_ptr<NanoflannImpl> impl_;
   /// Cube which contains all simulation objects
@@ -100,6 +209,11 @@ class KDTreeEnvironment : public Environment {
   /// to trigger a diffusion grid change
   std::array<int32_t, 2> threshold_dimensions_;
   NanoFlannAdapter* nf_adapter_ = nullptr;
+  /// Largest displacement of an agent since the tree was built.
+  /// Neighbor searches are enlarged by this distance.
+  double search_margin_ = 0;
+  LoadBalanceInfoKDTree lbi_;  //!
+  KDTreeNeighborMutexBuilder nb_mutex_builder_;  //!
 
   void RoundOffGridDimensions(const std::array<double, 6>& grid_dimensions);
 
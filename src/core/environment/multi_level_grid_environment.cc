@@ -0,0 +1,420 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#include "core/environment/multi_level_grid_environment.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "core/algorithm.h"
+#include "core/container/shared_data.h"
+#include "core/simulation.h"
+
+namespace bdm {
+
+// -----------------------------------------------------------------------------
+void MultiLevelGridEnvironment::Update() {
+  auto* sim = Simulation::GetActive();
+  auto* rm = sim->GetResourceManager();
+  auto* param = sim->GetParam();
+
+  flat_idx_map_.Update();
+  auto num_agents = rm->GetNumAgents();
+  if (num_agents != 0) {
+    Clear();
+    auto inf = Math::kInfinity;
+    std::array<double, 6> tmp_dim = {{inf, -inf, inf, -inf, inf, -inf}};
+    CalcSimDimensionsAndLargestAgent(&tmp_dim);
+    RoundOffGridDimensions(tmp_dim);
+    CheckGridGrowth();
+
+    // smallest spherical agent
+    SharedData<double> smallest(omp_get_max_threads(), inf);
+    auto find_smallest = L2F([&](Agent* agent, AgentHandle) {
+      auto tid = omp_get_thread_num();
+      if (agent->GetShape() == Shape::kSphere) {
+        smallest[tid] = std::min(smallest[tid], agent->GetDiameter());
+      }
+    });
+    rm->ForEachAgentParallel(param->scheduling_batch_size, find_smallest);
+    double min_diameter = inf;
+    for (uint64_t i = 0; i < smallest.size(); ++i) {
+      min_diameter = std::min(min_diameter, smallest[i]);
+    }
+    InitializeLevels(tmp_dim, min_diameter, num_agents);
+
+    // count the agents per box and determine their rank within the box
+    const bool automatic_locking = param->thread_safety_mechanism ==
+                                   Param::ThreadSafetyMechanism::kAutomatic;
+    slots_.resize(num_agents);
+    auto count = L2F([&](Agent* agent, AgentHandle ah) {
+      auto* soa = rm->GetAgentSoA(ah.GetNumaNode());
+      Double3 position =
+          soa ? soa->GetPosition(ah.GetElementIdx()) : agent->GetPosition();
+      uint64_t l = levels_.size() - 1;
+      if (agent->GetShape() == Shape::kSphere) {
+        auto diameter = agent->GetDiameter();
+        l = 0;
+        while (l < levels_.size() - 1 && diameter > levels_[l].box_length) {
+          ++l;
+        }
+      }
+      auto& level = levels_[l];
+      auto box = GetBoxIndex(level, position);
+      if (automatic_locking) {
+        // the neighbor mutexes are defined on the top level
+        auto top_box = l + 1 == levels_.size()
+                           ? box
+                           : GetBoxIndex(levels_.back(), position);
+        agent->SetBoxIdx(top_box);
+        if (soa) {
+          soa->SetBoxIdx(ah.GetElementIdx(), top_box);
+        }
+      }
+      // box_start[box + 1] counts the agents in this box
+      auto& counter = level.box_start[box + 1];
+      uint64_t rank;
+#pragma omp atomic capture
+      rank = counter++;
+      slots_[flat_idx_map_.GetFlatIdx(ah)] = {l, box, rank};
+    });
+    rm->ForEachAgentParallel(param->scheduling_batch_size, count);
+
+    // box_start[0] is zero. Therefore, the inclusive prefix sum turns the
+    // counts into the start index of each box.
+    uint64_t offset = 0;
+    for (auto& level : levels_) {
+      InPlaceParallelPrefixSum(level.box_start, level.box_start.size());
+      level.offset = offset;
+      offset += level.box_start.back();
+    }
+
+    // scatter agents
+    agents_.resize(num_agents);
+    handles_.resize(num_agents);
+    auto scatter = L2F([&](Agent* agent, AgentHandle ah) {
+      const auto& slot = slots_[flat_idx_map_.GetFlatIdx(ah)];
+      const auto& level = levels_[slot.level];
+      auto idx = level.offset + level.box_start[slot.box] + slot.rank;
+      agents_[idx] = agent;
+      handles_[idx] = ah;
+    });
+    rm->ForEachAgentParallel(param->scheduling_batch_size, scatter);
+    if (automatic_locking) {
+      nb_mutex_builder_.Update();
+    }
+  } else {
+    // There are no agents in this simulation
+    bool uninitialized = levels_.empty();
+    if (uninitialized && param->bound_space) {
+      // Simulation has never had any agents
+      // Initialize grid dimensions with `Param::min_bound` and
+      // `Param::max_bound`
+      // This is required for the DiffusionGrid
+      int min = param->min_bound;
+      int max = param->max_bound;
+      grid_dimensions_ = {min, max, min, max, min, max};
+      threshold_dimensions_ = {min, max};
+      has_grown_ = true;
+    } else if (!uninitialized) {
+      // all agents have been removed in the last iteration
+      // grid state remains the same, but we have to set has_grown_ to false
+      // otherwise the DiffusionGrid will attempt to resize
+      has_grown_ = false;
+      agents_.clear();
+      handles_.clear();
+      for (auto& level : levels_) {
+        std::fill(level.box_start.begin(), level.box_start.end(), 0);
+      }
+    } else {
+      Log::Fatal(
+          "MultiLevelGridEnvironment",
+          "You tried to initialize an empty simulation without bound space. "
+          "Therefore we cannot determine the size of the simulation space. "
+          "Please add agents, or set Param::bound_space, "
+          "Param::min_bound, and Param::max_bound.");
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void MultiLevelGridEnvironment::InitializeLevels(
+    const std::array<double, 6>& dimensions, double smallest,
+    uint64_t num_agents) {
+  auto top = GetLargestAgentSize();
+  if (top <= 0) {
+    Log::Fatal("MultiLevelGridEnvironment",
+               "The largest agent size was found to be 0. Please check if "
+               "your agents are correctly initialized.");
+  }
+  auto num_boxes_axis = [&](double box_length, int axis) {
+    auto length = dimensions[2 * axis + 1] - dimensions[2 * axis];
+    return static_cast<uint64_t>(length / box_length) + 1;
+  };
+  auto num_boxes = [&](double box_length) {
+    return num_boxes_axis(box_length, 0) * num_boxes_axis(box_length, 1) *
+           num_boxes_axis(box_length, 2);
+  };
+
+  auto* param = Simulation::GetActive()->GetParam();
+  int num_levels =
+      std::max(static_cast<int>(param->multi_level_grid_levels), 1);
+  // The finest level must be able to hold the smallest agent and must not
+  // have considerably more boxes than agents.
+  const uint64_t max_boxes =
+      std::max(8 * num_agents, static_cast<uint64_t>(1) << 16);
+  auto finest = [&]() { return std::ldexp(top, 1 - num_levels); };
+  while (num_levels > 1 &&
+         (finest() < smallest || num_boxes(finest()) > max_boxes)) {
+    num_levels--;
+  }
+
+  origin_ = {dimensions[0], dimensions[2], dimensions[4]};
+  levels_.resize(num_levels);
+  for (int l = 0; l < num_levels; ++l) {
+    auto& level = levels_[l];
+    level.box_length = std::ldexp(top, l + 1 - num_levels);
+    for (int i = 0; i < 3; ++i) {
+      level.num_boxes[i] = num_boxes_axis(level.box_length, i);
+    }
+    auto total = level.num_boxes[0] * level.num_boxes[1] * level.num_boxes[2];
+    level.box_start.resize(total + 1);
+#pragma omp parallel for
+    for (uint64_t i = 0; i < total + 1; ++i) {
+      level.box_start[i] = 0;
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+uint64_t MultiLevelGridEnvironment::GetBoxIndex(const Level& level,
+                                               const Double3& position) const {
+  std::array<uint64_t, 3> box_coord;
+  for (int i = 0; i < 3; ++i) {
+    auto coord = std::max(0.0, (position[i] - origin_[i]) / level.box_length);
+    box_coord[i] =
+        std::min(static_cast<uint64_t>(coord), level.num_boxes[i] - 1);
+  }
+  return level.GetBoxIndex(box_coord);
+}
+
+// -----------------------------------------------------------------------------
+template <typename TLambda>
+void MultiLevelGridEnvironment::ForEachAgentInCube(const Level& level,
+                                                   const Double3& position,
+                                                   double radius,
+                                                   TLambda&& lambda) const {
+  std::array<uint64_t, 3> lo;
+  std::array<uint64_t, 3> hi;
+  for (int i = 0; i < 3; ++i) {
+    auto min = (position[i] - radius - origin_[i]) / level.box_length;
+    auto max = (position[i] + radius - origin_[i]) / level.box_length;
+    if (max < 0 || min >= level.num_boxes[i]) {
+      return;
+    }
+    lo[i] = min < 0 ? 0 : static_cast<uint64_t>(min);
+    hi[i] = std::min(static_cast<uint64_t>(max), level.num_boxes[i] - 1);
+  }
+  // boxes along the x-axis are stored contiguously
+  for (uint64_t z = lo[2]; z <= hi[2]; ++z) {
+    for (uint64_t y = lo[1]; y <= hi[1]; ++y) {
+      auto start = level.box_start[level.GetBoxIndex({lo[0], y, z})];
+      auto end = level.box_start[level.GetBoxIndex({hi[0], y, z}) + 1];
+      for (uint64_t i = level.offset + start; i < level.offset + end; ++i) {
+        lambda(agents_[i]);
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void MultiLevelGridEnvironment::ForEachNeighbor(
+    Functor<void, Agent*, double>& lambda, const Agent& query,
+    double squared_radius) {
+  const auto& position = query.GetPosition();
+  auto radius = std::sqrt(squared_radius);
+  for (const auto& level : levels_) {
+    ForEachAgentInCube(level, position, radius, [&](Agent* agent) {
+      if (agent == &query) {
+        return;
+      }
+      auto diff = agent->GetPosition() - position;
+      auto squared_distance = diff * diff;
+      if (squared_distance <= squared_radius) {
+        lambda(agent, squared_distance);
+      }
+    });
+  }
+}
+
+// -----------------------------------------------------------------------------
+void MultiLevelGridEnvironment::ForEachNeighborInRange(
+    Functor<void, Agent*, double>& lambda, const Agent& query,
+    double squared_radius, double margin) {
+  // The diameter of other shapes does not bound their extent.
+  if (query.GetShape() != Shape::kSphere) {
+    ForEachNeighbor(lambda, query, squared_radius);
+    return;
+  }
+  const auto& position = query.GetPosition();
+  auto radius = std::sqrt(squared_radius);
+  // range of the query for a neighbor with diameter zero
+  auto query_range = 0.5 * query.GetDiameter() + margin;
+  for (uint64_t l = 0; l < levels_.size(); ++l) {
+    const auto& level = levels_[l];
+    // Spheres of this level are not larger than the box length. The top
+    // level also contains the agents that are not spheres.
+    auto level_radius = radius;
+    if (l + 1 != levels_.size()) {
+      level_radius = std::min(radius, query_range + 0.5 * level.box_length);
+    }
+    ForEachAgentInCube(level, position, level_radius, [&](Agent* agent) {
+      if (agent == &query) {
+        return;
+      }
+      auto diff = agent->GetPosition() - position;
+      auto squared_distance = diff * diff;
+      auto range = radius;
+      if (agent->GetShape() == Shape::kSphere) {
+        range = std::min(radius, query_range + 0.5 * agent->GetDiameter());
+      }
+      if (squared_distance <= range * range) {
+        lambda(agent, squared_distance);
+      }
+    });
+  }
+}
+
+// -----------------------------------------------------------------------------
+struct SortedHandleIteratorMLG : public Iterator<AgentHandle> {
+  const std::vector<AgentHandle>& handles;
+  uint64_t current;
+  uint64_t end;
+
+  SortedHandleIteratorMLG(const std::vector<AgentHandle>& handles,
+                          uint64_t start, uint64_t end)
+      : handles(handles), current(start), end(end) {}
+
+  bool HasNext() const override { return current < end; }
+
+  AgentHandle Next() override { return handles[current++]; }
+};
+
+void MultiLevelGridEnvironment::LoadBalanceInfoMLG::CallHandleIteratorConsumer(
+    uint64_t start, uint64_t end,
+    Functor<void, Iterator<AgentHandle>*>& f) const {
+  end = std::min(end, static_cast<uint64_t>(env_->handles_.size()));
+  if (end <= start) {
+    return;
+  }
+  SortedHandleIteratorMLG it(env_->handles_, start, end);
+  f(&it);
+}
+
+LoadBalanceInfo* MultiLevelGridEnvironment::GetLoadBalanceInfo() {
+  return &lbi_;
+}
+
+Environment::NeighborMutexBuilder*
+MultiLevelGridEnvironment::GetNeighborMutexBuilder() {
+  return &nb_mutex_builder_;
+}
+
+// -----------------------------------------------------------------------------
+std::array<int32_t, 6> MultiLevelGridEnvironment::GetDimensions() const {
+  return grid_dimensions_;
+}
+
+std::array<int32_t, 2> MultiLevelGridEnvironment::GetDimensionThresholds()
+    const {
+  return threshold_dimensions_;
+}
+
+void MultiLevelGridEnvironment::Clear() {
+  int32_t inf = std::numeric_limits<int32_t>::max();
+  grid_dimensions_ = {inf, -inf, inf, -inf, inf, -inf};
+  threshold_dimensions_ = {inf, -inf};
+  largest_object_size_ = 0;
+  largest_object_size_squared_ = 0;
+}
+
+void MultiLevelGridEnvironment::RoundOffGridDimensions(
+    const std::array<double, 6>& grid_dimensions) {
+  grid_dimensions_[0] = floor(grid_dimensions[0]);
+  grid_dimensions_[2] = floor(grid_dimensions[2]);
+  grid_dimensions_[4] = floor(grid_dimensions[4]);
+  grid_dimensions_[1] = ceil(grid_dimensions[1]);
+  grid_dimensions_[3] = ceil(grid_dimensions[3]);
+  grid_dimensions_[5] = ceil(grid_dimensions[5]);
+}
+
+void MultiLevelGridEnvironment::CheckGridGrowth() {
+  // Determine if the grid dimensions have changed (changed in the sense that
+  // the grid has grown outwards)
+  auto min_gd =
+      *std::min_element(grid_dimensions_.begin(), grid_dimensions_.end());
+  auto max_gd =
+      *std::max_element(grid_dimensions_.begin(), grid_dimensions_.end());
+  if (min_gd < threshold_dimensions_[0]) {
+    threshold_dimensions_[0] = min_gd;
+    has_grown_ = true;
+  }
+  if (max_gd > threshold_dimensions_[1]) {
+    threshold_dimensions_[1] = max_gd;
+    has_grown_ = true;
+  }
+}
+
+// -----------------------------------------------------------------------------
+using NeighborMutex = Environment::NeighborMutexBuilder::NeighborMutex;
+using MLGNeighborMutexBuilder =
+    MultiLevelGridEnvironment::MLGNeighborMutexBuilder;
+
+void MLGNeighborMutexBuilder::Update() {
+  const auto& num_boxes = env_->levels_.back().num_boxes;
+  auto size = num_boxes[0] * num_boxes[1] * num_boxes[2];
+  if (mutexes_.size() != size) {
+    mutexes_.resize(size);
+  }
+}
+
+NeighborMutex* MLGNeighborMutexBuilder::GetMutex(uint64_t box_idx) {
+  const auto& top = env_->levels_.back();
+  const auto& num_boxes = top.num_boxes;
+  std::array<uint64_t, 3> coord = {box_idx % num_boxes[0],
+                                   (box_idx / num_boxes[0]) % num_boxes[1],
+                                   box_idx / (num_boxes[0] * num_boxes[1])};
+  std::array<uint64_t, 3> lo;
+  std::array<uint64_t, 3> hi;
+  for (int i = 0; i < 3; ++i) {
+    lo[i] = coord[i] > 0 ? coord[i] - 1 : 0;
+    hi[i] = std::min(coord[i] + 1, num_boxes[i] - 1);
+  }
+  // The indices increase in this loop order, which avoids deadlocks.
+  FixedSizeVector<uint64_t, 27> mutex_indices;
+  for (uint64_t z = lo[2]; z <= hi[2]; ++z) {
+    for (uint64_t y = lo[1]; y <= hi[1]; ++y) {
+      for (uint64_t x = lo[0]; x <= hi[0]; ++x) {
+        mutex_indices.push_back(top.GetBoxIndex({x, y, z}));
+      }
+    }
+  }
+  thread_local MLGNeighborMutex* mutex = new MLGNeighborMutex();
+  mutex->SetMutexIndices(mutex_indices, this);
+  return mutex;
+}
+
+}  // namespace bdm
@@ -0,0 +1,226 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#ifndef CORE_ENVIRONMENT_MULTI_LEVEL_GRID_ENVIRONMENT_H_
+#define CORE_ENVIRONMENT_MULTI_LEVEL_GRID_ENVIRONMENT_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "core/container/agent_flat_idx_map.h"
+#include "core/container/fixed_size_vector.h"
+#include "core/container/math_array.h"
+#include "core/environment/environment.h"
+
+namespace bdm {
+
+/// Neighbor search for agents of very different sizes.\n
+/// A uniform grid uses the size of the largest agent as box length. A few
+/// large agents (e.g. a big soma among thousands of small cells) therefore
+/// increase the number of candidates of every query. This environment
+/// maintains several uniform grids (levels). The box length of the top level
+/// is the size of the largest agent, and each level below halves it. An
+/// agent is inserted into the finest level whose box length is not smaller
+/// than its diameter. Agents that are not spheres are inserted into the top
+/// level, because their diameter does not bound their extent.\n
+/// Queries search each level separately. `ForEachNeighborInRange` limits the
+/// search radius of each level to the distance at which the agents of this
+/// level can interact with the query (see `InteractionForce`).\n
+/// The agents of each box are stored contiguously (counting sort). The
+/// number of levels is limited by `Param::multi_level_grid_levels` and by the
+/// number of boxes of the finest level.
+class MultiLevelGridEnvironment : public Environment {
+ public:
+  MultiLevelGridEnvironment() : lbi_(this), nb_mutex_builder_(this) {}
+  virtual ~MultiLevelGridEnvironment() {}
+
+  void Update() override;
+
+  void ForEachNeighbor(Functor<void, Agent*, double>& lambda,
+                       const Agent& query, double squared_radius) override;
+
+  void ForEachNeighborInRange(Functor<void, Agent*, double>& lambda,
+                              const Agent& query, double squared_radius,
+                              double margin) override;
+
+  std::array<int32_t, 6> GetDimensions() const override;
+
+  std::array<int32_t, 2> GetDimensionThresholds() const override;
+
+  /// Orders the agents by level and box.
+  LoadBalanceInfo* GetLoadBalanceInfo() override;
+
+  /// Locks all agents in the neighborhood of the box with the given index
+  /// in the top level (see `MLGNeighborMutexBuilder`).
+  NeighborMutexBuilder* GetNeighborMutexBuilder() override;
+
+  void Clear() override;
+
+  uint64_t GetNumLevels() const { return levels_.size(); }
+
+  /// Returns the box length of the given level. It is also the largest
+  /// diameter of the spherical agents of this level.
+  double GetBoxLength(uint64_t level) const {
+    return levels_[level].box_length;
+  }
+
+  /// Returns the number of agents in the given level.
+  uint64_t GetNumAgents(uint64_t level) const {
+    return levels_[level].box_start.back();
+  }
+
+  // NeighborMutex ---------------------------------------------------------
+
+  /// Ensures thread-safety if agents modify their neighbors
+  /// (`Param::ThreadSafetyMechanism::kAutomatic`).\n
+  /// The box length of the top level is the size of the largest agent.
+  /// Hence, an agent locks the mutexes of the 27 boxes of the top level
+  /// around it, as in the `UniformGridEnvironment`.\n
+  /// The box index of an agent (`Agent::GetBoxIdx`) is the index of its box
+  /// in the top level, regardless of the level the agent is stored in.
+  class MLGNeighborMutexBuilder : public NeighborMutexBuilder {
+   public:
+    class MLGNeighborMutex : public NeighborMutex {
+     public:
+      virtual ~MLGNeighborMutex() {}
+
+      void lock() override {  // NOLINT
+        for (auto idx : mutex_indices_) {
+          auto& mutex = mutex_builder_->mutexes_[idx].mutex_;
+          // acquire lock (and spin if another thread is holding it)
+          while (mutex.test_and_set(std::memory_order_acquire)) {
+          }
+        }
+      }
+
+      void unlock() override {  // NOLINT
+        for (auto idx : mutex_indices_) {
+          auto& mutex = mutex_builder_->mutexes_[idx].mutex_;
+          mutex.clear(std::memory_order_release);
+        }
+      }
+
+      /// Indices must be sorted and unique to avoid deadlocks.
+      void SetMutexIndices(const FixedSizeVector<uint64_t, 27>& indices,
+                           MLGNeighborMutexBuilder* mutex_builder) {
+        mutex_indices_ = indices;
+        mutex_builder_ = mutex_builder;
+      }
+
+     private:
+      FixedSizeVector<uint64_t, 27> mutex_indices_;
+      MLGNeighborMutexBuilder* mutex_builder_ = nullptr;
+    };
+
+    /// Used to store mutexes in a vector.
+    /// Always creates a new mutex (even for the copy constructor)
+    struct MutexWrapper {
+      MutexWrapper() {}
+      MutexWrapper(const MutexWrapper&) {}
+      std::atomic_flag mutex_ = ATOMIC_FLAG_INIT;
+    };
+
+    explicit MLGNeighborMutexBuilder(MultiLevelGridEnvironment* env)
+        : env_(env) {}
+    virtual ~MLGNeighborMutexBuilder() {}
+
+    void Update();
+
+    NeighborMutex* GetMutex(uint64_t box_idx) override;
+
+   private:
+    MultiLevelGridEnvironment* env_;
+    /// one mutex for each box of the top level
+    std::vector<MutexWrapper> mutexes_;
+  };
+
+ private:
+  /// Iterates over the agents in the order of `handles_`.
+  class LoadBalanceInfoMLG : public LoadBalanceInfo {
+   public:
+    explicit LoadBalanceInfoMLG(MultiLevelGridEnvironment* env) : env_(env) {}
+    virtual ~LoadBalanceInfoMLG() {}
+    void CallHandleIteratorConsumer(
+        uint64_t start, uint64_t end,
+        Functor<void, Iterator<AgentHandle>*>& f) const override;
+
+   private:
+    MultiLevelGridEnvironment* env_;
+  };
+
+  /// One uniform grid
+  struct Level {
+    double box_length = 0;
+    std::array<uint64_t, 3> num_boxes = {{0, 0, 0}};
+    /// Agents of box `i` are stored in `agents_[offset + box_start[i]]` to
+    /// `agents_[offset + box_start[i + 1] - 1]`
+    std::vector<uint64_t> box_start;
+    uint64_t offset = 0;
+
+    uint64_t GetBoxIndex(const std::array<uint64_t, 3>& box_coord) const {
+      return (box_coord[2] * num_boxes[1] + box_coord[1]) * num_boxes[0] +
+             box_coord[0];
+    }
+  };
+
+  /// Level and box of an agent, and its position within the box
+  struct Slot {
+    uint64_t level;
+    uint64_t box;
+    uint64_t rank;
+  };
+
+  std::vector<Level> levels_;
+  /// Agents sorted by level and box index
+  std::vector<Agent*> agents_;
+  /// AgentHandles in the same order as `agents_`
+  std::vector<AgentHandle> handles_;
+  /// Lower corner of the boxes with index zero
+  Double3 origin_ = {0, 0, 0};
+  /// One entry for each agent; indexed by flat index
+  std::vector<Slot> slots_;
+  AgentFlatIdxMap flat_idx_map_;
+  /// Cube which contains all agents
+  /// {x_min, x_max, y_min, y_max, z_min, z_max}
+  std::array<int32_t, 6> grid_dimensions_;
+  /// Stores the min / max dimension value that need to be surpassed in order
+  /// to trigger a diffusion grid change
+  std::array<int32_t, 2> threshold_dimensions_;
+  LoadBalanceInfoMLG lbi_;  //!
+  MLGNeighborMutexBuilder nb_mutex_builder_;  //!
+
+  /// Returns the index of the box of `level` that contains `position`.
+  /// Positions outside the grid are assigned to the closest box.
+  uint64_t GetBoxIndex(const Level& level, const Double3& position) const;
+
+  /// Determines the number of levels and their box lengths.
+  void InitializeLevels(const std::array<double, 6>& dimensions,
+                        double smallest, uint64_t num_agents);
+
+  /// Calls `lambda` for each agent of `level` whose box intersects the cube
+  /// with side length `2 * radius` around `position`.
+  template <typename TLambda>
+  void ForEachAgentInCube(const Level& level, const Double3& position,
+                          double radius, TLambda&& lambda) const;
+
+  void RoundOffGridDimensions(const std::array<double, 6>& grid_dimensions);
+
+  void CheckGridGrowth();
+};
+
+}  // namespace bdm
+
+#endif  // CORE_ENVIRONMENT_MULTI_LEVEL_GRID_ENVIRONMENT_H_
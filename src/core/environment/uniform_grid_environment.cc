@@ -15,9 +15,384 @@
 #include "core/environment/uniform_grid_environment.h"
 #include <morton/morton.h>  // NOLINT
 #include "core/algorithm.h"
+#include "core/util/work_stealing_executor.h"
 
 namespace bdm {
 
+// -----------------------------------------------------------------------------
+void UniformGridEnvironment::ForEachNeighborPair(
+    Functor<void, Agent*, AgentHandle, Agent*, AgentHandle>& lambda) {
+  if (periodic_) {
+    Log::Fatal("UniformGridEnvironment::ForEachNeighborPair",
+               "Iterating over neighbor pairs is not supported if the "
+               "simulation space is periodic.");
+  }
+  // Agents are only stored in the boxes that are not used for padding.
+  if (num_boxes_axis_[0] < 3 || num_boxes_axis_[1] < 3 ||
+      num_boxes_axis_[2] < 3) {
+    return;
+  }
+  const uint64_t ny = num_boxes_axis_[1] - 2;
+  const uint64_t nz = num_boxes_axis_[2] - 2;
+  auto* executor = WorkStealingExecutor::GetInstance();
+  // The half stencil of box (x, y, z) covers rows y and y + 1 of plane z,
+  // and rows y - 1 to y + 1 of plane z + 1. Therefore, two rows do not share
+  // a box if their y coordinates differ by at least three or their z
+  // coordinates by at least two.
+  for (uint64_t color = 0; color < 6; ++color) {
+    const uint64_t y0 = color % 3;
+    const uint64_t z0 = color / 3;
+    const uint64_t rows_y = ny > y0 ? (ny - y0 + 2) / 3 : 0;
+    const uint64_t rows_z = nz > z0 ? (nz - z0 + 1) / 2 : 0;
+    executor->ParallelFor(rows_y * rows_z, 1, [&](uint64_t start,
+                                                  uint64_t end) {
+      for (uint64_t row = start; row < end; ++row) {
+        auto y = 1 + y0 + 3 * (row % rows_y);
+        auto z = 1 + z0 + 2 * (row / rows_y);
+        ForEachNeighborPairInRow(lambda, y, z);
+      }
+    });
+  }
+}
+
+// -----------------------------------------------------------------------------
+void UniformGridEnvironment::ForEachNeighborPairInRow(
+    Functor<void, Agent*, AgentHandle, Agent*, AgentHandle>& lambda,
+    uint64_t y, uint64_t z) {
+  auto* rm = Simulation::GetActive()->GetResourceManager();
+  FixedSizeVector<size_t, 14> stencil;
+  for (uint64_t x = 1; x < num_boxes_axis_[0] - 1; ++x) {
+    auto box_idx = GetBoxIndex(std::array<uint64_t, 3>{x, y, z});
+    const auto* box = &boxes_[box_idx];
+    if (box->IsEmpty(timestamp_)) {
+      continue;
+    }
+    stencil.clear();
+    GetHalfMooreBoxIndices(&stencil, box_idx);
+    for (Box::Iterator it(this, box); !it.IsAtEnd(); ++it) {
+      auto lhs_ah = *it;
+      auto* lhs = rm->GetAgent(lhs_ah);
+      // pairs within the same box
+      auto nb = it;
+      for (++nb; !nb.IsAtEnd(); ++nb) {
+        lambda(lhs, lhs_ah, rm->GetAgent(*nb), *nb);
+      }
+      // pairs with the other boxes of the half stencil
+      for (uint64_t i = 1; i < stencil.size(); ++i) {
+        Box::Iterator rhs(this, &boxes_[stencil[i]]);
+        for (; !rhs.IsAtEnd(); ++rhs) {
+          lambda(lhs, lhs_ah, rm->GetAgent(*rhs), *rhs);
+        }
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void UniformGridEnvironment::SortAgentsIntoBoxes() {
+  auto* sim = Simulation::GetActive();
+  auto* rm = sim->GetResourceManager();
+  auto* param = sim->GetParam();
+
+  // count agents per box
+  box_start_.resize(total_num_boxes_ + 1);
+#pragma omp parallel for
+  for (uint64_t i = 0; i < total_num_boxes_ + 1; ++i) {
+    box_start_[i] = 0;
+  }
+  box_rank_.reserve();
+  CountAgentsPerBoxFunctor count(this);
+  rm->ForEachAgentParallel(param->scheduling_batch_size, count);
+
+#pragma omp parallel for
+  for (uint64_t i = 0; i < total_num_boxes_; ++i) {
+    auto num_agents = box_start_[i + 1];
+    if (num_agents != 0) {
+      auto& box = boxes_[i];
+      box.timestamp_ = timestamp_;
+      box.length_ = num_agents;
+    }
+  }
+
+  // box_start_[0] is zero. Therefore, the inclusive prefix sum turns the
+  // counts into the start index of each box.
+  InPlaceParallelPrefixSum(box_start_, total_num_boxes_ + 1);
+
+  // scatter agent handles
+  sorted_agents_.resize(rm->GetNumAgents());
+  auto scatter = L2F([&](Agent* agent, AgentHandle ah) {
+    auto* soa = rm->GetAgentSoA(ah.GetNumaNode());
+    auto box_idx =
+        soa ? soa->GetBoxIdx(ah.GetElementIdx()) : agent->GetBoxIdx();
+    sorted_agents_[box_start_[box_idx] + box_rank_[ah]] = ah;
+  });
+  rm->ForEachAgentParallel(param->scheduling_batch_size, scatter);
+}
+
+// -----------------------------------------------------------------------------
+bool UniformGridEnvironment::UpdateIncrementally() {
+  auto* sim = Simulation::GetActive();
+  auto* rm = sim->GetResourceManager();
+  auto* param = sim->GetParam();
+  auto* ti = ThreadInfo::GetInstance();
+
+  if (!is_incremental_ || param->compact_uniform_grid ||
+      param->verlet_neighbor_lists ||
+      grid_entries_.size() != static_cast<uint64_t>(ti->GetNumaNodes()) ||
+      !successors_.resize_in_place()) {
+    return false;
+  }
+
+  // Agents must stay inside the boxes that are not used for padding.
+  // In periodic mode, `GetBoxIndex` never assigns agents to these boxes.
+  auto inside = [&](const Double3& position) {
+    if (periodic_) {
+      return true;
+    }
+    for (int i = 0; i < 3; ++i) {
+      auto coord = floor(position[i]) - grid_dimensions_[2 * i];
+      if (coord < box_length_ ||
+          coord >= static_cast<double>(num_boxes_axis_[i] - 1) * box_length_) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  // determine the agents that changed their box
+  grid_changes_.resize(ti->GetMaxThreads());
+  for (auto& changes : grid_changes_) {
+    changes.clear();
+  }
+  double largest = largest_object_size_;
+  bool outside = false;
+  uint64_t num_changes = 0;
+  for (uint64_t n = 0; n < grid_entries_.size(); ++n) {
+    auto& entries = grid_entries_[n];
+    const auto* soa = rm->GetAgentSoA(n);
+    const uint64_t num_agents = rm->GetNumAgents(n);
+    if (entries.size() < num_agents) {
+      entries.resize(num_agents);
+    }
+    const uint64_t num_entries = entries.size();
+#pragma omp parallel for reduction(max : largest) reduction(|| : outside) \
+    reduction(+ : num_changes)
+    for (uint64_t i = 0; i < num_entries; ++i) {
+      const auto& entry = entries[i];
+      AgentUid uid;
+      uint64_t box_idx = kNoBox;
+      if (i < num_agents) {
+        Double3 position;
+        double diameter;
+        if (soa) {
+          uid = soa->GetUid(i);
+          position = soa->GetPosition(i);
+          diameter = soa->GetDiameter(i);
+        } else {
+          auto* agent = rm->GetAgent(AgentHandle(n, i));
+          uid = agent->GetUid();
+          position = agent->GetPosition();
+          diameter = agent->GetDiameter();
+        }
+        largest = std::max(largest, diameter);
+        if (!inside(position)) {
+          outside = true;
+          continue;
+        }
+        box_idx = GetBoxIndex(position);
+      }
+      if (uid != entry.uid || box_idx != entry.box_idx) {
+        grid_changes_[ti->GetMyThreadId()].push_back(
+            {AgentHandle(n, i), box_idx});
+        num_changes++;
+      }
+    }
+  }
+
+  if (outside || num_changes > rm->GetNumAgents() / 2 ||
+      (!is_custom_box_length_ && ceil(largest) > box_length_)) {
+    return false;
+  }
+
+  // move agents; the box locks protect the linked lists
+#pragma omp parallel for schedule(dynamic, 1)
+  for (uint64_t t = 0; t < grid_changes_.size(); ++t) {
+    for (auto& change : grid_changes_[t]) {
+      auto ah = change.first;
+      auto box_idx = change.second;
+      auto& entry = grid_entries_[ah.GetNumaNode()][ah.GetElementIdx()];
+      if (entry.box_idx != kNoBox) {
+        boxes_[entry.box_idx].RemoveObject(ah, &successors_);
+      }
+      entry.box_idx = box_idx;
+      if (box_idx == kNoBox) {
+        continue;
+      }
+      auto* agent = rm->GetAgent(ah);
+      boxes_[box_idx].AddObject(ah, &successors_, this);
+      agent->SetBoxIdx(box_idx);
+      auto* soa = rm->GetAgentSoA(ah.GetNumaNode());
+      if (soa) {
+        soa->SetBoxIdx(ah.GetElementIdx(), box_idx);
+      }
+      entry.uid = agent->GetUid();
+    }
+  }
+  for (uint64_t n = 0; n < grid_entries_.size(); ++n) {
+    grid_entries_[n].resize(rm->GetNumAgents(n));
+  }
+
+  largest_object_size_ = largest;
+  largest_object_size_squared_ = largest * largest;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+void UniformGridEnvironment::BuildVerletLists() {
+  auto* sim = Simulation::GetActive();
+  auto* rm = sim->GetResourceManager();
+  auto* param = sim->GetParam();
+  auto* ti = ThreadInfo::GetInstance();
+
+  verlet_skin_ = param->verlet_skin;
+  verlet_entries_.resize(ti->GetNumaNodes());
+  for (uint64_t n = 0; n < verlet_entries_.size(); ++n) {
+    verlet_entries_[n].resize(rm->GetNumAgents(n));
+  }
+  verlet_neighbors_.resize(ti->GetMaxThreads());
+  for (auto& neighbors : verlet_neighbors_) {
+    neighbors.clear();
+  }
+
+  auto get_position = [&](AgentHandle ah) {
+    auto* soa = rm->GetAgentSoA(ah.GetNumaNode());
+    return soa ? soa->GetPosition(ah.GetElementIdx())
+               : rm->GetAgent(ah)->GetPosition();
+  };
+
+  const double squared_cutoff = box_length_squared_;
+  auto build = L2F([&](Agent* agent, AgentHandle ah) {
+    auto tid = ti->GetMyThreadId();
+    auto& neighbors = verlet_neighbors_[tid];
+    auto& entry = verlet_entries_[ah.GetNumaNode()][ah.GetElementIdx()];
+    const auto position = get_position(ah);
+    entry.uid = agent->GetUid();
+    entry.position = position;
+    entry.begin = neighbors.size();
+    entry.tid = tid;
+
+    FixedSizeVector<const Box*, 27> neighbor_boxes;
+    GetMooreBoxes(&neighbor_boxes, agent->GetBoxIdx());
+    NeighborIterator ni(neighbor_boxes, timestamp_);
+    while (!ni.IsAtEnd()) {
+      auto nah = *ni;
+      ++ni;
+      if (nah == ah) {
+        continue;
+      }
+      if (SquaredEuclideanDistance(position, get_position(nah)) <
+          squared_cutoff) {
+        neighbors.push_back(nah);
+      }
+    }
+    entry.size = neighbors.size() - entry.begin;
+  });
+  rm->ForEachAgentParallel(param->scheduling_batch_size, build);
+  verlet_valid_ = true;
+}
+
+// -----------------------------------------------------------------------------
+bool UniformGridEnvironment::IsVerletListValid() {
+  auto* sim = Simulation::GetActive();
+  auto* rm = sim->GetResourceManager();
+  auto* param = sim->GetParam();
+
+  if (!verlet_valid_ || verlet_skin_ != param->verlet_skin) {
+    return verlet_valid_ = false;
+  }
+  for (uint64_t n = 0; n < verlet_entries_.size(); ++n) {
+    if (rm->GetNumAgents(n) != verlet_entries_[n].size()) {
+      return verlet_valid_ = false;
+    }
+  }
+
+  double max_squared_displacement = 0;
+  double largest = 0;
+  bool reordered = false;
+  for (uint64_t n = 0; n < verlet_entries_.size(); ++n) {
+    const auto& entries = verlet_entries_[n];
+    const auto* soa = rm->GetAgentSoA(n);
+    const uint64_t num_entries = entries.size();
+#pragma omp parallel for reduction(max : max_squared_displacement, largest) \
+    reduction(|| : reordered)
+    for (uint64_t i = 0; i < num_entries; ++i) {
+      const auto& entry = entries[i];
+      AgentUid uid;
+      Double3 position;
+      double diameter;
+      if (soa) {
+        uid = soa->GetUid(i);
+        position = soa->GetPosition(i);
+        diameter = soa->GetDiameter(i);
+      } else {
+        auto* agent = rm->GetAgent(AgentHandle(n, i));
+        uid = agent->GetUid();
+        position = agent->GetPosition();
+        diameter = agent->GetDiameter();
+      }
+      reordered = reordered || uid != entry.uid;
+      max_squared_displacement =
+          std::max(max_squared_displacement,
+                   SquaredEuclideanDistance(position, entry.position));
+      largest = std::max(largest, diameter);
+    }
+  }
+
+  const double half_skin = verlet_skin_ / 2;
+  verlet_valid_ = !reordered &&
+                  max_squared_displacement <= half_skin * half_skin &&
+                  largest <= GetLargestAgentSize();
+  return verlet_valid_;
+}
+
+// -----------------------------------------------------------------------------
+bool UniformGridEnvironment::ForEachVerletNeighbor(
+    Functor<void, Agent*, double>& lambda, const Agent& query,
+    double squared_radius) {
+  auto* rm = Simulation::GetActive()->GetResourceManager();
+  const auto& uid = query.GetUid();
+  if (!rm->ContainsAgent(uid)) {
+    return false;
+  }
+  auto ah = rm->GetAgentHandle(uid);
+  const auto& entry = verlet_entries_[ah.GetNumaNode()][ah.GetElementIdx()];
+  if (entry.uid != uid) {
+    return false;
+  }
+
+  const double max_radius = box_length_ - verlet_skin_;
+  if (squared_radius > max_radius * max_radius) {
+    Log::Fatal("UniformGridEnvironment::ForEachNeighbor",
+               "The requested search radius (", std::sqrt(squared_radius),
+               ") exceeds the box length minus the neighbor list skin (",
+               max_radius, "). The resulting neighborhood would be "
+               "incomplete.");
+  }
+
+  const auto& position = query.GetPosition();
+  const auto* neighbors = verlet_neighbors_[entry.tid].data() + entry.begin;
+  for (uint32_t i = 0; i < entry.size; ++i) {
+    auto nah = neighbors[i];
+    auto* agent = rm->GetAgent(nah);
+    auto* soa = rm->GetAgentSoA(nah.GetNumaNode());
+    const auto& neighbor_position = soa
+                                        ? soa->GetPosition(nah.GetElementIdx())
+                                        : agent->GetPosition();
+    lambda(agent, SquaredEuclideanDistance(position, neighbor_position));
+  }
+  return true;
+}
+
 // -----------------------------------------------------------------------------
 UniformGridEnvironment::LoadBalanceInfoUG::LoadBalanceInfoUG(
     UniformGridEnvironment* grid)
@@ -32,7 +407,12 @@ void UniformGridEnvironment::LoadBalanceInfoUG::Update() {
     return;
   }
 
-  mo_.Update(grid_->num_boxes_axis_);
+  curve_ = Simulation::GetActive()->GetParam()->space_filling_curve;
+  if (curve_ == Param::SpaceFillingCurve::kMorton) {
+    mo_.Update(grid_->num_boxes_axis_);
+  } else if (curve_ == Param::SpaceFillingCurve::kHilbert) {
+    ho_.Update(grid_->num_boxes_axis_);
+  }
 
   AllocateMemory();
   InitializeVectors();
@@ -62,8 +442,18 @@ void UniformGridEnvironment::LoadBalanceInfoUG::InitializeVectors() {
     auto start = tid * chunk;
     auto end = std::min(grid_->total_num_boxes_, start + chunk);
 
-    InitializeVectorFunctor f(grid_, start, sorted_boxes_, cummulated_agents_);
-    mo_.CallMortonIteratorConsumer(start, end - 1, f);
+    if (curve_ == Param::SpaceFillingCurve::kMorton) {
+      InitializeVectorFunctor f(grid_, start, sorted_boxes_,
+                                cummulated_agents_);
+      mo_.CallMortonIteratorConsumer(start, end - 1, f);
+    } else {
+      const bool hilbert = curve_ == Param::SpaceFillingCurve::kHilbert;
+      for (uint64_t i = start; i < end; ++i) {
+        auto* box = grid_->GetBoxPointer(hilbert ? ho_.GetBoxIndex(i) : i);
+        sorted_boxes_[i] = box;
+        cummulated_agents_[i] = box->Size(grid_->timestamp_);
+      }
+    }
   }
 }
 
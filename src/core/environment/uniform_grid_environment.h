@@ -40,12 +40,14 @@
 #include "core/container/math_array.h"
 #include "core/container/parallel_resize_vector.h"
 #include "core/environment/environment.h"
+#include "core/environment/hilbert_order.h"
 #include "core/environment/morton_order.h"
 #include "core/functor.h"
 #include "core/load_balance_info.h"
 #include "core/param/param.h"
 #include "core/resource_manager.h"
 #include "core/util/log.h"
+#include "core/util/math.h"
 #include "core/util/spinlock.h"
 
 namespace bdm {
@@ -121,12 +123,39 @@ class UniformGridEnvironment : public Environment {
       }
     }
 
+    /// @brief      Removes an agent from this box
+    ///
+    /// @param[in]  ah          The agent's handle. Must be in this box.
+    /// @param      successors  The successors
+    void RemoveObject(AgentHandle ah, AgentVector<AgentHandle>* successors) {
+      std::lock_guard<Spinlock> lock_guard(lock_);
+
+      if (start_ == ah) {
+        start_ = (*successors)[ah];
+      } else {
+        auto current = start_;
+        for (uint16_t i = 1; i < length_; ++i) {
+          auto next = (*successors)[current];
+          if (next == ah) {
+            (*successors)[current] = (*successors)[ah];
+            break;
+          }
+          current = next;
+        }
+      }
+      assert(length_ > 0 && "Agent is not in this box");
+      length_--;
+    }
+
     /// An iterator that iterates over the cells in this box
     struct Iterator {
       Iterator(UniformGridEnvironment* grid, const Box* box)
           : grid_(grid), current_value_(box->start_), countdown_(box->length_) {
         if (grid->timestamp_ != box->timestamp_) {
           countdown_ = 0;
+        } else if (grid->is_compact_) {
+          sorted_idx_ = grid->box_start_[box - grid->boxes_.data()];
+          current_value_ = grid->sorted_agents_[sorted_idx_];
         }
       }
 
@@ -135,7 +164,11 @@ class UniformGridEnvironment : public Environment {
       Iterator& operator++() {
         countdown_--;
         if (countdown_ > 0) {
-          current_value_ = grid_->successors_[current_value_];
+          if (grid_->is_compact_) {
+            current_value_ = grid_->sorted_agents_[++sorted_idx_];
+          } else {
+            current_value_ = grid_->successors_[current_value_];
+          }
         }
         return *this;
       }
@@ -148,6 +181,8 @@ class UniformGridEnvironment : public Environment {
       AgentHandle current_value_;
       /// The remain number of agents to consider
       int countdown_ = 0;
+      /// Index of `current_value_` in `sorted_agents_` (compact mode only)
+      uint64_t sorted_idx_ = 0;
     };
 
     Iterator begin() const {  // NOLINT
@@ -247,26 +282,68 @@ class UniformGridEnvironment : public Environment {
     threshold_dimensions_ = {inf, -inf};
     successors_.clear();
     has_grown_ = false;
+    is_incremental_ = false;
   }
 
   struct AssignToBoxesFunctor : public Functor<void, Agent*, AgentHandle> {
     explicit AssignToBoxesFunctor(UniformGridEnvironment* grid) : grid_(grid) {}
 
     void operator()(Agent* agent, AgentHandle ah) override {
-      const auto& position = agent->GetPosition();
+      auto* soa = rm_->GetAgentSoA(ah.GetNumaNode());
+      const auto& position = soa ? soa->GetPosition(ah.GetElementIdx())
+                                 : agent->GetPosition();
       auto idx = grid_->GetBoxIndex(position);
       auto box = grid_->GetBoxPointer(idx);
       box->AddObject(ah, &(grid_->successors_), grid_);
       agent->SetBoxIdx(idx);
+      if (soa) {
+        soa->SetBoxIdx(ah.GetElementIdx(), idx);
+      }
+      if (grid_->is_incremental_) {
+        auto& entries = grid_->grid_entries_[ah.GetNumaNode()];
+        auto& entry = entries[ah.GetElementIdx()];
+        entry.uid = agent->GetUid();
+        entry.box_idx = idx;
+      }
     }
 
    private:
     UniformGridEnvironment* grid_ = nullptr;
+    ResourceManager* rm_ = Simulation::GetActive()->GetResourceManager();
+  };
+
+  /// Used in compact mode to determine the box of each agent and its rank
+  /// within this box (first pass of the counting sort).
+  struct CountAgentsPerBoxFunctor : public Functor<void, Agent*, AgentHandle> {
+    explicit CountAgentsPerBoxFunctor(UniformGridEnvironment* grid)
+        : grid_(grid) {}
+
+    void operator()(Agent* agent, AgentHandle ah) override {
+      auto* soa = rm_->GetAgentSoA(ah.GetNumaNode());
+      const auto& position = soa ? soa->GetPosition(ah.GetElementIdx())
+                                 : agent->GetPosition();
+      auto idx = grid_->GetBoxIndex(position);
+      agent->SetBoxIdx(idx);
+      if (soa) {
+        soa->SetBoxIdx(ah.GetElementIdx(), idx);
+      }
+      // box_start_[idx + 1] counts the agents in box idx
+      auto& counter = grid_->box_start_[idx + 1];
+      uint64_t rank;
+#pragma omp atomic capture
+      rank = counter++;
+      grid_->box_rank_[ah] = rank;
+    }
+
+   private:
+    UniformGridEnvironment* grid_ = nullptr;
+    ResourceManager* rm_ = Simulation::GetActive()->GetResourceManager();
   };
 
   void SetBoxLength(int32_t bl) {
     box_length_ = bl;
     is_custom_box_length_ = true;
+    is_incremental_ = false;
   }
 
   int32_t GetBoxLength() { return box_length_; }
@@ -276,6 +353,23 @@ class UniformGridEnvironment : public Environment {
     auto* rm = Simulation::GetActive()->GetResourceManager();
 
     if (rm->GetNumAgents() != 0) {
+      auto* param = Simulation::GetActive()->GetParam();
+      if (param->verlet_neighbor_lists && IsVerletListValid()) {
+        // No agent has moved far enough to invalidate the neighbor lists.
+        // Keep the grid and the neighbor lists of the last build.
+        has_grown_ = false;
+        updated_incrementally_ = false;
+        return;
+      }
+      updated_incrementally_ =
+          param->incremental_uniform_grid && UpdateIncrementally();
+      if (updated_incrementally_) {
+        // Only agents that changed their box have been moved.
+        // The grid dimensions remain the same.
+        has_grown_ = false;
+        return;
+      }
+
       Clear();
       timestamp_++;
 
@@ -285,9 +379,10 @@ class UniformGridEnvironment : public Environment {
       RoundOffGridDimensions(tmp_dim);
 
       // If the box_length_ is not set manually, we set it to the largest agent
-      // size
+      // size (plus the skin of the neighbor lists)
       if (!is_custom_box_length_) {
-        auto los = ceil(GetLargestAgentSize());
+        auto skin = param->verlet_neighbor_lists ? param->verlet_skin : 0.0;
+        auto los = ceil(GetLargestAgentSize() + skin);
         assert(
             los > 0 &&
             "The largest object size was found to be 0. Please check if your "
@@ -296,7 +391,25 @@ class UniformGridEnvironment : public Environment {
       }
       box_length_squared_ = box_length_ * box_length_;
 
-      for (int i = 0; i < 3; i++) {
+      periodic_ = param->bound_space == Param::BoundSpaceMode::kTorus;
+      if (periodic_) {
+        // The boxes cover the bound space independent of the agent
+        // positions. If the space is not a multiple of the box length, the
+        // last box along each axis also covers the remainder (see
+        // `GetBoxIndex`). Therefore, no box is smaller than the box length.
+        // The bounds are truncated to integers, like the grid dimensions
+        // (and the bounds of periodic diffusion grids).
+        int min = param->min_bound;
+        int max = param->max_bound;
+        period_ = max - min;
+        int num_boxes = std::max((max - min) / box_length_, 1);
+        for (int i = 0; i < 3; i++) {
+          grid_dimensions_[2 * i] = min;
+          grid_dimensions_[2 * i + 1] = min + num_boxes * box_length_;
+        }
+      }
+
+      for (int i = 0; i < 3 && !periodic_; i++) {
         int dimension_length =
             grid_dimensions_[2 * i + 1] - grid_dimensions_[2 * i];
         int r = dimension_length % box_length_;
@@ -340,12 +453,23 @@ class UniformGridEnvironment : public Environment {
         boxes_.resize(total_num_boxes_);
       }
 
-      successors_.reserve();
-
       // Assign agents to boxes
-      auto* param = Simulation::GetActive()->GetParam();
-      AssignToBoxesFunctor functor(this);
-      rm->ForEachAgentParallel(param->scheduling_batch_size, functor);
+      is_compact_ = param->compact_uniform_grid;
+      if (is_compact_) {
+        SortAgentsIntoBoxes();
+      } else {
+        successors_.reserve();
+        is_incremental_ = param->incremental_uniform_grid &&
+                          !param->verlet_neighbor_lists;
+        if (is_incremental_) {
+          grid_entries_.resize(ThreadInfo::GetInstance()->GetNumaNodes());
+          for (uint64_t n = 0; n < grid_entries_.size(); ++n) {
+            grid_entries_[n].resize(rm->GetNumAgents(n));
+          }
+        }
+        AssignToBoxesFunctor functor(this);
+        rm->ForEachAgentParallel(param->scheduling_batch_size, functor);
+      }
       if (param->bound_space) {
         int min = param->min_bound;
         int max = param->max_bound;
@@ -356,7 +480,16 @@ class UniformGridEnvironment : public Environment {
           Param::ThreadSafetyMechanism::kAutomatic) {
         nb_mutex_builder_->Update();
       }
+
+      if (param->verlet_neighbor_lists) {
+        BuildVerletLists();
+      } else {
+        verlet_valid_ = false;
+      }
     } else {
+      verlet_valid_ = false;
+      is_incremental_ = false;
+      updated_incrementally_ = false;
       // There are no agents in this simulation
       auto* param = Simulation::GetActive()->GetParam();
 
@@ -397,28 +530,28 @@ class UniformGridEnvironment : public Environment {
   ///
   inline double SquaredEuclideanDistance(const Double3& pos1,
                                          const Double3& pos2) const {
-    const double dx = pos2[0] - pos1[0];
-    const double dy = pos2[1] - pos1[1];
-    const double dz = pos2[2] - pos1[2];
+    const double dx = Difference(pos2[0], pos1[0]);
+    const double dy = Difference(pos2[1], pos1[1]);
+    const double dz = Difference(pos2[2], pos1[2]);
     return (dx * dx + dy * dy + dz * dz);
   }
 
   inline bool WithinSquaredEuclideanDistance(double squared_radius,
                                              const Double3& pos1,
                                              const Double3& pos2) const {
-    const double dx = pos2[0] - pos1[0];
+    const double dx = Difference(pos2[0], pos1[0]);
     const double dx2 = dx * dx;
     if (dx2 > squared_radius) {
       return false;
     }
 
-    const double dy = pos2[1] - pos1[1];
+    const double dy = Difference(pos2[1], pos1[1]);
     const double dy2_plus_dx2 = dy * dy + dx2;
     if (dy2_plus_dx2 > squared_radius) {
       return false;
     }
 
-    const double dz = pos2[2] - pos1[2];
+    const double dz = Difference(pos2[2], pos1[2]);
     const double distance = dz * dz + dy2_plus_dx2;
     return distance < squared_radius;
   }
@@ -472,6 +605,10 @@ class UniformGridEnvironment : public Environment {
           box_length_, "). The resulting neighborhood would be incomplete.");
     }
 
+    if (verlet_valid_ && ForEachVerletNeighbor(lambda, query, squared_radius)) {
+      return;
+    }
+
     const auto& position = query.GetPosition();
     auto idx = query.GetBoxIdx();
 
@@ -489,12 +626,19 @@ class UniformGridEnvironment : public Environment {
     double z[batch_size] __attribute__((aligned(64)));
     double squared_distance[batch_size] __attribute__((aligned(64)));
 
+    const bool periodic = periodic_;
+    const double period = period_;
     auto process_batch = [&]() {
 #pragma omp simd
       for (uint64_t i = 0; i < size; ++i) {
-        const double dx = x[i] - position[0];
-        const double dy = y[i] - position[1];
-        const double dz = z[i] - position[2];
+        double dx = x[i] - position[0];
+        double dy = y[i] - position[1];
+        double dz = z[i] - position[2];
+        if (periodic) {
+          dx = Math::MinimumImage(dx, period);
+          dy = Math::MinimumImage(dy, period);
+          dz = Math::MinimumImage(dz, period);
+        }
 
         squared_distance[i] = dx * dx + dy * dy + dz * dz;
       }
@@ -505,6 +649,30 @@ class UniformGridEnvironment : public Environment {
       size = 0;
     };
 
+    if (rm->IsAgentSoAEnabled()) {
+      // read neighbor positions from the contiguous per-NUMA arrays
+      // instead of dereferencing each neighbor
+      while (!ni.IsAtEnd()) {
+        auto ah = *ni;
+        ++ni;
+        auto* agent = rm->GetAgent(ah);
+        if (agent != &query) {
+          const auto* soa = rm->GetAgentSoA(ah.GetNumaNode());
+          auto eidx = ah.GetElementIdx();
+          agents[size] = agent;
+          x[size] = soa->GetX()[eidx];
+          y[size] = soa->GetY()[eidx];
+          z[size] = soa->GetZ()[eidx];
+          size++;
+          if (size == batch_size) {
+            process_batch();
+          }
+        }
+      }
+      process_batch();
+      return;
+    }
+
     while (!ni.IsAtEnd()) {
       auto ah = *ni;
       // increment iterator already here to hide memory latency
@@ -560,6 +728,20 @@ class UniformGridEnvironment : public Environment {
     }
   }
 
+  /// Calls `lambda(lhs, lhs_handle, rhs, rhs_handle)` once for each pair of
+  /// agents that are in the same or in adjacent boxes. These are the
+  /// candidates `ForEachNeighbor` passes to its functor. In contrast to
+  /// calling `ForEachNeighbor` for each agent, every pair is visited once
+  /// instead of twice.\n
+  /// Pairs are processed in parallel, but concurrent calls of `lambda` never
+  /// share an agent. Each box is paired with the boxes of its half stencil
+  /// (see `GetHalfMooreBoxIndices`). Rows of boxes along the x-axis are
+  /// processed by one thread and colored such that rows of the same color
+  /// do not share a box of their stencils.\n
+  /// Not supported if the space is periodic (see `IsPeriodic`).
+  void ForEachNeighborPair(
+      Functor<void, Agent*, AgentHandle, Agent*, AgentHandle>& lambda);
+
   /// @brief      Return the box index in the one dimensional array of the box
   ///             that contains the position
   ///
@@ -569,6 +751,19 @@ class UniformGridEnvironment : public Environment {
   ///
   size_t GetBoxIndex(const Double3& position) const {
     std::array<uint64_t, 3> box_coord;
+    if (periodic_) {
+      // Positions outside the bound space (e.g. of agents added during this
+      // iteration) are assigned to the closest box that is not used for
+      // padding.
+      for (int i = 0; i < 3; i++) {
+        auto coord = (floor(position[i]) - grid_dimensions_[2 * i]) /
+                     static_cast<double>(box_length_);
+        auto max = static_cast<double>(num_boxes_axis_[i] - 2);
+        box_coord[i] =
+            static_cast<uint64_t>(std::min(std::max(coord, 1.0), max));
+      }
+      return GetBoxIndex(box_coord);
+    }
     box_coord[0] = (floor(position[0]) - grid_dimensions_[0]) / box_length_;
     box_coord[1] = (floor(position[1]) - grid_dimensions_[2]) / box_length_;
     box_coord[2] = (floor(position[2]) - grid_dimensions_[4]) / box_length_;
@@ -592,6 +787,22 @@ class UniformGridEnvironment : public Environment {
 
   uint64_t GetNumBoxes() const { return boxes_.size(); }
 
+  /// Returns true if neighbor queries are currently answered from the
+  /// neighbor lists. \see `Param::verlet_neighbor_lists`
+  bool HasValidVerletLists() const { return verlet_valid_; }
+
+  /// Returns true if the last call to `Update` only moved the agents that
+  /// changed their box. \see `Param::incremental_uniform_grid`
+  bool WasUpdatedIncrementally() const { return updated_incrementally_; }
+
+  /// Returns true if the grid wraps around at the bounds of the simulation
+  /// space (`Param::BoundSpaceMode::kTorus`). In this case, agents close to
+  /// opposite faces of the space are neighbors, and distances follow the
+  /// minimum image convention.
+  bool IsPeriodic() const { return periodic_; }
+
+  double GetPeriod() const override { return periodic_ ? period_ : 0; }
+
   std::array<uint64_t, 3> GetBoxCoordinates(size_t box_idx) const {
     std::array<uint64_t, 3> box_coord;
     box_coord[2] = box_idx / num_boxes_xy_;
@@ -692,7 +903,10 @@ class UniformGridEnvironment : public Environment {
 
    private:
     UniformGridEnvironment* grid_;
+    /// Curve of the last call to `Update`. \see `Param::space_filling_curve`
+    Param::SpaceFillingCurve curve_ = Param::SpaceFillingCurve::kMorton;
     MortonOrder mo_;
+    HilbertOrder ho_;
     ParallelResizeVector<Box*> sorted_boxes_;
     ParallelResizeVector<uint64_t> cummulated_agents_;
 
@@ -727,6 +941,11 @@ class UniformGridEnvironment : public Environment {
   int32_t box_length_squared_ = 1;
   /// True when the box length was set manually
   bool is_custom_box_length_ = false;
+  /// True if the space is periodic (see `IsPeriodic`)
+  bool periodic_ = false;
+  /// Length of the periodic space along each axis (distance between the
+  /// bounds truncated to integers)
+  double period_ = 0;
   /// Stores the number of Boxes for each axis
   std::array<uint64_t, 3> num_boxes_axis_ = {{0}};
   /// Number of boxes in the xy plane (=num_boxes_axis_[0] * num_boxes_axis_[1])
@@ -739,6 +958,55 @@ class UniformGridEnvironment : public Environment {
   ///     AgentHandle current_element = ...;
   ///     AgentHandle next_element = successors_[current_element];
   AgentVector<AgentHandle> successors_;
+  /// True if agents are stored in `sorted_agents_` instead of the linked
+  /// lists (see `Param::compact_uniform_grid`)
+  bool is_compact_ = false;
+  /// Compact mode: agents of box `i` are stored in
+  /// `sorted_agents_[box_start_[i]]` to
+  /// `sorted_agents_[box_start_[i] + boxes_[i].length_ - 1]`
+  ParallelResizeVector<uint64_t> box_start_;  //!
+  /// Compact mode: agent handles sorted by box index
+  ParallelResizeVector<AgentHandle> sorted_agents_;  //!
+  /// Compact mode: position of each agent within its box
+  AgentVector<uint32_t> box_rank_;  //!
+  /// Neighbor list of one agent (see `Param::verlet_neighbor_lists`).
+  /// The neighbors are stored in `verlet_neighbors_[tid]` from index `begin`
+  /// to `begin + size - 1`.
+  struct VerletEntry {
+    /// Uid of the agent at this AgentHandle when the lists were built
+    AgentUid uid;
+    /// Position of the agent when the lists were built
+    Double3 position;
+    uint64_t begin;
+    uint32_t size;
+    uint32_t tid;
+  };
+  /// Box of an agent after the last update (incremental mode)
+  struct GridEntry {
+    /// Uid of the agent at this AgentHandle
+    AgentUid uid;
+    /// `kNoBox` if the AgentHandle has not been assigned to a box
+    uint64_t box_idx = kNoBox;
+  };
+  static constexpr uint64_t kNoBox = std::numeric_limits<uint64_t>::max();
+  /// True if `grid_entries_` reflect the content of the boxes and the grid
+  /// can be updated incrementally (see `Param::incremental_uniform_grid`)
+  bool is_incremental_ = false;
+  /// True if the last update was incremental
+  bool updated_incrementally_ = false;
+  /// One entry for each agent; indexed by AgentHandle
+  std::vector<std::vector<GridEntry>> grid_entries_;  //!
+  /// Handles that have to be moved to a different box (or removed if the
+  /// box is `kNoBox`); one vector for each thread
+  std::vector<std::vector<std::pair<AgentHandle, uint64_t>>> grid_changes_;  //!
+  /// True if the neighbor lists are up to date
+  bool verlet_valid_ = false;
+  /// Skin distance used to build the current neighbor lists
+  double verlet_skin_ = 0;
+  /// One entry for each agent; indexed by AgentHandle
+  std::vector<std::vector<VerletEntry>> verlet_entries_;  //!
+  /// Neighbor handles; one vector for each thread
+  std::vector<std::vector<AgentHandle>> verlet_neighbors_;  //!
   /// Determines which boxes to search neighbors in (see enum Adjacency)
   Adjacency adjacency_;
   /// Cube which contains all agents
@@ -777,6 +1045,45 @@ class UniformGridEnvironment : public Environment {
     }
   }
 
+  /// Builds the neighbor list of each agent. A list contains all agents
+  /// within `box_length_`, i.e. the largest agent size plus the skin.
+  void BuildVerletLists();
+
+  /// Returns true if the neighbor lists built during the last update can
+  /// be reused. This is the case if no agent has been added, removed or
+  /// reordered, no agent moved more than half the skin, and no agent grew
+  /// beyond the largest agent size of the last build.
+  bool IsVerletListValid();
+
+  /// Calls `lambda` for each entry in the neighbor list of `query`.
+  /// Returns false if `query` has no neighbor list (e.g. it has been created
+  /// during this iteration). In this case the grid must be searched.
+  bool ForEachVerletNeighbor(Functor<void, Agent*, double>& lambda,
+                             const Agent& query, double squared_radius);
+
+  /// Incremental mode: moves agents that changed their box since the last
+  /// update, inserts new agents and removes deleted ones. AgentHandles that
+  /// refer to a different agent than during the last update (e.g. after
+  /// agents have been removed) are treated as removal plus insertion.\n
+  /// Returns false without modifying the boxes if the grid has to be
+  /// rebuilt: an agent left the grid, the box length is too small for the
+  /// largest agent, or more than half of the agents changed.
+  bool UpdateIncrementally();
+
+  /// Calls `lambda` for all pairs of agents of the boxes in row (`y`, `z`)
+  /// and the boxes of their half stencils. \see `ForEachNeighborPair`
+  void ForEachNeighborPairInRow(
+      Functor<void, Agent*, AgentHandle, Agent*, AgentHandle>& lambda,
+      uint64_t y, uint64_t z);
+
+  /// Compact mode: sorts all agents by box index with a parallel counting
+  /// sort. First, the number of agents per box is determined. Second, a
+  /// prefix sum over these counts gives the start index of each box in
+  /// `sorted_agents_`. Finally, agent handles are scattered to their final
+  /// position. In contrast to `AssignToBoxesFunctor` no box locks are
+  /// required and agents of one box are stored contiguously.
+  void SortAgentsIntoBoxes();
+
   void RoundOffGridDimensions(const std::array<double, 6>& grid_dimensions) {
     grid_dimensions_[0] = floor(grid_dimensions[0]);
     grid_dimensions_[2] = floor(grid_dimensions[2]);
@@ -795,6 +1102,14 @@ class UniformGridEnvironment : public Environment {
   ///
   void GetMooreBoxes(FixedSizeVector<const Box*, 27>* neighbor_boxes,
                      size_t box_idx) const {
+    if (periodic_) {
+      FixedSizeVector<uint64_t, 27> box_indices;
+      GetPeriodicMooreBoxIndices(&box_indices, box_idx);
+      for (size_t i = 0; i < box_indices.size(); i++) {
+        neighbor_boxes->push_back(GetBoxPointer(box_indices[i]));
+      }
+      return;
+    }
     neighbor_boxes->push_back(GetBoxPointer(box_idx));
 
     // Adjacent 6 (top, down, left, right, front and back)
@@ -860,6 +1175,10 @@ class UniformGridEnvironment : public Environment {
   ///
   void GetMooreBoxIndices(FixedSizeVector<uint64_t, 27>* box_indices,
                           size_t box_idx) const {
+    if (periodic_) {
+      GetPeriodicMooreBoxIndices(box_indices, box_idx);
+      return;
+    }
     box_indices->push_back(box_idx);
 
     // Adjacent 6 (top, down, left, right, front and back)
@@ -901,6 +1220,40 @@ class UniformGridEnvironment : public Environment {
     }
   }
 
+  /// Periodic version of `GetMooreBoxIndices`. Box coordinates wrap around
+  /// within the boxes that are not used for padding. Each box is added only
+  /// once, even if there are less than three boxes along an axis.
+  void GetPeriodicMooreBoxIndices(FixedSizeVector<uint64_t, 27>* box_indices,
+                                  size_t box_idx) const {
+    auto box_coord = GetBoxCoordinates(box_idx);
+    // Distinct coordinates of the adjacent boxes along each axis. The first
+    // entry is the coordinate of the query box.
+    std::array<FixedSizeVector<uint64_t, 3>, 3> coords;
+    for (int i = 0; i < 3; i++) {
+      const uint64_t n = num_boxes_axis_[i] - 2;
+      const uint64_t c = box_coord[i] - 1;
+      coords[i].push_back(box_coord[i]);
+      if (n > 1) {
+        coords[i].push_back((c + 1) % n + 1);
+      }
+      if (n > 2) {
+        coords[i].push_back((c + n - 1) % n + 1);
+      }
+    }
+    for (size_t z = 0; z < coords[2].size(); z++) {
+      for (size_t y = 0; y < coords[1].size(); y++) {
+        for (size_t x = 0; x < coords[0].size(); x++) {
+          // number of axes along which the box is shifted
+          int shifted = (x != 0) + (y != 0) + (z != 0);
+          if (shifted <= adjacency_ + 1) {
+            box_indices->push_back(GetBoxIndex(std::array<uint64_t, 3>{
+                coords[0][x], coords[1][y], coords[2][z]}));
+          }
+        }
+      }
+    }
+  }
+
   /// Determines current box based on parameter box_idx and adds it together
   /// with half of the surrounding boxes to the vector.
   /// Legend: C = center, N = north, E = east, S = south, W = west, F = front,
@@ -968,6 +1321,12 @@ class UniformGridEnvironment : public Environment {
     neighbor_boxes->push_back(box_idx + num_boxes_xy_ + num_boxes_axis_[0] + 1);
   }
 
+  /// Returns `to - from` along one axis. Follows the minimum image
+  /// convention if the space is periodic.
+  double Difference(double to, double from) const {
+    return periodic_ ? Math::MinimumImage(to - from, period_) : to - from;
+  }
+
   /// @brief      Gets the pointer to the box with the given index
   ///
   /// @param[in]  index  The index of the box
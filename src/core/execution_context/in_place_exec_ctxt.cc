@@ -21,6 +21,7 @@
 #include "core/agent/agent.h"
 #include "core/environment/environment.h"
 #include "core/functor.h"
+#include "core/memory/memory_manager.h"
 #include "core/resource_manager.h"
 #include "core/scheduler.h"
 
@@ -127,10 +128,23 @@ void InPlaceExecutionContext::SetupIterationAll(
     const std::vector<InPlaceExecutionContext*>& all_exec_ctxts) {
   // first iteration might have uncommited changes
   TearDownIterationAll(all_exec_ctxts);
+
+  // agents and behaviors created during this iteration are allocated from
+  // per-thread arenas
+  auto* sim = Simulation::GetActive();
+  auto* mem_mgr = sim->GetMemoryManager();
+  if (mem_mgr && sim->GetParam()->mem_mgr_arena) {
+    mem_mgr->SetArenaEnabled(true);
+  }
 }
 
 void InPlaceExecutionContext::TearDownIterationAll(
     const std::vector<InPlaceExecutionContext*>& all_exec_ctxts) {
+  auto* mem_mgr = Simulation::GetActive()->GetMemoryManager();
+  if (mem_mgr) {
+    mem_mgr->SetArenaEnabled(false);
+  }
+
   // group execution contexts by numa domain
   std::vector<uint64_t> new_agent_per_numa(tinfo_->GetNumaNodes());
   std::vector<uint64_t> thread_offsets(tinfo_->GetMaxThreads());
@@ -318,6 +332,24 @@ void InPlaceExecutionContext::ForEachNeighbor(
   env->ForEachNeighbor(for_each, query, squared_radius);
 }
 
+void InPlaceExecutionContext::ForEachNeighborInRange(
+    Functor<void, Agent*, double>& lambda, const Agent& query,
+    double squared_radius, double margin) {
+  // the cache contains all neighbors within the search radius
+  if (IsNeighborCacheValid(squared_radius)) {
+    ForEachNeighbor(lambda, query, squared_radius);
+    return;
+  }
+
+  auto* env = Simulation::GetActive()->GetEnvironment();
+  auto for_each = L2F([&](Agent* agent, double squared_distance) {
+    if (squared_distance < squared_radius) {
+      lambda(agent, squared_distance);
+    }
+  });
+  env->ForEachNeighborInRange(for_each, query, squared_radius, margin);
+}
+
 Agent* InPlaceExecutionContext::GetAgent(const AgentUid& uid) {
   auto* sim = Simulation::GetActive();
   auto* rm = sim->GetResourceManager();
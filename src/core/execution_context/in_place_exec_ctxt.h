@@ -104,6 +104,13 @@ class InPlaceExecutionContext {
   void ForEachNeighbor(Functor<void, Agent*, double>& lambda,
                        const Agent& query, double squared_radius);
 
+  /// Applies the lambda `lambda` for each neighbor of the given `query`
+  /// agent within the given search radius `squared_radius` that might be in
+  /// range (see `Environment::ForEachNeighborInRange`)
+  void ForEachNeighborInRange(Functor<void, Agent*, double>& lambda,
+                              const Agent& query, double squared_radius,
+                              double margin);
+
   /// Check whether or not the neighbors in `neighbor_cache_` were queried with
   /// the same squared radius (`cached_squared_search_radius_`) as currently
   /// being queried with (`query_squared_radius_`)
@@ -25,17 +25,42 @@
 #include "core/resource_manager.h"
 #include "core/simulation.h"
 #include "core/util/log.h"
+#include "core/util/thread_info.h"
 
 namespace bdm {
 
+/// Calls `function(position, diameter)` for each agent in the order of
+/// `ResourceManager::ForEachAgent`. If `Param::soa_agent_storage` is turned
+/// on, the values are streamed from the structure-of-arrays mirror, which
+/// the agent operations keep in sync.
+template <typename TFunctor>
+static void ForEachPositionAndDiameter(TFunctor&& function) {
+  auto* rm = Simulation::GetActive()->GetResourceManager();
+  if (!rm->IsAgentSoAEnabled()) {
+    rm->ForEachAgent([&](Agent* agent) {
+      function(agent->GetPosition(), agent->GetDiameter());
+    });
+    return;
+  }
+  auto numa_nodes = ThreadInfo::GetInstance()->GetNumaNodes();
+  for (int n = 0; n < numa_nodes; ++n) {
+    const auto* soa = rm->GetAgentSoA(n);
+    const auto* x = soa->GetX();
+    const auto* y = soa->GetY();
+    const auto* z = soa->GetZ();
+    const auto* diameter = soa->GetDiameters();
+    for (uint64_t i = 0; i < soa->size(); ++i) {
+      function(Double3{x[i], y[i], z[i]}, diameter[i]);
+    }
+  }
+}
+
 Exporter::~Exporter() {}
 
 void BasicExporter::ExportIteration(std::string filename, uint64_t iteration) {
   std::ofstream outfile;
   outfile.open(filename);
-  auto* rm = Simulation::GetActive()->GetResourceManager();
-  rm->ForEachAgent([&](Agent* agent) {
-    auto curr_pos = agent->GetPosition();
+  ForEachPositionAndDiameter([&](const Double3& curr_pos, double) {
     outfile << "[" << curr_pos[0] << "," << curr_pos[1] << "," << curr_pos[2]
             << "]" << std::endl;
   });
@@ -56,8 +81,7 @@ void MatlabExporter::ExportIteration(std::string filename, uint64_t iteration) {
   outfile << "CellPos = zeros(" << num_cells << "," << 3 << ");" << std::endl;
 
   uint64_t i = 0;
-  rm->ForEachAgent([&](Agent* agent) {
-    auto curr_pos = agent->GetPosition();
+  ForEachPositionAndDiameter([&](const Double3& curr_pos, double) {
     outfile << "CellPos(" << i++ + 1 << ",1:3) = [" << curr_pos[0] << ","
             << curr_pos[1] << "," << curr_pos[2] << "];" << std::endl;
   });
@@ -178,8 +202,7 @@ void ParaviewExporter::ExportIteration(std::string filename,
   vtu << "            <DataArray type=\"Float64\" NumberOfComponents=\"3\" "
          "format=\"ascii\">"
       << std::endl;
-  rm->ForEachAgent([&](Agent* agent) {
-    auto& coord = agent->GetPosition();
+  ForEachPositionAndDiameter([&](const Double3& coord, double) {
     vtu << ' ' << coord[0] << ' ' << coord[1] << ' ' << coord[2] << std::flush;
   });
   vtu << std::endl;
@@ -211,8 +234,7 @@ void ParaviewExporter::ExportIteration(std::string filename,
   vtu << "            <DataArray type=\"Float64\" Name=\"Diameter\" "
          "NumberOfComponents=\"1\" format=\"ascii\">"
       << std::endl;
-  rm->ForEachAgent([&](Agent* agent) {
-    auto diam = agent->GetDiameter();
+  ForEachPositionAndDiameter([&](const Double3&, double diam) {
     vtu << ' ' << diam << std::flush;
   });
 
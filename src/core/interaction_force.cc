@@ -81,6 +81,12 @@ void InteractionForce::ForceBetweenSpheres(const Agent* sphere_lhs,
   double comp1 = c1[0] - c2[0];
   double comp2 = c1[1] - c2[1];
   double comp3 = c1[2] - c2[2];
+  // the closest image of the neighbor in a periodic space
+  if (period_ > 0) {
+    comp1 = Math::MinimumImage(comp1, period_);
+    comp2 = Math::MinimumImage(comp2, period_);
+    comp3 = Math::MinimumImage(comp3, period_);
+  }
   double center_distance =
       std::sqrt(comp1 * comp1 + comp2 * comp2 + comp3 * comp3);
   // the overlap distance (how much one penetrates in the other)
@@ -109,6 +115,74 @@ void InteractionForce::ForceBetweenSpheres(const Agent* sphere_lhs,
   *result = force2on1;
 }
 
+Double3 InteractionForce::CalculateSphereBatch(const Agent* lhs,
+                                               const double* x,
+                                               const double* y,
+                                               const double* z,
+                                               const double* diameter,
+                                               uint64_t size) const {
+  // see ForceBetweenSpheres for the scalar version of this kernel
+  const double iof_coefficient = 0.15;
+  const double additional_radius = 10.0 * iof_coefficient;
+  const double gamma = 1;  // attraction coeff
+  const double k = 2;      // repulsion coeff
+  const auto& c1 = lhs->GetPosition();
+  const double r1 = 0.5 * lhs->GetDiameter() + additional_radius;
+  // the closest image of each neighbor in a periodic space
+  const bool periodic = period_ > 0;
+  const double period = period_;
+  auto difference = [&](double lhs_coord, double rhs_coord) {
+    double d = lhs_coord - rhs_coord;
+    return periodic ? Math::MinimumImage(d, period) : d;
+  };
+
+  double fx = 0;
+  double fy = 0;
+  double fz = 0;
+  bool coinciding_centers = false;
+#pragma omp simd reduction(+ : fx, fy, fz) reduction(|| : coinciding_centers)
+  for (uint64_t i = 0; i < size; ++i) {
+    const double comp1 = difference(c1[0], x[i]);
+    const double comp2 = difference(c1[1], y[i]);
+    const double comp3 = difference(c1[2], z[i]);
+    const double r2 = 0.5 * diameter[i] + additional_radius;
+    const double center_distance =
+        std::sqrt(comp1 * comp1 + comp2 * comp2 + comp3 * comp3);
+    const double delta = r1 + r2 - center_distance;
+    const double r = (r1 * r2) / (r1 + r2);
+    const bool overlap = delta >= 0;
+    const bool coinciding = center_distance < 0.00000001;
+    // branch-free version of the early exits in ForceBetweenSpheres
+    const double safe_delta = overlap ? delta : 0.0;
+    const double f = k * safe_delta - gamma * std::sqrt(r * safe_delta);
+    const double module =
+        (overlap && !coinciding) ? f / center_distance : 0.0;
+    fx += module * comp1;
+    fy += module * comp2;
+    fz += module * comp3;
+    coinciding_centers = coinciding_centers || (overlap && coinciding);
+  }
+
+  // rare case: avoid a division by 0 if the centers are (almost) at the
+  // same location
+  if (coinciding_centers) {
+    auto* random = Simulation::GetActive()->GetRandom();
+    for (uint64_t i = 0; i < size; ++i) {
+      const double comp1 = difference(c1[0], x[i]);
+      const double comp2 = difference(c1[1], y[i]);
+      const double comp3 = difference(c1[2], z[i]);
+      if (std::sqrt(comp1 * comp1 + comp2 * comp2 + comp3 * comp3) <
+          0.00000001) {
+        auto force2on1 = random->template UniformArray<3>(-3.0, 3.0);
+        fx += force2on1[0];
+        fy += force2on1[1];
+        fz += force2on1[2];
+      }
+    }
+  }
+  return {fx, fy, fz};
+}
+
 void InteractionForce::ForceOnACylinderFromASphere(const Agent* cylinder,
                                                    const Agent* sphere,
                                                    Double4* result) const {
@@ -16,6 +16,7 @@
 #define CORE_INTERACTION_FORCE_H_
 
 #include <array>
+#include <cstdint>
 
 #include "core/container/math_array.h"
 
@@ -29,6 +30,36 @@ class InteractionForce {
   virtual ~InteractionForce() {}
 
   virtual Double4 Calculate(const Agent* lhs, const Agent* rhs) const;
+
+  /// Calculates the sum of the forces that `size` spheres exert on the
+  /// sphere `lhs`. Sphere `i` is described by its center
+  /// `(x[i], y[i], z[i])` and its diameter `diameter[i]`.\n
+  /// Computes the same force as `Calculate` for two spheres, but evaluates
+  /// several pairs per SIMD instruction. The input arrays should be aligned
+  /// to 64 bytes.\n
+  /// Used by `Cell::CalculateDisplacement` if
+  /// `Param::vectorize_sphere_forces` is turned on. Subclasses that change
+  /// the sphere-sphere interaction must override this function as well.
+  virtual Double3 CalculateSphereBatch(const Agent* lhs, const double* x,
+                                       const double* y, const double* z,
+                                       const double* diameter,
+                                       uint64_t size) const;
+
+  /// Returns how far beyond contact two agents interact. Agents with
+  /// diameters `d1` and `d2` do not exert a force on each other if their
+  /// centers are further apart than `0.5 * (d1 + d2) + margin`.\n
+  /// Used to limit the neighbor search of `Cell::CalculateDisplacement`
+  /// (see `Environment::ForEachNeighborInRange`). Subclasses with a longer
+  /// range must override this function.
+  virtual double GetInteractionMargin() const { return 3.0; }
+
+  /// Sets the length of the periodic space along each axis. If it is larger
+  /// than zero, sphere-sphere forces act between the closest periodic images
+  /// of the spheres. Set by `MechanicalForcesOp` at the beginning of each
+  /// step (see `Environment::GetPeriod`).
+  void SetPeriod(double period) { period_ = period; }
+  double GetPeriod() const { return period_; }
+
   virtual InteractionForce* NewCopy() const {
     return new InteractionForce(*this);
   }
@@ -48,6 +79,8 @@ class InteractionForce {
 
   Double4 ComputeForceOfASphereOnASphere(const Double3& c1, double r1,
                                          const Double3& c2, double r2) const;
+
+  double period_ = 0;
 };
 
 }  // namespace bdm
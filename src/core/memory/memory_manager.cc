@@ -16,9 +16,11 @@
 #include <unistd.h>
 #include <algorithm>
 #include <cmath>
+#include <cstddef>
 #include <cstdlib>
 #include <limits>
 #include <mutex>
+#include <new>
 #include "core/util/log.h"
 #include "core/util/string.h"
 
@@ -348,15 +350,28 @@ MemoryManager::MemoryManager(uint64_t aligned_pages_shift, double growth_rate,
   }
 
   allocators_.reserve(num_threads_ * 2 + 100);
+
+  auto numa_nodes = ThreadInfo::GetInstance()->GetNumaNodes();
+  arenas_.resize(num_threads_);
+  arena_blocks_.resize(numa_nodes);
+  arena_locks_.resize(numa_nodes);
 }
 
 MemoryManager::~MemoryManager() {
   for (auto& pair : allocators_) {
     delete pair.second;
   }
+  for (auto& memory : arena_memory_) {
+    numa_free(memory.first, memory.second);
+  }
 }
 
 void* MemoryManager::New(std::size_t size) {
+  if (arena_enabled_) {
+    if (auto* ret = NewFromArena(size)) {
+      return ret;
+    }
+  }
   if (allocators_.Capacity() > num_threads_) {
     auto it = allocators_.find(size);
     if (it != allocators_.end()) {
@@ -393,6 +408,14 @@ void MemoryManager::Delete(void* p) {
   auto page_number = addr >> (page_shift_ + aligned_pages_shift_);
   auto* page_addr = reinterpret_cast<char*>(
       page_number << (page_shift_ + aligned_pages_shift_));
+  if (memory_manager_detail::ArenaBlock::IsArenaBlock(page_addr)) {
+    auto* block =
+        reinterpret_cast<memory_manager_detail::ArenaBlock*>(page_addr);
+    if (block->Release()) {
+      RecycleArenaBlock(block);
+    }
+    return;
+  }
   auto* npa =
       *reinterpret_cast<memory_manager_detail::NumaPoolAllocator**>(page_addr);
   npa->Delete(p);
@@ -400,4 +423,91 @@ void MemoryManager::Delete(void* p) {
 
 void MemoryManager::SetIgnoreDelete(bool value) { ignore_delete_ = value; }
 
+using memory_manager_detail::ArenaBlock;
+using memory_manager_detail::NumaPoolAllocator;
+
+/// Objects in an arena block start after the header. One cache line keeps
+/// the reference counter away from the objects.
+static constexpr uint64_t kArenaHeaderSize = 64;
+static_assert(sizeof(ArenaBlock) <= kArenaHeaderSize,
+              "ArenaBlock does not fit into the header");
+/// Number of arena blocks that are allocated at once
+static constexpr uint64_t kArenaBlocksPerAllocation = 16;
+
+void* MemoryManager::NewFromArena(std::size_t size) {
+  auto* tinfo = ThreadInfo::GetInstance();
+  auto tid = tinfo->GetMyThreadId();
+  if (static_cast<uint64_t>(tid) >= arenas_.size()) {
+    return nullptr;
+  }
+  size = NumaPoolAllocator::RoundUpTo(size, alignof(std::max_align_t));
+  if (size > size_n_pages_ - kArenaHeaderSize) {
+    return nullptr;
+  }
+
+  auto& arena = arenas_[tid];
+  if (arena.block == nullptr ||
+      size > static_cast<uint64_t>(arena.end - arena.top)) {
+    // release the full block; it is reused once all its objects are deleted
+    if (arena.block != nullptr && arena.block->Release()) {
+      RecycleArenaBlock(arena.block);
+    }
+    arena.block = AcquireArenaBlock(tinfo->GetNumaNode(tid));
+    auto* block_start = reinterpret_cast<char*>(arena.block);
+    arena.top = block_start + kArenaHeaderSize;
+    arena.end = block_start + size_n_pages_;
+  }
+  auto* ret = arena.top;
+  arena.top += size;
+  arena.block->references.fetch_add(1, std::memory_order_relaxed);
+  return ret;
+}
+
+ArenaBlock* MemoryManager::AcquireArenaBlock(int nid) {
+  {
+    std::lock_guard<Spinlock> guard(arena_locks_[nid]);
+    auto& blocks = arena_blocks_[nid];
+    if (!blocks.empty()) {
+      auto* block = blocks.back();
+      blocks.pop_back();
+      block->references = 1;
+      return block;
+    }
+  }
+
+  // one additional block to be able to align the blocks to N pages
+  uint64_t size = (kArenaBlocksPerAllocation + 1) * size_n_pages_;
+  void* memory = numa_alloc_onnode(size, nid);
+  if (memory == nullptr) {
+    Log::Fatal("MemoryManager::AcquireArenaBlock", "Allocation failed");
+  }
+  {
+    std::lock_guard<Spinlock> guard(arena_memory_lock_);
+    arena_memory_.push_back({memory, size});
+  }
+
+  auto* start = reinterpret_cast<char*>(NumaPoolAllocator::RoundUpTo(
+      reinterpret_cast<uint64_t>(memory), size_n_pages_));
+  ArenaBlock* ret = nullptr;
+  std::lock_guard<Spinlock> guard(arena_locks_[nid]);
+  for (uint64_t i = 0; i < kArenaBlocksPerAllocation; ++i) {
+    auto* block = new (start + i * size_n_pages_) ArenaBlock();
+    block->tagged_address =
+        reinterpret_cast<uint64_t>(block) | ArenaBlock::kTag;
+    block->references = 1;
+    block->nid = nid;
+    if (i == 0) {
+      ret = block;
+    } else {
+      arena_blocks_[nid].push_back(block);
+    }
+  }
+  return ret;
+}
+
+void MemoryManager::RecycleArenaBlock(ArenaBlock* block) {
+  std::lock_guard<Spinlock> guard(arena_locks_[block->nid]);
+  arena_blocks_[block->nid].push_back(block);
+}
+
 }  // namespace bdm
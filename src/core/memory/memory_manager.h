@@ -15,6 +15,7 @@
 #ifndef CORE_MEMORY_MEMORY_MANAGER_H_
 #define CORE_MEMORY_MEMORY_MANAGER_H_
 
+#include <atomic>
 #include <cassert>
 #include <list>
 #include <utility>
@@ -143,6 +144,40 @@ class PoolAllocator {
   std::vector<NumaPoolAllocator*> numa_allocators_;
 };
 
+/// Header of an N aligned pages memory block that is used by an `Arena`.
+/// Objects of different size are stored consecutively after the header.\n
+/// The block counts the number of objects that have not been deleted yet,
+/// plus one reference held by the arena while it allocates from this block.
+/// Once the count drops to zero, the block can be reused.
+struct ArenaBlock {
+  /// Distinguishes arena blocks from blocks of a `NumaPoolAllocator`.
+  /// Both store their metadata at the beginning of the N aligned pages.
+  static constexpr uint64_t kTag = 1;
+
+  /// Must be the first member. Contains the address of this block with
+  /// the lowest bit set.
+  uint64_t tagged_address;
+  std::atomic<uint64_t> references;
+  int nid;
+
+  static bool IsArenaBlock(void* metadata) {
+    return *static_cast<uint64_t*>(metadata) & kTag;
+  }
+
+  /// Returns true if the last reference has been released.
+  bool Release() {
+    return references.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+};
+
+/// Bump pointer allocator of one thread. Allocates objects of arbitrary size
+/// consecutively from `ArenaBlock`s.
+struct Arena {
+  ArenaBlock* block = nullptr;
+  char* top = nullptr;
+  char* end = nullptr;
+};
+
 }  // namespace memory_manager_detail
 
 class MemoryManager {
@@ -158,6 +193,15 @@ class MemoryManager {
 
   void SetIgnoreDelete(bool value);
 
+  /// If enabled, `New` allocates memory from a per-thread arena instead of
+  /// the pool allocators (see `Param::mem_mgr_arena`). Objects that are
+  /// allocated consecutively by the same thread (e.g. a new agent and
+  /// copies of its behaviors) are stored next to each other.\n
+  /// Must not be called while other threads allocate memory.
+  void SetArenaEnabled(bool value) { arena_enabled_ = value; }
+
+  bool IsArenaEnabled() const { return arena_enabled_; }
+
  private:
   double growth_rate_;
   uint64_t max_mem_per_thread_;
@@ -168,11 +212,30 @@ class MemoryManager {
   uint64_t size_n_pages_;
   uint64_t num_threads_;
   bool ignore_delete_ = false;
+  bool arena_enabled_ = false;
 
   UnorderedFlatmap<std::size_t, memory_manager_detail::PoolAllocator*>
       allocators_;
 
   Spinlock lock_;
+
+  /// One arena for each thread
+  std::vector<memory_manager_detail::Arena> arenas_;
+  /// Unused arena blocks; one vector for each NUMA node
+  std::vector<std::vector<memory_manager_detail::ArenaBlock*>> arena_blocks_;
+  std::vector<Spinlock> arena_locks_;
+  /// Memory regions allocated for arena blocks (start, size)
+  std::vector<std::pair<void*, uint64_t>> arena_memory_;
+  Spinlock arena_memory_lock_;
+
+  /// Allocates `size` bytes from the arena of the calling thread.
+  /// Returns a nullptr if `size` does not fit into an arena block.
+  void* NewFromArena(std::size_t size);
+
+  /// Returns an unused arena block on NUMA node `nid`.
+  memory_manager_detail::ArenaBlock* AcquireArenaBlock(int nid);
+
+  void RecycleArenaBlock(memory_manager_detail::ArenaBlock* block);
 };
 
 }  // namespace bdm
@@ -13,9 +13,11 @@
 // -----------------------------------------------------------------------------
 
 #include "core/model_initializer.h"
+#include "core/diffusion/adi_grid.h"
 #include "core/diffusion/diffusion_grid.h"
 #include "core/diffusion/euler_grid.h"
 #include "core/diffusion/runga_kutta_grid.h"
+#include "core/diffusion/sparse_euler_grid.h"
 #include "core/diffusion/stencil_grid.h"
 
 namespace bdm {
@@ -37,6 +39,12 @@ void ModelInitializer::DefineSubstance(size_t substance_id,
   } else if (param->diffusion_method == "runga-kutta") {
     d_grid = new RungaKuttaGrid(substance_id, substance_name, diffusion_coeff,
                                 decay_constant, resolution);
+  } else if (param->diffusion_method == "adi") {
+    d_grid = new ADIGrid(substance_id, substance_name, diffusion_coeff,
+                         decay_constant, resolution);
+  } else if (param->diffusion_method == "sparse-euler") {
+    d_grid = new SparseEulerGrid(substance_id, substance_name, diffusion_coeff,
+                                 decay_constant, resolution);
   } else {
     Log::Error("ModelInitializer::DefineSubstance", "Diffusion method '",
                param->diffusion_method,
@@ -21,6 +21,7 @@
 
 #include "core/container/inline_vector.h"
 #include "core/diffusion/diffusion_grid.h"
+#include "core/diffusion/euler_grid.h"
 #include "core/environment/environment.h"
 #include "core/operation/operation.h"
 #include "core/operation/operation_registry.h"
@@ -40,7 +41,15 @@ struct DiffusionOp : public StandaloneOperationImpl {
     auto* env = sim->GetEnvironment();
     auto* param = sim->GetParam();
 
+    bool fuse = param->fuse_diffusion_grids &&
+                (param->diffusion_boundary_condition == "closed" ||
+                 param->diffusion_boundary_condition == "open");
+    // co-located Euler grids that are diffused in one sweep
+    std::vector<std::vector<EulerGrid*>> fused_grids;
+
     rm->ForEachDiffusionGrid([&](DiffusionGrid* dg) {
+      // Apply the concentration changes of this step (deferred mode)
+      dg->ApplyDeposits();
       // Update the diffusion grid dimension if the environment dimensions
       // have changed. If the space is bound, we do not need to update the
       // dimensions, because these should not be changing anyway
@@ -48,11 +57,30 @@ struct DiffusionOp : public StandaloneOperationImpl {
           param->bound_space == Param::BoundSpaceMode::kOpen) {
         dg->Update();
       }
+      auto* euler_grid = dynamic_cast<EulerGrid*>(dg);
+      // the fused sweep performs exactly one step of each grid
+      if (fuse && euler_grid != nullptr && !dg->IsFixedSubstance() &&
+          dg->GetUpdateFrequency() == 1 && dg->CalculateTimeStep() == 1) {
+        for (auto& group : fused_grids) {
+          if (group[0]->IsColocated(*euler_grid)) {
+            group.push_back(euler_grid);
+            return;
+          }
+        }
+        fused_grids.push_back({euler_grid});
+        return;
+      }
       dg->Diffuse();
-      if (param->calculate_gradients) {
+      if (param->calculate_gradients && dg->UpdatedInLastStep()) {
         dg->CalculateGradient();
       }
     });
+
+    for (auto& group : fused_grids) {
+      EulerGrid::DiffuseFused(group,
+                              param->diffusion_boundary_condition == "closed",
+                              param->calculate_gradients);
+    }
   }
 };
 
@@ -0,0 +1,110 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#include "core/operation/load_balancing_op.h"
+#include <atomic>
+#include <cstdlib>
+#include "core/environment/environment.h"
+#include "core/param/param.h"
+#include "core/util/work_stealing_executor.h"
+
+namespace bdm {
+
+// -----------------------------------------------------------------------------
+void LoadBalancingOp::operator()() {
+  auto* sim = Simulation::GetActive();
+  auto threshold = sim->GetParam()->adaptive_load_balancing_threshold;
+  if (threshold > 0 && !IsLayoutDegraded(threshold)) {
+    return;
+  }
+  sim->GetResourceManager()->LoadBalance();
+  balanced_ = true;
+  reference_distance_ = -1;
+}
+
+// -----------------------------------------------------------------------------
+bool LoadBalancingOp::IsLayoutDegraded(double threshold) {
+  if (!balanced_) {
+    return true;
+  }
+  // The environment is out of date directly after a rebalance. Therefore,
+  // the reference value is taken at the next invocation.
+  auto distance = MeasureNeighborMemoryDistance();
+  if (reference_distance_ < 0) {
+    reference_distance_ = distance;
+    return false;
+  }
+  return distance - reference_distance_ > threshold;
+}
+
+// -----------------------------------------------------------------------------
+struct CountDistantNeighbors : public Functor<void, Agent*, double> {
+  Agent* query;
+  uint64_t distant = 0;
+  uint64_t total = 0;
+
+  explicit CountDistantNeighbors(Agent* query) : query(query) {}
+
+  void operator()(Agent* neighbor, double) override {
+    if (neighbor == query) {
+      return;
+    }
+    auto t = reinterpret_cast<int64_t>(query);
+    auto l = reinterpret_cast<int64_t>(neighbor);
+    if (static_cast<uint64_t>(std::llabs(t - l)) >
+        LoadBalancingOp::kNeighborMemoryDistance) {
+      distant++;
+    }
+    total++;
+  }
+};
+
+// -----------------------------------------------------------------------------
+double LoadBalancingOp::MeasureNeighborMemoryDistance() {
+  auto* sim = Simulation::GetActive();
+  auto* rm = sim->GetResourceManager();
+  auto num_agents = rm->GetNumAgents();
+  if (num_agents == 0) {
+    return 0;
+  }
+  auto stride = (num_agents + kMaxSamples - 1) / kMaxSamples;
+  auto* env = sim->GetEnvironment();
+  auto squared_radius = env->GetLargestAgentSizeSquared();
+
+  std::atomic<uint64_t> distant(0);
+  std::atomic<uint64_t> total(0);
+  WorkStealingExecutor::GetInstance()->ParallelForNuma(
+      [&](int nid) { return (rm->GetNumAgents(nid) + stride - 1) / stride; },
+      64, [&](uint64_t nid, uint64_t start, uint64_t end) {
+        uint64_t local_distant = 0;
+        uint64_t local_total = 0;
+        for (uint64_t i = start; i < end; ++i) {
+          auto* agent = rm->GetAgent(AgentHandle(nid, i * stride));
+          CountDistantNeighbors count(agent);
+          // query the environment directly; the neighbor cache of the
+          // execution context belongs to the agent that is being processed
+          env->ForEachNeighbor(count, *agent, squared_radius);
+          local_distant += count.distant;
+          local_total += count.total;
+        }
+        distant += local_distant;
+        total += local_total;
+      });
+  if (total == 0) {
+    return 0;
+  }
+  return static_cast<double>(distant) / total;
+}
+
+}  // namespace bdm
@@ -16,6 +16,7 @@
 #define CORE_OPERATION_LOAD_BALANCING_OP_H_
 
 #include "core/operation/operation.h"
+#include "core/operation/operation_registry.h"
 #include "core/resource_manager.h"
 #include "core/simulation.h"
 
@@ -23,14 +24,33 @@ namespace bdm {
 
 /// A operation that balances the agents among the available NUMA
 /// domains in order to minimize crosstalk. This operation invalidates the
-/// AgentHandles in the ResourceManager
+/// AgentHandles in the ResourceManager\n
+/// If `Param::adaptive_load_balancing_threshold` is larger than zero, the
+/// agents are only rebalanced if their memory layout degraded since the last
+/// rebalance.
 struct LoadBalancingOp : public StandaloneOperationImpl {
   BDM_OP_HEADER(LoadBalancingOp);
 
-  void operator()() override {
-    auto* rm = Simulation::GetActive()->GetResourceManager();
-    rm->LoadBalance();
-  }
+  void operator()() override;
+
+  /// Returns the fraction of neighbor pairs whose agents are stored more
+  /// than `kNeighborMemoryDistance` bytes apart. Only every n-th agent is
+  /// evaluated, such that at most `kMaxSamples` agents are considered.\n
+  /// Requires an up to date environment.
+  static double MeasureNeighborMemoryDistance();
+
+  static constexpr uint64_t kNeighborMemoryDistance = 4096;
+  static constexpr uint64_t kMaxSamples = 10000;
+
+ private:
+  /// Result of `MeasureNeighborMemoryDistance` after the last rebalance.
+  /// Negative if no measurement has been taken since then.
+  double reference_distance_ = -1;
+  /// False until the first rebalance
+  bool balanced_ = false;
+
+  /// Returns true if the agents should be rebalanced.
+  bool IsLayoutDegraded(double threshold);
 };
 
 }  // namespace bdm
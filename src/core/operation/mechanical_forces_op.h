@@ -18,10 +18,14 @@
 #include <array>
 #include <cmath>
 #include <limits>
+#include <memory>
 #include <vector>
 
 #include "core/agent/agent.h"
+#include "core/agent/cell.h"
+#include "core/container/agent_vector.h"
 #include "core/environment/environment.h"
+#include "core/environment/uniform_grid_environment.h"
 #include "core/interaction_force.h"
 #include "core/operation/bound_space_op.h"
 #include "core/operation/operation.h"
@@ -34,7 +38,11 @@
 
 namespace bdm {
 
-/// Defines the 3D physical interactions between physical objects
+/// Defines the 3D physical interactions between physical objects.\n
+/// If `Param::symmetric_forces` is turned on, the operation runs in two
+/// phases. `SetUp` calculates the forces between all pairs of cells, and
+/// `operator()` turns the sum of these forces into the displacement of each
+/// cell.
 class MechanicalForcesOp : public AgentOperationImpl {
   BDM_OP_HEADER(MechanicalForcesOp);
 
@@ -73,6 +81,65 @@ class MechanicalForcesOp : public AgentOperationImpl {
     force_ = force;
   }
 
+  void SetUp() override {
+    pair_forces_valid_ = false;
+    auto* sim = Simulation::GetActive();
+    auto* param = sim->GetParam();
+    force_->SetPeriod(sim->GetEnvironment()->GetPeriod());
+    auto* grid = dynamic_cast<UniformGridEnvironment*>(sim->GetEnvironment());
+    // neighbor pairs are not available if the space is periodic
+    if (!param->symmetric_forces || grid == nullptr ||
+        param->bound_space == Param::BoundSpaceMode::kTorus) {
+      return;
+    }
+    auto* rm = sim->GetResourceManager();
+    if (!pair_forces_) {
+      pair_forces_.reset(new AgentVector<PairForce>());
+    }
+    pair_forces_->reserve();
+    auto reset = L2F([&](Agent* agent, AgentHandle ah) {
+      auto& entry = (*pair_forces_)[ah];
+      entry.force = {0, 0, 0};
+      entry.is_cell = agent->GetShape() == Shape::kSphere &&
+                      dynamic_cast<Cell*>(agent) != nullptr;
+    });
+    rm->ForEachAgentParallel(param->scheduling_batch_size, reset);
+
+    // Concurrent calls never share an agent. Hence, no locks are required.
+    auto* force = force_;
+    // same search radius as in `operator()`
+    auto squared_radius = grid->GetLargestAgentSizeSquared();
+    auto add_pair_force = L2F([&](Agent* lhs, AgentHandle lhs_ah, Agent* rhs,
+                                  AgentHandle rhs_ah) {
+      // static agents are not moved (see `operator()`)
+      if (lhs->IsStatic() && rhs->IsStatic()) {
+        return;
+      }
+      auto diff = lhs->GetPosition() - rhs->GetPosition();
+      if (diff * diff >= squared_radius) {
+        return;
+      }
+      auto& lhs_entry = (*pair_forces_)[lhs_ah];
+      auto& rhs_entry = (*pair_forces_)[rhs_ah];
+      if (lhs_entry.is_cell) {
+        auto f = force->Calculate(lhs, rhs);
+        lhs_entry.force += {f[0], f[1], f[2]};
+        if (rhs_entry.is_cell) {
+          rhs_entry.force -= {f[0], f[1], f[2]};
+          return;
+        }
+      }
+      if (rhs_entry.is_cell) {
+        auto f = force->Calculate(rhs, lhs);
+        rhs_entry.force += {f[0], f[1], f[2]};
+      }
+    });
+    grid->ForEachNeighborPair(add_pair_force);
+    pair_forces_valid_ = true;
+  }
+
+  void TearDown() override { pair_forces_valid_ = false; }
+
   void operator()(Agent* agent) override {
     auto* sim = Simulation::GetActive();
     auto* scheduler = sim->GetScheduler();
@@ -97,8 +164,19 @@ class MechanicalForcesOp : public AgentOperationImpl {
       last_time_run_[tid] = current_time;
     }
 
-    const auto& displacement =
-        agent->CalculateDisplacement(force_, squared_radius_, delta_time_[tid]);
+    Double3 displacement;
+    const PairForce* entry = nullptr;
+    if (pair_forces_valid_) {
+      auto ah = sim->GetResourceManager()->GetAgentHandle(agent->GetUid());
+      entry = &(*pair_forces_)[ah];
+    }
+    if (entry != nullptr && entry->is_cell) {
+      displacement = bdm_static_cast<Cell*>(agent)->DisplacementFromForce(
+          entry->force, delta_time_[tid]);
+    } else {
+      displacement = agent->CalculateDisplacement(force_, squared_radius_,
+                                                  delta_time_[tid]);
+    }
     agent->ApplyDisplacement(displacement);
     if (param->bound_space) {
       ApplyBoundingBox(agent, param->bound_space, param->min_bound,
@@ -107,11 +185,23 @@ class MechanicalForcesOp : public AgentOperationImpl {
   }
 
  private:
+  /// Sum of the forces that the neighbors exert on an agent
+  struct PairForce {
+    Double3 force;
+    /// True if `force` contains all interactions of this agent
+    bool is_cell;
+  };
+
   InteractionForce* force_ = nullptr;
   double squared_radius_ = 0;
   std::vector<double> last_time_run_;
   std::vector<double> delta_time_;
   std::vector<uint64_t> last_iteration_;
+  /// One entry for each agent (see `Param::symmetric_forces`)
+  std::unique_ptr<AgentVector<PairForce>> pair_forces_;
+  /// True between `SetUp` and `TearDown` if the pair forces have been
+  /// calculated
+  bool pair_forces_valid_ = false;
 };
 
 }  // namespace bdm
@@ -244,6 +244,11 @@ void MechanicalForcesOpCuda::SetUp() {
         "MechanicalForcesOpCuda::operator()",
         "MechanicalForcesOpCuda only works with UniformGridEnvironement.");
   }
+  if (sim->GetParam()->compact_uniform_grid) {
+    Log::Fatal("MechanicalForcesOpCuda::operator()",
+               "MechanicalForcesOpCuda does not support "
+               "Param::compact_uniform_grid.");
+  }
 
   auto num_numa_nodes = ThreadInfo::GetInstance()->GetNumaNodes();
   std::vector<AgentHandle::ElementIdx_t> offset(num_numa_nodes);
@@ -60,6 +60,11 @@ void MechanicalForcesOpOpenCL::operator()() {
         "MechanicalForcesOpOpenCL::operator()",
         "MechanicalForcesOpOpenCL only works with UniformGridEnvironement.");
   }
+  if (param->compact_uniform_grid) {
+    Log::Fatal("MechanicalForcesOpOpenCL::operator()",
+               "MechanicalForcesOpOpenCL does not support "
+               "Param::compact_uniform_grid.");
+  }
 
   // Check the number of NUMA domains on the system. Currently only 1 is
   // supported for GPU execution.
@@ -169,6 +169,31 @@ void AssignMappedDataArrayMode(const std::shared_ptr<cpptoml::table>& config,
   }
 }
 
+// -----------------------------------------------------------------------------
+void AssignSpaceFillingCurve(const std::shared_ptr<cpptoml::table>& config,
+                             Param* param) {
+  const std::string config_key = "performance.space_filling_curve";
+  if (config->contains_qualified(config_key)) {
+    auto value = config->get_qualified_as<std::string>(config_key);
+    if (!value) {
+      return;
+    }
+    auto str_value = *value;
+    if (str_value == "morton") {
+      param->space_filling_curve = Param::SpaceFillingCurve::kMorton;
+    } else if (str_value == "hilbert") {
+      param->space_filling_curve = Param::SpaceFillingCurve::kHilbert;
+    } else if (str_value == "row-major") {
+      param->space_filling_curve = Param::SpaceFillingCurve::kRowMajor;
+    } else {
+      Log::Fatal("Param",
+                 Concat("Parameter space_filling_curve was set to an invalid "
+                        "value (",
+                        str_value, ")."));
+    }
+  }
+}
+
 // -----------------------------------------------------------------------------
 void AssignBoundSpaceMode(const std::shared_ptr<cpptoml::table>& config,
                           Param* param) {
@@ -202,13 +227,18 @@ void Param::AssignFromConfig(const std::shared_ptr<cpptoml::table>& config) {
 
   // simulation group
   BDM_ASSIGN_CONFIG_VALUE(random_seed, "simulation.random_seed");
+  BDM_ASSIGN_CONFIG_VALUE(use_counter_rng, "simulation.use_counter_rng");
   BDM_ASSIGN_CONFIG_VALUE(output_dir, "simulation.output_dir");
   BDM_ASSIGN_CONFIG_VALUE(environment, "simulation.environment");
   BDM_ASSIGN_CONFIG_VALUE(nanoflann_depth, "simulation.nanoflann_depth");
   BDM_ASSIGN_CONFIG_VALUE(unibn_bucketsize, "simulation.unibn_bucketsize");
+  BDM_ASSIGN_CONFIG_VALUE(multi_level_grid_levels,
+                          "simulation.multi_level_grid_levels");
   BDM_ASSIGN_CONFIG_VALUE(backup_file, "simulation.backup_file");
   BDM_ASSIGN_CONFIG_VALUE(restore_file, "simulation.restore_file");
   BDM_ASSIGN_CONFIG_VALUE(backup_interval, "simulation.backup_interval");
+  BDM_ASSIGN_CONFIG_VALUE(async_backup, "simulation.async_backup");
+  BDM_ASSIGN_CONFIG_VALUE(sharded_backup, "simulation.sharded_backup");
   BDM_ASSIGN_CONFIG_VALUE(simulation_time_step, "simulation.time_step");
   BDM_ASSIGN_CONFIG_VALUE(simulation_max_displacement,
                           "simulation.max_displacement");
@@ -217,6 +247,14 @@ void Param::AssignFromConfig(const std::shared_ptr<cpptoml::table>& config) {
   BDM_ASSIGN_CONFIG_VALUE(diffusion_boundary_condition,
                           "simulation.diffusion_boundary_condition");
   BDM_ASSIGN_CONFIG_VALUE(diffusion_method, "simulation.diffusion_method");
+  BDM_ASSIGN_CONFIG_VALUE(non_cubic_diffusion_grid,
+                          "simulation.non_cubic_diffusion_grid");
+  BDM_ASSIGN_CONFIG_VALUE(scale_diffusion_with_time_step,
+                          "simulation.scale_diffusion_with_time_step");
+  BDM_ASSIGN_CONFIG_VALUE(trilinear_diffusion_sampling,
+                          "simulation.trilinear_diffusion_sampling");
+  BDM_ASSIGN_CONFIG_VALUE(sparse_diffusion_threshold,
+                          "simulation.sparse_diffusion_threshold");
   BDM_ASSIGN_CONFIG_VALUE(calculate_gradients,
                           "simulation.calculate_gradients");
   AssignBoundSpaceMode(config, this);
@@ -317,6 +355,8 @@ void Param::AssignFromConfig(const std::shared_ptr<cpptoml::table>& config) {
                           "performance.scheduling_batch_size");
   BDM_ASSIGN_CONFIG_VALUE(detect_static_agents,
                           "performance.detect_static_agents");
+  BDM_ASSIGN_CONFIG_VALUE(skip_static_agents,
+                          "performance.skip_static_agents");
   BDM_ASSIGN_CONFIG_VALUE(cache_neighbors, "performance.cache_neighbors");
   BDM_ASSIGN_CONFIG_VALUE(
       agent_uid_defragmentation_low_watermark,
@@ -331,13 +371,38 @@ void Param::AssignFromConfig(const std::shared_ptr<cpptoml::table>& config) {
                           "performance.mem_mgr_growth_rate");
   BDM_ASSIGN_CONFIG_VALUE(mem_mgr_max_mem_per_thread,
                           "performance.mem_mgr_max_mem_per_thread");
+  BDM_ASSIGN_CONFIG_VALUE(mem_mgr_arena, "performance.mem_mgr_arena");
   BDM_ASSIGN_CONFIG_VALUE(minimize_memory_while_rebalancing,
                           "performance.minimize_memory_while_rebalancing");
+  AssignSpaceFillingCurve(config, this);
+  BDM_ASSIGN_CONFIG_VALUE(adaptive_load_balancing_threshold,
+                          "performance.adaptive_load_balancing_threshold");
+  BDM_ASSIGN_CONFIG_VALUE(adaptive_load_balancing_interval,
+                          "performance.adaptive_load_balancing_interval");
+  BDM_ASSIGN_CONFIG_VALUE(soa_agent_storage, "performance.soa_agent_storage");
+  BDM_ASSIGN_CONFIG_VALUE(compact_uniform_grid,
+                          "performance.compact_uniform_grid");
+  BDM_ASSIGN_CONFIG_VALUE(incremental_uniform_grid,
+                          "performance.incremental_uniform_grid");
+  BDM_ASSIGN_CONFIG_VALUE(verlet_neighbor_lists,
+                          "performance.verlet_neighbor_lists");
+  BDM_ASSIGN_CONFIG_VALUE(verlet_skin, "performance.verlet_skin");
+  BDM_ASSIGN_CONFIG_VALUE(kd_tree_skin, "performance.kd_tree_skin");
+  BDM_ASSIGN_CONFIG_VALUE(vectorize_sphere_forces,
+                          "performance.vectorize_sphere_forces");
+  BDM_ASSIGN_CONFIG_VALUE(symmetric_forces, "performance.symmetric_forces");
+  BDM_ASSIGN_CONFIG_VALUE(fuse_diffusion_grids,
+                          "performance.fuse_diffusion_grids");
+  BDM_ASSIGN_CONFIG_VALUE(deferred_secretion,
+                          "performance.deferred_secretion");
   AssignMappedDataArrayMode(config, this);
 
   // development group
   BDM_ASSIGN_CONFIG_VALUE(statistics, "development.statistics");
   BDM_ASSIGN_CONFIG_VALUE(debug_numa, "development.debug_numa");
+  BDM_ASSIGN_CONFIG_VALUE(profiling, "development.profiling");
+  BDM_ASSIGN_CONFIG_VALUE(profiling_hardware_counters,
+                          "development.profiling_hardware_counters");
   BDM_ASSIGN_CONFIG_VALUE(show_simulation_step,
                           "development.show_simulation_step");
   BDM_ASSIGN_CONFIG_VALUE(simulation_step_freq,
@@ -72,6 +72,8 @@ struct Param {
   /// The pseudo random number generator (prng) of each thread will be
   /// initialized as follows:
   /// `prng[tid].SetSeed(random_seed * (tid + 1));`\n
+  /// It is also the key of the counter-based generators returned by
+  /// `Simulation::GetCounterRng`.\n
   /// Default value: `4357`\n
   /// TOML config file:
   ///
@@ -79,6 +81,21 @@ struct Param {
   ///     random_seed = 4357
   uint64_t random_seed = 4357;
 
+  /// If true, `Cell::Divide` draws the volume ratio and the axis of division
+  /// from counter-based random number generators keyed by the new agent
+  /// (see `Agent::GetRngKey`), instead of the thread local generators.
+  /// Together with `Simulation::GetCounterRng` in user-defined behaviors,
+  /// cell divisions are then reproducible independent of the number of
+  /// threads. Other built-in random numbers (e.g. the forces between agents
+  /// at the same position, neurite growth or the model initializers) are
+  /// still drawn from the thread local generators.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [simulation]
+  ///     use_counter_rng = false
+  bool use_counter_rng = false;
+
   /// List of default operation names that should not be scheduled by default
   /// Default value: `{}`\n
   /// TOML config file:
@@ -104,7 +121,7 @@ struct Param {
 
   /// The method used to query the environment of a simulation object.
   /// Default value: `"uniform_grid"`\n
-  /// Other allowed values: `"kd_tree", "octree"`\n
+  /// Other allowed values: `"kd_tree", "octree", "multi_level_grid"`\n
   /// TOML config file:
   ///
   ///     [simulation]
@@ -129,6 +146,16 @@ struct Param {
   ///     unibn_bucketsize = 16
   uint32_t unibn_bucketsize = 16;
 
+  /// The maximum number of levels of the multi level grid if it's set as the
+  /// environment (see Param::environment). Fewer levels are used if the
+  /// smallest agent does not require them.\n
+  /// Default value: `4`\n
+  /// TOML config file:
+  ///
+  ///     [simulation]
+  ///     multi_level_grid_levels = 4
+  uint32_t multi_level_grid_levels = 4;
+
   /// If set to true, BioDynaMo will automatically delete all contents
   /// inside `Param::output_dir` at the beginning of the simulation.
   /// Use with caution, especially in combination with `Param::output_dir`
@@ -162,6 +189,38 @@ struct Param {
   ///     backup_interval = 1800  # backup every half an hour
   uint32_t backup_interval = 1800;
 
+  /// Write backups in the background.\n
+  /// At the end of a step, the process is forked. The child process holds a
+  /// copy-on-write snapshot of the simulation and writes the backup file,
+  /// while the simulation continues in the parent process. The simulation
+  /// only stalls for the duration of `fork`. Pages are only duplicated if
+  /// the simulation modifies them while the backup is being written.\n
+  /// At most one backup is written at a time. If the previous backup has
+  /// not been finished, the next one is postponed to the end of the
+  /// following step. Custom streamers must not use OpenMP or other threads,
+  /// because the child process only contains the calling thread.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [simulation]
+  ///     async_backup = false
+  bool async_backup = false;
+
+  /// Split backups into a main file and agent shards.\n
+  /// The main file (`backup_file`) contains the simulation without its
+  /// agents. The agents of each NUMA node are divided into one contiguous
+  /// chunk per thread. Each chunk is written to a separate shard file
+  /// (`<backup_file>.<step>.shard<i>`) with one ROOT `TTree` per agent type,
+  /// whose data members are stored as separate columns. Shards are written
+  /// and read in parallel. Restore detects the format automatically.\n
+  /// Custom streamers of agents must be thread-safe if this option is used.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [simulation]
+  ///     sharded_backup = false
+  bool sharded_backup = false;
+
   /// Time between two simulation steps, in hours.
   /// Default value: `0.01`\n
   /// TOML config file:
@@ -191,7 +250,11 @@ struct Param {
     /// The dimensions of this cube are determined by parameter
     /// `min_bound` and `max_bound`.\n
     /// Agents that move outside the cube are moved back in on the opposite
-    /// side.
+    /// side.\n
+    /// The `UniformGridEnvironment` finds neighbors across opposite faces of
+    /// the cube, and forces between spheres use the closest periodic image
+    /// of the neighbor. Use `diffusion_boundary_condition = "periodic"` for
+    /// substances.
     kTorus
   };
 
@@ -221,7 +284,10 @@ struct Param {
   ///     max_bound = 100
   double max_bound = 100;
 
-  /// Define the boundary condition of the diffusion grid [open, closed]\n
+  /// Define the boundary condition of the diffusion grid
+  /// [open, closed, periodic]\n
+  /// The periodic boundary condition matches `BoundSpaceMode::kTorus` and is
+  /// only supported by the "euler" diffusion method.\n
   /// Default value: `"open"`\n
   /// TOML config file:
   ///
@@ -230,7 +296,10 @@ struct Param {
   std::string diffusion_boundary_condition = "open";
 
   /// A string for determining diffusion type within the simulation space.
-  /// current inputs include "euler", "stencil" and Runga Kutta ("runga-kutta")
+  /// current inputs include "euler", "stencil", Runga Kutta ("runga-kutta")
+  /// the unconditionally stable alternating direction implicit scheme
+  /// ("adi", see `ADIGrid`) and the block-sparse Euler scheme
+  /// ("sparse-euler", see `SparseEulerGrid`)
   /// Default value: `"euler"`\n
   /// TOML config file:
   ///
@@ -240,6 +309,55 @@ struct Param {
 
   std::string diffusion_method = "euler";
 
+  /// If false, diffusion grids are cube shaped and span the largest extent
+  /// of the environment along each axis. If true, each axis of a diffusion
+  /// grid only spans the extent of the environment along this axis. The
+  /// resolution of the grid then applies to the longest axis; the other axes
+  /// use the same box length and therefore fewer boxes. This saves memory
+  /// and computation for flat or elongated domains.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [simulation]
+  ///     non_cubic_diffusion_grid = false
+  bool non_cubic_diffusion_grid = false;
+
+  /// If false, each diffusion update advances the substances by one time
+  /// unit, independent of `simulation_time_step`. If true, it advances them
+  /// by `simulation_time_step` (times the update frequency of the substance,
+  /// see `DiffusionGrid::SetUpdateFrequency`). In both cases the update is
+  /// split into as many sub-steps as the stability limit of the diffusion
+  /// method requires (see `DiffusionGrid::SetTimeStep`).\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [simulation]
+  ///     scale_diffusion_with_time_step = false
+  bool scale_diffusion_with_time_step = false;
+
+  /// If false, concentrations and gradients are sampled from the box that
+  /// contains the queried position. If true, they are interpolated
+  /// trilinearly between the eight surrounding grid points. Interpolation
+  /// gives accurate values on coarser grids.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [simulation]
+  ///     trilinear_diffusion_sampling = false
+  bool trilinear_diffusion_sampling = false;
+
+  /// Diffusion grids of type `SparseEulerGrid` (`diffusion_method =
+  /// "sparse-euler"`) only store and update the tiles of the grid whose
+  /// maximum concentration is above this threshold, and their neighbors.
+  /// The substance left in a tile that falls below the threshold is
+  /// discarded.\n
+  /// Default value: `1e-9`\n
+  /// TOML config file:
+  ///
+  ///     [simulation]
+  ///     sparse_diffusion_threshold = 1e-9
+  double sparse_diffusion_threshold = 1e-9;
+
   /// Calculate the diffusion gradient for each substance.\n
   /// TOML config file:
   /// Default value: `true`\n
@@ -433,6 +551,21 @@ struct Param {
   ///     detect_static_agents = false
   bool detect_static_agents = false;
 
+  /// Agent operations only process agents that are not static, instead of
+  /// visiting every agent and skipping static ones in each operation.
+  /// The resource manager keeps the set of active agents for each NUMA
+  /// node and updates it incrementally: agents that become static leave
+  /// the set, new agents and agents woken up by a neighbor
+  /// (`Agent::PropagateStaticness`) join it.\n
+  /// Behaviors of static agents are not executed.
+  /// Has no effect if `detect_static_agents` is turned off.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     skip_static_agents = false
+  bool skip_static_agents = false;
+
   /// Neighbors of an agent can be cached so to avoid consecutive
   /// searches. This of course only makes sense if there is more than one
   /// `ForEachNeighbor*` operation.\n
@@ -502,6 +635,20 @@ struct Param {
   ///     mem_mgr_max_mem_per_thread = 131073
   uint64_t mem_mgr_max_mem_per_thread = 131073;
 
+  /// Agents and behaviors that are created during an iteration are
+  /// allocated from a per-thread arena of the BioDynaMo memory manager.
+  /// A new agent and the copies of its behaviors are therefore stored next
+  /// to each other. Arena memory blocks are reused once all objects in them
+  /// have been deleted. Hence, simulations in which only a small fraction
+  /// of the agents created in the same iteration survive, might use more
+  /// memory. Has no effect if `use_bdm_mem_mgr` is turned off.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     mem_mgr_arena = false
+  bool mem_mgr_arena = false;
+
   /// This parameter is used inside `ResourceManager::LoadBalance`.
   /// If it is set to true, the function will reuse existing memory to rebalance
   /// agents to NUMA nodes. (A small amount of additional memory
@@ -516,6 +663,184 @@ struct Param {
   ///     minimize_memory_while_rebalancing = true
   bool minimize_memory_while_rebalancing = true;
 
+  /// SpaceFillingCurve options:
+  ///   `kMorton`:   Z-order curve. \n
+  ///   `kHilbert`:  Hilbert curve. Consecutive boxes are always neighbors,
+  ///                which gives better locality for elongated domains.\n
+  ///   `kRowMajor`: Boxes are visited in x, y, z order.
+  enum SpaceFillingCurve { kMorton = 0, kHilbert, kRowMajor };
+
+  /// The curve along which `ResourceManager::LoadBalance` sorts the agents if
+  /// `UniformGridEnvironment` is used.\n
+  /// Possible values: morton, hilbert, row-major\n
+  /// Default value: `morton`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     space_filling_curve = "morton"
+  Param::SpaceFillingCurve space_filling_curve = SpaceFillingCurve::kMorton;
+
+  /// If larger than zero, operation "load balancing" is executed every
+  /// `adaptive_load_balancing_interval` iterations, but only rebalances the
+  /// agents if their memory layout degraded. The layout is measured as the
+  /// fraction of neighbor pairs whose agents are further apart in memory
+  /// than one page (see `LoadBalancingOp::MeasureNeighborMemoryDistance`).
+  /// A rebalance is triggered once this fraction exceeds the value measured
+  /// after the last rebalance by more than this threshold.\n
+  /// If zero, the frequency of operation "load balancing" determines when
+  /// agents are rebalanced.\n
+  /// Default value: `0`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     adaptive_load_balancing_threshold = 0
+  double adaptive_load_balancing_threshold = 0;
+
+  /// Number of iterations between two memory layout measurements.
+  /// \see `adaptive_load_balancing_threshold`\n
+  /// Default value: `10`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     adaptive_load_balancing_interval = 10
+  uint64_t adaptive_load_balancing_interval = 10;
+
+  /// Mirror the most frequently accessed agent attributes (position,
+  /// diameter, uid, box index and static flag) in contiguous per-NUMA arrays
+  /// inside the ResourceManager (see `AgentSoA`). Neighbor search and
+  /// exporters can then stream over these arrays instead of dereferencing
+  /// each agent. The agent operations write the attributes of an agent back
+  /// to the mirror once they have processed it. Agents that are modified
+  /// outside of agent operations must be written back with
+  /// `ResourceManager::UpdateAgentSoA`; `Scheduler::Simulate` does this
+  /// before the first step.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     soa_agent_storage = false
+  bool soa_agent_storage = false;
+
+  /// Build the `UniformGridEnvironment` with a parallel counting sort that
+  /// stores the agents of each box contiguously, instead of inserting each
+  /// agent into a per-box linked list protected by a spinlock.
+  /// Neighbor searches then iterate over plain index ranges.\n
+  /// This mode is not supported by the GPU implementations of the
+  /// mechanical forces operation.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     compact_uniform_grid = false
+  bool compact_uniform_grid = false;
+
+  /// Update the `UniformGridEnvironment` incrementally. Instead of inserting
+  /// all agents into the grid at every iteration, only agents that changed
+  /// their box, and agents that have been added or removed, are moved.
+  /// The grid is rebuilt if an agent leaves the grid, if the box length
+  /// has to be increased, or if most agents changed (e.g. after load
+  /// balancing). Has no effect if `compact_uniform_grid` or
+  /// `verlet_neighbor_lists` is turned on.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     incremental_uniform_grid = false
+  bool incremental_uniform_grid = false;
+
+  /// Keep a neighbor list for each agent across iterations
+  /// (`UniformGridEnvironment` only). The lists contain all agents within
+  /// the largest agent size plus `verlet_skin`. They, and the grid, are only
+  /// rebuilt if an agent moved more than half the skin since the last build,
+  /// if agents have been added, removed or reordered, or if an agent grew
+  /// beyond the largest agent size of the last build.\n
+  /// Benefits simulations in which agents barely move
+  /// (see also `simulation_max_displacement`).\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     verlet_neighbor_lists = false
+  bool verlet_neighbor_lists = false;
+
+  /// Skin distance of the neighbor lists. \see `verlet_neighbor_lists`\n
+  /// A larger skin reduces the number of rebuilds, but increases the size of
+  /// the neighbor lists and grid boxes.\n
+  /// Default value: `3.0`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     verlet_skin = 3.0
+  double verlet_skin = 3.0;
+
+  /// Reuse the tree of the `KDTreeEnvironment` as long as no agent moved more
+  /// than `kd_tree_skin` since the last rebuild, and no agents have been
+  /// added or removed. In between, the neighbor search enlarges the search
+  /// radius by the largest displacement and filters the candidates with the
+  /// current positions. `0` rebuilds the tree at every iteration.\n
+  /// Default value: `0`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     kd_tree_skin = 0
+  double kd_tree_skin = 0;
+
+  /// Evaluate the mechanical interaction between a cell and its spherical
+  /// neighbors in batches, using SIMD instructions
+  /// (see `InteractionForce::CalculateSphereBatch`).\n
+  /// Custom `InteractionForce` implementations that override `Calculate`
+  /// for spheres must also override `CalculateSphereBatch` before this
+  /// option is turned on.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     vectorize_sphere_forces = false
+  bool vectorize_sphere_forces = false;
+
+  /// Calculate the mechanical force between two cells once per pair and
+  /// apply it with opposite signs to both cells (Newton's third law),
+  /// instead of calculating it from both sides.\n
+  /// The forces are calculated for all cells before any agent is moved.
+  /// Therefore, displacements are based on the positions and diameters at
+  /// the beginning of the iteration. Interactions with agents that are not
+  /// cells (e.g. neurite elements) are still calculated by each agent.
+  /// Pairs of static agents are skipped.\n
+  /// Requires the `UniformGridEnvironment`; other environments ignore this
+  /// option. Custom `InteractionForce` implementations must be symmetric
+  /// between spheres, and cells must not override `CalculateDisplacement`.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     symmetric_forces = false
+  bool symmetric_forces = false;
+
+  /// Diffuse all co-located substances that use the Euler method
+  /// (`diffusion_method = "euler"`) in one sweep over the grid and calculate
+  /// their gradients in the same sweep (see `EulerGrid::DiffuseFused`).
+  /// The gradients are then calculated from the concentrations before the
+  /// diffusion step instead of after it.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     fuse_diffusion_grids = false
+  bool fuse_diffusion_grids = false;
+
+  /// If true, `DiffusionGrid::ChangeConcentrationBy` does not modify the
+  /// concentrations immediately. Each thread records the changes in a private
+  /// buffer instead, and the buffers are applied before the next diffusion
+  /// step (see `DiffusionGrid::ApplyDeposits`). This removes the lock per
+  /// box from secretion and concentration reads. Changes only become visible
+  /// after they have been applied.\n
+  /// Default value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [performance]
+  ///     deferred_secretion = false
+  bool deferred_secretion = false;
+
   /// MappedDataArrayMode options:
   ///   `kZeroCopy`: access agent data directly only if it is
   ///                requested. \n
@@ -557,6 +882,32 @@ struct Param {
   ///     debug_numa = false
   bool debug_numa = false;
 
+  /// Records the wall time of each operation per thread with nanosecond
+  /// resolution, and the load imbalance between threads during the
+  /// agent operations.\n
+  /// If set to true, a summary is printed at the end of the simulation and
+  /// all events are written to `profile.json` in the output directory
+  /// (Chrome trace format, open with chrome://tracing or
+  /// https://ui.perfetto.dev).\n
+  /// \see `Profiler`
+  /// Default Value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [development]
+  ///     profiling = false
+  bool profiling = false;
+
+  /// Records the number of cycles and instructions of each profiled
+  /// operation with `perf_event_open`. Only has an effect if
+  /// `profiling` is turned on and the kernel allows access to the
+  /// performance counters (see `/proc/sys/kernel/perf_event_paranoid`).\n
+  /// Default Value: `false`\n
+  /// TOML config file:
+  ///
+  ///     [development]
+  ///     profiling_hardware_counters = false
+  bool profiling_hardware_counters = false;
+
   /// Display the current simulation step in the terminal output
   /// Default value: `true`\n
   /// TOML config file:
@@ -610,7 +961,7 @@ struct Param {
   static std::unordered_map<ParamGroupUid, std::unique_ptr<ParamGroup>>
       registered_groups_;
   std::unordered_map<ParamGroupUid, ParamGroup*> groups_;
-  BDM_CLASS_DEF_NV(Param, 1);
+  BDM_CLASS_DEF_NV(Param, 2);
 };
 
 }  // namespace bdm
@@ -61,6 +61,7 @@ struct Ubrng {
 template <typename TBaseRm>
 void RandomizedRm<TBaseRm>::EndOfIteration() {
   TBaseRm::EndOfIteration();
+  this->active_agents_valid_ = false;
   // shuffle
 #pragma omp parallel for schedule(static, 1)
   for (uint64_t n = 0; n < this->agents_.size(); ++n) {
@@ -79,6 +80,8 @@ void RandomizedRm<TBaseRm>::EndOfIteration() {
     this->uid_ah_map_.Insert(a->GetUid(), ah);
   });
   TBaseRm::ForEachAgentParallel(update_agent_map);
+  // agents have been reordered
+  TBaseRm::UpdateAgentSoA();
 }
 
 }  // namespace bdm
@@ -20,10 +20,12 @@
 #include "core/algorithm.h"
 #include "core/container/shared_data.h"
 #include "core/environment/environment.h"
+#include "core/scheduler.h"
 #include "core/simulation.h"
 #include "core/util/partition.h"
 #include "core/util/plot_memory_layout.h"
 #include "core/util/timing.h"
+#include "core/util/work_stealing_executor.h"
 
 namespace bdm {
 
@@ -35,11 +37,15 @@ ResourceManager::ResourceManager() {
   }
   agents_.resize(numa_num_configured_nodes());
   agents_lb_.resize(numa_num_configured_nodes());
+  woken_agents_.resize(thread_info_->GetMaxThreads() + 1);
 
   auto* param = Simulation::GetActive()->GetParam();
   if (param->export_visualization || param->insitu_visualization) {
     type_index_ = new TypeIndex();
   }
+  if (param->soa_agent_storage) {
+    soa_.resize(numa_num_configured_nodes());
+  }
 }
 
 ResourceManager::~ResourceManager() {
@@ -82,6 +88,30 @@ void ResourceManager::ForEachAgentParallel(
   }
 }
 
+void ResourceManager::UpdateAgentSoA() {
+  if (!IsAgentSoAEnabled()) {
+    return;
+  }
+  for (uint64_t n = 0; n < agents_.size(); ++n) {
+    soa_[n].resize(agents_[n].size());
+  }
+#pragma omp parallel
+  {
+    auto tid = thread_info_->GetMyThreadId();
+    auto nid = thread_info_->GetNumaNode(tid);
+    auto& numa_agents = agents_[nid];
+    auto& numa_soa = soa_[nid];
+
+    uint64_t start = 0;
+    uint64_t end = 0;
+    Partition(numa_agents.size(), thread_info_->GetThreadsInNumaNode(nid),
+              thread_info_->GetNumaThreadId(tid), &start, &end);
+    for (uint64_t i = start; i < end; ++i) {
+      numa_soa.Set(i, *numa_agents[i]);
+    }
+  }
+}
+
 template <typename TFunctor>
 struct ForEachAgentParallelFunctor : public Functor<void, Agent*, AgentHandle> {
   TFunctor& functor_;
@@ -110,92 +140,161 @@ void ResourceManager::ForEachAgentParallel(
   chunk = (num_agents / thread_info_->GetMaxThreads()) / (factor + 1);
   chunk = chunk >= 1 ? chunk : 1;
 
-  // use dynamic scheduling
+  // use dynamic scheduling and work stealing
   // Unfortunately openmp's built in functionality can't be used, since
   // threads belong to different numa domains and thus operate on
   // different containers
-  auto numa_nodes = thread_info_->GetNumaNodes();
-  auto max_threads = omp_get_max_threads();
-  std::vector<uint64_t> num_chunks_per_numa(numa_nodes);
-  for (int n = 0; n < numa_nodes; n++) {
-    auto correction = agents_[n].size() % chunk == 0 ? 0 : 1;
-    num_chunks_per_numa[n] = agents_[n].size() / chunk + correction;
-  }
-
-  std::vector<std::atomic<uint64_t>*> counters(max_threads, nullptr);
-  std::vector<uint64_t> max_counters(max_threads);
-  for (int thread_cnt = 0; thread_cnt < max_threads; thread_cnt++) {
-    uint64_t current_nid = thread_info_->GetNumaNode(thread_cnt);
-
-    auto correction =
-        num_chunks_per_numa[current_nid] %
-                    thread_info_->GetThreadsInNumaNode(current_nid) ==
-                0
-            ? 0
-            : 1;
-    uint64_t num_chunks_per_thread =
-        num_chunks_per_numa[current_nid] /
-            thread_info_->GetThreadsInNumaNode(current_nid) +
-        correction;
-    auto start =
-        num_chunks_per_thread * thread_info_->GetNumaThreadId(thread_cnt);
-    auto end = std::min(num_chunks_per_numa[current_nid],
-                        start + num_chunks_per_thread);
-
-    counters[thread_cnt] = new std::atomic<uint64_t>(start);
-    max_counters[thread_cnt] = end;
-  }
-
-#pragma omp parallel
-  {
-    auto tid = omp_get_thread_num();
-    auto nid = thread_info_->GetNumaNode(tid);
-
-    // thread private variables (compilation error with
-    // firstprivate(chunk, numa_node_) with some openmp versions clause)
-    auto p_numa_nodes = thread_info_->GetNumaNodes();
-    auto p_max_threads = omp_get_max_threads();
-    auto p_chunk = chunk;
-    assert(thread_info_->GetNumaNode(tid) == numa_node_of_cpu(sched_getcpu()));
-
-    // dynamic scheduling
-    uint64_t start = 0;
-    uint64_t end = 0;
-
-    // this loop implements work stealing from other NUMA nodes if there
-    // are imbalances. Each thread starts with its NUMA domain. Once, it
-    // is finished the thread looks for tasks on other domains
-    for (int n = 0; n < p_numa_nodes; n++) {
-      int current_nid = (nid + n) % p_numa_nodes;
-      for (int thread_cnt = 0; thread_cnt < p_max_threads; thread_cnt++) {
-        uint64_t current_tid = (tid + thread_cnt) % p_max_threads;
-        if (current_nid != thread_info_->GetNumaNode(current_tid)) {
-          continue;
+  // measure the busy time of each thread if the profiler asks for it
+  auto* profiler = Simulation::GetActive()->GetScheduler()->GetProfiler();
+  bool profile = profiler->InParallelRegion();
+  auto* executor = WorkStealingExecutor::GetInstance();
+  executor->ParallelForNuma(
+      [&](int nid) { return agents_[nid].size(); }, chunk,
+      [&](uint64_t nid, uint64_t start, uint64_t end) {
+        int64_t chunk_start = profile ? profiler->Now() : 0;
+        auto& numa_agents = agents_[nid];
+        for (uint64_t i = start; i < end; ++i) {
+          auto* a = numa_agents[i];
+          if (!filter || (filter && (*filter)(a))) {
+            function(a, AgentHandle(nid, i));
+          }
+        }
+        if (profile) {
+          profiler->AddBusyTime(profiler->Now() - chunk_start);
         }
+      });
+}
 
-        auto& numa_agents = agents_[current_nid];
-        uint64_t old_count = (*(counters[current_tid]))++;
-        while (old_count < max_counters[current_tid]) {
-          start = old_count * p_chunk;
-          end = std::min(static_cast<uint64_t>(numa_agents.size()),
-                         start + p_chunk);
-
-          for (uint64_t i = start; i < end; ++i) {
-            auto* a = numa_agents[i];
-            if (!filter || (filter && (*filter)(a))) {
-              function(a, AgentHandle(current_nid, i));
-            }
+void ResourceManager::ForEachActiveAgentParallel(
+    uint64_t chunk, Functor<void, Agent*, AgentHandle>& function,
+    Functor<bool, Agent*>* filter) {
+  if (active_agents_.size() !=
+      static_cast<uint64_t>(thread_info_->GetNumaNodes())) {
+    UpdateActiveAgents();
+  }
+  // adapt chunk size
+  auto num_agents = GetNumActiveAgents();
+  uint64_t factor = (num_agents / thread_info_->GetMaxThreads()) / chunk;
+  chunk = (num_agents / thread_info_->GetMaxThreads()) / (factor + 1);
+  chunk = chunk >= 1 ? chunk : 1;
+
+  auto* profiler = Simulation::GetActive()->GetScheduler()->GetProfiler();
+  bool profile = profiler->InParallelRegion();
+  auto* executor = WorkStealingExecutor::GetInstance();
+  executor->ParallelForNuma(
+      [&](int nid) { return active_agents_[nid].size(); }, chunk,
+      [&](uint64_t nid, uint64_t start, uint64_t end) {
+        int64_t chunk_start = profile ? profiler->Now() : 0;
+        auto& numa_agents = agents_[nid];
+        auto& numa_active = active_agents_[nid];
+        for (uint64_t i = start; i < end; ++i) {
+          auto idx = numa_active[i];
+          auto* a = numa_agents[idx];
+          if (!filter || (filter && (*filter)(a))) {
+            function(a, AgentHandle(nid, idx));
           }
+        }
+        if (profile) {
+          profiler->AddBusyTime(profiler->Now() - chunk_start);
+        }
+      });
+}
 
-          old_count = (*(counters[current_tid]))++;
+void ResourceManager::UpdateActiveAgents() {
+  auto numa_nodes = thread_info_->GetNumaNodes();
+  if (active_agents_.size() != static_cast<uint64_t>(numa_nodes)) {
+    active_agents_valid_ = false;
+  }
+  for (uint64_t n = 0; active_agents_valid_ && n < agents_.size(); ++n) {
+    // agents might have been removed without `RemoveAgents`
+    active_agents_valid_ = agents_[n].size() >= active_agents_num_[n];
+  }
+  active_agents_.resize(numa_nodes);
+  active_agents_num_.resize(numa_nodes);
+
+  // An agent stays active if it will not be static in this iteration or if
+  // it has to wake up its neighbors. Inactive agents are not visited by
+  // `UpdateStaticnessOp`. Therefore, their staticness is updated here.
+  auto is_active = [](Agent* agent) {
+    if (!agent->GetStaticnessNextTimestep() ||
+        agent->GetPropagateStaticness()) {
+      return true;
+    }
+    agent->UpdateStaticness();
+    return false;
+  };
+
+  std::vector<uint8_t> keep;
+  if (!active_agents_valid_) {
+    // rebuild: visit all agents
+    for (int n = 0; n < numa_nodes; ++n) {
+      auto& numa_agents = agents_[n];
+      auto& numa_active = active_agents_[n];
+      keep.resize(numa_agents.size());
+#pragma omp parallel for
+      for (uint64_t i = 0; i < numa_agents.size(); ++i) {
+        keep[i] = is_active(numa_agents[i]);
+      }
+      numa_active.clear();
+      for (uint64_t i = 0; i < numa_agents.size(); ++i) {
+        if (keep[i]) {
+          numa_active.push_back(i);
+        }
+      }
+    }
+  } else {
+    // agents that joined the set; one vector per NUMA node
+    std::vector<std::vector<AgentHandle::ElementIdx_t>> joined(numa_nodes);
+    for (auto& thread_woken : woken_agents_) {
+      for (auto& uid : thread_woken) {
+        if (uid_ah_map_.Contains(uid)) {
+          auto ah = uid_ah_map_[uid];
+          joined[ah.GetNumaNode()].push_back(ah.GetElementIdx());
+        }
+      }
+    }
+    for (int n = 0; n < numa_nodes; ++n) {
+      auto& numa_agents = agents_[n];
+      auto& numa_active = active_agents_[n];
+      keep.resize(numa_active.size());
+#pragma omp parallel for
+      for (uint64_t i = 0; i < numa_active.size(); ++i) {
+        keep[i] = is_active(numa_agents[numa_active[i]]);
+      }
+      uint64_t num_kept = 0;
+      for (uint64_t i = 0; i < numa_active.size(); ++i) {
+        if (keep[i]) {
+          numa_active[num_kept++] = numa_active[i];
         }
-      }  // work stealing loop numa_nodes_
-    }    // work stealing loop  threads
+      }
+      numa_active.resize(num_kept);
+
+      // new agents have been appended to `agents_[n]`
+      auto& numa_joined = joined[n];
+      for (uint64_t i = active_agents_num_[n]; i < numa_agents.size(); ++i) {
+        numa_joined.push_back(i);
+      }
+      if (!numa_joined.empty()) {
+        std::sort(numa_joined.begin(), numa_joined.end());
+        auto middle = numa_active.size();
+        numa_active.insert(numa_active.end(), numa_joined.begin(),
+                           numa_joined.end());
+        std::inplace_merge(numa_active.begin(), numa_active.begin() + middle,
+                           numa_active.end());
+        numa_active.erase(std::unique(numa_active.begin(), numa_active.end()),
+                          numa_active.end());
+      }
+    }
   }
 
-  for (auto* counter : counters) {
-    delete counter;
+  for (int n = 0; n < numa_nodes; ++n) {
+    active_agents_num_[n] = agents_[n].size();
+  }
+  for (auto& thread_woken : woken_agents_) {
+    thread_woken.clear();
   }
+  woken_agents_.resize(thread_info_->GetMaxThreads() + 1);
+  active_agents_valid_ = true;
 }
 
 struct LoadBalanceFunctor : public Functor<void, Iterator<AgentHandle>*> {
@@ -239,6 +338,7 @@ struct LoadBalanceFunctor : public Functor<void, Iterator<AgentHandle>*> {
 
 void ResourceManager::LoadBalance() {
   auto* param = Simulation::GetActive()->GetParam();
+  active_agents_valid_ = false;
   if (param->plot_memory_layout) {
     PlotNeighborMemoryHistogram(true);
   }
@@ -276,7 +376,7 @@ void ResourceManager::LoadBalance() {
 
   const bool minimize_memory = param->minimize_memory_while_rebalancing;
 
-// create new agents
+// allocate the destination containers
 #pragma omp parallel
   {
     auto tid = thread_info_->GetMyThreadId();
@@ -289,25 +389,23 @@ void ResourceManager::LoadBalance() {
       }
       dest.resize(agent_per_numa[nid]);
     }
-
-#pragma omp barrier
-
-    auto threads_in_numa = thread_info_->GetThreadsInNumaNode(nid);
-    assert(thread_info_->GetNumaNode(tid) == numa_node_of_cpu(sched_getcpu()));
-
-    // use static scheduling
-    auto correction = agent_per_numa[nid] % threads_in_numa == 0 ? 0 : 1;
-    auto chunk = agent_per_numa[nid] / threads_in_numa + correction;
-    auto start =
-        thread_info_->GetNumaThreadId(tid) * chunk + agent_per_numa_cumm[nid];
-    auto end =
-        std::min(agent_per_numa_cumm[nid] + agent_per_numa[nid], start + chunk);
-
-    LoadBalanceFunctor f(minimize_memory, start - agent_per_numa_cumm[nid], nid,
-                         agents_, dest, uid_ah_map_, type_index_);
-    lbi->CallHandleIteratorConsumer(start, end, f);
   }
 
+  // copy agents into their new location
+  // chunks are only processed by threads in the destination numa domain,
+  // such that the copies are allocated on this domain (first touch)
+  auto* executor = WorkStealingExecutor::GetInstance();
+  executor->ParallelForNuma(
+      [&](int nid) { return agent_per_numa[nid]; },
+      param->scheduling_batch_size,
+      [&](uint64_t nid, uint64_t start, uint64_t end) {
+        LoadBalanceFunctor f(minimize_memory, start, nid, agents_,
+                             agents_lb_[nid], uid_ah_map_, type_index_);
+        lbi->CallHandleIteratorConsumer(start + agent_per_numa_cumm[nid],
+                                        end + agent_per_numa_cumm[nid], f);
+      },
+      false);
+
   // delete old objects. This approach has a high chance that a thread
   // in the right numa node will delete the object, thus minimizing thread
   // synchronization overheads. The bdm memory allocator does not have this
@@ -324,6 +422,8 @@ void ResourceManager::LoadBalance() {
       PlotMemoryHistogram(agents_[n], n);
     }
   }
+  // agents have been reordered
+  UpdateAgentSoA();
   if (param->plot_memory_layout) {
     PlotNeighborMemoryHistogram();
   }
@@ -336,6 +436,13 @@ void ResourceManager::LoadBalance() {
 // -----------------------------------------------------------------------------
 void ResourceManager::RemoveAgents(
     const std::vector<std::vector<AgentUid>*>& uids) {
+  auto* param = Simulation::GetActive()->GetParam();
+  for (auto* thread_uids : uids) {
+    if (!thread_uids->empty()) {
+      active_agents_valid_ = false;
+      break;
+    }
+  }
   // initialization
   // cumulative numbers of to be removed agents
   auto numa_nodes = thread_info_->GetNumaNodes();
@@ -464,108 +571,112 @@ void ResourceManager::RemoveAgents(
         ExclusivePrefixSum(&swaps_to_left[nid], swaps_to_left[nid].size() - 1);
       }
     }
-#pragma omp barrier
-    if (remove[nid] != 0) {
-      uint64_t num_swaps = swaps_to_right[nid][threads_in_numa];
-      if (num_swaps != 0) {
-        // perform swaps
-        uint64_t swap_start = 0;
-        uint64_t swap_end = 0;
-        Partition(num_swaps, threads_in_numa, ntid, &swap_start, &swap_end);
-
-        if (swap_start < swap_end) {
-          auto tr_block = BinarySearch(swap_start, swaps_to_right[nid], 0,
-                                       swaps_to_right[nid].size() - 1);
-          auto tl_block = BinarySearch(swap_start, swaps_to_left[nid], 0,
-                                       swaps_to_left[nid].size() - 1);
-
-          auto tr_block_swaps =
-              swaps_to_right[nid][tr_block + 1] - swaps_to_right[nid][tr_block];
-          auto tl_block_swaps =
-              swaps_to_left[nid][tl_block + 1] - swaps_to_left[nid][tl_block];
-
-          // number of elements to discard in the beginning
-          auto tr_block_idx = swap_start - swaps_to_right[nid][tr_block];
-          auto tl_block_idx = swap_start - swaps_to_left[nid][tl_block];
-
-          for (uint64_t s = swap_start; s < swap_end; ++s) {
-            // calculate element indices that should be swapped
-            auto tr_idx = start[nid][tr_block] + tr_block_idx;
-            auto tl_idx = start[nid][tl_block] + tl_block_idx;
-            auto tr_eidx = parallel_remove_.to_right[nid][tr_idx];
-            auto tl_eidx =
-                parallel_remove_.not_to_left[nid][tl_idx] + lowest[nid];
-
-            // swap
-            assert(tl_eidx < agents_[nid].size());
-            assert(tr_eidx < agents_[nid].size());
-            auto* reordered = agents_[nid][tl_eidx];
+  }
+
+  // perform swaps
+  auto* executor = WorkStealingExecutor::GetInstance();
+  auto num_swaps = [&](int nid) -> uint64_t {
+    if (remove[nid] == 0) {
+      return 0;
+    }
+    return swaps_to_right[nid][thread_info_->GetThreadsInNumaNode(nid)];
+  };
+  executor->ParallelForNuma(
+      num_swaps, param->scheduling_batch_size,
+      [&](uint64_t nid, uint64_t swap_start, uint64_t swap_end) {
+        auto tr_block = BinarySearch(swap_start, swaps_to_right[nid], 0,
+                                     swaps_to_right[nid].size() - 1);
+        auto tl_block = BinarySearch(swap_start, swaps_to_left[nid], 0,
+                                     swaps_to_left[nid].size() - 1);
+
+        auto tr_block_swaps =
+            swaps_to_right[nid][tr_block + 1] - swaps_to_right[nid][tr_block];
+        auto tl_block_swaps =
+            swaps_to_left[nid][tl_block + 1] - swaps_to_left[nid][tl_block];
+
+        // number of elements to discard in the beginning
+        auto tr_block_idx = swap_start - swaps_to_right[nid][tr_block];
+        auto tl_block_idx = swap_start - swaps_to_left[nid][tl_block];
+
+        for (uint64_t s = swap_start; s < swap_end; ++s) {
+          // calculate element indices that should be swapped
+          auto tr_idx = start[nid][tr_block] + tr_block_idx;
+          auto tl_idx = start[nid][tl_block] + tl_block_idx;
+          auto tr_eidx = parallel_remove_.to_right[nid][tr_idx];
+          auto tl_eidx =
+              parallel_remove_.not_to_left[nid][tl_idx] + lowest[nid];
+
+          // swap
+          assert(tl_eidx < agents_[nid].size());
+          assert(tr_eidx < agents_[nid].size());
+          auto* reordered = agents_[nid][tl_eidx];
 #ifndef NDEBUG
-            assert(toberemoved.find(agents_[nid][tl_eidx]->GetUid()) ==
-                   toberemoved.end());
-            assert(toberemoved.find(agents_[nid][tr_eidx]->GetUid()) !=
-                   toberemoved.end());
+          assert(toberemoved.find(agents_[nid][tl_eidx]->GetUid()) ==
+                 toberemoved.end());
+          assert(toberemoved.find(agents_[nid][tr_eidx]->GetUid()) !=
+                 toberemoved.end());
 #endif  // NDBUG
-            agents_[nid][tl_eidx] = agents_[nid][tr_eidx];
-            agents_[nid][tr_eidx] = reordered;
-            uid_ah_map_.Insert(reordered->GetUid(), AgentHandle(nid, tr_eidx));
-
-            // find next pair
-            if (swap_end - s > 1) {
-              // right
-              tr_block_idx++;
-              if (tr_block_idx >= tr_block_swaps) {
-                tr_block_idx = 0;
-                tr_block_swaps = 0;
-                while (!tr_block_swaps) {
-                  tr_block++;
-                  tr_block_swaps = swaps_to_right[nid][tr_block + 1] -
-                                   swaps_to_right[nid][tr_block];
-                }
+          agents_[nid][tl_eidx] = agents_[nid][tr_eidx];
+          agents_[nid][tr_eidx] = reordered;
+          uid_ah_map_.Insert(reordered->GetUid(), AgentHandle(nid, tr_eidx));
+          if (IsAgentSoAEnabled()) {
+            // element tl_eidx will be removed
+            soa_[nid].Copy(tl_eidx, tr_eidx);
+          }
+
+          // find next pair
+          if (swap_end - s > 1) {
+            // right
+            tr_block_idx++;
+            if (tr_block_idx >= tr_block_swaps) {
+              tr_block_idx = 0;
+              tr_block_swaps = 0;
+              while (!tr_block_swaps) {
+                tr_block++;
+                tr_block_swaps = swaps_to_right[nid][tr_block + 1] -
+                                 swaps_to_right[nid][tr_block];
               }
-              // left
-              tl_block_idx++;
-              if (tl_block_idx >= tl_block_swaps) {
-                tl_block_idx = 0;
-                tl_block_swaps = 0;
-                while (!tl_block_swaps) {
-                  tl_block++;
-                  tl_block_swaps = swaps_to_left[nid][tl_block + 1] -
-                                   swaps_to_left[nid][tl_block];
-                }
+            }
+            // left
+            tl_block_idx++;
+            if (tl_block_idx >= tl_block_swaps) {
+              tl_block_idx = 0;
+              tl_block_swaps = 0;
+              while (!tl_block_swaps) {
+                tl_block++;
+                tl_block_swaps = swaps_to_left[nid][tl_block + 1] -
+                                 swaps_to_left[nid][tl_block];
               }
             }
           }
         }
-      }
-    }
-#pragma omp barrier
-    if (remove[nid] != 0) {
-      // delete agents
-      uint64_t start_del = 0;
-      uint64_t end_del = 0;
-      Partition(remove[nid], threads_in_numa, ntid, &start_del, &end_del);
-
-      start_del += lowest[nid];
-      end_del += lowest[nid];
-
-      for (uint64_t i = start_del; i < end_del; ++i) {
-        Agent* agent = agents_[nid][i];
-        assert(toberemoved.find(agent->GetUid()) != toberemoved.end());
-        uid_ah_map_.Remove(agent->GetUid());
-        if (type_index_) {
-          // TODO parallelize type_index removal
+      });
+
+  // delete agents
+  executor->ParallelForNuma(
+      [&](int nid) { return remove[nid]; }, param->scheduling_batch_size,
+      [&](uint64_t nid, uint64_t start_del, uint64_t end_del) {
+        start_del += lowest[nid];
+        end_del += lowest[nid];
+        for (uint64_t i = start_del; i < end_del; ++i) {
+          Agent* agent = agents_[nid][i];
+          assert(toberemoved.find(agent->GetUid()) != toberemoved.end());
+          uid_ah_map_.Remove(agent->GetUid());
+          if (type_index_) {
+            // TODO parallelize type_index removal
 #pragma omp critical
-          type_index_->Remove(agent);
+            type_index_->Remove(agent);
+          }
+          delete agent;
         }
-        delete agent;
-      }
-    }
-  }
+      });
   // shrink container
   for (uint64_t n = 0; n < agents_.size(); ++n) {
     agents_[n].resize(lowest[n]);
   }
+  for (uint64_t n = 0; n < soa_.size(); ++n) {
+    soa_[n].resize(lowest[n]);
+  }
 }
 
 }  // namespace bdm
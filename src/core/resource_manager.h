@@ -21,6 +21,7 @@
 #include <cmath>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <ostream>
 #include <set>
 #include <string>
@@ -32,6 +33,7 @@
 #include "core/agent/agent_handle.h"
 #include "core/agent/agent_uid.h"
 #include "core/agent/agent_uid_generator.h"
+#include "core/container/agent_soa.h"
 #include "core/container/agent_uid_map.h"
 #include "core/diffusion/diffusion_grid.h"
 #include "core/functor.h"
@@ -40,6 +42,7 @@
 #include "core/type_index.h"
 #include "core/util/numa.h"
 #include "core/util/root.h"
+#include "core/util/spinlock.h"
 #include "core/util/thread_info.h"
 #include "core/util/type.h"
 
@@ -75,6 +78,7 @@ class ResourceManager {
     diffusion_grids_ = std::move(other.diffusion_grids_);
 
     RebuildAgentUidMap();
+    UpdateAgentSoA();
     // restore type_index_
     if (type_index_) {
       for (auto& numa_agents : agents_) {
@@ -92,8 +96,11 @@ class ResourceManager {
     auto* agent_uid_generator = Simulation::GetActive()->GetAgentUidGenerator();
     uid_ah_map_.resize(agent_uid_generator->GetHighestIndex() + 1);
     for (unsigned n = 0; n < agents_.size(); ++n) {
-      for (unsigned i = 0; i < agents_[n].size(); ++i) {
-        auto* agent = agents_[n][i];
+      const auto& numa_agents = agents_[n];
+      // agents have distinct uids; they can be inserted concurrently
+#pragma omp parallel for
+      for (uint64_t i = 0; i < numa_agents.size(); ++i) {
+        auto* agent = numa_agents[i];
         this->uid_ah_map_.Insert(agent->GetUid(), AgentHandle(n, i));
       }
     }
@@ -246,8 +253,8 @@ class ResourceManager {
 
   /// Call a function for all or a subset of agents in the simulation.
   /// Function invocations are parallelized.\n
-  /// Uses dynamic scheduling and work stealing. Batch size controlled by
-  /// `chunk`.
+  /// Uses dynamic scheduling and NUMA-aware work stealing
+  /// (see `WorkStealingExecutor`). Batch size controlled by `chunk`.
   /// \param chunk number of agents that are assigned to a thread (batch
   /// size)
   /// \see ForEachAgent
@@ -255,12 +262,57 @@ class ResourceManager {
       uint64_t chunk, Functor<void, Agent*, AgentHandle>& function,
       Functor<bool, Agent*>* filter = nullptr);
 
+  /// Call a function for all or a subset of the active agents, i.e. agents
+  /// that are not static (see `Param::skip_static_agents`).
+  /// The set of active agents is determined by `UpdateActiveAgents`.\n
+  /// Uses dynamic scheduling and NUMA-aware work stealing
+  /// (see `WorkStealingExecutor`).
+  /// \param chunk number of agents that are assigned to a thread (batch
+  /// size)
+  virtual void ForEachActiveAgentParallel(
+      uint64_t chunk, Functor<void, Agent*, AgentHandle>& function,
+      Functor<bool, Agent*>* filter = nullptr);
+
+  /// Updates the set of active agents for the next execution of the agent
+  /// operations. Agents that are neither going to be non-static in this
+  /// iteration nor have to propagate their staticness leave the set. New
+  /// agents and agents that have been woken up (see `WakeUp`) join it.\n
+  /// The set is rebuilt from scratch if agents have been removed or
+  /// reordered since the last update.
+  void UpdateActiveAgents();
+
+  /// Returns the number of agents in the set of active agents.
+  /// \see `UpdateActiveAgents`
+  uint64_t GetNumActiveAgents() const {
+    uint64_t num_agents = 0;
+    for (auto& numa_active : active_agents_) {
+      num_agents += numa_active.size();
+    }
+    return num_agents;
+  }
+
+  /// Adds a static agent to the set of active agents during the next
+  /// call to `UpdateActiveAgents`. Thread-safe.
+  void WakeUp(const AgentUid& uid) {
+    auto tid = thread_info_->GetMyThreadId();
+    if (static_cast<uint64_t>(tid) >= woken_agents_.size()) {
+      // e.g. a thread that does not belong to the OpenMP thread pool
+      std::lock_guard<Spinlock> guard(woken_agents_lock_);
+      woken_agents_.back().push_back(uid);
+      return;
+    }
+    woken_agents_[tid].push_back(uid);
+  }
+
   /// Reserves enough memory to hold `capacity` number of agents for
   /// each numa domain.
   void Reserve(size_t capacity) {
     for (auto& numa_agents : agents_) {
       numa_agents.reserve(capacity);
     }
+    for (auto& numa_soa : soa_) {
+      numa_soa.reserve(capacity);
+    }
     if (type_index_) {
       type_index_->Reserve(capacity);
     }
@@ -278,6 +330,9 @@ class ResourceManager {
       agents_[numa_node].reserve((current + additional) * 1.5);
     }
     agents_[numa_node].resize(current + additional);
+    if (IsAgentSoAEnabled()) {
+      soa_[numa_node].resize(current + additional);
+    }
     return current;
   }
 
@@ -292,6 +347,7 @@ class ResourceManager {
   /// agent references pointing into the ResourceManager. AgentPointer are
   /// not affected.
   void ClearAgents() {
+    active_agents_valid_ = false;
     uid_ah_map_.clear();
     for (auto& numa_agents : agents_) {
       for (auto* agent : numa_agents) {
@@ -299,6 +355,9 @@ class ResourceManager {
       }
       numa_agents.clear();
     }
+    for (auto& numa_soa : soa_) {
+      numa_soa.clear();
+    }
     if (type_index_) {
       type_index_->Clear();
     }
@@ -322,6 +381,9 @@ class ResourceManager {
     agents_[numa_node].push_back(agent);
     uid_ah_map_.Insert(uid,
                        AgentHandle(numa_node, agents_[numa_node].size() - 1));
+    if (IsAgentSoAEnabled()) {
+      soa_[numa_node].PushBack(*agent);
+    }
     if (type_index_) {
       type_index_->Add(agent);
     }
@@ -364,6 +426,9 @@ class ResourceManager {
       auto uid = agent->GetUid();
       uid_ah_map_.Insert(uid, AgentHandle(numa_node, offset + i));
       agents_[numa_node][offset + i] = agent;
+      if (IsAgentSoAEnabled()) {
+        soa_[numa_node].Set(offset + i, *agent);
+      }
       i++;
     }
     if (type_index_) {
@@ -381,6 +446,7 @@ class ResourceManager {
   void RemoveAgent(const AgentUid& uid) {
     // remove from map
     if (uid_ah_map_.Contains(uid)) {
+      active_agents_valid_ = false;
       auto ah = uid_ah_map_[uid];
       uid_ah_map_.Remove(uid);
       // remove from vector
@@ -396,6 +462,13 @@ class ResourceManager {
         numa_agents[ah.GetElementIdx()] = reordered;
         numa_agents.pop_back();
         uid_ah_map_.Insert(reordered->GetUid(), ah);
+        if (IsAgentSoAEnabled()) {
+          auto& numa_soa = soa_[ah.GetNumaNode()];
+          numa_soa.Copy(numa_soa.size() - 1, ah.GetElementIdx());
+        }
+      }
+      if (IsAgentSoAEnabled()) {
+        soa_[ah.GetNumaNode()].resize(numa_agents.size());
       }
       if (type_index_) {
         type_index_->Remove(agent);
@@ -410,6 +483,30 @@ class ResourceManager {
 
   const TypeIndex* GetTypeIndex() const { return type_index_; }
 
+  /// Returns true if the hot agent attributes are mirrored in a
+  /// structure-of-arrays layout. \see `Param::soa_agent_storage`
+  bool IsAgentSoAEnabled() const { return !soa_.empty(); }
+
+  /// Returns the structure-of-arrays mirror of the agents in `numa_node`,
+  /// or a nullptr if `Param::soa_agent_storage` is turned off.
+  /// Element `i` belongs to the agent with AgentHandle `(numa_node, i)`.
+  const AgentSoA* GetAgentSoA(
+      typename AgentHandle::NumaNode_t numa_node) const {
+    return IsAgentSoAEnabled() ? &soa_[numa_node] : nullptr;
+  }
+
+  AgentSoA* GetAgentSoA(typename AgentHandle::NumaNode_t numa_node) {
+    return IsAgentSoAEnabled() ? &soa_[numa_node] : nullptr;
+  }
+
+  /// Copies the current attribute values of all agents into the
+  /// structure-of-arrays mirror. Does nothing if `Param::soa_agent_storage`
+  /// is turned off.\n
+  /// Called at the beginning of each iteration before the environment is
+  /// updated. Therefore, the mirror reflects the agent state at the
+  /// beginning of the iteration while agent operations are executed.
+  void UpdateAgentSoA();
+
  protected:
   /// Maps an AgentUid to its storage location in `agents_` \n
   AgentUidMap<AgentHandle> uid_ah_map_ = AgentUidMap<AgentHandle>(100u);  //!
@@ -417,6 +514,9 @@ class ResourceManager {
   std::vector<std::vector<Agent*>> agents_;
   /// Container used during load balancing
   std::vector<std::vector<Agent*>> agents_lb_;  //!
+  /// Structure-of-arrays mirror of hot agent attributes (one per NUMA node).
+  /// Empty if `Param::soa_agent_storage` is turned off.
+  std::vector<AgentSoA> soa_;  //!
   /// Maps a diffusion grid ID to the pointer to the diffusion grid
   std::unordered_map<uint64_t, DiffusionGrid*> diffusion_grids_;
 
@@ -432,6 +532,20 @@ class ResourceManager {
   /// auxiliary data required for parallel agent removal
   ParallelRemovalAuxData parallel_remove_;  //!
 
+  /// Element indices of the active agents; one sorted vector for each NUMA
+  /// node. \see `UpdateActiveAgents`
+  std::vector<std::vector<AgentHandle::ElementIdx_t>> active_agents_;  //!
+  /// Number of agents in each NUMA node when `active_agents_` was updated
+  std::vector<uint64_t> active_agents_num_;  //!
+  /// False if agents have been removed or reordered since `active_agents_`
+  /// was updated
+  bool active_agents_valid_ = false;  //!
+  /// Agents that have been woken up since the last update of
+  /// `active_agents_`. One vector for each thread; the last one is shared
+  /// by threads outside the OpenMP thread pool.
+  std::vector<std::vector<AgentUid>> woken_agents_;  //!
+  Spinlock woken_agents_lock_;  //!
+
   friend class SimulationBackup;
   friend std::ostream& operator<<(std::ostream& os, const ResourceManager& rm);
   BDM_CLASS_DEF_NV(ResourceManager, 2);
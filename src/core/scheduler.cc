@@ -39,6 +39,8 @@ Scheduler::Scheduler() {
     restore_point_ = backup_->GetSimulationStepsFromBackup();
   }
   root_visualization_ = new RootAdaptor();
+  profiler_.SetEnabled(param->profiling);
+  profiler_.SetHardwareCounters(param->profiling_hardware_counters);
 
   // Operations are scheduled in the following order (sub categorated by their
   // operation implementation type, so that actual order may vary)
@@ -105,6 +107,11 @@ Scheduler::Scheduler() {
     ScheduleOp(NewOperation(def_op), OpType::kPostSchedule);
   }
 
+  auto lb_ops = GetOps("load balancing");
+  if (param->adaptive_load_balancing_threshold > 0 && !lb_ops.empty()) {
+    lb_ops[0]->frequency_ = param->adaptive_load_balancing_interval;
+  }
+
   if (!GetOps("visualize").empty()) {
     GetOps("visualize")[0]->GetImplementation<VisualizationOp>()->Initialize();
   }
@@ -151,6 +158,8 @@ uint64_t Scheduler::GetSimulatedSteps() const { return total_steps_; }
 
 TimingAggregator* Scheduler::GetOpTimes() { return &op_times_; }
 
+Profiler* Scheduler::GetProfiler() { return &profiler_; }
+
 void Scheduler::ScheduleOp(Operation* op, OpType op_type) {
   // Check if operation is already in all_ops_ (could be the case when
   // trying to reschedule a previously unscheduled operation)
@@ -235,13 +244,19 @@ struct RunAllScheduledOps : Functor<void, Agent*, AgentHandle> {
   explicit RunAllScheduledOps(std::vector<Operation*>& scheduled_ops)
       : scheduled_ops_(scheduled_ops) {
     sim_ = Simulation::GetActive();
+    rm_ = sim_->GetResourceManager();
   }
 
-  void operator()(Agent* agent, AgentHandle) override {
+  void operator()(Agent* agent, AgentHandle ah) override {
     sim_->GetExecutionContext()->Execute(agent, scheduled_ops_);
+    // write the changes back to the structure-of-arrays mirror
+    if (auto* soa = rm_->GetAgentSoA(ah.GetNumaNode())) {
+      soa->Set(ah.GetElementIdx(), *agent);
+    }
   }
 
   Simulation* sim_;
+  ResourceManager* rm_;
   std::vector<Operation*>& scheduled_ops_;
 };
 
@@ -285,15 +300,42 @@ void Scheduler::RunAgentOps(Functor<bool, Agent*>* filter) {
   }
   RunAllScheduledOps functor(agent_ops);
 
+  if (profiler_.IsEnabled()) {
+    profiler_.BeginParallelRegion();
+  }
   Timing::Time("agent ops", [&]() {
-    rm->ForEachAgentParallel(batch_size, functor, filter);
+    if (param->skip_static_agents && param->detect_static_agents) {
+      rm->ForEachActiveAgentParallel(batch_size, functor, filter);
+    } else {
+      rm->ForEachAgentParallel(batch_size, functor, filter);
+    }
   });
+  if (profiler_.IsEnabled()) {
+    profiler_.EndParallelRegion("agent ops");
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool Scheduler::HasAgentOpsToRun() const {
+  for (auto* op : scheduled_agent_ops_) {
+    if (op->frequency_ != 0 && total_steps_ % op->frequency_ == 0) {
+      return true;
+    }
+  }
+  return false;
 }
 
 // -----------------------------------------------------------------------------
 void Scheduler::RunScheduledOps() {
   SetUpOps();
 
+  auto* sim = Simulation::GetActive();
+  auto* param = sim->GetParam();
+  if (param->skip_static_agents && param->detect_static_agents &&
+      HasAgentOpsToRun()) {
+    sim->GetResourceManager()->UpdateActiveAgents();
+  }
+
   // Run the agent operations
   if (agent_filters_.size() == 0) {
     RunAgentOps(nullptr);
@@ -327,6 +369,7 @@ void Scheduler::Execute() {
     std::cout << "Time step: " << total_steps_ << std::endl;
   }
   ScheduleOps();
+  profiler_.SetStep(total_steps_);
 
   RunPreScheduledOps();
   RunScheduledOps();
@@ -340,8 +383,24 @@ void Scheduler::Backup() {
   if (backup_->BackupEnabled() &&
       duration_cast<seconds>(Clock::now() - last_backup_).count() >=
           param->backup_interval) {
-    last_backup_ = Clock::now();
-    backup_->Backup(total_steps_);
+    auto start = Clock::now();
+    {
+      Profiler::Scope scope(profiler_.IsEnabled() ? &profiler_ : nullptr,
+                            "backup");
+      if (!param->async_backup) {
+        backup_->Backup(total_steps_);
+      } else if (!backup_->BackupAsync(total_steps_)) {
+        // The previous backup is still being written. Try again after the
+        // next step.
+        return;
+      }
+    }
+    last_backup_ = start;
+    // time the simulation was stalled by the backup
+    auto stall =
+        std::chrono::duration<double, std::milli>(Clock::now() - start);
+    Log::Info("Scheduler", "Backup after step ", total_steps_,
+              " stalled the simulation for ", stall.count(), " ms");
   }
 }
 
@@ -382,6 +441,9 @@ void Scheduler::Initialize() {
     rm->ForEachAgentParallel(*bound_space);
     delete bound_space;
   }
+  // agents might have been modified outside of operations since the last
+  // call to Simulate
+  rm->UpdateAgentSoA();
   env->Update();
   rm->ForEachDiffusionGrid([&](DiffusionGrid* dgrid) {
     // Create data structures, whose size depend on the env dimensions
@@ -26,6 +26,7 @@
 #include "core/functor.h"
 #include "core/operation/operation.h"
 #include "core/param/param.h"
+#include "core/util/profiler.h"
 #include "core/util/timing_aggregator.h"
 
 namespace bdm {
@@ -96,6 +97,9 @@ class Scheduler {
 
   TimingAggregator* GetOpTimes();
 
+  /// \see `Param::profiling`
+  Profiler* GetProfiler();
+
  protected:
   uint64_t total_steps_ = 0;
 
@@ -135,6 +139,8 @@ class Scheduler {
   std::vector<Operation*> post_scheduled_ops_;
   /// Tracks operations' execution times
   TimingAggregator op_times_;
+  /// Records per-thread events if `Param::profiling` is turned on
+  Profiler profiler_;  //!
 
   /// Agent operations are executed for each filter in agent_filters_.\n
   /// By default no filter is specified which means that all
@@ -197,6 +203,9 @@ class Scheduler {
 
   void RunAgentOps(Functor<bool, Agent*>* filter);
 
+  /// Returns true if any agent operation has to be executed in this step.
+  bool HasAgentOpsToRun() const;
+
   // Run the operations in post_scheduled_ops_ (executed after RunScheduledOps)
   void RunPostScheduledOps();
 
@@ -29,10 +29,12 @@
 #include <vector>
 
 #include "bdm_version.h"
+#include "core/agent/agent.h"
 #include "core/agent/agent_uid_generator.h"
 #include "core/analysis/time_series.h"
 #include "core/environment/environment.h"
 #include "core/environment/kd_tree_environment.h"
+#include "core/environment/multi_level_grid_environment.h"
 #include "core/environment/octree_environment.h"
 #include "core/environment/uniform_grid_environment.h"
 #include "core/execution_context/in_place_exec_ctxt.h"
@@ -221,6 +223,12 @@ Simulation::~Simulation() {
     ofs << sstr.str() << std::endl;
   }
 
+  if (param_ != nullptr && param_->profiling && scheduler_ != nullptr) {
+    auto* profiler = scheduler_->GetProfiler();
+    std::cout << *profiler << std::endl;
+    profiler->WriteChromeTrace(Concat(output_dir_, "/profile.json"));
+  }
+
   if (mem_mgr_) {
     mem_mgr_->SetIgnoreDelete(true);
   }
@@ -285,6 +293,11 @@ Random* Simulation::GetRandom() { return random_[omp_get_thread_num()]; }
 
 std::vector<Random*>& Simulation::GetAllRandom() { return random_; }
 
+CounterRng Simulation::GetCounterRng(const Agent* agent, uint32_t stream) {
+  return CounterRng(param_->random_seed, agent->GetRngKey(),
+                    scheduler_->GetSimulatedSteps(), stream);
+}
+
 InPlaceExecutionContext* Simulation::GetExecutionContext() {
   return exec_ctxt_[omp_get_thread_num()];
 }
@@ -355,6 +368,8 @@ void Simulation::InitializeMembers() {
     environment_ = new KDTreeEnvironment();
   } else if (param_->environment == "octree") {
     environment_ = new OctreeEnvironment();
+  } else if (param_->environment == "multi_level_grid") {
+    environment_ = new MultiLevelGridEnvironment();
   } else if (param_->environment == "uniform_grid") {
     environment_ = new UniformGridEnvironment();
   } else {
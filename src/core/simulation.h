@@ -21,12 +21,14 @@
 #include "core/agent/agent_uid.h"
 #include "core/gpu/opencl_state.h"
 #include "core/memory/memory_manager.h"
+#include "core/util/counter_rng.h"
 #include "core/util/random.h"
 #include "core/util/root.h"
 
 namespace bdm {
 
 // forward declarations
+class Agent;
 class ResourceManager;
 class Environment;
 class Grid;
@@ -118,6 +120,16 @@ class Simulation {
   /// Returns all thread local random number generator.
   std::vector<Random*>& GetAllRandom();
 
+  /// Returns a counter-based random number generator for `agent` in the
+  /// current time step. Unlike `GetRandom()`, the returned numbers do not
+  /// depend on the number of threads or on the order in which agents are
+  /// processed (see `Agent::GetRngKey`).\n
+  /// Each call for the same agent, step and stream returns a generator
+  /// that produces the identical sequence of numbers. Use different streams
+  /// to draw independent numbers for the same agent in the same step.
+  /// \param stream selects one of several independent sequences
+  CounterRng GetCounterRng(const Agent* agent, uint32_t stream = 0);
+
   /// Returns a thread local execution context.
   InPlaceExecutionContext* GetExecutionContext();
 
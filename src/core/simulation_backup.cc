@@ -13,6 +13,18 @@
 // -----------------------------------------------------------------------------
 
 #include "core/simulation_backup.h"
+#include <TClass.h>
+#include <TROOT.h>
+#include <TTree.h>
+#include <omp.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <unordered_map>
+
+#include "core/resource_manager.h"
+#include "core/util/thread_info.h"
+#include "core/util/work_stealing_executor.h"
 
 namespace bdm {
 
@@ -39,6 +51,324 @@ SimulationBackup::SimulationBackup(const std::string& backup_file,
   }
 }
 
+SimulationBackup::~SimulationBackup() { WaitForBackup(); }
+
+bool SimulationBackup::BackupAsync(size_t completed_simulation_steps) {
+  if (!backup_) {
+    Log::Fatal("SimulationBackup",
+               "Requested to backup data, but no backup file given.");
+  }
+  if (IsBackupInProgress()) {
+    return false;
+  }
+
+  // The child process gets a copy-on-write snapshot of the whole process.
+  pid_t pid = fork();
+  if (pid == -1) {
+    Log::Warning("SimulationBackup",
+                 "Could not create a process for the asynchronous backup. "
+                 "Writing the backup synchronously.");
+    Backup(completed_simulation_steps);
+    return true;
+  }
+  if (pid == 0) {
+    // Only the calling thread exists in the child process. Therefore,
+    // parallel regions must not use the thread pool of the parent.
+    omp_set_num_threads(1);
+    int exit_code = 0;
+    try {
+      Backup(completed_simulation_steps);
+    } catch (...) {
+      exit_code = 1;
+    }
+    // skip exit handlers and destructors; they belong to the parent
+    _exit(exit_code);
+  }
+  backup_pid_ = pid;
+  return true;
+}
+
+bool SimulationBackup::IsBackupInProgress() {
+  if (backup_pid_ == 0) {
+    return false;
+  }
+  int status = 0;
+  auto ret = waitpid(backup_pid_, &status, WNOHANG);
+  if (ret == 0) {
+    return true;
+  }
+  CheckBackupStatus(ret == backup_pid_ ? status : -1);
+  backup_pid_ = 0;
+  return false;
+}
+
+void SimulationBackup::WaitForBackup() {
+  if (backup_pid_ == 0) {
+    return;
+  }
+  int status = 0;
+  auto ret = waitpid(backup_pid_, &status, 0);
+  CheckBackupStatus(ret == backup_pid_ ? status : -1);
+  backup_pid_ = 0;
+}
+
+void SimulationBackup::CheckBackupStatus(int status) {
+  if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    Log::Warning("SimulationBackup", "The asynchronous backup to ",
+                 backup_file, " failed. The previous backup is kept.");
+  }
+}
+
+void SimulationBackup::BackupSharded(size_t completed_simulation_steps) {
+  auto* rm = Simulation::GetActive()->GetResourceManager();
+  auto* tinfo = ThreadInfo::GetInstance();
+
+  // divide the agents of each NUMA node into one chunk per thread
+  std::vector<Shard> shards;
+  for (uint64_t n = 0; n < rm->agents_.size(); ++n) {
+    uint64_t num_agents = rm->agents_[n].size();
+    uint64_t num_chunks = std::max(tinfo->GetThreadsInNumaNode(n), 1);
+    uint64_t chunk_size = (num_agents + num_chunks - 1) / num_chunks;
+    for (uint64_t start = 0; start < num_agents; start += chunk_size) {
+      shards.push_back({n, start, std::min(start + chunk_size, num_agents)});
+    }
+  }
+
+  // The shards and the main file are written to temporary files, which are
+  // only renamed once all of them are complete. Hence, the previous backup
+  // remains complete until the files are renamed, even if it has been
+  // written for the same step (same shard file names). Its remaining
+  // shards are removed afterwards.
+  std::vector<std::string> old_shard_files;
+  if (FileExists(backup_file)) {
+    TFileRaii f(TFile::Open(backup_file.c_str()));
+    old_shard_files = GetShardFileNames(f.Get(), backup_file);
+  }
+
+  std::vector<std::string> shard_files(shards.size());
+  std::vector<std::string> tmp_shard_files(shards.size());
+  for (uint64_t i = 0; i < shards.size(); ++i) {
+    shard_files[i] =
+        GetShardFileName(backup_file, completed_simulation_steps, i);
+    tmp_shard_files[i] = "tmp_" + shard_files[i];
+  }
+
+  ROOT::EnableThreadSafety();
+#pragma omp parallel for schedule(dynamic, 1)
+  for (uint64_t i = 0; i < shards.size(); ++i) {
+    WriteShard(tmp_shard_files[i], shards[i]);
+  }
+
+  std::stringstream tmp_file;
+  tmp_file << "tmp_" << backup_file;
+  {
+    TFileRaii f(tmp_file.str(), "RECREATE");
+    // Write the simulation without agents. They are stored in the shards.
+    std::vector<std::vector<Agent*>> agents(rm->agents_.size());
+    std::swap(agents, rm->agents_);
+    f.Get()->WriteObject(Simulation::GetActive(), kSimulationName.c_str());
+    std::swap(agents, rm->agents_);
+    IntegralTypeWrapper<size_t> steps(completed_simulation_steps);
+    f.Get()->WriteObject(&steps, kSimulationStepName.c_str());
+    RuntimeVariables rv;
+    f.Get()->WriteObject(&rv, kRuntimeVariableName.c_str());
+    IntegralTypeWrapper<size_t> num_shards(shards.size());
+    f.Get()->WriteObject(&num_shards, kNumShardsName.c_str());
+  }
+
+  // rename replaces existing files of a previous backup of the same step
+  for (uint64_t i = 0; i < shards.size(); ++i) {
+    rename(tmp_shard_files[i].c_str(), shard_files[i].c_str());
+  }
+  remove(backup_file.c_str());
+  rename(tmp_file.str().c_str(), backup_file.c_str());
+
+  for (auto& old_shard_file : old_shard_files) {
+    if (std::find(shard_files.begin(), shard_files.end(), old_shard_file) ==
+        shard_files.end()) {
+      remove(old_shard_file.c_str());
+    }
+  }
+}
+
+void SimulationBackup::RestoreShards(
+    const std::vector<std::string>& shard_files, Simulation* restored) {
+  std::vector<Shard> shards(shard_files.size());
+  ROOT::EnableThreadSafety();
+#pragma omp parallel for schedule(dynamic, 1)
+  for (uint64_t i = 0; i < shard_files.size(); ++i) {
+    ReadShardHeader(shard_files[i], &shards[i]);
+  }
+
+  auto& agents = restored->GetResourceManager()->agents_;
+  auto numa_nodes = ThreadInfo::GetInstance()->GetNumaNodes();
+  // shards of each NUMA node
+  std::vector<std::vector<uint64_t>> numa_shards(numa_nodes);
+  for (uint64_t i = 0; i < shards.size(); ++i) {
+    auto& shard = shards[i];
+    if (shard.numa_node >= agents.size() ||
+        shard.numa_node >= static_cast<uint64_t>(numa_nodes)) {
+      Log::Fatal("SimulationBackup", "Shard of NUMA node ", shard.numa_node,
+                 " does not match the restored simulation.");
+    }
+    if (agents[shard.numa_node].size() < shard.end) {
+      agents[shard.numa_node].resize(shard.end);
+    }
+    numa_shards[shard.numa_node].push_back(i);
+  }
+
+  // Threads only read the shards of their own NUMA node. Hence, the agents
+  // are allocated in the NUMA node they were stored in.
+  auto* executor = WorkStealingExecutor::GetInstance();
+  executor->ParallelForNuma(
+      [&](int nid) { return numa_shards[nid].size(); }, 1,
+      [&](uint64_t nid, uint64_t start, uint64_t end) {
+        for (uint64_t s = start; s < end; ++s) {
+          auto i = numa_shards[nid][s];
+          std::vector<Agent*> shard_agents;
+          ReadShard(shard_files[i], shards[i], &shard_agents);
+          std::copy(shard_agents.begin(), shard_agents.end(),
+                    agents[nid].begin() + shards[i].start);
+        }
+      },
+      false);
+}
+
+void SimulationBackup::WriteShard(const std::string& file_name,
+                                  const Shard& shard) {
+  const auto& numa_agents = Simulation::GetActive()
+                                ->GetResourceManager()
+                                ->agents_[shard.numa_node];
+
+  TFileRaii f(file_name, "RECREATE");
+  IntegralTypeWrapper<size_t> numa_node(shard.numa_node);
+  f.Get()->WriteObject(&numa_node, "numa_node");
+  IntegralTypeWrapper<size_t> start(shard.start);
+  f.Get()->WriteObject(&start, "start");
+  IntegralTypeWrapper<size_t> size(shard.end - shard.start);
+  f.Get()->WriteObject(&size, "size");
+
+  // One tree for each agent type. The data members of the agents are split
+  // into separate branches (columns).
+  struct TypeTree {
+    TTree* tree;
+    Agent* agent;
+    ULong64_t idx;
+  };
+  std::unordered_map<TClass*, TypeTree> trees;
+  for (uint64_t i = shard.start; i < shard.end; ++i) {
+    auto* agent = numa_agents[i];
+    auto* cl = agent->IsA();
+    auto it = trees.find(cl);
+    if (it == trees.end()) {
+      std::stringstream name;
+      name << "agents" << trees.size();
+      auto& type_tree = trees[cl];
+      type_tree.tree = new TTree(name.str().c_str(), cl->GetName());
+      type_tree.tree->SetDirectory(f.Get());
+      type_tree.tree->Branch("agent", cl->GetName(),
+                             static_cast<void*>(&type_tree.agent), 32000, 99);
+      type_tree.tree->Branch("idx", &type_tree.idx, "idx/l");
+      it = trees.find(cl);
+    }
+    it->second.agent = agent;
+    it->second.idx = i - shard.start;
+    it->second.tree->Fill();
+  }
+  for (auto& el : trees) {
+    el.second.tree->Write();
+  }
+  IntegralTypeWrapper<size_t> num_types(trees.size());
+  f.Get()->WriteObject(&num_types, "num_types");
+}
+
+/// Reads the value with the given name from a shard file.
+static size_t ReadShardValue(TFile* file, const std::string& file_name,
+                             const char* name) {
+  IntegralTypeWrapper<size_t>* wrapper = nullptr;
+  file->GetObject(name, wrapper);
+  if (wrapper == nullptr) {
+    Log::Fatal("SimulationBackup", "Shard file ", file_name,
+               " does not contain '", name, "'.");
+  }
+  size_t value = wrapper->Get();
+  delete wrapper;
+  return value;
+}
+
+void SimulationBackup::ReadShardHeader(const std::string& file_name,
+                                       Shard* shard) {
+  if (!FileExists(file_name)) {
+    Log::Fatal("SimulationBackup", "Shard file does not exist: ", file_name);
+  }
+  TFileRaii f(TFile::Open(file_name.c_str()));
+  shard->numa_node = ReadShardValue(f.Get(), file_name, "numa_node");
+  shard->start = ReadShardValue(f.Get(), file_name, "start");
+  shard->end = shard->start + ReadShardValue(f.Get(), file_name, "size");
+}
+
+void SimulationBackup::ReadShard(const std::string& file_name,
+                                 const Shard& shard,
+                                 std::vector<Agent*>* agents) {
+  TFileRaii f(TFile::Open(file_name.c_str()));
+  agents->resize(shard.end - shard.start);
+
+  auto num_types = ReadShardValue(f.Get(), file_name, "num_types");
+  for (uint64_t t = 0; t < num_types; ++t) {
+    std::stringstream name;
+    name << "agents" << t;
+    TTree* tree = nullptr;
+    f.Get()->GetObject(name.str().c_str(), tree);
+    if (tree == nullptr) {
+      Log::Fatal("SimulationBackup", "Shard file ", file_name,
+                 " does not contain '", name.str(), "'.");
+    }
+    Agent* agent = nullptr;
+    ULong64_t idx = 0;
+    tree->SetBranchAddress("agent", static_cast<void*>(&agent));
+    tree->SetBranchAddress("idx", &idx);
+    auto num_entries = tree->GetEntries();
+    for (Long64_t e = 0; e < num_entries; ++e) {
+      // ROOT creates a new agent if the address points to nullptr
+      agent = nullptr;
+      tree->GetEntry(e);
+      if (idx >= agents->size()) {
+        Log::Fatal("SimulationBackup", "Shard file ", file_name,
+                   " contains agent index ", idx, ", but only ",
+                   agents->size(), " agents.");
+      }
+      (*agents)[idx] = agent;
+    }
+    tree->ResetBranchAddresses();
+  }
+}
+
+std::string SimulationBackup::GetShardFileName(
+    const std::string& file_name, size_t completed_simulation_steps,
+    size_t shard) {
+  std::stringstream name;
+  name << file_name << "." << completed_simulation_steps << ".shard" << shard;
+  return name.str();
+}
+
+std::vector<std::string> SimulationBackup::GetShardFileNames(
+    TFile* file, const std::string& file_name) {
+  std::vector<std::string> shard_files;
+  IntegralTypeWrapper<size_t>* num_shards = nullptr;
+  file->GetObject(kNumShardsName.c_str(), num_shards);
+  if (num_shards == nullptr) {
+    return shard_files;
+  }
+  IntegralTypeWrapper<size_t>* steps = nullptr;
+  file->GetObject(kSimulationStepName.c_str(), steps);
+  for (size_t i = 0; i < num_shards->Get(); ++i) {
+    shard_files.push_back(GetShardFileName(file_name, steps->Get(), i));
+  }
+  delete num_shards;
+  delete steps;
+  return shard_files;
+}
+
 size_t SimulationBackup::GetSimulationStepsFromBackup() {
   if (restore_) {
     IntegralTypeWrapper<size_t>* wrapper = nullptr;
@@ -60,6 +390,7 @@ const std::string SimulationBackup::kSimulationName = "simulation";
 const std::string SimulationBackup::kSimulationStepName =
     "completed_simulation_steps";
 const std::string SimulationBackup::kRuntimeVariableName = "runtime_variable";
+const std::string SimulationBackup::kNumShardsName = "num_shards";
 
 std::vector<std::function<void()>> SimulationBackup::after_restore_event_ = {};
 
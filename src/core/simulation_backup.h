@@ -15,12 +15,15 @@
 #ifndef CORE_SIMULATION_BACKUP_H_
 #define CORE_SIMULATION_BACKUP_H_
 
+#include <sys/types.h>
 #include <functional>
 #include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "core/agent/agent.h"
+#include "core/param/param.h"
 #include "core/simulation.h"
 
 #include "core/util/io.h"
@@ -36,6 +39,7 @@ class SimulationBackup {
   static const std::string kSimulationName;
   static const std::string kSimulationStepName;
   static const std::string kRuntimeVariableName;
+  static const std::string kNumShardsName;
 
   /// If a whole simulation is restored from a ROOT file, the new
   /// ResourceManager is not updated before the end. Consequently, during
@@ -51,11 +55,18 @@ class SimulationBackup {
   SimulationBackup(const std::string& backup_file,
                    const std::string& restore_file);
 
+  /// Waits for the asynchronous backup that is in progress (if any).
+  ~SimulationBackup();
+
   void Backup(size_t completed_simulation_steps) {
     if (!backup_) {
       Log::Fatal("SimulationBackup",
                  "Requested to backup data, but no backup file given.");
     }
+    if (Simulation::GetActive()->GetParam()->sharded_backup) {
+      BackupSharded(completed_simulation_steps);
+      return;
+    }
 
     // create temporary file
     // if application crashes during backup; last backup is not corrupted
@@ -80,6 +91,21 @@ class SimulationBackup {
     rename(tmp_file.str().c_str(), backup_file.c_str());
   }
 
+  /// Writes the backup in a child process (see `Param::async_backup`).
+  /// The child process writes the same temporary file as `Backup` and renames
+  /// it once it is complete.\n
+  /// Returns false without making a backup if the previous asynchronous
+  /// backup is still being written. Falls back to `Backup` if the child
+  /// process cannot be created.
+  bool BackupAsync(size_t completed_simulation_steps);
+
+  /// Returns true if an asynchronous backup is being written.
+  bool IsBackupInProgress();
+
+  /// Blocks until the asynchronous backup that is in progress (if any) has
+  /// been written.
+  void WaitForBackup();
+
   void Restore() {
     if (!restore_) {
       Log::Fatal("SimulationBackup",
@@ -97,6 +123,11 @@ class SimulationBackup {
     }
     Simulation* restored_simulation = nullptr;
     file.Get()->GetObject(kSimulationName.c_str(), restored_simulation);
+    // the agents of a sharded backup are not part of the main file
+    auto shard_files = GetShardFileNames(file.Get(), restore_file);
+    if (!shard_files.empty()) {
+      RestoreShards(shard_files, restored_simulation);
+    }
     Simulation::GetActive()->Restore(std::move(*restored_simulation));
     Log::Info("Scheduler", "Restored simulation from ", restore_file);
     delete restored_simulation;
@@ -119,6 +150,54 @@ class SimulationBackup {
   bool restore_ = true;
   std::string backup_file;
   std::string restore_file;
+  /// Process id of the child process that writes the asynchronous backup;
+  /// zero if there is none
+  pid_t backup_pid_ = 0;
+
+  /// Warns if the child process with the given wait status did not write
+  /// the backup successfully.
+  void CheckBackupStatus(int status);
+
+  /// Contiguous range of agents in one NUMA node that is stored in one
+  /// shard file
+  struct Shard {
+    uint64_t numa_node;
+    uint64_t start;
+    uint64_t end;
+  };
+
+  /// Writes the simulation without its agents to `backup_file` and the
+  /// agents to shard files in parallel (see `Param::sharded_backup`).
+  void BackupSharded(size_t completed_simulation_steps);
+
+  /// Reads the agents from the given shard files in parallel and inserts
+  /// them into the ResourceManager of `restored`. Each shard is read by a
+  /// thread of the NUMA node it belongs to, such that the agents are
+  /// allocated in this NUMA node.
+  static void RestoreShards(const std::vector<std::string>& shard_files,
+                            Simulation* restored);
+
+  /// Writes the agents of `shard` to the given file. Agents of the same type
+  /// are stored in one `TTree`.
+  static void WriteShard(const std::string& file_name, const Shard& shard);
+
+  /// Reads the NUMA node and the agent range of the given shard file.
+  static void ReadShardHeader(const std::string& file_name, Shard* shard);
+
+  /// Reads the agents of the given shard file. The agents are returned in
+  /// the order in which they were stored in the NUMA node.
+  static void ReadShard(const std::string& file_name, const Shard& shard,
+                        std::vector<Agent*>* agents);
+
+  static std::string GetShardFileName(const std::string& file_name,
+                                      size_t completed_simulation_steps,
+                                      size_t shard);
+
+  /// Returns the names of the shard files that belong to the backup `file`
+  /// with the given `file_name`. Returns an empty vector if the backup is not
+  /// sharded.
+  static std::vector<std::string> GetShardFileNames(
+      TFile* file, const std::string& file_name);
 };
 
 }  // namespace bdm
@@ -0,0 +1,200 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#ifndef CORE_UTIL_COUNTER_RNG_H_
+#define CORE_UTIL_COUNTER_RNG_H_
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "core/container/math_array.h"
+
+namespace bdm {
+
+/// Philox4x32-10 block function.\n
+/// Maps a 128 bit counter and a 64 bit key to 128 random bits. The output
+/// depends only on its arguments, which makes it possible to assign
+/// independent random streams to agents instead of threads.
+/// \see Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC11
+struct Philox4x32 {
+  using Counter = std::array<uint32_t, 4>;
+  using Key = std::array<uint32_t, 2>;
+
+  static Counter Generate(Counter ctr, Key key) {
+    for (int round = 0; round < 10; ++round) {
+      if (round != 0) {
+        key[0] += 0x9E3779B9;
+        key[1] += 0xBB67AE85;
+      }
+      uint64_t p0 = static_cast<uint64_t>(0xD2511F53) * ctr[0];
+      uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57) * ctr[2];
+      ctr = {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0],
+             static_cast<uint32_t>(p1),
+             static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1],
+             static_cast<uint32_t>(p0)};
+    }
+    return ctr;
+  }
+};
+
+/// Counter-based random number generator.\n
+/// A generator is identified by (seed, agent key, step, stream). Two
+/// generators with the same identity return the same sequence of numbers,
+/// regardless of the thread that uses them. Hence, two generators that are
+/// obtained for the same agent, step and stream return identical numbers.
+/// Streams must be used to obtain several independent sequences for the
+/// same agent and step (e.g. one per behavior).\n
+/// The generator is small and has no virtual functions. It is meant to be
+/// created on the stack where it is needed:
+///
+///     auto rng = sim->GetCounterRng(agent);
+///     auto direction = rng.UniformArray<3>(-1, 1);
+///
+/// \see `Simulation::GetCounterRng`, `Agent::GetRngKey`
+class CounterRng {
+ public:
+  CounterRng(uint64_t seed, uint64_t agent_key, uint64_t step,
+             uint32_t stream = 0) {
+    uint64_t key = Mix(seed ^ Mix(step));
+    key_ = {static_cast<uint32_t>(key), static_cast<uint32_t>(key >> 32)};
+    ctr_ = {0, stream, static_cast<uint32_t>(agent_key),
+            static_cast<uint32_t>(agent_key >> 32)};
+  }
+
+  /// Returns the agent key of the `daughter`-th agent that was created by
+  /// the agent with key `mother_key`. Unlike agent uids, the result does not
+  /// depend on the order in which agents are created.
+  static uint64_t DaughterKey(uint64_t mother_key, uint64_t step,
+                              uint64_t daughter) {
+    return Mix(Mix(mother_key ^ Mix(step)) + daughter);
+  }
+
+  /// Returns a uniform deviate on the interval (0, max).
+  double Uniform(double max = 1.0) { return max * NextUniform(); }
+
+  /// Returns a uniform deviate on the interval (min, max).
+  double Uniform(double min, double max) {
+    return min + (max - min) * NextUniform();
+  }
+
+  /// Returns a normally distributed deviate (Box-Muller transform).
+  double Gaus(double mean = 0.0, double sigma = 1.0) {
+    if (has_spare_) {
+      has_spare_ = false;
+      return mean + sigma * spare_;
+    }
+    double u1 = NextUniform();
+    double u2 = NextUniform();
+    double r = std::sqrt(-2.0 * std::log(u1));
+    spare_ = r * std::sin(kTwoPi * u2);
+    has_spare_ = true;
+    return mean + sigma * r * std::cos(kTwoPi * u2);
+  }
+
+  /// Returns an array of uniform random numbers in the interval (0, max)
+  template <uint64_t N>
+  MathArray<double, N> UniformArray(double max = 1.0) {
+    return UniformArray<N>(0.0, max);
+  }
+
+  /// Returns an array of uniform random numbers in the interval (min, max)
+  template <uint64_t N>
+  MathArray<double, N> UniformArray(double min, double max) {
+    MathArray<double, N> ret;
+    FillUniform(&ret[0], N, min, max);
+    return ret;
+  }
+
+  /// Fills `out` with `n` uniform random numbers in the interval (min, max).\n
+  /// Each Philox block is converted into two numbers without touching the
+  /// scalar buffer, so the loop has no carried dependency except the
+  /// block counter.
+  void FillUniform(double* out, uint64_t n, double min = 0.0,
+                   double max = 1.0) {
+    auto range = max - min;
+    uint64_t i = 0;
+    for (; i + 1 < n; i += 2) {
+      auto bits = NextBlock();
+      out[i] = min + range * ToUniform(bits[0], bits[1]);
+      out[i + 1] = min + range * ToUniform(bits[2], bits[3]);
+    }
+    if (i < n) {
+      out[i] = min + range * NextUniform();
+    }
+  }
+
+  /// Fills `out` with `n` normally distributed random numbers.
+  /// Uses both outputs of each Box-Muller transform.
+  void FillGaus(double* out, uint64_t n, double mean = 0.0,
+                double sigma = 1.0) {
+    uint64_t i = 0;
+    for (; i + 1 < n; i += 2) {
+      auto bits = NextBlock();
+      double r = std::sqrt(-2.0 * std::log(ToUniform(bits[0], bits[1])));
+      double phi = kTwoPi * ToUniform(bits[2], bits[3]);
+      out[i] = mean + sigma * r * std::cos(phi);
+      out[i + 1] = mean + sigma * r * std::sin(phi);
+    }
+    if (i < n) {
+      out[i] = Gaus(mean, sigma);
+    }
+  }
+
+ private:
+  static constexpr double kTwoPi = 6.283185307179586;
+
+  Philox4x32::Key key_;
+  /// {block, stream, agent key (low), agent key (high)}
+  Philox4x32::Counter ctr_;
+  /// Random bits of the current block
+  Philox4x32::Counter block_;
+  /// Number of consumed 64 bit halves of `block_` (2: block is empty)
+  uint32_t used_ = 2;
+  bool has_spare_ = false;
+  double spare_ = 0;
+
+  /// SplitMix64 finalizer. Used to derive the key from seed and step.
+  static uint64_t Mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+  }
+
+  /// Converts 64 random bits into a double in the open interval (0, 1).
+  static double ToUniform(uint32_t lo, uint32_t hi) {
+    uint64_t bits = (static_cast<uint64_t>(hi) << 32) | lo;
+    return ((bits >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+  }
+
+  Philox4x32::Counter NextBlock() {
+    auto bits = Philox4x32::Generate(ctr_, key_);
+    ctr_[0]++;
+    return bits;
+  }
+
+  double NextUniform() {
+    if (used_ == 2) {
+      block_ = NextBlock();
+      used_ = 0;
+    }
+    auto offset = 2 * used_++;
+    return ToUniform(block_[offset], block_[offset + 1]);
+  }
+};
+
+}  // namespace bdm
+
+#endif  // CORE_UTIL_COUNTER_RNG_H_
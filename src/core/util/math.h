@@ -46,6 +46,13 @@ struct Math {
     return dist_array.Norm();
   }
 
+  /// Returns the component `d` of a difference vector in a periodic space
+  /// with the given period such that its absolute value is minimal
+  /// (minimum image convention).
+  static double MinimumImage(double d, double period) {
+    return d - period * std::round(d / period);
+  }
+
   /// Returns the cross product of two vectors.
   /// @param a
   /// @param b
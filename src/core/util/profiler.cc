@@ -0,0 +1,378 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#include "core/util/profiler.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <numeric>
+
+#ifdef LINUX
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // LINUX
+
+#include "core/util/log.h"
+
+namespace bdm {
+
+namespace {
+
+std::atomic<uint64_t> gProfilerCounter(0);
+
+/// Opens a hardware counter for the calling thread.
+/// Returns -1 if the counter is not available.
+int OpenHardwareCounter(uint64_t config) {
+#ifdef LINUX
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+  return -1;
+#endif  // LINUX
+}
+
+void WriteJsonString(std::ostream& os, const std::string& str) {
+  os << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      os << '\\';
+    }
+    os << c;
+  }
+  os << '"';
+}
+
+}  // namespace
+
+// -----------------------------------------------------------------------------
+struct Profiler::ThreadBuffer {
+  uint32_t thread;
+  std::vector<Event> events;
+  /// File descriptors of the hardware counters (-1: not opened)
+  std::array<int, kNumCounters> counters;
+  bool counters_opened = false;
+
+  explicit ThreadBuffer(uint32_t thread) : thread(thread) {
+    counters.fill(-1);
+  }
+
+  ~ThreadBuffer() {
+#ifdef LINUX
+    for (auto fd : counters) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+#endif  // LINUX
+  }
+};
+
+// -----------------------------------------------------------------------------
+Profiler::Scope::Scope(Profiler* profiler, const std::string& name)
+    : profiler_(profiler) {
+  if (profiler_ == nullptr) {
+    return;
+  }
+  event_.name = profiler_->GetNameId(name);
+  event_.step = profiler_->step_;
+  event_.counters.fill(0);
+  if (profiler_->hardware_counters_) {
+    profiler_->ReadCounters(profiler_->GetThreadBuffer(), &event_.counters);
+  }
+  event_.start = profiler_->Now();
+}
+
+Profiler::Scope::~Scope() {
+  if (profiler_ == nullptr) {
+    return;
+  }
+  event_.duration = profiler_->Now() - event_.start;
+  auto* buffer = profiler_->GetThreadBuffer();
+  if (profiler_->hardware_counters_) {
+    std::array<uint64_t, kNumCounters> end;
+    profiler_->ReadCounters(buffer, &end);
+    for (int i = 0; i < kNumCounters; ++i) {
+      event_.counters[i] = end[i] - event_.counters[i];
+    }
+  }
+  event_.thread = buffer->thread;
+  buffer->events.push_back(event_);
+}
+
+// -----------------------------------------------------------------------------
+Profiler::Profiler()
+    : id_(++gProfilerCounter), epoch_(std::chrono::steady_clock::now()) {}
+
+Profiler::~Profiler() {}
+
+int64_t Profiler::Now() const {
+  auto elapsed = std::chrono::steady_clock::now() - epoch_;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+uint32_t Profiler::GetNameId(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = name_ids_.find(name);
+  if (it != name_ids_.end()) {
+    return it->second;
+  }
+  uint32_t id = names_.size();
+  names_.push_back(name);
+  name_ids_[name] = id;
+  return id;
+}
+
+std::string Profiler::GetName(uint32_t id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return names_[id];
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::BeginParallelRegion() {
+  auto max_threads = static_cast<size_t>(omp_get_max_threads());
+  if (busy_.size() != max_threads) {
+    busy_.resize(max_threads);
+  }
+  for (size_t i = 0; i < busy_.size(); ++i) {
+    busy_[i] = 0;
+  }
+  in_region_ = true;
+}
+
+void Profiler::AddBusyTime(int64_t duration) {
+  auto tid = static_cast<size_t>(omp_get_thread_num());
+  if (in_region_ && tid < busy_.size()) {
+    busy_[tid] += duration;
+  }
+}
+
+void Profiler::EndParallelRegion(const std::string& name) {
+  in_region_ = false;
+  Imbalance imbalance;
+  imbalance.name = GetNameId(name);
+  imbalance.step = step_;
+  imbalance.end = Now();
+  imbalance.busy.resize(busy_.size());
+  int64_t max = 0;
+  int64_t sum = 0;
+  for (size_t i = 0; i < busy_.size(); ++i) {
+    imbalance.busy[i] = busy_[i];
+    max = std::max(max, busy_[i]);
+    sum += busy_[i];
+  }
+  if (sum == 0) {
+    return;
+  }
+  imbalance.max_over_mean = static_cast<double>(max) * busy_.size() / sum;
+  imbalances_.push_back(std::move(imbalance));
+}
+
+// -----------------------------------------------------------------------------
+std::vector<Profiler::Event> Profiler::GetEvents() const {
+  std::vector<Event> events;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& buffer : buffers_) {
+      events.insert(events.end(), buffer->events.begin(),
+                    buffer->events.end());
+    }
+  }
+  std::sort(events.begin(), events.end(),
+            [](const Event& a, const Event& b) { return a.start < b.start; });
+  return events;
+}
+
+std::vector<int64_t> Profiler::GetStepTimes(const std::string& name) const {
+  uint32_t id = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = name_ids_.find(name);
+    if (it == name_ids_.end()) {
+      return {};
+    }
+    id = it->second;
+  }
+  std::map<uint64_t, int64_t> per_step;
+  for (auto& event : GetEvents()) {
+    if (event.name == id) {
+      per_step[event.step] += event.duration;
+    }
+  }
+  std::vector<int64_t> times;
+  times.reserve(per_step.size());
+  for (auto& el : per_step) {
+    times.push_back(el.second);
+  }
+  return times;
+}
+
+std::vector<uint64_t> Profiler::GetStepHistogram(const std::string& name,
+                                                 uint64_t bins) const {
+  std::vector<uint64_t> histogram(bins, 0);
+  auto times = GetStepTimes(name);
+  if (times.empty() || bins == 0) {
+    return histogram;
+  }
+  auto minmax = std::minmax_element(times.begin(), times.end());
+  double min = *minmax.first;
+  double width = (*minmax.second - min) / static_cast<double>(bins);
+  for (auto time : times) {
+    uint64_t bin = width == 0 ? 0 : static_cast<uint64_t>((time - min) / width);
+    histogram[std::min(bin, bins - 1)]++;
+  }
+  return histogram;
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::WriteChromeTrace(const std::string& filename) const {
+  std::ofstream ofs(filename);
+  if (!ofs) {
+    Log::Error("Profiler::WriteChromeTrace", "Could not open file ",
+               filename);
+    return;
+  }
+  // Chrome trace timestamps are in microseconds
+  ofs << std::fixed << std::setprecision(3);
+  ofs << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  auto separator = [&]() {
+    ofs << (first ? "\n" : ",\n");
+    first = false;
+  };
+  for (auto& event : GetEvents()) {
+    separator();
+    ofs << "{\"name\":";
+    WriteJsonString(ofs, GetName(event.name));
+    ofs << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread
+        << ",\"ts\":" << event.start * 1e-3
+        << ",\"dur\":" << event.duration * 1e-3
+        << ",\"args\":{\"step\":" << event.step;
+    if (hardware_counters_) {
+      ofs << ",\"cycles\":" << event.counters[kCycles]
+          << ",\"instructions\":" << event.counters[kInstructions];
+    }
+    ofs << "}}";
+  }
+  for (auto& imbalance : imbalances_) {
+    separator();
+    ofs << "{\"name\":";
+    WriteJsonString(ofs, GetName(imbalance.name) + " imbalance");
+    ofs << ",\"ph\":\"C\",\"pid\":0,\"ts\":" << imbalance.end * 1e-3
+        << ",\"args\":{\"max/mean\":" << imbalance.max_over_mean << "}}";
+  }
+  ofs << "\n]}\n";
+}
+
+void Profiler::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& buffer : buffers_) {
+    buffer->events.clear();
+  }
+  imbalances_.clear();
+}
+
+// -----------------------------------------------------------------------------
+Profiler::ThreadBuffer* Profiler::GetThreadBuffer() {
+  struct Cache {
+    uint64_t profiler = 0;
+    ThreadBuffer* buffer = nullptr;
+  };
+  static thread_local Cache kCache;
+  if (kCache.profiler != id_) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.emplace_back(new ThreadBuffer(buffers_.size()));
+    kCache.profiler = id_;
+    kCache.buffer = buffers_.back().get();
+  }
+  return kCache.buffer;
+}
+
+void Profiler::ReadCounters(ThreadBuffer* buffer,
+                            std::array<uint64_t, kNumCounters>* values) {
+  values->fill(0);
+  if (!buffer->counters_opened) {
+    buffer->counters_opened = true;
+    buffer->counters[kCycles] = OpenHardwareCounter(0);
+    buffer->counters[kInstructions] = OpenHardwareCounter(1);
+    if (buffer->counters[kCycles] == -1) {
+      Log::Warning("Profiler",
+                   "Hardware counters are not available (perf_event_open "
+                   "failed). Check /proc/sys/kernel/perf_event_paranoid.");
+    }
+  }
+#ifdef LINUX
+  for (int i = 0; i < kNumCounters; ++i) {
+    uint64_t value = 0;
+    if (buffer->counters[i] != -1 &&
+        read(buffer->counters[i], &value, sizeof(value)) == sizeof(value)) {
+      (*values)[i] = value;
+    }
+  }
+#endif  // LINUX
+}
+
+// -----------------------------------------------------------------------------
+std::ostream& operator<<(std::ostream& os, const Profiler& p) {
+  std::vector<std::string> names;
+  {
+    std::lock_guard<std::mutex> lock(p.mutex_);
+    names = p.names_;
+  }
+  os << "\033[1mProfile (per step, in ms)\033[0m" << std::endl;
+  os << std::fixed << std::setprecision(3);
+  for (auto& name : names) {
+    auto times = p.GetStepTimes(name);
+    if (times.empty()) {
+      continue;
+    }
+    auto total = std::accumulate(times.begin(), times.end(), int64_t(0));
+    std::sort(times.begin(), times.end());
+    auto percentile = [&](double q) {
+      return times[static_cast<size_t>(q * (times.size() - 1))] * 1e-6;
+    };
+    os << name << ": total " << total * 1e-6 << ", mean "
+       << total * 1e-6 / times.size() << ", p50 " << percentile(0.5)
+       << ", p95 " << percentile(0.95) << ", max " << times.back() * 1e-6;
+
+    double max_imbalance = 0;
+    double sum_imbalance = 0;
+    uint64_t num_imbalance = 0;
+    for (auto& imbalance : p.imbalances_) {
+      if (names[imbalance.name] == name) {
+        max_imbalance = std::max(max_imbalance, imbalance.max_over_mean);
+        sum_imbalance += imbalance.max_over_mean;
+        num_imbalance++;
+      }
+    }
+    if (num_imbalance != 0) {
+      os << ", imbalance (max/mean) mean " << sum_imbalance / num_imbalance
+         << " max " << max_imbalance;
+    }
+    os << std::endl;
+  }
+  return os;
+}
+
+}  // namespace bdm
@@ -0,0 +1,178 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#ifndef CORE_UTIL_PROFILER_H_
+#define CORE_UTIL_PROFILER_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "core/container/shared_data.h"
+
+namespace bdm {
+
+/// \brief Records the wall time of named code regions with nanosecond
+/// resolution for each thread.
+///
+/// The scheduler records one event for each operation it executes (see
+/// `Param::profiling`). For the agent operations it also measures how long
+/// each thread was busy, to quantify the load imbalance of the parallel
+/// region (maximum / mean busy time across threads).\n
+/// Events are stored in thread local buffers and can be exported to the
+/// Chrome trace format, which can be opened with chrome://tracing or
+/// https://ui.perfetto.dev.\n
+/// On Linux, the number of cycles and instructions of each event can be
+/// recorded in addition with `perf_event_open`
+/// (`Param::profiling_hardware_counters`).
+class Profiler {
+ public:
+  /// Hardware counters that are recorded for each event
+  enum Counter { kCycles = 0, kInstructions, kNumCounters };
+
+  struct Event {
+    uint32_t name;
+    /// Index of the thread in the order in which threads recorded their first
+    /// event.
+    uint32_t thread;
+    uint64_t step;
+    /// Nanoseconds since the construction of the profiler
+    int64_t start;
+    int64_t duration;
+    /// Zero if hardware counters are disabled or not available.
+    std::array<uint64_t, kNumCounters> counters;
+  };
+
+  /// Load imbalance of one parallel region
+  struct Imbalance {
+    uint32_t name;
+    uint64_t step;
+    /// End of the parallel region
+    int64_t end;
+    /// Busy time of each OpenMP thread in nanoseconds
+    std::vector<int64_t> busy;
+    /// max(busy) / mean(busy)
+    double max_over_mean;
+  };
+
+  /// Records an event for the lifetime of this object.
+  /// Does nothing if `profiler` is a nullptr.
+  class Scope {
+   public:
+    Scope(Profiler* profiler, const std::string& name);
+    ~Scope();
+
+   private:
+    Profiler* profiler_;
+    Event event_;
+  };
+
+  Profiler();
+  ~Profiler();
+
+  void SetEnabled(bool enabled) { enabled_ = enabled; }
+  bool IsEnabled() const { return enabled_; }
+
+  /// Records cycles and instructions for subsequent events.
+  /// Has no effect if `perf_event_open` is not available.
+  void SetHardwareCounters(bool enabled) { hardware_counters_ = enabled; }
+
+  /// Sets the simulation step that is attached to subsequent events.
+  void SetStep(uint64_t step) { step_ = step; }
+
+  /// Returns nanoseconds since the construction of the profiler.
+  int64_t Now() const;
+
+  uint32_t GetNameId(const std::string& name);
+  std::string GetName(uint32_t id) const;
+
+  /// Calls `f` and records an event with the given name.
+  template <typename TFunctor>
+  void Time(const std::string& name, TFunctor&& f) {
+    Scope scope(enabled_ ? this : nullptr, name);
+    f();
+  }
+
+  /// Resets the busy time of all threads.
+  /// Must be called outside of a parallel region.
+  void BeginParallelRegion();
+  /// Adds `duration` nanoseconds to the busy time of the calling OpenMP
+  /// thread. Has no effect outside of `BeginParallelRegion` and
+  /// `EndParallelRegion`.
+  void AddBusyTime(int64_t duration);
+  /// Returns true between `BeginParallelRegion` and `EndParallelRegion`
+  bool InParallelRegion() const { return in_region_; }
+  /// Stores the load imbalance of the region under the given name.
+  void EndParallelRegion(const std::string& name);
+
+  /// Returns the events of all threads sorted by start time.
+  std::vector<Event> GetEvents() const;
+  const std::vector<Imbalance>& GetImbalances() const { return imbalances_; }
+
+  /// Returns the total duration of all events with the given name for each
+  /// step in which at least one event was recorded (in nanoseconds).
+  std::vector<int64_t> GetStepTimes(const std::string& name) const;
+
+  /// Returns a histogram of `GetStepTimes(name)` with `bins` bins of equal
+  /// width between the minimum and maximum step time.
+  std::vector<uint64_t> GetStepHistogram(const std::string& name,
+                                         uint64_t bins = 10) const;
+
+  /// Writes all events in the Chrome trace event format (JSON).
+  /// The load imbalance is exported as counter track.
+  void WriteChromeTrace(const std::string& filename) const;
+
+  /// Removes all events and imbalances.
+  void Clear();
+
+ private:
+  struct ThreadBuffer;
+
+  /// Distinguishes profilers in the thread local buffer cache
+  uint64_t id_;
+  bool enabled_ = false;
+  bool hardware_counters_ = false;
+  uint64_t step_ = 0;
+  std::chrono::steady_clock::time_point epoch_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+  std::unordered_map<std::string, uint32_t> name_ids_;
+  std::vector<std::string> names_;
+
+  bool in_region_ = false;
+  SharedData<int64_t> busy_;
+  std::vector<Imbalance> imbalances_;
+
+  ThreadBuffer* GetThreadBuffer();
+  void ReadCounters(ThreadBuffer* buffer,
+                    std::array<uint64_t, kNumCounters>* values);
+
+  friend std::ostream& operator<<(std::ostream& os, const Profiler& p);
+};
+
+/// Prints a summary of all recorded events (total time, per-step
+/// statistics and load imbalance per name).
+std::ostream& operator<<(std::ostream& os, const Profiler& p);
+
+}  // namespace bdm
+
+#endif  // CORE_UTIL_PROFILER_H_
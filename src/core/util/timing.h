@@ -21,6 +21,7 @@
 
 #include "core/param/param.h"
 #include "core/simulation.h"
+#include "core/util/profiler.h"
 #include "core/util/timing_aggregator.h"
 
 namespace bdm {
@@ -41,6 +42,9 @@ class Timing {
   template <typename TFunctor>
   static void Time(const std::string& description, TFunctor&& f) {
     static bool kUseTimer = Simulation::GetActive()->GetParam()->statistics;
+    auto* profiler = Simulation::GetActive()->GetScheduler()->GetProfiler();
+    Profiler::Scope scope(profiler->IsEnabled() ? profiler : nullptr,
+                          description);
     if (kUseTimer) {
       auto* agg = Simulation::GetActive()->GetScheduler()->GetOpTimes();
       Timing timing(description, agg);
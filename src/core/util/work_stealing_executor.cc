@@ -0,0 +1,109 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#include "core/util/work_stealing_executor.h"
+#include "core/util/partition.h"
+
+namespace bdm {
+
+void WorkStealingExecutor::Prepare(uint64_t chunk, bool numa_aware) {
+  int max_threads = thread_info_->GetMaxThreads();
+  int numa_nodes = thread_info_->GetNumaNodes();
+
+  // rebuild the steal order if the thread to NUMA node mapping changed
+  bool changed =
+      thread_numa_mapping_.size() != static_cast<size_t>(max_threads);
+  for (int t = 0; !changed && t < max_threads; ++t) {
+    changed = thread_numa_mapping_[t] != thread_info_->GetNumaNode(t);
+  }
+  if (changed) {
+    thread_numa_mapping_.resize(max_threads);
+    for (int t = 0; t < max_threads; ++t) {
+      thread_numa_mapping_[t] = thread_info_->GetNumaNode(t);
+    }
+    queues_.resize(max_threads + numa_nodes);
+    victims_.clear();
+    victims_.resize(max_threads);
+    local_victims_.clear();
+    local_victims_.resize(max_threads);
+    for (int t = 0; t < max_threads; ++t) {
+      auto& victims = victims_[t];
+      auto& local_victims = local_victims_[t];
+      auto nid = thread_numa_mapping_[t];
+      // threads in the same NUMA domain first, then the other domains
+      for (int n = 0; n < numa_nodes; ++n) {
+        int current_nid = (nid + n) % numa_nodes;
+        for (int i = 1; i < max_threads; ++i) {
+          int other = (t + i) % max_threads;
+          if (thread_numa_mapping_[other] == current_nid) {
+            victims.push_back(other);
+            if (n == 0) {
+              local_victims.push_back(other);
+            }
+          }
+        }
+      }
+      for (int n = 0; n < numa_nodes; ++n) {
+        victims.push_back(max_threads + n);
+        local_victims.push_back(max_threads + n);
+      }
+    }
+  }
+
+  // chunk indices must fit into 32 bits
+  uint64_t max_size = 0;
+  for (auto size : sizes_) {
+    max_size = std::max(max_size, size);
+  }
+  chunk_ = std::max(chunk, static_cast<uint64_t>(1));
+  chunk_ = std::max(chunk_, max_size / (TaskQueue::kMask - 1) + 1);
+  auto num_chunks = [&](uint64_t domain) {
+    return (sizes_[domain] + chunk_ - 1) / chunk_;
+  };
+
+  uint64_t start = 0;
+  uint64_t end = 0;
+  if (numa_aware) {
+    for (int t = 0; t < max_threads; ++t) {
+      auto nid = thread_numa_mapping_[t];
+      Partition(num_chunks(nid), thread_info_->GetThreadsInNumaNode(nid),
+                thread_info_->GetNumaThreadId(t), &start, &end);
+      queues_[t].Set(nid, std::min(start, end), end);
+    }
+    // chunks of NUMA domains without threads can only be stolen
+    for (int n = 0; n < numa_nodes; ++n) {
+      auto chunks = thread_info_->GetThreadsInNumaNode(n) == 0 ? num_chunks(n)
+                                                               : 0;
+      queues_[max_threads + n].Set(n, 0, chunks);
+    }
+  } else {
+    // threads of the same NUMA domain receive neighboring ranges
+    std::vector<int> numa_offset(numa_nodes + 1, 0);
+    for (int n = 0; n < numa_nodes; ++n) {
+      numa_offset[n + 1] =
+          numa_offset[n] + thread_info_->GetThreadsInNumaNode(n);
+    }
+    for (int t = 0; t < max_threads; ++t) {
+      auto rank = numa_offset[thread_numa_mapping_[t]] +
+                  thread_info_->GetNumaThreadId(t);
+      Partition(num_chunks(0), max_threads, rank, &start, &end);
+      queues_[t].Set(0, std::min(start, end), end);
+    }
+    for (int n = 0; n < numa_nodes; ++n) {
+      queues_[max_threads + n].Set(0, 0, 0);
+    }
+  }
+}
+
+}  // namespace bdm
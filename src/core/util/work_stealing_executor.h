@@ -0,0 +1,212 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#ifndef CORE_UTIL_WORK_STEALING_EXECUTOR_H_
+#define CORE_UTIL_WORK_STEALING_EXECUTOR_H_
+
+#include <omp.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "core/container/shared_data.h"
+#include "core/util/thread_info.h"
+
+namespace bdm {
+
+/// \brief Executes parallel loops with NUMA-aware work stealing.
+///
+/// The iteration space is divided into chunks. Each thread owns a task
+/// queue that is initialized with a contiguous range of chunks. Threads take
+/// chunks from the front of their own queue. Once it is empty, they steal
+/// chunks from the back of other queues: first from threads in the same
+/// NUMA domain, then from the other domains.\n
+/// The queues and the steal order are allocated once and reused by all
+/// subsequent loops.\n
+/// Loops must not be nested. If a loop is started inside a parallel region,
+/// it is executed sequentially by the calling thread.
+class WorkStealingExecutor {
+ public:
+  static WorkStealingExecutor* GetInstance() {
+    static WorkStealingExecutor kInstance;
+    return &kInstance;
+  }
+
+  /// Calls `function(numa_node, start, end)` for consecutive element ranges
+  /// that together cover `[0, domain_size(numa_node))` for each NUMA node.
+  /// The chunks of NUMA node `n` are initially distributed among the threads
+  /// of NUMA node `n`.
+  /// \param chunk maximum number of elements of each range
+  /// \param steal_across_domains if false, threads only steal chunks from
+  ///        threads in their own NUMA domain. The chunks of NUMA nodes
+  ///        without threads are still processed by the other domains.
+  template <typename TSize, typename TFunction>
+  void ParallelForNuma(TSize&& domain_size, uint64_t chunk,
+                       TFunction&& function, bool steal_across_domains = true) {
+    auto numa_nodes = thread_info_->GetNumaNodes();
+    sizes_.resize(numa_nodes);
+    for (int n = 0; n < numa_nodes; ++n) {
+      sizes_[n] = domain_size(n);
+    }
+    if (omp_in_parallel()) {
+      for (int n = 0; n < numa_nodes; ++n) {
+        if (sizes_[n] != 0) {
+          function(n, 0, sizes_[n]);
+        }
+      }
+      return;
+    }
+    Prepare(chunk, true);
+    steal_across_domains_ = steal_across_domains;
+    Run(function);
+  }
+
+  /// Calls `function(start, end)` for consecutive element ranges that
+  /// together cover `[0, size)`.
+  /// \param chunk maximum number of elements of each range
+  template <typename TFunction>
+  void ParallelFor(uint64_t size, uint64_t chunk, TFunction&& function) {
+    if (size == 0) {
+      return;
+    }
+    if (omp_in_parallel()) {
+      function(0, size);
+      return;
+    }
+    sizes_.resize(1);
+    sizes_[0] = size;
+    Prepare(chunk, false);
+    steal_across_domains_ = true;
+    Run([&](uint64_t, uint64_t start, uint64_t end) { function(start, end); });
+  }
+
+ private:
+  /// Range of chunk indices `[head, tail)` of one domain.
+  /// Both values are packed into one atomic word. The owner increments the
+  /// head, thieves decrement the tail.
+  struct TaskQueue {
+    std::atomic<uint64_t> range;
+    uint64_t domain;
+
+    static constexpr uint64_t kMask = 0xFFFFFFFF;
+
+    TaskQueue() : range(0), domain(0) {}
+    /// Required to resize `queues_`. Must not be used while a loop is running.
+    TaskQueue(const TaskQueue& other)
+        : range(other.range.load()), domain(other.domain) {}
+
+    void Set(uint64_t domain, uint64_t head, uint64_t tail) {
+      this->domain = domain;
+      range.store((tail << 32) | head, std::memory_order_relaxed);
+    }
+
+    bool Pop(uint64_t* chunk) {
+      auto old = range.fetch_add(1, std::memory_order_acq_rel);
+      if ((old & kMask) < (old >> 32)) {
+        *chunk = old & kMask;
+        return true;
+      }
+      return false;
+    }
+
+    bool Steal(uint64_t* chunk) {
+      auto old = range.load(std::memory_order_acquire);
+      while ((old & kMask) < (old >> 32)) {
+        auto tail = (old >> 32) - 1;
+        if (range.compare_exchange_weak(old, (tail << 32) | (old & kMask),
+                                        std::memory_order_acq_rel,
+                                        std::memory_order_acquire)) {
+          *chunk = tail;
+          return true;
+        }
+      }
+      return false;
+    }
+  };
+
+  ThreadInfo* thread_info_ = ThreadInfo::GetInstance();
+  /// One queue per thread followed by one queue per NUMA node.
+  /// The latter hold the chunks of NUMA nodes without threads.
+  SharedData<TaskQueue> queues_;
+  /// The order in which each thread visits the queues of the other threads.
+  std::vector<std::vector<uint32_t>> victims_;
+  /// Same as `victims_`, but without the threads of other NUMA domains.
+  std::vector<std::vector<uint32_t>> local_victims_;
+  /// False if the current loop must not steal from other NUMA domains.
+  bool steal_across_domains_ = true;
+  /// Thread to NUMA node mapping for which `victims_` has been built.
+  std::vector<int> thread_numa_mapping_;
+  /// Number of elements in each domain of the current loop.
+  std::vector<uint64_t> sizes_;
+  uint64_t chunk_ = 1;
+
+  WorkStealingExecutor() {}
+
+  /// Distributes the chunks of the current loop among the task queues.
+  void Prepare(uint64_t chunk, bool numa_aware);
+
+  template <typename TFunction>
+  void Run(TFunction&& function) {
+#pragma omp parallel
+    {
+      auto tid = omp_get_thread_num();
+      // position in the steal order (0: own queue)
+      uint64_t victim = 0;
+      uint64_t domain = 0;
+      uint64_t start = 0;
+      uint64_t end = 0;
+      while (Next(tid, &victim, &domain, &start, &end)) {
+        function(domain, start, end);
+      }
+    }
+  }
+
+  /// Queues never receive new chunks during a loop. Hence, a queue that was
+  /// found to be empty can be skipped for the rest of the loop.
+  bool Next(int tid, uint64_t* victim, uint64_t* domain, uint64_t* start,
+            uint64_t* end) {
+    uint64_t chunk = 0;
+    TaskQueue* queue = &queues_[tid];
+    if (*victim == 0) {
+      if (queue->Pop(&chunk)) {
+        SetRange(*queue, chunk, domain, start, end);
+        return true;
+      }
+      *victim = 1;
+    }
+    const auto& victims =
+        steal_across_domains_ ? victims_[tid] : local_victims_[tid];
+    while (*victim <= victims.size()) {
+      queue = &queues_[victims[*victim - 1]];
+      if (queue->Steal(&chunk)) {
+        SetRange(*queue, chunk, domain, start, end);
+        return true;
+      }
+      (*victim)++;
+    }
+    return false;
+  }
+
+  void SetRange(const TaskQueue& queue, uint64_t chunk, uint64_t* domain,
+                uint64_t* start, uint64_t* end) const {
+    *domain = queue.domain;
+    *start = chunk * chunk_;
+    *end = std::min(sizes_[queue.domain], *start + chunk_);
+  }
+};
+
+}  // namespace bdm
+
+#endif  // CORE_UTIL_WORK_STEALING_EXECUTOR_H_
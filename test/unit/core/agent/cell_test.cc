@@ -113,6 +113,33 @@ TEST(CellTest, Divide) {
   EXPECT_NEAR(cell.captured_phi_, Math::kPi / 2, Math::kPi / 2);  // (0 - PI)
 }
 
+// With counter-based random numbers, the division only depends on the
+// dividing cell and not on the state of the thread local generators.
+TEST(CellTest, DivideWithCounterRng) {
+  auto set_param = [](Param* param) { param->use_counter_rng = true; };
+  Simulation simulation(TEST_NAME, set_param);
+
+  TestCell cell;
+  cell.capture_input_parameters_ = true;
+  TestCell copy(cell);
+
+  auto* daughter = cell.Divide();
+  simulation.GetRandom()->Uniform();
+  auto* copy_daughter = copy.Divide();
+
+  EXPECT_EQ(daughter->GetRngKey(), copy_daughter->GetRngKey());
+  EXPECT_NE(cell.GetRngKey(), daughter->GetRngKey());
+  EXPECT_EQ(cell.captured_volume_ratio, copy.captured_volume_ratio);
+  EXPECT_EQ(cell.captured_phi_, copy.captured_phi_);
+  EXPECT_EQ(cell.captured_theta_, copy.captured_theta_);
+  EXPECT_NEAR(cell.captured_volume_ratio, 1.0, 0.1);
+
+  // the next division creates a different daughter
+  auto* second_daughter = cell.Divide();
+  EXPECT_NE(daughter->GetRngKey(), second_daughter->GetRngKey());
+  EXPECT_NE(copy.captured_volume_ratio, cell.captured_volume_ratio);
+}
+
 TEST(CellTest, DivideVolumeRatio) {
   Simulation simulation(TEST_NAME);
 
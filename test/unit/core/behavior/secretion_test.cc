@@ -44,4 +44,27 @@ TEST(SecretionTest, Run) {
   EXPECT_NEAR(conc, 3.14, 1e-9);
 }
 
+TEST(SecretionTest, RunDeferred) {
+  auto set_param = [](Param* param) { param->deferred_secretion = true; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  ModelInitializer::DefineSubstance(0, "TestSubstance", 0, 0);
+
+  Double3 pos = {10, 11, 12};
+  for (int i = 0; i < 100; i++) {
+    auto* cell = new Cell();
+    cell->SetPosition(pos);
+    cell->SetDiameter(40);
+    cell->AddBehavior(new Secretion("TestSubstance", 0.5));
+    rm->AddAgent(cell);
+  }
+
+  // the changes are applied by the diffusion operation at the end of the
+  // step
+  simulation.Simulate(1);
+
+  auto* dg = rm->GetDiffusionGrid(0);
+  EXPECT_NEAR(dg->GetConcentration(pos), 50, 1e-9);
+}
+
 }  // namespace bdm
@@ -15,9 +15,11 @@
 #include <fstream>
 
 #include "core/agent/cell.h"
+#include "core/diffusion/adi_grid.h"
 #include "core/diffusion/diffusion_grid.h"
 #include "core/diffusion/euler_grid.h"
 #include "core/diffusion/runga_kutta_grid.h"
+#include "core/diffusion/sparse_euler_grid.h"
 #include "core/diffusion/stencil_grid.h"
 #include "core/environment/environment.h"
 #include "core/model_initializer.h"
@@ -153,6 +155,73 @@ TEST(DiffusionTest, FalseUpdateGrid) {
   delete d_grid;
 }
 
+// Test if each axis of a non-cubic diffusion grid only spans the
+// neighbor env dimensions along this axis
+TEST(DiffusionTest, NonCubicGrid) {
+  auto set_param = [](auto* param) {
+    param->non_cubic_diffusion_grid = true;
+    param->diffusion_boundary_condition = "closed";
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* env = simulation.GetEnvironment();
+
+  std::vector<Double3> positions;
+  positions.push_back({-10, -10, -10});
+  positions.push_back({290, 140, 20});
+  CellFactory(positions);
+
+  DiffusionGrid* d_grid = new EulerGrid(0, "Kalium", 0.4, 0, 21);
+
+  env->Update();
+  d_grid->Initialize();
+
+  auto env_dims = env->GetDimensions();
+  auto dims = d_grid->GetDimensions();
+  for (int i = 0; i < 6; i++) {
+    EXPECT_EQ(env_dims[i], dims[i]);
+  }
+
+  auto num_boxes = d_grid->GetNumBoxesArray();
+  EXPECT_EQ(21u, num_boxes[0]);
+  EXPECT_LT(num_boxes[1], num_boxes[0]);
+  EXPECT_LT(num_boxes[2], num_boxes[1]);
+  EXPECT_EQ(num_boxes[0] * num_boxes[1] * num_boxes[2],
+            d_grid->GetNumBoxes());
+  EXPECT_EQ(21, d_grid->GetResolution());
+
+  // the boxes must cover the whole grid
+  auto bl = d_grid->GetBoxLength();
+  for (int i = 0; i < 3; i++) {
+    EXPECT_GE(dims[2 * i] + (num_boxes[i] - 1) * bl, dims[2 * i + 1] - 1e-9);
+  }
+  auto corner = d_grid->GetBoxCoordinates({290, 140, 20});
+  for (int i = 0; i < 3; i++) {
+    EXPECT_LT(corner[i], num_boxes[i]);
+  }
+
+  Double3 center = {140, 65, 5};
+  d_grid->ChangeConcentrationBy(center, 1);
+  EXPECT_NEAR(1, d_grid->GetConcentration(center), abs_error<double>::value);
+  d_grid->Diffuse();
+  d_grid->CalculateGradient();
+
+  // the substance must spread equally along each axis
+  auto c = d_grid->GetBoxCoordinates(center);
+  auto* conc = d_grid->GetAllConcentrations();
+  EXPECT_GT(1, conc[d_grid->GetBoxIndex(c)]);
+  for (int i = 0; i < 3; i++) {
+    auto upper = c;
+    auto lower = c;
+    upper[i]++;
+    lower[i]--;
+    EXPECT_GT(conc[d_grid->GetBoxIndex(upper)], 0);
+    EXPECT_NEAR(conc[d_grid->GetBoxIndex(upper)],
+                conc[d_grid->GetBoxIndex(lower)], abs_error<double>::value);
+  }
+
+  delete d_grid;
+}
+
 // Create a 5x5x5 diffusion grid, with a substance being
 // added at center box 2,2,2, causing a symmetrical diffusion
 TEST(DiffusionTest, LeakingEdge) {
@@ -445,6 +514,7 @@ TEST(DISABLED_DiffusionTest, WrongParameters) {
   ASSERT_DEATH(
       {
         StencilGrid d_grid(0, "Kalium", 1, 0.5, 51);
+        d_grid.SetTimeStep(1);
         d_grid.Initialize();
       },
       ".*unphysical behavior*");
@@ -540,6 +610,615 @@ TEST(DiffusionTest, EulerConvergence) {
   delete d_grid8;
 }
 
+TEST(DiffusionTest, ADIConvergence) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kClosed;
+    param->min_bound = -100;
+    param->max_bound = 100;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+
+  double diff_coef = 0.5;
+  std::vector<DiffusionGrid*> grids = {
+      new ADIGrid(0, "Kalium1", diff_coef, 0, 21),
+      new ADIGrid(1, "Kalium4", diff_coef, 0, 41),
+      new ADIGrid(2, "Kalium8", diff_coef, 0, 81)};
+
+  // instantaneous point source
+  int init = 1e5;
+  Double3 source = {{0, 0, 0}};
+  Double3 marker = {10.0, 10.0, 10.0};
+  int tot = 100;
+
+  std::vector<double> errors;
+  for (auto* d_grid : grids) {
+    d_grid->Initialize();
+    d_grid->SetConcentrationThreshold(1e15);
+    d_grid->ChangeConcentrationBy(source,
+                                  init / pow(d_grid->GetBoxLength(), 3));
+    for (int t = 0; t < tot; t++) {
+      d_grid->DiffuseWithClosedEdge();
+    }
+
+    auto rc = GetRealCoordinates(d_grid->GetBoxCoordinates(source),
+                                 d_grid->GetBoxCoordinates(marker),
+                                 d_grid->GetBoxLength());
+    auto real_val =
+        CalculateAnalyticalSolution(init, rc[0], rc[1], rc[2], diff_coef, tot);
+    auto conc = d_grid->GetAllConcentrations();
+    errors.push_back(std::abs(real_val - conc[d_grid->GetBoxIndex(marker)]) /
+                     std::abs(real_val));
+
+    // closed edges conserve the total amount of substance
+    double sum = 0;
+    for (size_t i = 0; i < d_grid->GetNumBoxes(); i++) {
+      sum += conc[i];
+    }
+    EXPECT_NEAR(init, sum * pow(d_grid->GetBoxLength(), 3), 1e-6 * init);
+  }
+
+  EXPECT_TRUE(errors[1] < errors[0]);
+  EXPECT_TRUE(errors[2] < errors[1]);
+  EXPECT_NEAR(errors[2], 0.015, 0.01);
+
+  for (auto* d_grid : grids) {
+    delete d_grid;
+  }
+}
+
+// The explicit solvers would abort for these parameters
+// (D * dt / dx^2 >= 1/6)
+TEST(DiffusionTest, ADIBeyondExplicitStabilityLimit) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kClosed;
+    param->min_bound = -100;
+    param->max_bound = 100;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+
+  ADIGrid d_grid(0, "Oxygen", 50, 0, 41);
+  d_grid.Initialize();
+  d_grid.SetConcentrationThreshold(1e15);
+  d_grid.ChangeConcentrationBy({0, 0, 0}, 1e5);
+  for (int t = 0; t < 4; t++) {
+    d_grid.DiffuseWithClosedEdge();
+  }
+
+  auto conc = d_grid.GetAllConcentrations();
+  double sum = 0;
+  for (size_t i = 0; i < d_grid.GetNumBoxes(); i++) {
+    EXPECT_LE(0, conc[i]);
+    EXPECT_GT(1e5, conc[i]);
+    sum += conc[i];
+  }
+  EXPECT_NEAR(1e5, sum, 1e-3);
+}
+
+// As long as the substance does not reach the edges, the sparse grid must
+// produce the same result as the dense one (up to the discarded values below
+// the threshold)
+TEST(DiffusionTest, SparseEulerMatchesEuler) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kClosed;
+    param->min_bound = -100;
+    param->max_bound = 100;
+    param->sparse_diffusion_threshold = 1e-12;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+
+  EulerGrid dense(0, "Kalium", 0.4, 0.01, 41);
+  SparseEulerGrid sparse(1, "Kalium", 0.4, 0.01, 41);
+  dense.Initialize();
+  sparse.Initialize();
+  dense.ChangeConcentrationBy({0, 0, 0}, 1e5);
+  sparse.ChangeConcentrationBy({0, 0, 0}, 1e5);
+
+  // 41 boxes per axis -> 6 tiles per axis
+  EXPECT_EQ(216u, sparse.GetNumTiles());
+  for (int t = 0; t < 10; t++) {
+    dense.DiffuseWithClosedEdge();
+    sparse.DiffuseWithClosedEdge();
+  }
+  EXPECT_LT(0u, sparse.GetNumActiveTiles());
+  EXPECT_GT(sparse.GetNumTiles() / 4, sparse.GetNumActiveTiles());
+
+  auto expected = dense.GetAllConcentrations();
+  auto actual = sparse.GetAllConcentrations();
+  for (size_t i = 0; i < dense.GetNumBoxes(); i++) {
+    EXPECT_NEAR(expected[i], actual[i], 1e-9);
+  }
+
+  // The gradients are only calculated for the active tiles, which contain
+  // all boxes with a non-negligible gradient
+  dense.CalculateGradient();
+  sparse.CalculateGradient();
+  auto expected_grad = dense.GetAllGradients();
+  auto actual_grad = sparse.GetAllGradients();
+  for (size_t i = 0; i < 3 * dense.GetNumBoxes(); i++) {
+    EXPECT_NEAR(expected_grad[i], actual_grad[i], 1e-9);
+  }
+}
+
+TEST(DiffusionTest, SparseEulerActivation) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kClosed;
+    param->min_bound = -100;
+    param->max_bound = 100;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+
+  // The closed edge conserves the amount of substance, except for the
+  // amount discarded with deactivated tiles (at most the threshold per box)
+  SparseEulerGrid d_grid(0, "Kalium", 0.4, 0, 21);
+  d_grid.Initialize();
+  d_grid.ChangeConcentrationBy({90, 90, 90}, 1e5);
+  for (int t = 0; t < 300; t++) {
+    d_grid.DiffuseWithClosedEdge();
+  }
+  auto conc = d_grid.GetAllConcentrations();
+  double sum = 0;
+  for (size_t i = 0; i < d_grid.GetNumBoxes(); i++) {
+    sum += conc[i];
+  }
+  EXPECT_NEAR(1e5, sum, 1e-3);
+
+  // Tiles are deactivated once the substance has decayed and activated by
+  // changes of their concentration
+  SparseEulerGrid decaying(1, "Natrium", 0.4, 0.5, 41);
+  decaying.Initialize();
+  decaying.ChangeConcentrationBy({0, 0, 0}, 1);
+  decaying.DiffuseWithOpenEdge();
+  EXPECT_EQ(1u, decaying.GetNumActiveTiles());
+  for (int t = 0; t < 40; t++) {
+    decaying.DiffuseWithOpenEdge();
+  }
+  EXPECT_EQ(0u, decaying.GetNumActiveTiles());
+  decaying.ChangeConcentrationBy({50, 50, 50}, 1);
+  EXPECT_EQ(1u, decaying.GetNumActiveTiles());
+}
+
+TEST(DiffusionTest, TrilinearSampling) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kClosed;
+    param->min_bound = -100;
+    param->max_bound = 100;
+    param->trilinear_diffusion_sampling = true;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+
+  // Trilinear interpolation reproduces linear functions exactly
+  auto linear = [](const Double3& pos) {
+    return 100 + 0.5 * pos[0] - 0.25 * pos[1] + 2 * pos[2];
+  };
+
+  EulerGrid d_grid(0, "Kalium", 0.4, 0, 11);
+  d_grid.Initialize();
+  auto nba = d_grid.GetNumBoxesArray();
+  auto dims = d_grid.GetDimensions();
+  auto bl = d_grid.GetBoxLength();
+  for (uint32_t z = 0; z < nba[2]; z++) {
+    for (uint32_t y = 0; y < nba[1]; y++) {
+      for (uint32_t x = 0; x < nba[0]; x++) {
+        Double3 node = {dims[0] + x * bl, dims[2] + y * bl, dims[4] + z * bl};
+        std::array<uint32_t, 3> box = {x, y, z};
+        d_grid.ChangeConcentrationBy(d_grid.GetBoxIndex(box), linear(node));
+      }
+    }
+  }
+  d_grid.CalculateGradient();
+
+  std::vector<Double3> positions = {
+      {0, 0, 0}, {12.3, -45.6, 78.9}, {-99.5, 99.5, 3.7}, {33.3, 1e-3, -7}};
+  Double3 expected_gradient = {0.5, -0.25, 2};
+  for (auto& pos : positions) {
+    EXPECT_NEAR(linear(pos), d_grid.GetConcentration(pos), 1e-9);
+    Double3 gradient;
+    d_grid.GetGradient(pos, &gradient);
+    auto normalized = expected_gradient;
+    normalized.Normalize();
+    for (int i = 0; i < 3; i++) {
+      EXPECT_NEAR(normalized[i], gradient[i], 1e-9);
+    }
+  }
+
+  // positions outside the grid are clamped to its border
+  EXPECT_NEAR(linear({100, 0, 0}), d_grid.GetConcentration({150, 0, 0}),
+              1e-9);
+
+  // batch API
+  std::vector<double> concentrations(positions.size());
+  std::vector<Double3> gradients(positions.size());
+  d_grid.GetConcentrations(positions.data(), positions.size(),
+                           concentrations.data());
+  d_grid.GetGradients(positions.data(), positions.size(), gradients.data(),
+                      false);
+  for (size_t i = 0; i < positions.size(); i++) {
+    EXPECT_NEAR(linear(positions[i]), concentrations[i], 1e-9);
+    for (int d = 0; d < 3; d++) {
+      EXPECT_NEAR(expected_gradient[d], gradients[i][d], 1e-9);
+    }
+  }
+}
+
+TEST(DiffusionTest, BatchSampling) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kClosed;
+    param->min_bound = -100;
+    param->max_bound = 100;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+  auto* random = simulation.GetRandom();
+
+  EulerGrid d_grid(0, "Kalium", 0.4, 0, 21);
+  d_grid.Initialize();
+  for (int i = 0; i < 20; i++) {
+    d_grid.ChangeConcentrationBy(random->UniformArray<3>(-90, 90), 1e4);
+  }
+  for (int i = 0; i < 5; i++) {
+    d_grid.DiffuseWithClosedEdge();
+  }
+  d_grid.CalculateGradient();
+
+  // more positions than one internal batch
+  std::vector<Double3> positions(150);
+  for (auto& pos : positions) {
+    pos = random->UniformArray<3>(-100, 100);
+  }
+  std::vector<double> concentrations(positions.size());
+  std::vector<Double3> gradients(positions.size());
+  d_grid.GetConcentrations(positions.data(), positions.size(),
+                           concentrations.data());
+  d_grid.GetGradients(positions.data(), positions.size(), gradients.data());
+  for (size_t i = 0; i < positions.size(); i++) {
+    EXPECT_EQ(d_grid.GetConcentration(positions[i]), concentrations[i]);
+    Double3 gradient;
+    d_grid.GetGradient(positions[i], &gradient);
+    for (int d = 0; d < 3; d++) {
+      EXPECT_NEAR(gradient[d], gradients[i][d], 1e-12);
+    }
+  }
+}
+
+TEST(DiffusionTest, DeferredDeposits) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kClosed;
+    param->min_bound = 0;
+    param->max_bound = 100;
+    param->deferred_secretion = true;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+
+  EulerGrid d_grid(0, "Kalium", 0.4, 0, 11);
+  d_grid.Initialize();
+  d_grid.SetConcentrationThreshold(150);
+  auto num_boxes = d_grid.GetNumBoxes();
+
+#pragma omp parallel for
+  for (size_t i = 0; i < 100 * num_boxes; i++) {
+    d_grid.ChangeConcentrationBy(i % num_boxes, 1 + (i % num_boxes) % 2);
+  }
+
+  // the changes are not visible before they are applied
+  auto conc = d_grid.GetAllConcentrations();
+  for (size_t i = 0; i < num_boxes; i++) {
+    EXPECT_EQ(0, conc[i]);
+  }
+
+  d_grid.ApplyDeposits();
+  for (size_t i = 0; i < num_boxes; i++) {
+    EXPECT_DOUBLE_EQ(i % 2 == 0 ? 100 : 150, conc[i]);
+  }
+
+  // the buffers are empty after the changes have been applied
+  d_grid.ApplyDeposits();
+  EXPECT_DOUBLE_EQ(100, conc[0]);
+}
+
+TEST(DiffusionTest, DeferredDepositsInitializer) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kClosed;
+    param->min_bound = 0;
+    param->max_bound = 100;
+    param->deferred_secretion = true;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+
+  EulerGrid d_grid(0, "Kalium", 0.4, 0, 11);
+  d_grid.AddInitializer([](double x, double y, double z) { return x; });
+  d_grid.Initialize();
+  d_grid.RunInitializers();
+
+  // the initial values are visible before the first step
+  auto conc = d_grid.GetAllConcentrations();
+  auto num_boxes = d_grid.GetNumBoxes();
+  auto dims = d_grid.GetDimensions();
+  auto box_length = d_grid.GetBoxLength();
+  auto nx = d_grid.GetNumBoxesArray()[0];
+  for (size_t i = 0; i < num_boxes; i++) {
+    EXPECT_DOUBLE_EQ(dims[0] + (i % nx) * box_length, conc[i]);
+  }
+}
+
+// Without sub-cycling these parameters would be unstable (D * dt / dx^2 >=
+// 1/6 for dt = 1)
+TEST(DiffusionTest, SubCycling) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kClosed;
+    param->min_bound = 0;
+    param->max_bound = 100;
+    param->diffusion_boundary_condition = "closed";
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+
+  EulerGrid d_grid(0, "Kalium", 2, 0, 51);
+  d_grid.Initialize();
+  ASSERT_DOUBLE_EQ(2, d_grid.GetBoxLength());
+  // stability limit: 2^2 / (6 * 2) = 1/3
+  EXPECT_EQ(4u, d_grid.CalculateTimeStep());
+  EXPECT_DOUBLE_EQ(0.25, d_grid.GetTimeStep());
+
+  d_grid.ChangeConcentrationBy({50, 50, 50}, 1e5);
+  for (int t = 0; t < 10; t++) {
+    d_grid.Diffuse();
+  }
+
+  auto conc = d_grid.GetAllConcentrations();
+  double sum = 0;
+  for (size_t i = 0; i < d_grid.GetNumBoxes(); i++) {
+    EXPECT_LE(0, conc[i]);
+    EXPECT_GT(1e5, conc[i]);
+    sum += conc[i];
+  }
+  EXPECT_NEAR(1e5, sum, 1e-3);
+
+  // time step set by the user
+  d_grid.SetTimeStep(0.1);
+  EXPECT_EQ(10u, d_grid.CalculateTimeStep());
+  EXPECT_DOUBLE_EQ(0.1, d_grid.GetTimeStep());
+
+  // time step scaled with the simulation time step
+  auto* param = const_cast<Param*>(simulation.GetParam());
+  param->scale_diffusion_with_time_step = true;
+  param->simulation_time_step = 0.5;
+  d_grid.SetTimeStep(0);
+  EXPECT_EQ(2u, d_grid.CalculateTimeStep());
+  EXPECT_DOUBLE_EQ(0.25, d_grid.GetTimeStep());
+}
+
+TEST(DiffusionTest, UpdateFrequencyWithInterpolation) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kClosed;
+    param->min_bound = 0;
+    param->max_bound = 100;
+    param->diffusion_boundary_condition = "closed";
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+
+  // With a stability limit of 4 / 3.6 each update of the slow grid consists
+  // of four sub-steps with dt = 1, i.e. it is equivalent to four steps of
+  // the reference grid.
+  EulerGrid reference(0, "Kalium", 0.6, 0, 51);
+  EulerGrid slow(1, "Kalium", 0.6, 0, 51);
+  slow.SetUpdateFrequency(4, true);
+  Double3 source = {50, 50, 50};
+  Double3 marker = {54, 50, 50};
+  for (auto* d_grid : {&reference, &slow}) {
+    d_grid->Initialize();
+    d_grid->ChangeConcentrationBy(source, 1e5);
+  }
+
+  double previous = slow.GetConcentration(marker);
+  EXPECT_EQ(0, previous);
+  for (int t = 1; t <= 8; t++) {
+    reference.Diffuse();
+    slow.Diffuse();
+    EXPECT_EQ(t % 4 == 1, slow.UpdatedInLastStep());
+    if (t % 4 == 0) {
+      EXPECT_DOUBLE_EQ(1, slow.GetTimeStep());
+      EXPECT_DOUBLE_EQ(reference.GetConcentration(marker),
+                       slow.GetConcentration(marker));
+      previous = slow.GetConcentration(marker);
+    }
+  }
+
+  // in between two updates the values are interpolated
+  slow.Diffuse();
+  auto next = slow.GetAllConcentrations()[slow.GetBoxIndex(marker)];
+  EXPECT_DOUBLE_EQ(0.75 * previous + 0.25 * next,
+                   slow.GetConcentration(marker));
+}
+
+// The fused sweep must produce the same concentrations and gradients as
+// diffusing each grid separately and calculating its gradients afterwards.
+// The grid spans several slabs of the sweep.
+TEST(DiffusionTest, EulerFusedSweep) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kClosed;
+    param->min_bound = -100;
+    param->max_bound = 100;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+
+  for (bool closed_edge : {true, false}) {
+    EulerGrid separate0(0, "Kalium", 0.4, 0.01, 21);
+    EulerGrid separate1(1, "Natrium", 0.2, 0, 21);
+    EulerGrid fused0(2, "Kalium", 0.4, 0.01, 21);
+    EulerGrid fused1(3, "Natrium", 0.2, 0, 21);
+    std::vector<EulerGrid*> separate = {&separate0, &separate1};
+    std::vector<EulerGrid*> fused = {&fused0, &fused1};
+    for (size_t i = 0; i < 2; i++) {
+      for (auto* d_grid : {separate[i], fused[i]}) {
+        d_grid->Initialize();
+        d_grid->SetConcentrationThreshold(1e15);
+        d_grid->ChangeConcentrationBy({0, 0, 0}, 1e5 * (i + 1));
+        d_grid->ChangeConcentrationBy({30, -40, 50}, 1e4);
+      }
+    }
+    ASSERT_TRUE(fused0.IsColocated(fused1));
+
+    for (int t = 0; t < 10; t++) {
+      for (auto* d_grid : separate) {
+        if (closed_edge) {
+          d_grid->DiffuseWithClosedEdge();
+        } else {
+          d_grid->DiffuseWithOpenEdge();
+        }
+        d_grid->CalculateGradient();
+      }
+      EulerGrid::DiffuseFused(fused, closed_edge, true);
+    }
+
+    for (size_t i = 0; i < 2; i++) {
+      auto num_boxes = separate[i]->GetNumBoxes();
+      ASSERT_EQ(num_boxes, fused[i]->GetNumBoxes());
+      auto expected_conc = separate[i]->GetAllConcentrations();
+      auto actual_conc = fused[i]->GetAllConcentrations();
+      auto expected_grad = separate[i]->GetAllGradients();
+      auto actual_grad = fused[i]->GetAllGradients();
+      for (size_t b = 0; b < num_boxes; b++) {
+        EXPECT_DOUBLE_EQ(expected_conc[b], actual_conc[b]);
+        for (size_t d = 0; d < 3; d++) {
+          EXPECT_DOUBLE_EQ(expected_grad[3 * b + d], actual_grad[3 * b + d]);
+        }
+      }
+    }
+  }
+}
+
+// Substance deposited at the lower bound must diffuse across the bound and
+// the total amount must be conserved
+TEST(DiffusionTest, PeriodicEdge) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kTorus;
+    param->min_bound = -100;
+    param->max_bound = 100;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+
+  EulerGrid d_grid(0, "Kalium", 0.4, 0, 21);
+  d_grid.Initialize();
+  d_grid.SetConcentrationThreshold(1e15);
+  d_grid.ChangeConcentrationBy({-100, 0, 0}, 1e4);
+  ASSERT_EQ(21u, d_grid.GetNumBoxesArray()[0]);
+
+  // the last box along each axis is a copy of the first one
+  auto total = [&]() {
+    const auto* conc = d_grid.GetAllConcentrations();
+    double sum = 0;
+    for (uint32_t z = 0; z < 20; z++) {
+      for (uint32_t y = 0; y < 20; y++) {
+        for (uint32_t x = 0; x < 20; x++) {
+          sum += conc[d_grid.GetBoxIndex(std::array<uint32_t, 3>{x, y, z})];
+        }
+      }
+    }
+    return sum;
+  };
+  double initial = total();
+
+  for (int i = 0; i < 20; i++) {
+    d_grid.DiffuseWithPeriodicEdge();
+  }
+
+  const auto* conc = d_grid.GetAllConcentrations();
+  auto get = [&](uint32_t x, uint32_t y, uint32_t z) {
+    return conc[d_grid.GetBoxIndex(std::array<uint32_t, 3>{x, y, z})];
+  };
+  EXPECT_NEAR(initial, total(), 1e-9 * initial);
+  EXPECT_DOUBLE_EQ(get(0, 10, 10), get(20, 10, 10));
+  EXPECT_NEAR(get(1, 10, 10), get(19, 10, 10), 1e-9 * get(1, 10, 10));
+  EXPECT_NEAR(get(0, 9, 10), get(0, 11, 10), 1e-9 * get(0, 9, 10));
+  EXPECT_LT(0, get(19, 10, 10));
+  EXPECT_GT(get(0, 10, 10), get(2, 10, 10));
+}
+
+// The gradients at the bounds of a periodic space must take the boxes on the
+// opposite side into account
+TEST(DiffusionTest, PeriodicGradient) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kTorus;
+    param->min_bound = -100;
+    param->max_bound = 100;
+    param->diffusion_boundary_condition = "periodic";
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.GetEnvironment()->Update();
+
+  EulerGrid d_grid(0, "Kalium", 0.4, 0, 21);
+  d_grid.Initialize();
+  d_grid.SetConcentrationThreshold(1e15);
+  ASSERT_EQ(21u, d_grid.GetNumBoxesArray()[0]);
+  // the box below the lower bound is the second to last box
+  d_grid.ChangeConcentrationBy(
+      d_grid.GetBoxIndex(std::array<uint32_t, 3>{19, 10, 10}), 100);
+  d_grid.ChangeConcentrationBy(
+      d_grid.GetBoxIndex(std::array<uint32_t, 3>{10, 1, 10}), 100);
+  d_grid.CalculateGradient();
+
+  const auto* gradients = d_grid.GetAllGradients();
+  auto get = [&](uint32_t x, uint32_t y, uint32_t z, int d) {
+    auto idx = d_grid.GetBoxIndex(std::array<uint32_t, 3>{x, y, z});
+    return gradients[3 * idx + d];
+  };
+  double expected = 100 / (2 * d_grid.GetBoxLength());
+  EXPECT_DOUBLE_EQ(-expected, get(0, 10, 10, 0));
+  EXPECT_DOUBLE_EQ(-expected, get(20, 10, 10, 0));
+  EXPECT_DOUBLE_EQ(expected, get(18, 10, 10, 0));
+  EXPECT_DOUBLE_EQ(expected, get(10, 0, 10, 1));
+  EXPECT_DOUBLE_EQ(expected, get(10, 20, 10, 1));
+  EXPECT_DOUBLE_EQ(-expected, get(10, 2, 10, 1));
+  EXPECT_DOUBLE_EQ(0, get(10, 10, 0, 2));
+}
+
+// The grid of a periodic space must span exactly the bound space, even if
+// the agents (and hence the environment) cover a different region
+TEST(DiffusionTest, PeriodicEdgeWithAgents) {
+  auto set_param = [](auto* param) {
+    param->bound_space = Param::BoundSpaceMode::kTorus;
+    param->min_bound = -100;
+    param->max_bound = 100;
+    param->diffusion_boundary_condition = "periodic";
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  CellFactory({{-60, -60, -60}, {70, 20, 0}});
+  simulation.GetEnvironment()->Update();
+
+  EulerGrid d_grid(0, "Kalium", 0.4, 0, 21);
+  d_grid.Initialize();
+  auto dims = d_grid.GetDimensions();
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(-100, dims[2 * i]);
+    EXPECT_EQ(100, dims[2 * i + 1]);
+  }
+  ASSERT_EQ(21u, d_grid.GetNumBoxesArray()[0]);
+
+  d_grid.ChangeConcentrationBy({-100, 0, 0}, 1e4);
+  for (int i = 0; i < 20; i++) {
+    d_grid.Diffuse();
+  }
+
+  // The substance crossed the lower bound and the values are symmetric
+  // around it
+  EXPECT_LT(0, d_grid.GetConcentration({95, 0, 0}));
+  EXPECT_DOUBLE_EQ(d_grid.GetConcentration({-100, 0, 0}),
+                   d_grid.GetConcentration({100, 0, 0}));
+  EXPECT_NEAR(d_grid.GetConcentration({-85, 0, 0}),
+              d_grid.GetConcentration({95, 0, 0}),
+              1e-9 * d_grid.GetConcentration({-85, 0, 0}));
+}
+
 TEST(DISABLED_DiffusionTest, RungeKuttaConvergence) {
   auto set_param = [](auto* param) {
     param->bound_space = Param::BoundSpaceMode::kClosed;
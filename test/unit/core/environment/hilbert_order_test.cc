@@ -0,0 +1,104 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#include "core/environment/hilbert_order.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+
+namespace bdm {
+namespace hilbert_order_test_internal {
+
+// -----------------------------------------------------------------------------
+void VerifyHilbertOrder(const std::array<uint64_t, 3>& num_boxes_axis,
+                        bool check_neighbors) {
+  HilbertOrder ho;
+  ho.Update(num_boxes_axis);
+  auto num_boxes = num_boxes_axis[0] * num_boxes_axis[1] * num_boxes_axis[2];
+  ASSERT_EQ(num_boxes, ho.GetNumBoxes());
+
+  // each box must be visited exactly once
+  std::vector<uint64_t> actual(num_boxes);
+  for (uint64_t i = 0; i < num_boxes; ++i) {
+    actual[i] = ho.GetBoxIndex(i);
+  }
+  std::sort(actual.begin(), actual.end());
+  for (uint64_t i = 0; i < num_boxes; ++i) {
+    EXPECT_EQ(i, actual[i]);
+  }
+
+  if (!check_neighbors) {
+    return;
+  }
+  // consecutive boxes must share a face
+  auto coord = [&](uint64_t idx) {
+    return std::array<int64_t, 3>{
+        {static_cast<int64_t>(idx % num_boxes_axis[0]),
+         static_cast<int64_t>(idx / num_boxes_axis[0] % num_boxes_axis[1]),
+         static_cast<int64_t>(idx / (num_boxes_axis[0] * num_boxes_axis[1]))}};
+  };
+  for (uint64_t i = 1; i < num_boxes; ++i) {
+    auto c0 = coord(ho.GetBoxIndex(i - 1));
+    auto c1 = coord(ho.GetBoxIndex(i));
+    auto distance = std::llabs(c0[0] - c1[0]) + std::llabs(c0[1] - c1[1]) +
+                    std::llabs(c0[2] - c1[2]);
+    EXPECT_EQ(1, distance) << "position " << i;
+  }
+}
+
+// -----------------------------------------------------------------------------
+TEST(HilbertOrder, Cube1) { VerifyHilbertOrder({1, 1, 1}, true); }
+
+// -----------------------------------------------------------------------------
+TEST(HilbertOrder, Cube2) { VerifyHilbertOrder({2, 2, 2}, true); }
+
+// -----------------------------------------------------------------------------
+TEST(HilbertOrder, Cube8) { VerifyHilbertOrder({8, 8, 8}, true); }
+
+// -----------------------------------------------------------------------------
+TEST(HilbertOrder, Cube32) { VerifyHilbertOrder({32, 32, 32}, true); }
+
+// -----------------------------------------------------------------------------
+/// Not power of 2
+TEST(HilbertOrder, Cube3) { VerifyHilbertOrder({3, 3, 3}, false); }
+
+// -----------------------------------------------------------------------------
+TEST(HilbertOrder, Elongated) { VerifyHilbertOrder({50, 3, 7}, false); }
+
+// -----------------------------------------------------------------------------
+TEST(HilbertOrder, UpdateWithDifferentDimensions) {
+  HilbertOrder ho;
+  ho.Update({4, 4, 4});
+  EXPECT_EQ(64u, ho.GetNumBoxes());
+  ho.Update({5, 2, 3});
+  EXPECT_EQ(30u, ho.GetNumBoxes());
+}
+
+// -----------------------------------------------------------------------------
+TEST(HilbertOrder, GetHilbertCode) {
+  EXPECT_EQ(0u, HilbertOrder::GetHilbertCode({{0, 0, 0}}, 1));
+  // the curve of a 2x2x2 cube ends in a box next to the first one
+  uint64_t last = 0;
+  for (uint32_t x = 0; x < 2; ++x) {
+    for (uint32_t y = 0; y < 2; ++y) {
+      for (uint32_t z = 0; z < 2; ++z) {
+        last = std::max(last, HilbertOrder::GetHilbertCode({{x, y, z}}, 1));
+      }
+    }
+  }
+  EXPECT_EQ(7u, last);
+}
+
+}  // namespace hilbert_order_test_internal
+}  // namespace bdm
@@ -13,6 +13,9 @@
 // -----------------------------------------------------------------------------
 
 #include "core/environment/kd_tree_environment.h"
+#include <algorithm>
+#include <atomic>
+#include <set>
 #include "core/agent/cell.h"
 #include "gtest/gtest.h"
 #include "unit/test_util/test_util.h"
@@ -102,6 +105,119 @@ TEST(KDTreeTest, Setup) {
   EXPECT_EQ(expected_63, neighbors[AgentUid(63)]);
 }
 
+// Neighbors must not change if the tree is reused (`Param::kd_tree_skin`)
+TEST(KDTreeTest, ReuseTreeWithSkin) {
+  auto set_param = [](auto* param) {
+    param->environment = "kd_tree";
+    param->kd_tree_skin = 5;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* kdtree = dynamic_cast<KDTreeEnvironment*>(simulation.GetEnvironment());
+  CellFactory(rm, 4);
+
+  auto get_neighbors = [&]() {
+    std::unordered_map<AgentUid, std::vector<AgentUid>> neighbors;
+    rm->ForEachAgent([&](Agent* so) {
+      FillNeighborList fill_neighbor_list(&neighbors, so->GetUid());
+      kdtree->ForEachNeighbor(fill_neighbor_list, *so, 400);
+    });
+    for (auto& el : neighbors) {
+      std::sort(el.second.begin(), el.second.end());
+    }
+    return neighbors;
+  };
+
+  kdtree->Update();
+  EXPECT_FALSE(kdtree->IsTreeReused());
+
+  // move agents in and out of each other's search radius
+  rm->ForEachAgent([](Agent* so) {
+    auto uid = so->GetUid().GetIndex();
+    double shift = uid % 2 == 0 ? 2 : -2;
+    so->SetPosition(so->GetPosition() + Double3{shift, 0, 0});
+  });
+  kdtree->Update();
+  EXPECT_TRUE(kdtree->IsTreeReused());
+  auto reused = get_neighbors();
+
+  auto* param = const_cast<Param*>(simulation.GetParam());
+  param->kd_tree_skin = 0;
+  kdtree->Update();
+  EXPECT_FALSE(kdtree->IsTreeReused());
+  EXPECT_EQ(get_neighbors(), reused);
+
+  // displacements larger than the skin trigger a rebuild
+  param->kd_tree_skin = 5;
+  rm->GetAgent(AgentUid(0))->SetPosition({-10, 0, 0});
+  kdtree->Update();
+  EXPECT_FALSE(kdtree->IsTreeReused());
+
+  // as do new agents
+  rm->AddAgent(new Cell({1, 1, 1}));
+  kdtree->Update();
+  EXPECT_FALSE(kdtree->IsTreeReused());
+}
+
+struct CollectHandles : public Functor<void, Iterator<AgentHandle>*> {
+  std::vector<AgentHandle>* handles_;
+  explicit CollectHandles(std::vector<AgentHandle>* handles)
+      : handles_(handles) {}
+
+  void operator()(Iterator<AgentHandle>* it) override {
+    while (it->HasNext()) {
+      handles_->push_back(it->Next());
+    }
+  }
+};
+
+TEST(KDTreeTest, LoadBalanceInfo) {
+  auto set_param = [](auto* param) { param->environment = "kd_tree"; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* kdtree = simulation.GetEnvironment();
+  CellFactory(rm, 5);
+  kdtree->Update();
+
+  std::vector<AgentHandle> handles;
+  CollectHandles collect(&handles);
+  auto* lbi = kdtree->GetLoadBalanceInfo();
+  lbi->CallHandleIteratorConsumer(0, 60, collect);
+  lbi->CallHandleIteratorConsumer(60, rm->GetNumAgents(), collect);
+
+  // each agent exactly once
+  EXPECT_EQ(rm->GetNumAgents(), handles.size());
+  std::set<AgentUid> uids;
+  for (auto& ah : handles) {
+    uids.insert(rm->GetAgent(ah)->GetUid());
+  }
+  EXPECT_EQ(rm->GetNumAgents(), uids.size());
+}
+
+TEST(KDTreeTest, NeighborMutexBuilder) {
+  auto set_param = [](auto* param) {
+    param->environment = "kd_tree";
+    param->thread_safety_mechanism = Param::ThreadSafetyMechanism::kAutomatic;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* kdtree = simulation.GetEnvironment();
+  CellFactory(rm, 4);
+  kdtree->Update();
+
+  auto* builder = kdtree->GetNeighborMutexBuilder();
+  ASSERT_NE(builder, nullptr);
+  std::atomic<uint64_t> counter(0);
+  auto lock_neighborhood = L2F([&](Agent* agent) {
+    auto* mutex = builder->GetMutex(agent->GetBoxIdx());
+    mutex->lock();
+    counter++;
+    mutex->unlock();
+  });
+  rm->ForEachAgentParallel(lock_neighborhood);
+  EXPECT_EQ(rm->GetNumAgents(), counter);
+}
+
 // Test if SetEnvironment method works correctly for KDTreeEnvironment.
 TEST(KDTreeTest, SetEnvironment) {
   Simulation simulation(TEST_NAME);
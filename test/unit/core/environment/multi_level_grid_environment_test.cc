@@ -0,0 +1,203 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#include "core/environment/multi_level_grid_environment.h"
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <vector>
+#include "core/agent/cell.h"
+#include "unit/test_util/test_util.h"
+
+#include "gtest/gtest.h"
+
+namespace bdm {
+
+// Small cells on a regular grid and one large cell in the center
+inline void PolydisperseCellFactory(ResourceManager* rm,
+                                    size_t cells_per_dim) {
+  const double space = 10;
+  for (size_t i = 0; i < cells_per_dim; i++) {
+    for (size_t j = 0; j < cells_per_dim; j++) {
+      for (size_t k = 0; k < cells_per_dim; k++) {
+        Cell* cell = new Cell({k * space, j * space, i * space});
+        cell->SetDiameter(5 + (i + j + k) % 4);
+        rm->AddAgent(cell);
+      }
+    }
+  }
+  double center = 0.5 * (cells_per_dim - 1) * space;
+  Cell* large = new Cell({center, center, center});
+  large->SetDiameter(80);
+  rm->AddAgent(large);
+}
+
+struct CollectNeighbors : public Functor<void, Agent*, double> {
+  std::vector<AgentUid>* neighbors_;
+  explicit CollectNeighbors(std::vector<AgentUid>* neighbors)
+      : neighbors_(neighbors) {}
+
+  void operator()(Agent* neighbor, double squared_distance) override {
+    neighbors_->push_back(neighbor->GetUid());
+  }
+};
+
+TEST(MultiLevelGridTest, Levels) {
+  auto set_param = [](auto* param) {
+    param->environment = "multi_level_grid";
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* grid =
+      dynamic_cast<MultiLevelGridEnvironment*>(simulation.GetEnvironment());
+  ASSERT_NE(nullptr, grid);
+
+  PolydisperseCellFactory(rm, 8);
+  grid->Update();
+
+  // 80 / 2^3 = 10 is larger than the largest small cell
+  ASSERT_EQ(4u, grid->GetNumLevels());
+  EXPECT_NEAR(10, grid->GetBoxLength(0), abs_error<double>::value);
+  EXPECT_NEAR(80, grid->GetBoxLength(3), abs_error<double>::value);
+  EXPECT_EQ(512u, grid->GetNumAgents(0));
+  EXPECT_EQ(0u, grid->GetNumAgents(1));
+  EXPECT_EQ(0u, grid->GetNumAgents(2));
+  EXPECT_EQ(1u, grid->GetNumAgents(3));
+}
+
+TEST(MultiLevelGridTest, ForEachNeighbor) {
+  auto set_param = [](auto* param) {
+    param->environment = "multi_level_grid";
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* grid = simulation.GetEnvironment();
+
+  PolydisperseCellFactory(rm, 6);
+  grid->Update();
+
+  double squared_radius = 400;
+  rm->ForEachAgent([&](Agent* query) {
+    std::vector<AgentUid> actual;
+    CollectNeighbors collect(&actual);
+    grid->ForEachNeighbor(collect, *query, squared_radius);
+
+    std::vector<AgentUid> expected;
+    rm->ForEachAgent([&](Agent* other) {
+      auto diff = other->GetPosition() - query->GetPosition();
+      if (other != query && diff * diff <= squared_radius) {
+        expected.push_back(other->GetUid());
+      }
+    });
+    std::sort(actual.begin(), actual.end());
+    std::sort(expected.begin(), expected.end());
+    EXPECT_EQ(expected, actual);
+  });
+}
+
+// Every neighbor that is in range must be found. Others may be reported.
+TEST(MultiLevelGridTest, ForEachNeighborInRange) {
+  auto set_param = [](auto* param) {
+    param->environment = "multi_level_grid";
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* grid = simulation.GetEnvironment();
+
+  PolydisperseCellFactory(rm, 6);
+  grid->Update();
+
+  double squared_radius = grid->GetLargestAgentSizeSquared();
+  double margin = 3;
+  uint64_t num_in_range = 0;
+  rm->ForEachAgent([&](Agent* query) {
+    std::vector<AgentUid> actual;
+    CollectNeighbors collect(&actual);
+    grid->ForEachNeighborInRange(collect, *query, squared_radius, margin);
+    std::set<AgentUid> found(actual.begin(), actual.end());
+    EXPECT_EQ(actual.size(), found.size());
+
+    rm->ForEachAgent([&](Agent* other) {
+      auto diff = other->GetPosition() - query->GetPosition();
+      auto squared_distance = diff * diff;
+      auto range =
+          0.5 * (query->GetDiameter() + other->GetDiameter()) + margin;
+      if (other != query && squared_distance < squared_radius &&
+          squared_distance < range * range) {
+        EXPECT_TRUE(found.find(other->GetUid()) != found.end());
+        num_in_range++;
+      }
+    });
+  });
+  // the large cell interacts with many small cells
+  EXPECT_LT(216u, num_in_range);
+}
+
+TEST(MultiLevelGridTest, LoadBalanceInfo) {
+  auto set_param = [](auto* param) {
+    param->environment = "multi_level_grid";
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* grid = simulation.GetEnvironment();
+  PolydisperseCellFactory(rm, 5);
+  grid->Update();
+
+  std::vector<AgentHandle> handles;
+  auto collect = L2F([&](Iterator<AgentHandle>* it) {
+    while (it->HasNext()) {
+      handles.push_back(it->Next());
+    }
+  });
+  auto* lbi = grid->GetLoadBalanceInfo();
+  lbi->CallHandleIteratorConsumer(0, 60, collect);
+  lbi->CallHandleIteratorConsumer(60, rm->GetNumAgents() + 10, collect);
+
+  // each agent exactly once
+  EXPECT_EQ(rm->GetNumAgents(), handles.size());
+  std::set<AgentUid> uids;
+  for (auto& ah : handles) {
+    uids.insert(rm->GetAgent(ah)->GetUid());
+  }
+  EXPECT_EQ(rm->GetNumAgents(), uids.size());
+}
+
+TEST(MultiLevelGridTest, NeighborMutexBuilder) {
+  auto set_param = [](auto* param) {
+    param->environment = "multi_level_grid";
+    param->thread_safety_mechanism = Param::ThreadSafetyMechanism::kAutomatic;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* grid =
+      dynamic_cast<MultiLevelGridEnvironment*>(simulation.GetEnvironment());
+  ASSERT_NE(nullptr, grid);
+  PolydisperseCellFactory(rm, 5);
+  grid->Update();
+  ASSERT_LT(1u, grid->GetNumLevels());
+
+  auto* builder = grid->GetNeighborMutexBuilder();
+  ASSERT_NE(builder, nullptr);
+  std::atomic<uint64_t> counter(0);
+  auto lock_neighborhood = L2F([&](Agent* agent) {
+    auto* mutex = builder->GetMutex(agent->GetBoxIdx());
+    mutex->lock();
+    counter++;
+    mutex->unlock();
+  });
+  rm->ForEachAgentParallel(lock_neighborhood);
+  EXPECT_EQ(rm->GetNumAgents(), counter);
+}
+
+}  // namespace bdm
@@ -13,6 +13,11 @@
 // -----------------------------------------------------------------------------
 
 #include "core/environment/uniform_grid_environment.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
 #include "core/agent/cell.h"
 #include "core/environment/environment.h"
 #include "gtest/gtest.h"
@@ -186,6 +191,166 @@ TEST(UniformGridEnvironmentTest, NoRaceConditionDuringUpdate) {
   }
 }
 
+TEST(UniformGridEnvironmentTest, UpdateGridCompact) {
+  auto set_param = [](Param* param) { param->compact_uniform_grid = true; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* env = simulation.GetEnvironment();
+
+  CellFactory(rm, 4);
+
+  // make sure that there are multiple cells per box
+  rm->GetAgent(AgentUid(0))->SetDiameter(60);
+
+  env->Update();
+
+  // Remove cells 1 and 42
+  rm->RemoveAgent(AgentUid(1));
+  rm->RemoveAgent(AgentUid(42));
+
+  for (uint16_t i = 0; i < 10; i++) {
+    RunUpdateGridTest(&simulation);
+  }
+}
+
+TEST(UniformGridEnvironmentTest, UpdateGridIncremental) {
+  auto set_param = [](Param* param) { param->incremental_uniform_grid = true; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* grid =
+      static_cast<UniformGridEnvironment*>(simulation.GetEnvironment());
+
+  CellFactory(rm, 4);
+
+  // make sure that there are multiple cells per box
+  rm->GetAgent(AgentUid(0))->SetDiameter(60);
+
+  grid->Update();
+  EXPECT_FALSE(grid->WasUpdatedIncrementally());
+
+  // Remove cells 1 and 42
+  rm->RemoveAgent(AgentUid(1));
+  rm->RemoveAgent(AgentUid(42));
+
+  for (uint16_t i = 0; i < 10; i++) {
+    RunUpdateGridTest(&simulation);
+    EXPECT_TRUE(grid->WasUpdatedIncrementally());
+  }
+}
+
+TEST(UniformGridEnvironmentTest, UpdateGridIncrementalMovedAgents) {
+  auto set_param = [](Param* param) { param->incremental_uniform_grid = true; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* param = const_cast<Param*>(simulation.GetParam());
+  auto* grid =
+      static_cast<UniformGridEnvironment*>(simulation.GetEnvironment());
+
+  CellFactory(rm, 4);
+  grid->Update();
+
+  auto get_neighbors = [&]() {
+    std::unordered_map<AgentUid, std::vector<AgentUid>> neighbors;
+    rm->ForEachAgent([&](Agent* agent) {
+      auto& current = neighbors[agent->GetUid()];
+      auto fill_neighbor_list = L2F([&](Agent* neighbor, double squared_dist) {
+        if (squared_dist < 900) {
+          current.push_back(neighbor->GetUid());
+        }
+      });
+      grid->ForEachNeighbor(fill_neighbor_list, *agent, 900);
+      std::sort(current.begin(), current.end());
+    });
+    return neighbors;
+  };
+
+  // move agents to different boxes, add and remove agents
+  rm->GetAgent(AgentUid(0))->SetPosition({30, 30, 30});
+  rm->GetAgent(AgentUid(21))->SetPosition({1, 55, 2});
+  rm->GetAgent(AgentUid(63))->SetPosition({59, 59, 58});
+  rm->RemoveAgent(AgentUid(5));
+  rm->AddAgent(new Cell({10, 10, 10}));
+  grid->Update();
+  EXPECT_TRUE(grid->WasUpdatedIncrementally());
+  auto incremental = get_neighbors();
+
+  param->incremental_uniform_grid = false;
+  grid->Update();
+  EXPECT_FALSE(grid->WasUpdatedIncrementally());
+  EXPECT_EQ(get_neighbors(), incremental);
+
+  // an agent that leaves the grid triggers a rebuild
+  param->incremental_uniform_grid = true;
+  grid->Update();
+  rm->GetAgent(AgentUid(0))->SetPosition({200, 0, 0});
+  grid->Update();
+  EXPECT_FALSE(grid->WasUpdatedIncrementally());
+  std::array<int32_t, 6> expected_dim = {{-30, 240, -30, 120, -30, 120}};
+  EXPECT_EQ(expected_dim, grid->GetDimensions());
+}
+
+TEST(UniformGridEnvironmentTest, VerletNeighborLists) {
+  auto set_param = [](Param* param) {
+    param->verlet_neighbor_lists = true;
+    param->verlet_skin = 4;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* grid =
+      static_cast<UniformGridEnvironment*>(simulation.GetEnvironment());
+
+  CellFactory(rm, 4);
+  grid->Update();
+  EXPECT_TRUE(grid->HasValidVerletLists());
+  // largest agent size plus skin
+  EXPECT_EQ(34, grid->GetBoxLength());
+
+  auto get_neighbors = [&](const AgentUid& uid) {
+    std::vector<AgentUid> neighbors;
+    auto fill_neighbor_list = L2F([&](Agent* neighbor, double squared_dist) {
+      if (squared_dist < 900) {
+        neighbors.push_back(neighbor->GetUid());
+      }
+    });
+    grid->ForEachNeighbor(fill_neighbor_list, *rm->GetAgent(uid), 900);
+    std::sort(neighbors.begin(), neighbors.end());
+    return neighbors;
+  };
+
+  std::vector<AgentUid> expected_0 = {AgentUid(1),  AgentUid(4),
+                                      AgentUid(5),  AgentUid(16),
+                                      AgentUid(17), AgentUid(20)};
+  EXPECT_EQ(expected_0, get_neighbors(AgentUid(0)));
+
+  // small displacement (< skin / 2): lists are reused, but distances are
+  // calculated with the current positions
+  rm->GetAgent(AgentUid(5))->SetPosition({21.3, 21.3, 0});
+  grid->Update();
+  EXPECT_TRUE(grid->HasValidVerletLists());
+  std::vector<AgentUid> expected_0_small = {AgentUid(1), AgentUid(4),
+                                            AgentUid(16), AgentUid(17),
+                                            AgentUid(20)};
+  EXPECT_EQ(expected_0_small, get_neighbors(AgentUid(0)));
+
+  // large displacement triggers a rebuild
+  rm->GetAgent(AgentUid(1))->SetPosition({40, 0, 0});
+  grid->Update();
+  EXPECT_TRUE(grid->HasValidVerletLists());
+  std::vector<AgentUid> expected_0_large = {AgentUid(4), AgentUid(16),
+                                            AgentUid(17), AgentUid(20)};
+  EXPECT_EQ(expected_0_large, get_neighbors(AgentUid(0)));
+
+  // new agents invalidate the lists
+  auto* cell = new Cell({1, 1, 1});
+  cell->SetDiameter(30);
+  rm->AddAgent(cell);
+  grid->Update();
+  EXPECT_TRUE(grid->HasValidVerletLists());
+  auto neighbors_0 = get_neighbors(AgentUid(0));
+  EXPECT_NE(neighbors_0.end(),
+            std::find(neighbors_0.begin(), neighbors_0.end(), cell->GetUid()));
+}
+
 TEST(UniformGridEnvironmentTest, GetBoxIndex) {
   Simulation simulation(TEST_NAME);
   auto* rm = simulation.GetResourceManager();
@@ -275,6 +440,192 @@ struct TestFunctor : public Functor<void, Agent*, double> {
   void operator()(Agent* neighbor, double squared_distance) override {}
 };
 
+TEST(UniformGridEnvironmentTest, ForEachNeighborWithAgentSoA) {
+  auto set_param = [](Param* param) { param->soa_agent_storage = true; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* grid =
+      static_cast<UniformGridEnvironment*>(simulation.GetEnvironment());
+
+  CellFactory(rm, 4);
+  rm->UpdateAgentSoA();
+  grid->Update();
+
+  std::unordered_map<AgentUid, std::vector<AgentUid>> neighbors;
+  rm->ForEachAgent([&](Agent* agent) {
+    auto uid = agent->GetUid();
+    auto fill_neighbor_list = L2F([&](Agent* neighbor, double squared_dist) {
+      if (squared_dist < 1201) {
+        neighbors[uid].push_back(neighbor->GetUid());
+      }
+    });
+    grid->ForEachNeighbor(fill_neighbor_list, *agent, 1201);
+    // box indices are written to the mirror during the update
+    const auto* soa = rm->GetAgentSoA(0);
+    auto ah = rm->GetAgentHandle(uid);
+    EXPECT_EQ(agent->GetBoxIdx(), soa->GetBoxIdx(ah.GetElementIdx()));
+  });
+
+  std::vector<AgentUid> expected_0 = {AgentUid(1),  AgentUid(4),  AgentUid(5),
+                                      AgentUid(16), AgentUid(17), AgentUid(20),
+                                      AgentUid(21)};
+  std::vector<AgentUid> expected_63 = {AgentUid(42), AgentUid(43), AgentUid(46),
+                                       AgentUid(47), AgentUid(58), AgentUid(59),
+                                       AgentUid(62)};
+  std::sort(neighbors[AgentUid(0)].begin(), neighbors[AgentUid(0)].end());
+  std::sort(neighbors[AgentUid(63)].begin(), neighbors[AgentUid(63)].end());
+  EXPECT_EQ(expected_0, neighbors[AgentUid(0)]);
+  EXPECT_EQ(expected_63, neighbors[AgentUid(63)]);
+}
+
+TEST(UniformGridEnvironmentTest, ForEachNeighborPair) {
+  Simulation simulation(TEST_NAME);
+  auto* rm = simulation.GetResourceManager();
+  auto* grid =
+      static_cast<UniformGridEnvironment*>(simulation.GetEnvironment());
+
+  CellFactory(rm, 6);
+  grid->Update();
+
+  // each pair of candidates of ForEachNeighbor
+  std::map<std::pair<AgentUid, AgentUid>, int> expected;
+  rm->ForEachAgent([&](Agent* agent) {
+    auto uid = agent->GetUid();
+    auto add_pair = L2F([&](Agent* neighbor, double squared_dist) {
+      if (uid < neighbor->GetUid()) {
+        expected[{uid, neighbor->GetUid()}] = 1;
+      }
+    });
+    grid->ForEachNeighbor(add_pair, *agent, 900);
+  });
+
+  std::map<std::pair<AgentUid, AgentUid>, int> pairs;
+  std::mutex mutex;
+  // concurrent calls must not share an agent
+  std::vector<std::atomic<bool>> in_use(rm->GetNumAgents());
+  for (auto& el : in_use) {
+    el = false;
+  }
+  std::atomic<bool> conflict(false);
+  auto visit_pair = L2F([&](Agent* lhs, AgentHandle lhs_ah, Agent* rhs,
+                            AgentHandle rhs_ah) {
+    EXPECT_EQ(lhs, rm->GetAgent(lhs_ah));
+    EXPECT_EQ(rhs, rm->GetAgent(rhs_ah));
+    auto lhs_idx = lhs->GetUid().GetIndex();
+    auto rhs_idx = rhs->GetUid().GetIndex();
+    if (in_use[lhs_idx].exchange(true) || in_use[rhs_idx].exchange(true)) {
+      conflict = true;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto key = std::make_pair(std::min(lhs->GetUid(), rhs->GetUid()),
+                                std::max(lhs->GetUid(), rhs->GetUid()));
+      pairs[key]++;
+    }
+    in_use[lhs_idx] = false;
+    in_use[rhs_idx] = false;
+  });
+  grid->ForEachNeighborPair(visit_pair);
+
+  EXPECT_FALSE(conflict);
+  EXPECT_EQ(expected, pairs);
+}
+
+// Compares ForEachNeighbor with a brute force search that uses the minimum
+// image convention
+void RunPeriodicNeighborsTest(Simulation* simulation, uint64_t num_agents) {
+  auto* rm = simulation->GetResourceManager();
+  auto* random = simulation->GetRandom();
+  auto* grid =
+      static_cast<UniformGridEnvironment*>(simulation->GetEnvironment());
+  const double max_bound = simulation->GetParam()->max_bound;
+
+  for (uint64_t i = 0; i < num_agents; ++i) {
+    auto* cell = new Cell(random->UniformArray<3>(0, max_bound));
+    cell->SetDiameter(10);
+    rm->AddAgent(cell);
+  }
+  grid->Update();
+  EXPECT_TRUE(grid->IsPeriodic());
+
+  const double squared_radius = 100;
+  rm->ForEachAgent([&](Agent* query) {
+    std::vector<AgentUid> actual;
+    auto collect = L2F([&](Agent* neighbor, double squared_distance) {
+      if (squared_distance < squared_radius) {
+        actual.push_back(neighbor->GetUid());
+      }
+    });
+    grid->ForEachNeighbor(collect, *query, squared_radius);
+
+    std::vector<AgentUid> expected;
+    rm->ForEachAgent([&](Agent* neighbor) {
+      double squared_distance = 0;
+      for (int i = 0; i < 3; ++i) {
+        auto d = Math::MinimumImage(
+            neighbor->GetPosition()[i] - query->GetPosition()[i], max_bound);
+        squared_distance += d * d;
+      }
+      if (neighbor != query && squared_distance < squared_radius) {
+        expected.push_back(neighbor->GetUid());
+      }
+    });
+    std::sort(actual.begin(), actual.end());
+    std::sort(expected.begin(), expected.end());
+    EXPECT_EQ(expected, actual);
+  });
+}
+
+TEST(UniformGridEnvironmentTest, PeriodicNeighbors) {
+  auto set_param = [](Param* param) {
+    param->bound_space = Param::BoundSpaceMode::kTorus;
+    param->min_bound = 0;
+    param->max_bound = 100;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  RunPeriodicNeighborsTest(&simulation, 500);
+}
+
+// Less than three boxes along each axis: every box must be searched once
+TEST(UniformGridEnvironmentTest, PeriodicNeighborsFewBoxes) {
+  auto set_param = [](Param* param) {
+    param->bound_space = Param::BoundSpaceMode::kTorus;
+    param->min_bound = 0;
+    param->max_bound = 25;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  RunPeriodicNeighborsTest(&simulation, 20);
+}
+
+TEST(UniformGridEnvironmentTest, PeriodicNeighborsAcrossBound) {
+  auto set_param = [](Param* param) {
+    param->bound_space = Param::BoundSpaceMode::kTorus;
+    param->min_bound = 0;
+    param->max_bound = 100;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* grid =
+      static_cast<UniformGridEnvironment*>(simulation.GetEnvironment());
+
+  auto* cell0 = new Cell({1, 50, 99});
+  cell0->SetDiameter(10);
+  rm->AddAgent(cell0);
+  auto* cell1 = new Cell({99, 50, 1});
+  cell1->SetDiameter(10);
+  rm->AddAgent(cell1);
+  grid->Update();
+  EXPECT_DOUBLE_EQ(100, grid->GetPeriod());
+
+  std::vector<double> distances;
+  auto collect = L2F([&](Agent* neighbor, double squared_distance) {
+    distances.push_back(squared_distance);
+  });
+  grid->ForEachNeighbor(collect, *cell0, 100);
+  ASSERT_EQ(1u, distances.size());
+  EXPECT_NEAR(8, distances[0], abs_error<double>::value);
+}
+
 TEST(UniformGridEnvironment, CustomBoxLength) {
   Simulation simulation(TEST_NAME);
   auto* rm = simulation.GetResourceManager();
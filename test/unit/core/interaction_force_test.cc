@@ -68,6 +68,76 @@ TEST(InteractionForce, AllNonOverlappingSphere) {
   EXPECT_NEAR(0, result[2], abs_error<double>::value);
 }
 
+/// Tests that the batched sphere kernel returns the sum of the scalar
+/// sphere-sphere forces (overlapping and non-overlapping neighbors)
+TEST(InteractionForce, SphereBatch) {
+  Simulation simulation(TEST_NAME);
+
+  Cell cell({1.1, 1.0, 0.9});
+  cell.SetDiameter(8);
+  std::vector<Cell> neighbors = {Cell({0, 0, 0}), Cell({5, 5, 0}),
+                                 Cell({30, 0, 0}), Cell({-3, 2, 4})};
+  neighbors[0].SetDiameter(5);
+  neighbors[1].SetDiameter(10);
+  neighbors[2].SetDiameter(8);
+  neighbors[3].SetDiameter(12);
+
+  InteractionForce force;
+  Double3 expected = {0, 0, 0};
+  alignas(64) double x[4];
+  alignas(64) double y[4];
+  alignas(64) double z[4];
+  alignas(64) double diameter[4];
+  for (uint64_t i = 0; i < neighbors.size(); ++i) {
+    auto scalar = force.Calculate(&cell, &neighbors[i]);
+    expected += {scalar[0], scalar[1], scalar[2]};
+    x[i] = neighbors[i].GetPosition()[0];
+    y[i] = neighbors[i].GetPosition()[1];
+    z[i] = neighbors[i].GetPosition()[2];
+    diameter[i] = neighbors[i].GetDiameter();
+  }
+  auto result = force.CalculateSphereBatch(&cell, x, y, z, diameter, 4);
+
+  EXPECT_NEAR(expected[0], result[0], abs_error<double>::value);
+  EXPECT_NEAR(expected[1], result[1], abs_error<double>::value);
+  EXPECT_NEAR(expected[2], result[2], abs_error<double>::value);
+
+  result = force.CalculateSphereBatch(&cell, x, y, z, diameter, 0);
+  EXPECT_NEAR(0, result[0], abs_error<double>::value);
+  EXPECT_NEAR(0, result[1], abs_error<double>::value);
+  EXPECT_NEAR(0, result[2], abs_error<double>::value);
+}
+
+/// Tests that spheres interact across the bounds of a periodic space
+TEST(InteractionForce, PeriodicSphere) {
+  Simulation simulation(TEST_NAME);
+
+  Cell cell({1, 0, 0});
+  cell.SetDiameter(8);
+  Cell nb({98, 0, 0});
+  nb.SetDiameter(8);
+  // the image of the neighbor at -2
+  Cell image({-2, 0, 0});
+  image.SetDiameter(8);
+
+  InteractionForce force;
+  auto result = force.Calculate(&cell, &nb);
+  EXPECT_NEAR(0, result[0], abs_error<double>::value);
+
+  force.SetPeriod(100);
+  result = force.Calculate(&cell, &nb);
+  auto expected = force.Calculate(&cell, &image);
+  EXPECT_LT(0, result[0]);
+  EXPECT_NEAR(expected[0], result[0], abs_error<double>::value);
+
+  alignas(64) double x[1] = {98};
+  alignas(64) double y[1] = {0};
+  alignas(64) double z[1] = {0};
+  alignas(64) double diameter[1] = {8};
+  auto batch = force.CalculateSphereBatch(&cell, x, y, z, diameter, 1);
+  EXPECT_NEAR(expected[0], batch[0], abs_error<double>::value);
+}
+
 /// Tests the special case that neighbor and reference cell
 /// are at the same position -> should return random force
 TEST(InteractionForce, AllAtSamePositionSphere) {
@@ -285,5 +285,48 @@ TEST(MemoryManagerTest, New) {
   }
 }
 
+// -----------------------------------------------------------------------------
+TEST(MemoryManagerTest, Arena) {
+  Simulation simulation(TEST_NAME);
+  auto* param = simulation.GetParam();
+  auto* mem_mgr = simulation.GetMemoryManager();
+  ASSERT_TRUE(mem_mgr != nullptr);
+
+  mem_mgr->SetArenaEnabled(true);
+  auto* cell_1 = new Cell();
+  auto* cell_2 = new Cell();
+  mem_mgr->SetArenaEnabled(false);
+
+  // objects are stored consecutively
+  auto size =
+      NumaPoolAllocator::RoundUpTo(sizeof(Cell), alignof(std::max_align_t));
+  EXPECT_EQ(reinterpret_cast<char*>(cell_1) + size,
+            reinterpret_cast<char*>(cell_2));
+
+  uint64_t page_shift = static_cast<uint64_t>(std::log2(sysconf(_SC_PAGESIZE)));
+  auto addr = reinterpret_cast<uint64_t>(cell_1);
+  auto page_number = addr >> (page_shift + param->mem_mgr_aligned_pages_shift);
+  auto* page_addr = reinterpret_cast<char*>(
+      page_number << (page_shift + param->mem_mgr_aligned_pages_shift));
+  ASSERT_TRUE(ArenaBlock::IsArenaBlock(page_addr));
+
+  // one reference for each object plus one for the arena
+  auto* block = reinterpret_cast<ArenaBlock*>(page_addr);
+  EXPECT_EQ(3u, block->references);
+  delete cell_1;
+  EXPECT_EQ(2u, block->references);
+  delete cell_2;
+  EXPECT_EQ(1u, block->references);
+
+  // allocations outside the arena use the pool allocators
+  auto* cell_3 = new Cell();
+  addr = reinterpret_cast<uint64_t>(cell_3);
+  page_number = addr >> (page_shift + param->mem_mgr_aligned_pages_shift);
+  page_addr = reinterpret_cast<char*>(
+      page_number << (page_shift + param->mem_mgr_aligned_pages_shift));
+  EXPECT_FALSE(ArenaBlock::IsArenaBlock(page_addr));
+  delete cell_3;
+}
+
 }  // namespace memory_manager_detail
 }  // namespace bdm
@@ -21,10 +21,101 @@ namespace mechanical_forces_op_test_internal {
 TEST(DisplacementOpTest, ComputeUniformGrid) { RunTest("uniform_grid"); }
 TEST(DisplacementOpTest, ComputeKDTree) { RunTest("kd_tree"); }
 TEST(DisplacementOpTest, ComputeOctree) { RunTest("octree"); }
+TEST(DisplacementOpTest, ComputeMultiLevelGrid) {
+  RunTest("multi_level_grid");
+}
 
 TEST(DisplacementOpTest, ComputeNewUniformGrid) { RunTest2("uniform_grid"); }
 TEST(DisplacementOpTest, ComputeNewKDTree) { RunTest2("kd_tree"); }
 TEST(DisplacementOpTest, ComputeNewOctree) { RunTest2("octree"); }
+TEST(DisplacementOpTest, ComputeNewMultiLevelGrid) {
+  RunTest2("multi_level_grid");
+}
+
+// The forces of each pair are calculated once, but the displacements must
+// be the same as if each cell calculated its forces before any cell moved.
+TEST(DisplacementOpTest, SymmetricForces) {
+  auto set_param = [](auto* param) { param->symmetric_forces = true; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* random = simulation.GetRandom();
+  auto* env = simulation.GetEnvironment();
+
+  for (uint64_t i = 0; i < 500; ++i) {
+    Cell* cell = new Cell(random->UniformArray<3>(0, 100));
+    cell->SetDiameter(random->Uniform(8, 12));
+    cell->SetAdherence(0.01);
+    rm->AddAgent(cell);
+  }
+  env->Update();
+
+  // expected displacements
+  InteractionForce force;
+  auto squared_radius = env->GetLargestAgentSize() * env->GetLargestAgentSize();
+  auto dt = simulation.GetParam()->simulation_time_step;
+  std::unordered_map<AgentUid, Double3> expected;
+  rm->ForEachAgent([&](Agent* agent) {
+    expected[agent->GetUid()] =
+        agent->GetPosition() +
+        agent->CalculateDisplacement(&force, squared_radius, dt);
+  });
+
+  auto* op = NewOperation("mechanical forces");
+  op->SetUp();
+  auto* ctxt = simulation.GetExecutionContext();
+  rm->ForEachAgent([&](Agent* agent) { ctxt->Execute(agent, {op}); });
+  op->TearDown();
+
+  rm->ForEachAgent([&](Agent* agent) {
+    EXPECT_ARR_NEAR(expected[agent->GetUid()], agent->GetPosition());
+  });
+  delete op;
+}
+
+// Pairs of static cells are skipped, but static cells still push their
+// neighbors.
+TEST(DisplacementOpTest, SymmetricForcesStaticCells) {
+  auto set_param = [](auto* param) { param->symmetric_forces = true; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  auto* random = simulation.GetRandom();
+  auto* env = simulation.GetEnvironment();
+
+  for (uint64_t i = 0; i < 500; ++i) {
+    Cell* cell = new Cell(random->UniformArray<3>(0, 100));
+    cell->SetDiameter(random->Uniform(8, 12));
+    cell->SetAdherence(0.01);
+    if (i % 2 == 0) {
+      cell->SetStaticnessNextTimestep(true);
+      cell->UpdateStaticness();
+    }
+    rm->AddAgent(cell);
+  }
+  env->Update();
+
+  InteractionForce force;
+  auto squared_radius = env->GetLargestAgentSize() * env->GetLargestAgentSize();
+  auto dt = simulation.GetParam()->simulation_time_step;
+  std::unordered_map<AgentUid, Double3> expected;
+  rm->ForEachAgent([&](Agent* agent) {
+    expected[agent->GetUid()] = agent->GetPosition();
+    if (!agent->IsStatic()) {
+      expected[agent->GetUid()] +=
+          agent->CalculateDisplacement(&force, squared_radius, dt);
+    }
+  });
+
+  auto* op = NewOperation("mechanical forces");
+  op->SetUp();
+  auto* ctxt = simulation.GetExecutionContext();
+  rm->ForEachAgent([&](Agent* agent) { ctxt->Execute(agent, {op}); });
+  op->TearDown();
+
+  rm->ForEachAgent([&](Agent* agent) {
+    EXPECT_ARR_NEAR(expected[agent->GetUid()], agent->GetPosition());
+  });
+  delete op;
+}
 
 }  // namespace mechanical_forces_op_test_internal
 }  // namespace bdm
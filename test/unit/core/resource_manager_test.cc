@@ -14,6 +14,7 @@
 
 // I/O related code must be in header file
 #include "unit/core/resource_manager_test.h"
+#include "core/agent/cell.h"
 #include "core/model_initializer.h"
 #include "unit/test_util/io_test.h"
 #include "unit/test_util/test_agent.h"
@@ -156,6 +157,14 @@ TEST(ResourceManagerTest, SortAndForEachAgentParallel) {
   RunSortAndForEachAgentParallel();
 }
 
+TEST(ResourceManagerTest, SortAndForEachAgentParallelHilbert) {
+  RunSortAndForEachAgentParallel(Param::SpaceFillingCurve::kHilbert);
+}
+
+TEST(ResourceManagerTest, SortAndForEachAgentParallelRowMajor) {
+  RunSortAndForEachAgentParallel(Param::SpaceFillingCurve::kRowMajor);
+}
+
 TEST(ResourceManagerTest, SortAndForEachAgentParallelDynamic) {
   RunSortAndForEachAgentParallelDynamic();
 }
@@ -335,4 +344,180 @@ TEST(ResourceManagerTest, ParallelAgentRemoval_LargeScale75) {
   });
 }
 
+// -----------------------------------------------------------------------------
+void ExpectAgentSoAInSync(ResourceManager* rm) {
+  uint64_t cnt = 0;
+  rm->ForEachAgent([&](Agent* agent, AgentHandle ah) {
+    const auto* soa = rm->GetAgentSoA(ah.GetNumaNode());
+    ASSERT_TRUE(soa != nullptr);
+    auto idx = ah.GetElementIdx();
+    EXPECT_EQ(agent->GetUid(), soa->GetUid(idx));
+    EXPECT_EQ(agent->GetPosition(), soa->GetPosition(idx));
+    EXPECT_EQ(agent->GetDiameter(), soa->GetDiameter(idx));
+    EXPECT_EQ(agent->GetBoxIdx(), soa->GetBoxIdx(idx));
+    EXPECT_EQ(agent->IsStatic(), soa->IsStatic(idx));
+    cnt++;
+  });
+  EXPECT_EQ(rm->GetNumAgents(), cnt);
+}
+
+// -----------------------------------------------------------------------------
+TEST(ResourceManagerTest, AgentSoADisabledByDefault) {
+  Simulation simulation(TEST_NAME);
+  auto* rm = simulation.GetResourceManager();
+  EXPECT_FALSE(rm->IsAgentSoAEnabled());
+  EXPECT_TRUE(rm->GetAgentSoA(0) == nullptr);
+}
+
+// -----------------------------------------------------------------------------
+TEST(ResourceManagerTest, AgentSoAAddAndRemove) {
+  auto set_param = [](Param* param) { param->soa_agent_storage = true; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  EXPECT_TRUE(rm->IsAgentSoAEnabled());
+
+  std::vector<AgentUid> uids;
+  for (uint64_t i = 0; i < 10; ++i) {
+    auto* agent = new TestAgent({i * 1.0, i * 2.0, i * 3.0});
+    agent->SetDiameter(i + 1);
+    uids.push_back(agent->GetUid());
+    rm->AddAgent(agent);
+  }
+  ExpectAgentSoAInSync(rm);
+  EXPECT_EQ(10u, rm->GetAgentSoA(0)->size());
+
+  // removing an agent in the middle swaps in the last one
+  rm->RemoveAgent(uids[3]);
+  ExpectAgentSoAInSync(rm);
+  rm->RemoveAgent(uids[9]);
+  ExpectAgentSoAInSync(rm);
+  EXPECT_EQ(8u, rm->GetAgentSoA(0)->size());
+
+  // values are refreshed on request
+  rm->GetAgent(uids[0])->SetPosition({-1, -2, -3});
+  rm->UpdateAgentSoA();
+  ExpectAgentSoAInSync(rm);
+
+  rm->ClearAgents();
+  EXPECT_EQ(0u, rm->GetAgentSoA(0)->size());
+}
+
+// -----------------------------------------------------------------------------
+TEST(ResourceManagerTest, AgentSoAParallelRemovalAndLoadBalancing) {
+  auto set_param = [](Param* param) { param->soa_agent_storage = true; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+
+  auto construct = [](const Double3& pos) {
+    auto* agent = new TestAgent(pos);
+    agent->SetDiameter(10);
+    return agent;
+  };
+  ModelInitializer::Grid3D(8, 20, construct);
+  // runs load balancing in the first iteration
+  simulation.GetScheduler()->Simulate(1);
+  ExpectAgentSoAInSync(rm);
+
+  std::vector<bool> remove(rm->GetNumAgents());
+  for (uint64_t i = 0; i < remove.size(); ++i) {
+    remove[i] = i % 3 == 0;
+  }
+  DeleteFunctor f(remove);
+  rm->ForEachAgentParallel(f);
+  simulation.GetScheduler()->Simulate(1);
+  ExpectAgentSoAInSync(rm);
+}
+
+// -----------------------------------------------------------------------------
+// The agent operations write their changes back to the mirror, such that
+// it can be read after a step without a refresh.
+TEST(ResourceManagerTest, AgentSoAInSyncAfterAgentOperations) {
+  auto set_param = [](Param* param) { param->soa_agent_storage = true; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+
+  // overlapping cells push each other away
+  auto construct = [](const Double3& pos) {
+    auto* cell = new Cell(pos);
+    cell->SetDiameter(30);
+    return cell;
+  };
+  ModelInitializer::Grid3D(4, 20, construct);
+  std::unordered_map<AgentUid, Double3> initial_positions;
+  rm->ForEachAgent([&](Agent* agent) {
+    initial_positions[agent->GetUid()] = agent->GetPosition();
+  });
+
+  simulation.GetScheduler()->Simulate(3);
+  ExpectAgentSoAInSync(rm);
+  uint64_t moved = 0;
+  rm->ForEachAgent([&](Agent* agent) {
+    auto diff = agent->GetPosition() - initial_positions[agent->GetUid()];
+    if (diff.Norm() > 0) {
+      moved++;
+    }
+  });
+  EXPECT_LT(0u, moved);
+}
+
+// -----------------------------------------------------------------------------
+TEST(ResourceManagerTest, ActiveAgents) {
+  auto set_param = [](Param* param) {
+    param->detect_static_agents = true;
+    param->skip_static_agents = true;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+
+  std::vector<AgentUid> uids;
+  for (uint64_t i = 0; i < 10; ++i) {
+    auto* agent = new TestAgent(i);
+    uids.push_back(agent->GetUid());
+    rm->AddAgent(agent);
+  }
+
+  // imitates the operations "update staticness" and "propagate staticness"
+  // (without neighbors)
+  auto run_iteration = [&]() {
+    rm->UpdateActiveAgents();
+    std::set<AgentUid> visited;
+    Spinlock lock;
+    auto update_staticness = L2F([&](Agent* agent, AgentHandle) {
+      agent->UpdateStaticness();
+      agent->SetPropagateStaticness(false);
+      std::lock_guard<Spinlock> guard(lock);
+      visited.insert(agent->GetUid());
+    });
+    rm->ForEachActiveAgentParallel(1, update_staticness);
+    EXPECT_EQ(rm->GetNumActiveAgents(), visited.size());
+    return visited;
+  };
+
+  // new agents are active
+  EXPECT_EQ(10u, run_iteration().size());
+
+  // agent 3 moved during the last iteration
+  rm->GetAgent(uids[3])->SetStaticnessNextTimestep(false);
+  EXPECT_EQ(std::set<AgentUid>({uids[3]}), run_iteration());
+  for (uint64_t i = 0; i < uids.size(); ++i) {
+    EXPECT_EQ(i != 3, rm->GetAgent(uids[i])->IsStatic());
+  }
+
+  // agent 7 is woken up by a neighbor, agent 10 is new
+  rm->GetAgent(uids[7])->SetStaticnessNextTimestep(false);
+  auto* agent = new TestAgent(10);
+  uids.push_back(agent->GetUid());
+  rm->AddAgent(agent);
+  EXPECT_EQ(std::set<AgentUid>({uids[7], uids[10]}), run_iteration());
+  EXPECT_FALSE(rm->GetAgent(uids[7])->IsStatic());
+
+  // removing agents triggers a rebuild
+  rm->GetAgent(uids[7])->SetStaticnessNextTimestep(false);
+  rm->GetAgent(uids[9])->SetPropagateStaticness();
+  rm->RemoveAgent(uids[0]);
+  EXPECT_EQ(std::set<AgentUid>({uids[7], uids[9]}), run_iteration());
+
+  EXPECT_EQ(0u, run_iteration().size());
+}
+
 }  // namespace bdm
@@ -358,8 +358,11 @@ inline void CheckForEachAgent(ResourceManager* rm, uint64_t num_agent_per_type,
   }
 }
 
-inline void RunSortAndForEachAgentParallel(uint64_t num_agent_per_type) {
-  Simulation simulation("RunSortAndForEachAgentParallel");
+inline void RunSortAndForEachAgentParallel(
+    uint64_t num_agent_per_type,
+    Param::SpaceFillingCurve curve = Param::SpaceFillingCurve::kMorton) {
+  auto set_param = [&](Param* param) { param->space_filling_curve = curve; };
+  Simulation simulation("RunSortAndForEachAgentParallel", set_param);
   auto* rm = simulation.GetResourceManager();
 
   std::unordered_map<AgentUid, double> a_x_values;
@@ -398,17 +401,18 @@ inline void RunSortAndForEachAgentParallel(uint64_t num_agent_per_type) {
   }
 }
 
-inline void RunSortAndForEachAgentParallel() {
+inline void RunSortAndForEachAgentParallel(
+    Param::SpaceFillingCurve curve = Param::SpaceFillingCurve::kMorton) {
   int num_threads = omp_get_max_threads();
   std::vector<int> num_agent_per_type = {std::max(1, num_threads - 1),
                                          num_threads, 3 * num_threads,
                                          3 * num_threads + 1};
 
   for (auto n : num_agent_per_type) {
-    RunSortAndForEachAgentParallel(n);
+    RunSortAndForEachAgentParallel(n, curve);
   }
 
-  RunSortAndForEachAgentParallel(1000);
+  RunSortAndForEachAgentParallel(1000, curve);
 }
 
 // -----------------------------------------------------------------------------
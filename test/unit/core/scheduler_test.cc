@@ -15,6 +15,7 @@
 #include "unit/core/scheduler_test.h"
 #include "core/environment/uniform_grid_environment.h"
 #include "core/model_initializer.h"
+#include "core/operation/load_balancing_op.h"
 #include "core/operation/operation_registry.h"
 #include "unit/test_util/test_agent.h"
 
@@ -510,6 +511,30 @@ TEST_F(SchedulerTest, LoadAndBalanceAfterEnvironment) {
   }
 }
 
+// Test for Param::adaptive_load_balancing_threshold
+TEST_F(SchedulerTest, AdaptiveLoadBalancing) {
+  auto set_param = [&](Param* param) {
+    param->adaptive_load_balancing_threshold = 0.5;
+    param->adaptive_load_balancing_interval = 2;
+  };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* scheduler = simulation.GetScheduler();
+  EXPECT_EQ(2u, scheduler->GetOps("load balancing")[0]->frequency_);
+
+  ModelInitializer::Grid3D(5, 10, [](const Double3& pos) {
+    Cell* cell = new Cell(pos);
+    cell->SetDiameter(8);
+    return cell;
+  });
+  scheduler->Simulate(5);
+  EXPECT_EQ(125u, simulation.GetResourceManager()->GetNumAgents());
+
+  simulation.GetEnvironment()->Update();
+  auto distance = LoadBalancingOp::MeasureNeighborMemoryDistance();
+  EXPECT_LE(0.0, distance);
+  EXPECT_GE(1.0, distance);
+}
+
 // Test for Param::unschedule_default_operations
 TEST_F(SchedulerTest, DisableDefaultOperations) {
   auto set_param = [&](Param* param) {
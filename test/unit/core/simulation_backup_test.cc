@@ -143,6 +143,74 @@ TEST(SimulationBackupTest, BackupAndRestore) {
   remove(ROOTFILE);
 }
 
+TEST(SimulationBackupTest, BackupAsync) {
+  remove(ROOTFILE);
+  Simulation simulation(TEST_NAME);
+  auto* rm = simulation.GetResourceManager();
+
+  rm->AddAgent(new Cell());
+  size_t iterations = 26;
+
+  SimulationBackup backup(ROOTFILE, "");
+  EXPECT_TRUE(backup.BackupAsync(iterations));
+  // modifications after the snapshot must not be part of the backup
+  rm->AddAgent(new Cell());
+  backup.WaitForBackup();
+  EXPECT_FALSE(backup.IsBackupInProgress());
+  ASSERT_TRUE(FileExists(ROOTFILE));
+
+  SimulationBackup restore("", ROOTFILE);
+  EXPECT_EQ(26u, restore.GetSimulationStepsFromBackup());
+  restore.Restore();
+  EXPECT_EQ(1u, simulation.GetResourceManager()->GetNumAgents());
+
+  remove(ROOTFILE);
+}
+
+TEST(SimulationBackupTest, BackupAndRestoreSharded) {
+  remove(ROOTFILE);
+  auto set_param = [](Param* param) { param->sharded_backup = true; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+
+  for (uint64_t i = 0; i < 100; ++i) {
+    auto* cell = new Cell(i + 1);
+    cell->SetPosition({i * 1.0, 0, 0});
+    rm->AddAgent(cell);
+  }
+  std::vector<AgentUid> uids;
+  rm->ForEachAgent([&](Agent* agent) { uids.push_back(agent->GetUid()); });
+
+  SimulationBackup backup(ROOTFILE, "");
+  backup.Backup(25);
+  backup.Backup(26);
+
+  ASSERT_TRUE(FileExists(ROOTFILE));
+  // the shards of the previous backup have been removed
+  EXPECT_FALSE(FileExists(std::string(ROOTFILE) + ".25.shard0"));
+  EXPECT_TRUE(FileExists(std::string(ROOTFILE) + ".26.shard0"));
+
+  SimulationBackup restore("", ROOTFILE);
+  EXPECT_EQ(26u, restore.GetSimulationStepsFromBackup());
+  restore.Restore();
+
+  rm = simulation.GetResourceManager();
+  ASSERT_EQ(100u, rm->GetNumAgents());
+  // agents are restored in the same order
+  uint64_t cnt = 0;
+  rm->ForEachAgent([&](Agent* agent) {
+    EXPECT_EQ(uids[cnt], agent->GetUid());
+    EXPECT_EQ(uids[cnt], rm->GetAgent(uids[cnt])->GetUid());
+    EXPECT_NEAR(agent->GetDiameter() - 1, agent->GetPosition()[0], 1e-9);
+    cnt++;
+  });
+
+  remove(ROOTFILE);
+  for (uint64_t i = 0; i < 100; ++i) {
+    remove((std::string(ROOTFILE) + ".26.shard" + std::to_string(i)).c_str());
+  }
+}
+
 }  // namespace bdm
 
 #endif  // USE_DICT
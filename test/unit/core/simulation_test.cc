@@ -37,17 +37,25 @@ class SimulationTest : public ::testing::Test {
       "[simulation]\n"
       "unschedule_default_operations = [\"mechanical forces\"]\n"
       "random_seed = 123\n"
+      "use_counter_rng = true\n"
       "output_dir = \"result-dir\"\n"
       "backup_file = \"backup.root\"\n"
       "restore_file = \"restore.root\"\n"
       "backup_interval = 3600\n"
+      "async_backup = true\n"
+      "sharded_backup = true\n"
       "time_step = 0.0125\n"
       "max_displacement = 2.0\n"
       "bound_space = 0\n"
       "min_bound = -100\n"
       "max_bound =  200\n"
       "diffusion_method = \"runga-kutta\"\n"
+      "non_cubic_diffusion_grid = true\n"
+      "scale_diffusion_with_time_step = true\n"
+      "trilinear_diffusion_sampling = true\n"
+      "sparse_diffusion_threshold = 1e-6\n"
       "thread_safety_mechanism = \"automatic\"\n"
+      "multi_level_grid_levels = 3\n"
       "\n"
       "[visualization]\n"
       "insitu = false\n"
@@ -77,6 +85,7 @@ class SimulationTest : public ::testing::Test {
       "[performance]\n"
       "scheduling_batch_size = 123\n"
       "detect_static_agents = true\n"
+      "skip_static_agents = true\n"
       "cache_neighbors = true\n"
       "agent_uid_defragmentation_low_watermark = 0.123\n"
       "agent_uid_defragmentation_high_watermark = 0.456\n"
@@ -84,13 +93,29 @@ class SimulationTest : public ::testing::Test {
       "mem_mgr_aligned_pages_shift = 7\n"
       "mem_mgr_growth_rate = 1.123\n"
       "mem_mgr_max_mem_per_thread = 987654\n"
+      "mem_mgr_arena = true\n"
       "minimize_memory_while_rebalancing = false\n"
+      "space_filling_curve = \"hilbert\"\n"
+      "adaptive_load_balancing_threshold = 0.25\n"
+      "adaptive_load_balancing_interval = 7\n"
+      "soa_agent_storage = true\n"
+      "compact_uniform_grid = true\n"
+      "incremental_uniform_grid = true\n"
+      "verlet_neighbor_lists = true\n"
+      "verlet_skin = 4.5\n"
+      "kd_tree_skin = 1.5\n"
+      "vectorize_sphere_forces = true\n"
+      "symmetric_forces = true\n"
+      "fuse_diffusion_grids = true\n"
+      "deferred_secretion = true\n"
       "mapped_data_array_mode = \"cache\"\n"
       "\n"
       "[development]\n"
       "# this is a comment\n"
       "statistics = false\n"
-      "debug_numa = true\n";
+      "debug_numa = true\n"
+      "profiling = true\n"
+      "profiling_hardware_counters = true\n";
 
  protected:
   void SetUp() override {
@@ -117,10 +142,17 @@ class SimulationTest : public ::testing::Test {
 
   void ValidateNonCLIParameter(const Param* param) {
     EXPECT_EQ(123u, param->random_seed);
+    EXPECT_TRUE(param->use_counter_rng);
     EXPECT_EQ("paraview", param->visualization_engine);
     EXPECT_EQ("result-dir", param->output_dir);
     EXPECT_EQ("runga-kutta", param->diffusion_method);
+    EXPECT_TRUE(param->non_cubic_diffusion_grid);
+    EXPECT_TRUE(param->scale_diffusion_with_time_step);
+    EXPECT_TRUE(param->trilinear_diffusion_sampling);
+    EXPECT_NEAR(1e-6, param->sparse_diffusion_threshold, 1e-12);
     EXPECT_EQ(3600u, param->backup_interval);
+    EXPECT_TRUE(param->async_backup);
+    EXPECT_TRUE(param->sharded_backup);
     EXPECT_EQ(0.0125, param->simulation_time_step);
     EXPECT_EQ(1u, param->unschedule_default_operations.size());
     EXPECT_EQ("mechanical forces", param->unschedule_default_operations[0]);
@@ -130,6 +162,7 @@ class SimulationTest : public ::testing::Test {
     EXPECT_EQ(200, param->max_bound);
     EXPECT_EQ(Param::ThreadSafetyMechanism::kAutomatic,
               param->thread_safety_mechanism);
+    EXPECT_EQ(3u, param->multi_level_grid_levels);
     EXPECT_FALSE(param->insitu_visualization);
     EXPECT_TRUE(param->export_visualization);
     EXPECT_EQ("my-insitu-script.py", param->pv_insitu_pipeline);
@@ -175,6 +208,7 @@ class SimulationTest : public ::testing::Test {
     // performance group
     EXPECT_EQ(123u, param->scheduling_batch_size);
     EXPECT_TRUE(param->detect_static_agents);
+    EXPECT_TRUE(param->skip_static_agents);
     EXPECT_TRUE(param->cache_neighbors);
     EXPECT_NEAR(0.123, param->agent_uid_defragmentation_low_watermark,
                 abs_error<double>::value);
@@ -184,13 +218,30 @@ class SimulationTest : public ::testing::Test {
     EXPECT_EQ(7u, param->mem_mgr_aligned_pages_shift);
     EXPECT_NEAR(1.123, param->mem_mgr_growth_rate, abs_error<double>::value);
     EXPECT_EQ(987654u, param->mem_mgr_max_mem_per_thread);
+    EXPECT_TRUE(param->mem_mgr_arena);
     EXPECT_FALSE(param->minimize_memory_while_rebalancing);
+    EXPECT_EQ(Param::SpaceFillingCurve::kHilbert, param->space_filling_curve);
+    EXPECT_NEAR(0.25, param->adaptive_load_balancing_threshold,
+                abs_error<double>::value);
+    EXPECT_EQ(7u, param->adaptive_load_balancing_interval);
+    EXPECT_TRUE(param->soa_agent_storage);
+    EXPECT_TRUE(param->compact_uniform_grid);
+    EXPECT_TRUE(param->incremental_uniform_grid);
+    EXPECT_TRUE(param->verlet_neighbor_lists);
+    EXPECT_NEAR(4.5, param->verlet_skin, abs_error<double>::value);
+    EXPECT_NEAR(1.5, param->kd_tree_skin, abs_error<double>::value);
+    EXPECT_TRUE(param->vectorize_sphere_forces);
+    EXPECT_TRUE(param->symmetric_forces);
+    EXPECT_TRUE(param->fuse_diffusion_grids);
+    EXPECT_TRUE(param->deferred_secretion);
     EXPECT_EQ(Param::MappedDataArrayMode::kCache,
               param->mapped_data_array_mode);
 
     // development group
     EXPECT_FALSE(param->statistics);
     EXPECT_TRUE(param->debug_numa);
+    EXPECT_TRUE(param->profiling);
+    EXPECT_TRUE(param->profiling_hardware_counters);
   }
 };
 
@@ -0,0 +1,141 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <omp.h>
+#include <vector>
+
+#include "core/agent/cell.h"
+#include "core/param/param.h"
+#include "core/scheduler.h"
+#include "core/simulation.h"
+#include "core/util/counter_rng.h"
+#include "unit/test_util/test_util.h"
+
+namespace bdm {
+
+// Known answer tests from the Random123 distribution
+TEST(CounterRngTest, PhiloxKnownAnswers) {
+  auto r0 = Philox4x32::Generate({0, 0, 0, 0}, {0, 0});
+  EXPECT_EQ(0x6627e8d5u, r0[0]);
+  EXPECT_EQ(0xe169c58du, r0[1]);
+  EXPECT_EQ(0xbc57ac4cu, r0[2]);
+  EXPECT_EQ(0x9b00dbd8u, r0[3]);
+
+  uint32_t f = 0xffffffff;
+  auto r1 = Philox4x32::Generate({f, f, f, f}, {f, f});
+  EXPECT_EQ(0x408f276du, r1[0]);
+  EXPECT_EQ(0x41c83b0eu, r1[1]);
+  EXPECT_EQ(0xa20bc7c6u, r1[2]);
+  EXPECT_EQ(0x6d5451fdu, r1[3]);
+}
+
+TEST(CounterRngTest, Identity) {
+  CounterRng a(42, 7, 3);
+  CounterRng b(42, 7, 3);
+  CounterRng other_key(42, 8, 3);
+  CounterRng other_step(42, 7, 4);
+  CounterRng other_stream(42, 7, 3, 1);
+  CounterRng other_seed(43, 7, 3);
+  for (int i = 0; i < 10; i++) {
+    auto expected = a.Uniform();
+    EXPECT_EQ(expected, b.Uniform());
+    EXPECT_NE(expected, other_key.Uniform());
+    EXPECT_NE(expected, other_step.Uniform());
+    EXPECT_NE(expected, other_stream.Uniform());
+    EXPECT_NE(expected, other_seed.Uniform());
+  }
+}
+
+// The numbers drawn for an agent must not depend on the number of threads
+// or on the thread that processes the agent.
+TEST(CounterRngTest, IndependentOfThreadCount) {
+  const int kAgents = 1000;
+  auto draw = [&](int threads) {
+    std::vector<double> result(3 * kAgents);
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 7)
+    for (int i = 0; i < kAgents; i++) {
+      CounterRng rng(1, i, 5);
+      result[3 * i] = rng.Uniform(-1, 1);
+      result[3 * i + 1] = rng.Gaus();
+      result[3 * i + 2] = rng.UniformArray<3>()[2];
+    }
+    return result;
+  };
+  auto expected = draw(1);
+  for (int threads : {2, 3, omp_get_max_threads()}) {
+    EXPECT_EQ(expected, draw(threads));
+  }
+}
+
+TEST(CounterRngTest, Moments) {
+  const uint64_t kSize = 100001;
+  std::vector<double> samples(kSize);
+  CounterRng rng(4357, 0, 0);
+
+  rng.FillUniform(samples.data(), kSize, 2, 4);
+  double sum = 0;
+  for (auto s : samples) {
+    EXPECT_LT(2, s);
+    EXPECT_GT(4, s);
+    sum += s;
+  }
+  EXPECT_NEAR(3, sum / kSize, 1e-2);
+
+  rng.FillGaus(samples.data(), kSize, 1, 2);
+  sum = 0;
+  double sum2 = 0;
+  for (auto s : samples) {
+    sum += s;
+    sum2 += s * s;
+  }
+  auto mean = sum / kSize;
+  EXPECT_NEAR(1, mean, 2e-2);
+  EXPECT_NEAR(4, sum2 / kSize - mean * mean, 5e-2);
+}
+
+// Integer arguments must select the scalar functions (same as for the
+// ROOT based random number generator)
+TEST(CounterRngTest, IntegerArguments) {
+  CounterRng rng(4357, 0, 0);
+  CounterRng expected(4357, 0, 0);
+  EXPECT_EQ(expected.Uniform(0.0, 1.0), rng.Uniform(0, 1));
+  EXPECT_EQ(expected.Gaus(0.0, 1.0), rng.Gaus(0, 1));
+}
+
+TEST(CounterRngTest, SimulationAccessor) {
+  auto set_param = [](Param* param) { param->random_seed = 11; };
+  Simulation simulation(TEST_NAME, set_param);
+  simulation.Simulate(2);
+
+  Cell cell;
+  auto rng = simulation.GetCounterRng(&cell, 1);
+  auto same = simulation.GetCounterRng(&cell, 1);
+  CounterRng expected(11, cell.GetRngKey(), 2, 1);
+  for (int i = 0; i < 5; i++) {
+    auto value = expected.Uniform();
+    EXPECT_EQ(value, rng.Uniform());
+    EXPECT_EQ(value, same.Uniform());
+  }
+}
+
+TEST(CounterRngTest, DaughterKey) {
+  auto key = CounterRng::DaughterKey(7, 3, 0);
+  EXPECT_EQ(key, CounterRng::DaughterKey(7, 3, 0));
+  EXPECT_NE(key, CounterRng::DaughterKey(8, 3, 0));
+  EXPECT_NE(key, CounterRng::DaughterKey(7, 4, 0));
+  EXPECT_NE(key, CounterRng::DaughterKey(7, 3, 1));
+}
+
+}  // namespace bdm
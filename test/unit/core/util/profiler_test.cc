@@ -0,0 +1,158 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#include "core/util/profiler.h"
+#include <gtest/gtest.h>
+#include <omp.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "core/agent/cell.h"
+#include "core/resource_manager.h"
+#include "core/scheduler.h"
+#include "core/simulation.h"
+#include "unit/test_util/test_util.h"
+
+namespace bdm {
+
+TEST(ProfilerTest, Scope) {
+  Profiler profiler;
+  profiler.SetEnabled(true);
+  profiler.SetStep(3);
+  profiler.Time("a", []() {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  });
+  { Profiler::Scope scope(&profiler, "b"); }
+  { Profiler::Scope scope(nullptr, "c"); }
+
+  auto events = profiler.GetEvents();
+  ASSERT_EQ(2u, events.size());
+  EXPECT_EQ("a", profiler.GetName(events[0].name));
+  EXPECT_EQ("b", profiler.GetName(events[1].name));
+  EXPECT_LE(100000, events[0].duration);
+  EXPECT_LE(events[0].start + events[0].duration, events[1].start);
+  EXPECT_EQ(3u, events[0].step);
+  EXPECT_EQ(events[0].thread, events[1].thread);
+
+  profiler.Clear();
+  EXPECT_EQ(0u, profiler.GetEvents().size());
+}
+
+TEST(ProfilerTest, Threads) {
+  Profiler profiler;
+  std::thread t1([&]() { Profiler::Scope scope(&profiler, "op"); });
+  t1.join();
+  std::thread t2([&]() { Profiler::Scope scope(&profiler, "op"); });
+  t2.join();
+
+  auto events = profiler.GetEvents();
+  ASSERT_EQ(2u, events.size());
+  EXPECT_NE(events[0].thread, events[1].thread);
+  EXPECT_EQ(events[0].name, events[1].name);
+}
+
+TEST(ProfilerTest, StepTimes) {
+  Profiler profiler;
+  for (uint64_t step = 0; step < 4; ++step) {
+    profiler.SetStep(step);
+    // two events in the same step are added up
+    for (int i = 0; i < 2; ++i) {
+      Profiler::Scope scope(&profiler, "op");
+      std::this_thread::sleep_for(std::chrono::microseconds(50 * (step + 1)));
+    }
+  }
+  auto times = profiler.GetStepTimes("op");
+  ASSERT_EQ(4u, times.size());
+  for (uint64_t step = 0; step < 4; ++step) {
+    EXPECT_LE(static_cast<int64_t>(100000 * (step + 1)), times[step]);
+  }
+  EXPECT_EQ(0u, profiler.GetStepTimes("unknown").size());
+
+  auto histogram = profiler.GetStepHistogram("op", 3);
+  ASSERT_EQ(3u, histogram.size());
+  EXPECT_EQ(4u, histogram[0] + histogram[1] + histogram[2]);
+  // the shortest and the longest step are in the outer bins
+  EXPECT_LE(1u, histogram[0]);
+  EXPECT_LE(1u, histogram[2]);
+}
+
+TEST(ProfilerTest, Imbalance) {
+  Profiler profiler;
+  profiler.BeginParallelRegion();
+  EXPECT_TRUE(profiler.InParallelRegion());
+#pragma omp parallel
+  {
+    // thread 0 does all the work
+    if (omp_get_thread_num() == 0) {
+      profiler.AddBusyTime(1000);
+    }
+  }
+  profiler.EndParallelRegion("region");
+  EXPECT_FALSE(profiler.InParallelRegion());
+
+  // no effect outside of a region
+  profiler.AddBusyTime(1000);
+
+  auto& imbalances = profiler.GetImbalances();
+  ASSERT_EQ(1u, imbalances.size());
+  EXPECT_EQ("region", profiler.GetName(imbalances[0].name));
+  EXPECT_EQ(static_cast<size_t>(omp_get_max_threads()),
+            imbalances[0].busy.size());
+  EXPECT_EQ(1000, imbalances[0].busy[0]);
+  EXPECT_DOUBLE_EQ(omp_get_max_threads(), imbalances[0].max_over_mean);
+}
+
+TEST(ProfilerTest, ChromeTrace) {
+  Profiler profiler;
+  { Profiler::Scope scope(&profiler, "my \"op\""); }
+  profiler.BeginParallelRegion();
+  profiler.AddBusyTime(10);
+  profiler.EndParallelRegion("agent ops");
+
+  std::string filename = "profiler_test_trace.json";
+  profiler.WriteChromeTrace(filename);
+  std::ifstream ifs(filename);
+  std::stringstream content;
+  content << ifs.rdbuf();
+  auto trace = content.str();
+  EXPECT_EQ(0u, trace.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+  EXPECT_NE(std::string::npos, trace.find("\"name\":\"my \\\"op\\\"\""));
+  EXPECT_NE(std::string::npos, trace.find("\"ph\":\"X\""));
+  EXPECT_NE(std::string::npos,
+            trace.find("\"name\":\"agent ops imbalance\",\"ph\":\"C\""));
+  remove(filename.c_str());
+}
+
+TEST(ProfilerTest, Simulation) {
+  auto set_param = [](Param* param) { param->profiling = true; };
+  Simulation simulation(TEST_NAME, set_param);
+  auto* rm = simulation.GetResourceManager();
+  for (int i = 0; i < 100; ++i) {
+    rm->AddAgent(new Cell({i * 20.0, 0, 0}));
+  }
+  simulation.Simulate(3);
+
+  auto* profiler = simulation.GetScheduler()->GetProfiler();
+  EXPECT_TRUE(profiler->IsEnabled());
+  EXPECT_EQ(3u, profiler->GetStepTimes("agent ops").size());
+  EXPECT_EQ(3u, profiler->GetStepTimes("diffusion").size());
+  EXPECT_EQ(3u, profiler->GetImbalances().size());
+  for (auto& imbalance : profiler->GetImbalances()) {
+    EXPECT_LE(1.0, imbalance.max_over_mean);
+  }
+}
+
+}  // namespace bdm
@@ -0,0 +1,122 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <vector>
+
+#include "core/util/work_stealing_executor.h"
+
+namespace bdm {
+
+TEST(WorkStealingExecutorTest, ParallelFor) {
+  auto* executor = WorkStealingExecutor::GetInstance();
+  // run several loops to test that the state is reset correctly
+  for (uint64_t size : {0, 1, 7, 1000, 12345}) {
+    for (uint64_t chunk : {1, 3, 100, 100000}) {
+      std::vector<std::atomic<int>> visited(size);
+      for (auto& el : visited) {
+        el = 0;
+      }
+      executor->ParallelFor(size, chunk, [&](uint64_t start, uint64_t end) {
+        EXPECT_LT(start, end);
+        EXPECT_LE(end - start, chunk);
+        for (uint64_t i = start; i < end; ++i) {
+          visited[i]++;
+        }
+      });
+      for (uint64_t i = 0; i < size; ++i) {
+        EXPECT_EQ(1, visited[i]) << "size " << size << " chunk " << chunk;
+      }
+    }
+  }
+}
+
+TEST(WorkStealingExecutorTest, ParallelForNuma) {
+  auto* executor = WorkStealingExecutor::GetInstance();
+  auto numa_nodes = ThreadInfo::GetInstance()->GetNumaNodes();
+  std::vector<std::vector<std::atomic<int>>> visited(numa_nodes);
+  for (int n = 0; n < numa_nodes; ++n) {
+    visited[n] = std::vector<std::atomic<int>>(1000 * (n + 1) + 3);
+    for (auto& el : visited[n]) {
+      el = 0;
+    }
+  }
+  executor->ParallelForNuma(
+      [&](int nid) { return visited[nid].size(); }, 10,
+      [&](uint64_t nid, uint64_t start, uint64_t end) {
+        for (uint64_t i = start; i < end; ++i) {
+          visited[nid][i]++;
+        }
+      });
+  for (int n = 0; n < numa_nodes; ++n) {
+    for (uint64_t i = 0; i < visited[n].size(); ++i) {
+      EXPECT_EQ(1, visited[n][i]);
+    }
+  }
+}
+
+TEST(WorkStealingExecutorTest, ParallelForNumaWithoutCrossDomainStealing) {
+  auto* executor = WorkStealingExecutor::GetInstance();
+  auto* thread_info = ThreadInfo::GetInstance();
+  auto numa_nodes = thread_info->GetNumaNodes();
+  std::vector<std::vector<std::atomic<int>>> visited(numa_nodes);
+  for (int n = 0; n < numa_nodes; ++n) {
+    visited[n] = std::vector<std::atomic<int>>(1000 * (n + 1) + 3);
+    for (auto& el : visited[n]) {
+      el = 0;
+    }
+  }
+  std::atomic<int> remote_chunks(0);
+  executor->ParallelForNuma(
+      [&](int nid) { return visited[nid].size(); }, 10,
+      [&](uint64_t nid, uint64_t start, uint64_t end) {
+        auto tid = thread_info->GetMyThreadId();
+        if (thread_info->GetThreadsInNumaNode(nid) != 0 &&
+            thread_info->GetNumaNode(tid) != static_cast<int>(nid)) {
+          remote_chunks++;
+        }
+        for (uint64_t i = start; i < end; ++i) {
+          visited[nid][i]++;
+        }
+      },
+      false);
+  EXPECT_EQ(0, remote_chunks);
+  for (int n = 0; n < numa_nodes; ++n) {
+    for (uint64_t i = 0; i < visited[n].size(); ++i) {
+      EXPECT_EQ(1, visited[n][i]);
+    }
+  }
+}
+
+TEST(WorkStealingExecutorTest, NestedCallRunsSequentially) {
+  auto* executor = WorkStealingExecutor::GetInstance();
+  std::vector<int> visited(100, 0);
+#pragma omp parallel
+  {
+#pragma omp single
+    executor->ParallelFor(visited.size(), 1, [&](uint64_t start, uint64_t end) {
+      EXPECT_EQ(0u, start);
+      EXPECT_EQ(visited.size(), end);
+      for (uint64_t i = start; i < end; ++i) {
+        visited[i]++;
+      }
+    });
+  }
+  for (auto el : visited) {
+    EXPECT_EQ(1, el);
+  }
+}
+
+}  // namespace bdm
@@ -0,0 +1,104 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & Newcastle University for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+//
+// Microbenchmark for the mechanical interaction between spherical cells.
+// Places one million cells randomly in a cube with the same cell density as
+// the soma_clustering demo and measures the time needed to calculate the
+// displacement of all cells with the scalar and with the batched (SIMD)
+// sphere-sphere force kernel (see Param::vectorize_sphere_forces).
+// Usage: util/benchmark/benchmark.sh sphere_forces
+//
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "biodynamo.h"
+
+namespace bdm {
+
+inline int Benchmark(int argc, const char** argv) {
+  // soma_clustering: 20000 cells with diameter 10 in a cube of length 250
+  const uint64_t num_cells = 1000000;
+  const double max_bound = 250 * std::cbrt(num_cells / 20000.0);
+  const uint64_t repetitions = 5;
+
+  auto set_param = [&](Param* param) {
+    param->bound_space = Param::BoundSpaceMode::kClosed;
+    param->min_bound = 0;
+    param->max_bound = max_bound;
+  };
+  Simulation simulation(argc, argv, set_param);
+  auto* param = const_cast<Param*>(simulation.GetParam());
+  auto* rm = simulation.GetResourceManager();
+  auto* env = simulation.GetEnvironment();
+
+#pragma omp parallel
+  simulation.GetRandom()->SetSeed(4357);
+
+  auto construct = [](const Double3& position) {
+    auto* cell = new Cell(position);
+    cell->SetDiameter(10);
+    return cell;
+  };
+  ModelInitializer::CreateAgentsRandom(param->min_bound, param->max_bound,
+                                       num_cells, construct);
+  env->Update();
+
+  InteractionForce force;
+  const double squared_radius = env->GetLargestAgentSizeSquared();
+  const double dt = param->simulation_time_step;
+  std::vector<Double3> displacements[2];
+
+  auto run = [&](bool vectorize) {
+    param->vectorize_sphere_forces = vectorize;
+    auto& result = displacements[vectorize];
+    result.resize(rm->GetNumAgents());
+    auto calculate_displacement = L2F([&](Agent* agent) {
+      result[agent->GetUid().GetIndex()] =
+          agent->CalculateDisplacement(&force, squared_radius, dt);
+    });
+    // warm-up
+    rm->ForEachAgentParallel(calculate_displacement);
+    auto start = Timing::Timestamp();
+    for (uint64_t i = 0; i < repetitions; ++i) {
+      rm->ForEachAgentParallel(calculate_displacement);
+    }
+    return (Timing::Timestamp() - start) / static_cast<double>(repetitions);
+  };
+
+  auto scalar_ms = run(false);
+  auto vectorized_ms = run(true);
+
+  double max_deviation = 0;
+  for (uint64_t i = 0; i < displacements[0].size(); ++i) {
+    auto diff = displacements[0][i] - displacements[1][i];
+    max_deviation = std::max(max_deviation, diff.Norm());
+  }
+
+  std::cout << "Number of cells                " << num_cells << std::endl;
+  std::cout << "Scalar kernel                  " << scalar_ms << " ms"
+            << std::endl;
+  std::cout << "Batched kernel                 " << vectorized_ms << " ms"
+            << std::endl;
+  std::cout << "Speedup                        " << scalar_ms / vectorized_ms
+            << std::endl;
+  std::cout << "Max displacement deviation     " << max_deviation << std::endl;
+  return 0;
+}
+
+}  // namespace bdm
+
+int main(int argc, const char** argv) { return bdm::Benchmark(argc, argv); }